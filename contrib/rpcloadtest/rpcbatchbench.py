@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 The Stealth Developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+# Batch latency benchmark for the JSON-RPC server.
+#
+# Sends JSON-RPC batches of increasing size and reports the latency of the
+# whole batch and per call for each size. Run it against nodes started with
+# different -rpcbatchthreads (1 executes a batch sequentially) to compare.
+#
+#   ./rpcbatchbench.py -u user -p pass getblockbynumber %h true
+#   ./rpcbatchbench.py -u user -p pass -s 1,10,100 getaddressinouts SAddr...
+#
+# In the parameters, %h is replaced by a different block height for every
+# call of a batch, counting down from the best block. Other parameters are
+# parsed as JSON when possible, so numbers and booleans can be given bare.
+
+import argparse
+import base64
+import http.client
+import json
+import time
+
+
+def parse_param(s):
+    try:
+        return json.loads(s)
+    except ValueError:
+        return s
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+class Client(object):
+    def __init__(self, args):
+        self.args = args
+        auth = base64.b64encode(
+            ("%s:%s" % (args.user, args.password)).encode()).decode()
+        self.headers = {"Authorization": "Basic " + auth,
+                        "Content-Type": "application/json",
+                        "Connection": "keep-alive"}
+        self.conn = None
+
+    def post(self, body):
+        if self.conn is None:
+            self.conn = http.client.HTTPConnection(self.args.host,
+                                                   self.args.port,
+                                                   timeout=self.args.timeout)
+        self.conn.request("POST", "/", body, self.headers)
+        resp = self.conn.getresponse()
+        data = resp.read()
+        if resp.status != 200:
+            raise RuntimeError("HTTP %d: %s" % (resp.status, data[:200]))
+        return json.loads(data)
+
+    def call(self, method, params):
+        reply = self.post(json.dumps({"method": method,
+                                      "params": params,
+                                      "id": 0}))
+        if reply.get("error"):
+            raise RuntimeError(reply["error"])
+        return reply["result"]
+
+
+def make_batch(args, size, height):
+    batch = []
+    for i in range(size):
+        params = []
+        for p in args.params:
+            if p == "%h":
+                params.append(max(height - i, 0))
+            else:
+                params.append(parse_param(p))
+        batch.append({"method": args.method, "params": params, "id": i})
+    return json.dumps(batch)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="JSON-RPC batch benchmark")
+    parser.add_argument("-H", "--host", default="127.0.0.1")
+    parser.add_argument("-P", "--port", type=int, default=46502)
+    parser.add_argument("-u", "--user", required=True)
+    parser.add_argument("-p", "--password", required=True)
+    parser.add_argument("-s", "--sizes", default="1,10,50,100,250,500",
+                        help="comma separated batch sizes")
+    parser.add_argument("-r", "--rounds", type=int, default=20,
+                        help="batches sent per size")
+    parser.add_argument("-t", "--timeout", type=float, default=120.0)
+    parser.add_argument("method")
+    parser.add_argument("params", nargs="*")
+    args = parser.parse_args()
+
+    client = Client(args)
+    height = client.call("getblockcount", [])
+    sizes = [int(s) for s in args.sizes.split(",") if s]
+
+    print("%6s %10s %10s %10s %12s %8s" %
+          ("size", "p50 ms", "p90 ms", "max ms", "ms per call", "errors"))
+    for size in sizes:
+        body = make_batch(args, size, height)
+        latencies = []
+        errors = 0
+        for _ in range(args.rounds):
+            start = time.time()
+            replies = client.post(body)
+            latencies.append(time.time() - start)
+            if len(replies) != size:
+                raise RuntimeError("expected %d replies, got %d" %
+                                   (size, len(replies)))
+            # replies must come back in request order
+            for i, reply in enumerate(replies):
+                if reply.get("id") != i:
+                    raise RuntimeError("reply %d out of order" % i)
+                if reply.get("error"):
+                    errors += 1
+        latencies.sort()
+        p50 = percentile(latencies, 50) * 1000
+        print("%6d %10.2f %10.2f %10.2f %12.3f %8d" %
+              (size, p50, percentile(latencies, 90) * 1000,
+               latencies[-1] * 1000, p50 / size, errors))
+
+
+if __name__ == "__main__":
+    main()
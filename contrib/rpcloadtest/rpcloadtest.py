@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 The Stealth Developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+# Load test for the JSON-RPC server.
+#
+# Opens a number of keep-alive connections to a local node and sends one
+# method over and over from each of them, then reports throughput, latency
+# percentiles and the HTTP status counts (503 means the work queue was full).
+#
+#   ./rpcloadtest.py -u user -p pass -c 200 -n 50 getblockcount
+#   ./rpcloadtest.py -u user -p pass -c 50 -d 30 getblock <hash>
+#
+# Parameters after the method are parsed as JSON when possible, so numbers
+# and booleans can be given bare.
+
+import argparse
+import base64
+import http.client
+import json
+import threading
+import time
+
+
+def parse_param(s):
+    try:
+        return json.loads(s)
+    except ValueError:
+        return s
+
+
+class Stats(object):
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = []
+        self.status = {}
+        self.errors = 0
+
+    def add(self, status, latency):
+        with self.lock:
+            self.status[status] = self.status.get(status, 0) + 1
+            if status == 200:
+                self.latencies.append(latency)
+
+    def add_error(self):
+        with self.lock:
+            self.errors += 1
+
+
+def client(args, body, headers, stats, deadline):
+    conn = None
+    sent = 0
+    while True:
+        if args.requests and sent >= args.requests:
+            break
+        if deadline and time.time() >= deadline:
+            break
+        sent += 1
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(args.host, args.port,
+                                                  timeout=args.timeout)
+            start = time.time()
+            conn.request("POST", "/", body, headers)
+            resp = conn.getresponse()
+            resp.read()
+            stats.add(resp.status, time.time() - start)
+            if resp.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            stats.add_error()
+            if conn is not None:
+                conn.close()
+            conn = None
+    if conn is not None:
+        conn.close()
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="JSON-RPC load test")
+    parser.add_argument("-H", "--host", default="127.0.0.1")
+    parser.add_argument("-P", "--port", type=int, default=46502)
+    parser.add_argument("-u", "--user", required=True)
+    parser.add_argument("-p", "--password", required=True)
+    parser.add_argument("-c", "--connections", type=int, default=100,
+                        help="concurrent keep-alive connections")
+    parser.add_argument("-n", "--requests", type=int, default=0,
+                        help="requests per connection (0: use --duration)")
+    parser.add_argument("-d", "--duration", type=float, default=10.0,
+                        help="seconds to run when --requests is 0")
+    parser.add_argument("-t", "--timeout", type=float, default=30.0)
+    parser.add_argument("method")
+    parser.add_argument("params", nargs="*")
+    args = parser.parse_args()
+
+    body = json.dumps({"method": args.method,
+                       "params": [parse_param(p) for p in args.params],
+                       "id": 1})
+    auth = base64.b64encode(
+        ("%s:%s" % (args.user, args.password)).encode()).decode()
+    headers = {"Authorization": "Basic " + auth,
+               "Content-Type": "application/json",
+               "Connection": "keep-alive"}
+
+    stats = Stats()
+    deadline = 0
+    if not args.requests:
+        deadline = time.time() + args.duration
+
+    threads = []
+    start = time.time()
+    for _ in range(args.connections):
+        t = threading.Thread(target=client,
+                             args=(args, body, headers, stats, deadline))
+        t.start()
+        threads.append(t)
+    for t in threads:
+        t.join()
+    elapsed = time.time() - start
+
+    lat = sorted(stats.latencies)
+    total = sum(stats.status.values())
+    print("connections : %d" % args.connections)
+    print("elapsed     : %.2f s" % elapsed)
+    print("requests    : %d (%.1f/s)" % (total, total / elapsed))
+    for status in sorted(stats.status):
+        print("  HTTP %d   : %d" % (status, stats.status[status]))
+    print("  errors    : %d" % stats.errors)
+    print("latency ms  : p50 %.2f  p90 %.2f  p99 %.2f  max %.2f" %
+          (percentile(lat, 50) * 1000, percentile(lat, 90) * 1000,
+           percentile(lat, 99) * 1000, (lat[-1] if lat else 0) * 1000))
+
+
+if __name__ == "__main__":
+    main()
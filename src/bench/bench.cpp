@@ -0,0 +1,249 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "util.h"
+
+#include "json/json_spirit_writer_template.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <regex>
+#include <vector>
+
+using namespace json_spirit;
+using namespace std;
+
+// warm up until a batch takes this fraction of a sample
+static const int64_t BENCH_WARMUP_DIVISOR = 10;
+static const uint64_t BENCH_MAX_BATCH = 1ULL << 32;
+
+static int64_t GetBenchNanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+             chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool CBenchState::KeepRunning()
+{
+    if (nLeft == nIterations)
+    {
+        nStart = GetBenchNanos();
+    }
+    if (nLeft == 0)
+    {
+        nElapsed = GetBenchNanos() - nStart;
+        return false;
+    }
+    --nLeft;
+    return true;
+}
+
+CBenchRegistration::CBenchRegistration(const char* pszName,
+                                       BenchFunction func)
+{
+    GetBenchmarks().insert(make_pair(string(pszName), func));
+}
+
+map<string, BenchFunction>& CBenchRegistration::GetBenchmarks()
+{
+    // a function static, so registrations from other files find it built
+    static map<string, BenchFunction> mapBenchmarks;
+    return mapBenchmarks;
+}
+
+static int64_t RunBatch(BenchFunction func, uint64_t nIterations)
+{
+    CBenchState state(nIterations);
+    func(state);
+    return max(state.GetElapsed(), (int64_t)1);
+}
+
+static Object RunBenchmark(const string& strName,
+                           BenchFunction func,
+                           int nSamples,
+                           int64_t nSampleNanos)
+{
+    // Warm up caches and allocators, and find how many iterations make a
+    //    sample. Slow operations, like feework at high mcost, run once.
+    uint64_t nBatch = 1;
+    int64_t nElapsed = RunBatch(func, nBatch);
+    while ((nElapsed < (nSampleNanos / BENCH_WARMUP_DIVISOR)) &&
+           (nBatch < BENCH_MAX_BATCH))
+    {
+        nBatch *= 2;
+        nElapsed = RunBatch(func, nBatch);
+    }
+    double dNanosPerOp = (double)nElapsed / nBatch;
+    nBatch = max((uint64_t)1, (uint64_t)(nSampleNanos / dNanosPerOp));
+
+    vector<double> vSamples;
+    for (int i = 0; i < nSamples; ++i)
+    {
+        vSamples.push_back((double)RunBatch(func, nBatch) / nBatch);
+    }
+    sort(vSamples.begin(), vSamples.end());
+
+    double dSum = 0.0;
+    for (unsigned int i = 0; i < vSamples.size(); ++i)
+    {
+        dSum += vSamples[i];
+    }
+    double dMean = dSum / vSamples.size();
+    double dVariance = 0.0;
+    for (unsigned int i = 0; i < vSamples.size(); ++i)
+    {
+        dVariance += (vSamples[i] - dMean) * (vSamples[i] - dMean);
+    }
+    if (vSamples.size() > 1)
+    {
+        dVariance /= (vSamples.size() - 1);
+    }
+    unsigned int nMid = vSamples.size() / 2;
+    double dMedian = (vSamples.size() % 2) ?
+                        vSamples[nMid] :
+                        (vSamples[nMid - 1] + vSamples[nMid]) / 2.0;
+
+    Object objNanos;
+    objNanos.push_back(Pair("min", vSamples.front()));
+    objNanos.push_back(Pair("median", dMedian));
+    objNanos.push_back(Pair("mean", dMean));
+    objNanos.push_back(Pair("max", vSamples.back()));
+    objNanos.push_back(Pair("stddev", sqrt(dVariance)));
+
+    Object obj;
+    obj.push_back(Pair("name", strName));
+    obj.push_back(Pair("samples", nSamples));
+    obj.push_back(Pair("iterations", (boost::uint64_t)nBatch));
+    obj.push_back(Pair("ns_per_op", objNanos));
+    obj.push_back(Pair("ops_per_second",
+                       (dMedian > 0.0) ? (1000000000.0 / dMedian) : 0.0));
+    return obj;
+}
+
+static string BenchUsage()
+{
+    return string("Usage: bench_stealth [options]\n\n") +
+        "  -list                  List the benchmarks and exit\n" +
+        "  -filter=<regex>        Run only benchmarks whose names match\n" +
+        "  -samples=<n>           Timed batches of each benchmark (default: 10)\n" +
+        "  -sampletime=<ms>       Target length of a batch (default: 50)\n" +
+        "  -output=<file>         Write the JSON report to <file>\n" +
+        "  -datadir=<dir>         Where the benchmarks that need a database make\n" +
+        "                         their scratch directory (default: the system\n" +
+        "                         temp directory)\n";
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("--help") ||
+        mapArgs.count("-help"))
+    {
+        fprintf(stdout, "%s", BenchUsage().c_str());
+        return 0;
+    }
+
+    const map<string, BenchFunction>& mapBenchmarks =
+                                 CBenchRegistration::GetBenchmarks();
+    if (GetBoolArg("-list", false))
+    {
+        map<string, BenchFunction>::const_iterator it;
+        for (it = mapBenchmarks.begin(); it != mapBenchmarks.end(); ++it)
+        {
+            fprintf(stdout, "%s\n", it->first.c_str());
+        }
+        return 0;
+    }
+
+    regex reFilter;
+    try
+    {
+        reFilter = regex(GetArg("-filter", ".*"));
+    }
+    catch (regex_error& e)
+    {
+        fprintf(stderr, "Error: bad -filter: %s\n", e.what());
+        return 1;
+    }
+    int nSamples = max((int64_t)1, GetArg("-samples", (int64_t)10));
+    int64_t nSampleNanos = max((int64_t)1,
+                               GetArg("-sampletime", (int64_t)50)) * 1000000;
+
+    // The database benchmarks get a new scratch directory, removed at the
+    //    end. With -datadir it is made inside that directory, so the
+    //    benchmarks never write into an existing node's databases.
+    boost::filesystem::path pathParent = mapArgs.count("-datadir") ?
+            boost::filesystem::path(mapArgs["-datadir"]) :
+            boost::filesystem::temp_directory_path();
+    boost::filesystem::path pathTemp = pathParent /
+            boost::filesystem::unique_path("bench_stealth-%%%%-%%%%");
+    try
+    {
+        boost::filesystem::create_directories(pathTemp);
+    }
+    catch (boost::filesystem::filesystem_error& e)
+    {
+        fprintf(stderr, "Error: can't make a scratch directory: %s\n",
+                e.what());
+        return 1;
+    }
+    mapArgs["-datadir"] = pathTemp.string();
+
+    Array arrayResults;
+    map<string, BenchFunction>::const_iterator it;
+    for (it = mapBenchmarks.begin(); it != mapBenchmarks.end(); ++it)
+    {
+        if (!regex_search(it->first, reFilter))
+        {
+            continue;
+        }
+        fprintf(stderr, "%s\n", it->first.c_str());
+        try
+        {
+            arrayResults.push_back(RunBenchmark(it->first, it->second,
+                                                nSamples, nSampleNanos));
+        }
+        catch (std::exception& e)
+        {
+            fprintf(stderr, "  failed: %s\n", e.what());
+            Object obj;
+            obj.push_back(Pair("name", it->first));
+            obj.push_back(Pair("error", string(e.what())));
+            arrayResults.push_back(obj);
+        }
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(pathTemp, ec);
+
+    Object objReport;
+    objReport.push_back(Pair("version", FormatFullVersion()));
+    objReport.push_back(Pair("time", GetTime()));
+    objReport.push_back(Pair("sampletime_ms", nSampleNanos / 1000000));
+    objReport.push_back(Pair("benchmarks", arrayResults));
+    string strReport = write_string(Value(objReport), true) + "\n";
+
+    if (mapArgs.count("-output"))
+    {
+        FILE* file = fopen(mapArgs["-output"].c_str(), "w");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Error: can't open %s\n",
+                    mapArgs["-output"].c_str());
+            return 1;
+        }
+        fwrite(strReport.data(), 1, strReport.size(), file);
+        fclose(file);
+    }
+    else
+    {
+        fwrite(strReport.data(), 1, strReport.size(), stdout);
+    }
+
+    return 0;
+}
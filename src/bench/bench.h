@@ -0,0 +1,77 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+//
+// bench_stealth: microbenchmarks of the hot paths of the node.
+//
+// A benchmark is a function that runs its operation while
+// state.KeepRunning() is true, and is registered with BENCHMARK(name):
+//
+//     static void Hash9Header(CBenchState& state)
+//     {
+//         CBlock block;
+//         while (state.KeepRunning())
+//         {
+//             block.GetHash();
+//         }
+//     }
+//     BENCHMARK(Hash9Header);
+//
+// Set up outside the loop is not timed. Each benchmark is first warmed up,
+// which also sizes a batch to take about -sampletime milliseconds, then
+// timed for -samples batches. The result is printed as JSON so runs of
+// different releases can be compared.
+//
+
+class CBenchState
+{
+private:
+    uint64_t nIterations;
+    uint64_t nLeft;
+    int64_t nStart;
+    int64_t nElapsed;
+
+public:
+    explicit CBenchState(uint64_t nIterationsIn)
+        : nIterations(nIterationsIn),
+          nLeft(nIterationsIn),
+          nStart(0),
+          nElapsed(0) {}
+
+    bool KeepRunning();
+
+    uint64_t GetIterations() const
+    {
+        return nIterations;
+    }
+
+    // nanoseconds from the first to the last call of KeepRunning
+    int64_t GetElapsed() const
+    {
+        return nElapsed;
+    }
+};
+
+typedef void (*BenchFunction)(CBenchState&);
+
+class CBenchRegistration
+{
+public:
+    CBenchRegistration(const char* pszName, BenchFunction func);
+
+    static std::map<std::string, BenchFunction>& GetBenchmarks();
+};
+
+#define BENCHMARK(name) \
+    static CBenchRegistration benchregistration_##name(#name, name)
+
+#endif  /* BENCH_H */
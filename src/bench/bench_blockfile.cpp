@@ -0,0 +1,114 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+
+using namespace std;
+
+static const unsigned int BENCH_FILE_BLOCKS = 20;
+static const unsigned int BENCH_FILE_BLOCK_TXS = 100;
+
+
+// Blocks appended to a block file under -datadir, with the disk position
+//    of every transaction in them, found the way ConnectBlock finds them.
+class CBenchBlockFile
+{
+public:
+    vector<CDiskTxPos> vTxPos;
+    vector<uint256> vTxHashes;
+
+    CBenchBlockFile();
+};
+
+CBenchBlockFile::CBenchBlockFile()
+{
+    for (unsigned int b = 0; b < BENCH_FILE_BLOCKS; ++b)
+    {
+        CBlock block;
+        block.nTime = 1600000000 + b;
+        for (unsigned int n = 0; n < BENCH_FILE_BLOCK_TXS; ++n)
+        {
+            CTransaction tx;
+            CTxIn txin(COutPoint(uint256(b * BENCH_FILE_BLOCK_TXS + n + 1),
+                                 0));
+            txin.scriptSig << vector<unsigned char>(72, 0x30)
+                           << vector<unsigned char>(33, 0x02);
+            tx.vin.push_back(txin);
+            for (unsigned int i = 0; i < 2; ++i)
+            {
+                CScript script;
+                script.SetDestination(CKeyID(uint160(n * 2 + i + 1)));
+                tx.vout.push_back(CTxOut((i + 1) * COIN, script));
+            }
+            block.vtx.push_back(tx);
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+
+        unsigned int nFile;
+        long int nBlockPos;
+        if (!block.WriteToDisk(nFile, nBlockPos))
+        {
+            throw runtime_error("can't write the benchmark blocks");
+        }
+
+        CBlock blockTemp;
+        blockTemp.nVersion = block.nVersion;
+        unsigned int nTxPos = nBlockPos +
+                              ::GetSerializeSize(blockTemp,
+                                                 SER_DISK,
+                                                 CLIENT_VERSION) -
+                              (2 * GetSizeOfCompactSize(0)) +
+                              GetSizeOfCompactSize(block.vtx.size());
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
+            vTxPos.push_back(CDiskTxPos(nFile, nBlockPos, nTxPos));
+            vTxHashes.push_back(tx.GetHash());
+            nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        }
+    }
+
+    CTransaction tx;
+    if (!tx.ReadFromDisk(vTxPos.back()) || (tx.GetHash() != vTxHashes.back()))
+    {
+        throw runtime_error("benchmark tx positions are wrong");
+    }
+}
+
+static CBenchBlockFile& GetBenchBlockFile()
+{
+    static CBenchBlockFile blockfile;
+    return blockfile;
+}
+
+// what FetchInputs pays for a previous tx that isn't cached
+static void ReadTxFromDisk(CBenchState& state, unsigned int nMaxMaps)
+{
+    CBenchBlockFile& blockfile = GetBenchBlockFile();
+    blockFileReader.SetMaxMaps(nMaxMaps);
+    unsigned int nRand = 1;
+    CTransaction tx;
+    while (state.KeepRunning())
+    {
+        nRand = nRand * 1103515245 + 12345;
+        unsigned int i = (nRand >> 8) % blockfile.vTxPos.size();
+        if (!tx.ReadFromDisk(blockfile.vTxPos[i]))
+        {
+            throw runtime_error("can't read tx");
+        }
+    }
+    blockFileReader.SetMaxMaps(0);
+}
+
+static void ReadTxFromDiskStdio(CBenchState& state)
+{
+    ReadTxFromDisk(state, 0);
+}
+BENCHMARK(ReadTxFromDiskStdio);
+
+static void ReadTxFromDiskMapped(CBenchState& state)
+{
+    ReadTxFromDisk(state, chainParams.DEFAULT_BLOCKFILEMAPS);
+}
+BENCHMARK(ReadTxFromDiskMapped);
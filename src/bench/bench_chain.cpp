@@ -0,0 +1,130 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+#include "txdb-leveldb.h"
+#include "QPRegistry.hpp"
+
+using namespace std;
+
+// stakers bought in the fixture, about as many as the main chain has
+static const unsigned int BENCH_STAKERS = 100;
+
+
+// A short chain in a scratch block index database under -datadir: the
+// block before the staker purchases, the block that buys BENCH_STAKERS
+// stakers, and the block after it. The indices are written through
+// WriteDiskBlockIndex, which also puts them in the block index cache.
+class CBenchChain
+{
+public:
+    static const int BLOCKS = 3;
+
+    CTxDB* ptxdb;
+    uint256 vHashes[BLOCKS];
+    CBlockMemIndex vMemIndexes[BLOCKS];
+    CDiskBlockIndex vDiskIndexes[BLOCKS];
+    // the registry after the purchases
+    QPRegistry registry;
+
+    CBenchChain();
+};
+
+CBenchChain::CBenchChain()
+{
+    ptxdb = new CTxDB("cr+");
+    int nFirst = chainParams.START_PURCHASE2_M + 1;
+    for (int i = 0; i < BLOCKS; ++i)
+    {
+        CDiskBlockIndex& diskIndex = vDiskIndexes[i];
+        diskIndex.nVersion = CBlock::PURCHASE_VERSION;
+        diskIndex.nHeight = nFirst + i;
+        diskIndex.nTime = 1620000000 + (i * 5);
+        diskIndex.hashMerkleRoot = uint256(nFirst + i);
+        diskIndex.hashPrev = (i > 0) ? vHashes[i - 1] : uint256(0);
+        vHashes[i] = diskIndex.GetBlockHash();
+        vMemIndexes[i].phashBlock = &vHashes[i];
+        if (i > 0)
+        {
+            vMemIndexes[i].pprev = &vMemIndexes[i - 1];
+            vMemIndexes[i - 1].pnext = &vMemIndexes[i];
+        }
+    }
+
+    // the second block carries the purchases
+    for (unsigned int n = 0; n < BENCH_STAKERS; ++n)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        QPTxDetails deet;
+        deet.t = TX_PURCHASE1;
+        deet.alias = strprintf("bench%u", n);
+        deet.keys.push_back(key.GetPubKey());
+        deet.hash = vHashes[1];
+        deet.txid = uint256(n + 1);
+        vDiskIndexes[1].vDeets.push_back(deet);
+    }
+
+    for (int i = 0; i < BLOCKS; ++i)
+    {
+        WriteDiskBlockIndex("CBenchChain", &vMemIndexes[i],
+                            vDiskIndexes[i], ptxdb);
+    }
+
+    if (!registry.UpdateOnNewBlock(&vDiskIndexes[1],
+                                   QPRegistry::NO_SNAPS, false, true))
+    {
+        throw runtime_error("can't buy the benchmark stakers");
+    }
+}
+
+static CBenchChain& GetBenchChain()
+{
+    static CBenchChain chain;
+    return chain;
+}
+
+
+// what most of validation pays to look at a block index
+static void ReadDiskBlockIndexCached(CBenchState& state)
+{
+    CBenchChain& chain = GetBenchChain();
+    CDiskBlockIndex diskIndex;
+    while (state.KeepRunning())
+    {
+        ReadDiskBlockIndex("ReadDiskBlockIndexCached",
+                           &chain.vMemIndexes[2], diskIndex, chain.ptxdb);
+    }
+}
+BENCHMARK(ReadDiskBlockIndexCached);
+
+// ProcessBlock copies the main registry for every block it checks
+static void QPRegistryCopy(CBenchState& state)
+{
+    CBenchChain& chain = GetBenchChain();
+    QPRegistry registry;
+    while (state.KeepRunning())
+    {
+        registry.Copy(&chain.registry);
+    }
+}
+BENCHMARK(QPRegistryCopy);
+
+// The fixed cost of advancing the registry by a block without ops. The
+// fixture is pre-qPoS, so it doesn't rotate a staker queue.
+static void QPRegistryUpdateOnNewBlock(CBenchState& state)
+{
+    CBenchChain& chain = GetBenchChain();
+    QPRegistry registry(&chain.registry);
+    while (state.KeepRunning())
+    {
+        if (!registry.UpdateOnNewBlock(&chain.vDiskIndexes[2],
+                                       QPRegistry::NO_SNAPS, false, true))
+        {
+            throw runtime_error("UpdateOnNewBlock failed");
+        }
+    }
+}
+BENCHMARK(QPRegistryUpdateOnNewBlock);
@@ -0,0 +1,64 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "key.h"
+#include "base58.h"
+#include "script.h"
+
+using namespace std;
+
+
+// one input signature check, the bulk of connecting a block
+static void ECDSAVerify(CBenchState& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash(0x5a5a5a5a);
+    vector<unsigned char> vchSig;
+    if (!key.Sign(hash, vchSig))
+    {
+        throw runtime_error("can't sign");
+    }
+    while (state.KeepRunning())
+    {
+        if (!key.Verify(hash, vchSig))
+        {
+            throw runtime_error("signature doesn't verify");
+        }
+    }
+}
+BENCHMARK(ECDSAVerify);
+
+// an address: version byte, key hash and checksum
+static void EncodeBase58Address(CBenchState& state)
+{
+    vector<unsigned char> vch(25);
+    for (unsigned int i = 0; i < vch.size(); ++i)
+    {
+        vch[i] = (unsigned char)(i * 37 + 11);
+    }
+    while (state.KeepRunning())
+    {
+        EncodeBase58(vch);
+    }
+}
+BENCHMARK(EncodeBase58Address);
+
+static void SolverPubKeyHash(CBenchState& state)
+{
+    CScript script;
+    script.SetDestination(CKeyID(uint160(12345)));
+    txnouttype type;
+    vector<vector<unsigned char> > vSolutions;
+    while (state.KeepRunning())
+    {
+        vSolutions.clear();
+        if (!Solver(script, type, vSolutions))
+        {
+            throw runtime_error("script doesn't solve");
+        }
+    }
+}
+BENCHMARK(SolverPubKeyHash);
@@ -0,0 +1,86 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+#include "Feework.hpp"
+#include "core-hashes.hpp"
+
+using namespace std;
+
+
+// the proof of work hash of a qPoS block header
+static void Hash9Header(CBenchState& state)
+{
+    CBlock block;
+    block.nVersion = CBlock::QPOS_VERSION;
+    block.nTime = 1700000000;
+    while (state.KeepRunning())
+    {
+        ++block.nNonce;
+        block.GetHash9();
+    }
+}
+BENCHMARK(Hash9Header);
+
+static void SHA256D(CBenchState& state, unsigned int nSize)
+{
+    vector<unsigned char> vch(nSize, 0x5a);
+    unsigned char pchDigest[32];
+    while (state.KeepRunning())
+    {
+        CoreHashes::SHA256D(&vch[0], vch.size(), pchDigest);
+        vch[0] = pchDigest[0];
+    }
+}
+
+// a merkle tree node
+static void SHA256D_64B(CBenchState& state)
+{
+    SHA256D(state, 64);
+}
+BENCHMARK(SHA256D_64B);
+
+static void SHA256D_1MB(CBenchState& state)
+{
+    SHA256D(state, 1024 * 1024);
+}
+BENCHMARK(SHA256D_1MB);
+
+// argon2d over a typical feeless tx at a given memory cost in KiB
+static void FeeworkHash(CBenchState& state, uint32_t mcost)
+{
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << vector<unsigned char>(250, 0x3c);
+    FeeworkBuffer buffer;
+    if (buffer.status != FeeworkBuffer::INIT_OK)
+    {
+        throw runtime_error("can't allocate feework buffer");
+    }
+    Feework feework;
+    feework.mcost = mcost;
+    while (state.KeepRunning())
+    {
+        ++feework.work;
+        feework.GetFeeworkHash(ss, buffer);
+    }
+}
+
+static void FeeworkMcostMin(CBenchState& state)
+{
+    FeeworkHash(state, chainParams.FEELESS_MCOST_MIN);
+}
+BENCHMARK(FeeworkMcostMin);
+
+static void FeeworkMcost4x(CBenchState& state)
+{
+    FeeworkHash(state, 4 * chainParams.FEELESS_MCOST_MIN);
+}
+BENCHMARK(FeeworkMcost4x);
+
+static void FeeworkMcostMax(CBenchState& state)
+{
+    FeeworkHash(state, chainParams.FEEWORK_MAX_MCOST);
+}
+BENCHMARK(FeeworkMcostMax);
@@ -0,0 +1,80 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "jsonreader.h"
+#include "json/json_spirit_reader_template.h"
+
+#include <boost/lexical_cast.hpp>
+
+using namespace std;
+using namespace json_spirit;
+
+// calls in the batch, about what an explorer sends at once
+static const int BENCH_BATCH_CALLS = 100;
+
+
+static string MakeBenchRequest()
+{
+    return "{\"method\":\"getblockbynumber\",\"params\":[1234567,true],"
+           "\"id\":42}";
+}
+
+static string MakeBenchBatch()
+{
+    string strBatch = "[";
+    for (int i = 0; i < BENCH_BATCH_CALLS; ++i)
+    {
+        string strIndex = boost::lexical_cast<string>(i);
+        strBatch += (i ? "," : "");
+        strBatch += "{\"method\":\"getblockhash\",\"params\":[" + strIndex +
+                    "],\"id\":" + strIndex + "}";
+    }
+    strBatch += "]";
+    return strBatch;
+}
+
+static void ReadJSONRequest(CBenchState& state)
+{
+    string str = MakeBenchRequest();
+    while (state.KeepRunning())
+    {
+        Value value;
+        ReadJSON(str, value);
+    }
+}
+BENCHMARK(ReadJSONRequest);
+
+static void ReadStringRequest(CBenchState& state)
+{
+    string str = MakeBenchRequest();
+    while (state.KeepRunning())
+    {
+        Value value;
+        read_string(str, value);
+    }
+}
+BENCHMARK(ReadStringRequest);
+
+static void ReadJSONBatch(CBenchState& state)
+{
+    string str = MakeBenchBatch();
+    while (state.KeepRunning())
+    {
+        Value value;
+        ReadJSON(str, value);
+    }
+}
+BENCHMARK(ReadJSONBatch);
+
+static void ReadStringBatch(CBenchState& state)
+{
+    string str = MakeBenchBatch();
+    while (state.KeepRunning())
+    {
+        Value value;
+        read_string(str, value);
+    }
+}
+BENCHMARK(ReadStringBatch);
@@ -0,0 +1,183 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+#include "txdb-leveldb.h"
+
+using namespace std;
+
+static const unsigned int BENCH_REORG_BLOCKS = 100;
+static const unsigned int BENCH_REORG_BLOCK_TXS = 20;
+
+
+static CTransaction MakeReorgTx(const vector<COutPoint>& vPrevouts,
+                                unsigned int n)
+{
+    CTransaction tx;
+    BOOST_FOREACH(const COutPoint& prevout, vPrevouts)
+    {
+        CTxIn txin(prevout);
+        txin.scriptSig << vector<unsigned char>(72, 0x30)
+                       << vector<unsigned char>(33, 0x02);
+        tx.vin.push_back(txin);
+    }
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        CScript script;
+        script.SetDestination(CKeyID(uint160(n * 2 + i + 1)));
+        tx.vout.push_back(CTxOut((i + 1) * COIN, script));
+    }
+    return tx;
+}
+
+// A block of transactions appended to the block file under -datadir,
+//    with the disk position of each.
+static void WriteReorgBlock(CBlock& block, vector<CDiskTxPos>& vTxPosRet)
+{
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    unsigned int nFile;
+    long int nBlockPos;
+    if (!block.WriteToDisk(nFile, nBlockPos))
+    {
+        throw runtime_error("can't write the benchmark blocks");
+    }
+    CBlock blockTemp;
+    blockTemp.nVersion = block.nVersion;
+    unsigned int nTxPos = nBlockPos +
+                          ::GetSerializeSize(blockTemp,
+                                             SER_DISK,
+                                             CLIENT_VERSION) -
+                          (2 * GetSizeOfCompactSize(0)) +
+                          GetSizeOfCompactSize(block.vtx.size());
+    vTxPosRet.clear();
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        vTxPosRet.push_back(CDiskTxPos(nFile, nBlockPos, nTxPos));
+        nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+}
+
+
+// BENCH_REORG_BLOCKS blocks connected to a scratch txdb, each with
+//    BENCH_REORG_BLOCK_TXS transactions that spend both outputs of a tx
+//    in a funding block. The txindex bookkeeping is what ConnectBlock
+//    does, without validation. With fUndo the blocks get undo records.
+class CBenchReorg
+{
+public:
+    CTxDB* ptxdb;
+    vector<CBlock> vBlocks;
+
+    CBenchReorg(bool fUndo);
+};
+
+CBenchReorg::CBenchReorg(bool fUndo)
+{
+    ptxdb = new CTxDB("cr+");
+    unsigned int nSalt = fUndo ? 1 : 2;
+    vector<CDiskTxPos> vTxPos;
+
+    CBlock blockFunding;
+    blockFunding.nTime = 1600000000 + nSalt;
+    for (unsigned int n = 0; n < BENCH_REORG_BLOCKS * BENCH_REORG_BLOCK_TXS; ++n)
+    {
+        vector<COutPoint> vPrevouts(1, COutPoint(uint256(n + 1), nSalt));
+        blockFunding.vtx.push_back(MakeReorgTx(vPrevouts, n));
+    }
+    WriteReorgBlock(blockFunding, vTxPos);
+    for (unsigned int i = 0; i < blockFunding.vtx.size(); ++i)
+    {
+        const CTransaction& tx = blockFunding.vtx[i];
+        ptxdb->UpdateTxIndex(tx.GetHash(),
+                             CTxIndex(vTxPos[i], tx.vout.size()));
+    }
+
+    for (unsigned int b = 0; b < BENCH_REORG_BLOCKS; ++b)
+    {
+        CBlock block;
+        block.nTime = blockFunding.nTime + 10 * (b + 1);
+        for (unsigned int n = 0; n < BENCH_REORG_BLOCK_TXS; ++n)
+        {
+            const CTransaction& txPrev =
+                        blockFunding.vtx[b * BENCH_REORG_BLOCK_TXS + n];
+            vector<COutPoint> vPrevouts;
+            vPrevouts.push_back(COutPoint(txPrev.GetHash(), 0));
+            vPrevouts.push_back(COutPoint(txPrev.GetHash(), 1));
+            block.vtx.push_back(MakeReorgTx(vPrevouts, n));
+        }
+        WriteReorgBlock(block, vTxPos);
+
+        map<uint256, CTxIndex> mapQueuedChanges;
+        CBlockUndo undo;
+        for (unsigned int i = 0; i < block.vtx.size(); ++i)
+        {
+            const CTransaction& tx = block.vtx[i];
+            MapPrevTx mapInputs;
+            bool fInvalid;
+            if (!tx.FetchInputs(*ptxdb, mapQueuedChanges, true, false,
+                                mapInputs, fInvalid))
+            {
+                throw runtime_error("can't fetch benchmark inputs");
+            }
+            undo.AddTx(tx, mapInputs, mapQueuedChanges);
+            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            {
+                CTxIndex& txindex = mapInputs[txin.prevout.hash].first;
+                txindex.vSpent[txin.prevout.n] = vTxPos[i];
+                mapQueuedChanges[txin.prevout.hash] = txindex;
+            }
+            mapQueuedChanges[tx.GetHash()] = CTxIndex(vTxPos[i],
+                                                      tx.vout.size());
+        }
+        for (map<uint256, CTxIndex>::iterator mi = mapQueuedChanges.begin();
+             mi != mapQueuedChanges.end();
+             ++mi)
+        {
+            ptxdb->UpdateTxIndex((*mi).first, (*mi).second);
+        }
+        if (fUndo)
+        {
+            ptxdb->WriteBlockUndo(block.GetHash(), undo);
+        }
+        vBlocks.push_back(block);
+    }
+}
+
+// Disconnects every block, newest first, in one batch like Reorganize
+//    does, then aborts the batch so the next iteration starts over.
+static void Reorg100(CBenchState& state, CBenchReorg& reorg)
+{
+    CDiskBlockIndex diskIndex;
+    while (state.KeepRunning())
+    {
+        if (!reorg.ptxdb->TxnBegin())
+        {
+            throw runtime_error("TxnBegin failed");
+        }
+        BOOST_REVERSE_FOREACH(CBlock& block, reorg.vBlocks)
+        {
+            if (!block.DisconnectBlock(*reorg.ptxdb, &diskIndex))
+            {
+                throw runtime_error("DisconnectBlock failed");
+            }
+        }
+        reorg.ptxdb->TxnAbort();
+    }
+}
+
+static void Reorg100Undo(CBenchState& state)
+{
+    static CBenchReorg reorg(true);
+    Reorg100(state, reorg);
+}
+BENCHMARK(Reorg100Undo);
+
+// blocks connected before undo records were written
+static void Reorg100NoUndo(CBenchState& state)
+{
+    static CBenchReorg reorg(false);
+    Reorg100(state, reorg);
+}
+BENCHMARK(Reorg100NoUndo);
@@ -0,0 +1,98 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+
+using namespace std;
+
+// transactions in the block, about a busy block on the main chain
+static const unsigned int BENCH_BLOCK_TXS = 500;
+
+
+// two pay to pubkey hash inputs and outputs, the most common shape
+static CTransaction MakeBenchTx(unsigned int n)
+{
+    CTransaction tx;
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        CTxIn txin(COutPoint(uint256(n * 2 + i + 1), i));
+        txin.scriptSig << vector<unsigned char>(72, 0x30)
+                       << vector<unsigned char>(33, 0x02);
+        tx.vin.push_back(txin);
+    }
+    for (unsigned int i = 0; i < 2; ++i)
+    {
+        CScript script;
+        script.SetDestination(CKeyID(uint160(n * 2 + i + 1)));
+        tx.vout.push_back(CTxOut((i + 1) * COIN, script));
+    }
+    return tx;
+}
+
+static CBlock MakeBenchBlock()
+{
+    CBlock block;
+    block.nVersion = CBlock::QPOS_VERSION;
+    block.nTime = 1700000000;
+    block.nHeight = chainParams.START_QPOS_M;
+    for (unsigned int i = 0; i < BENCH_BLOCK_TXS; ++i)
+    {
+        block.vtx.push_back(MakeBenchTx(i));
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void SerializeTx(CBenchState& state)
+{
+    CTransaction tx = MakeBenchTx(1);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    while (state.KeepRunning())
+    {
+        ss.clear();
+        ss << tx;
+    }
+}
+BENCHMARK(SerializeTx);
+
+static void DeserializeTx(CBenchState& state)
+{
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << MakeBenchTx(1);
+    vector<char> vch(ssTx.begin(), ssTx.end());
+    while (state.KeepRunning())
+    {
+        CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+        CTransaction tx;
+        ss >> tx;
+    }
+}
+BENCHMARK(DeserializeTx);
+
+static void SerializeBlock(CBenchState& state)
+{
+    CBlock block = MakeBenchBlock();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    while (state.KeepRunning())
+    {
+        ss.clear();
+        ss << block;
+    }
+}
+BENCHMARK(SerializeBlock);
+
+static void DeserializeBlock(CBenchState& state)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << MakeBenchBlock();
+    vector<char> vch(ssBlock.begin(), ssBlock.end());
+    while (state.KeepRunning())
+    {
+        CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+BENCHMARK(DeserializeBlock);
@@ -0,0 +1,105 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+using namespace std;
+
+
+CRawBlockCache::CRawBlockCache()
+{
+    nBytes = 0;
+    nMaxBytes = 0;
+    nHits = 0;
+    nMisses = 0;
+}
+
+void CRawBlockCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+CRawBlockCache::RawBlock CRawBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    map<uint256, pair<RawBlock, LruList::iterator> >::iterator mi =
+                                                        mapBlocks.find(hash);
+    if (mi == mapBlocks.end())
+    {
+        nMisses += 1;
+        return RawBlock();
+    }
+    nHits += 1;
+    lruBlocks.splice(lruBlocks.begin(), lruBlocks, (*mi).second.second);
+    return (*mi).second.first;
+}
+
+void CRawBlockCache::Put(const uint256& hash, const RawBlock& pvch)
+{
+    LOCK(cs);
+    if (!pvch || (pvch->size() > nMaxBytes))
+    {
+        return;
+    }
+    map<uint256, pair<RawBlock, LruList::iterator> >::iterator mi =
+                                                        mapBlocks.find(hash);
+    if (mi != mapBlocks.end())
+    {
+        lruBlocks.splice(lruBlocks.begin(), lruBlocks, (*mi).second.second);
+        return;
+    }
+    lruBlocks.push_front(hash);
+    mapBlocks[hash] = make_pair(pvch, lruBlocks.begin());
+    nBytes += pvch->size();
+    Trim();
+}
+
+void CRawBlockCache::Erase(const uint256& hash)
+{
+    LOCK(cs);
+    map<uint256, pair<RawBlock, LruList::iterator> >::iterator mi =
+                                                        mapBlocks.find(hash);
+    if (mi == mapBlocks.end())
+    {
+        return;
+    }
+    nBytes -= (*mi).second.first->size();
+    lruBlocks.erase((*mi).second.second);
+    mapBlocks.erase(mi);
+}
+
+void CRawBlockCache::Clear()
+{
+    LOCK(cs);
+    mapBlocks.clear();
+    lruBlocks.clear();
+    nBytes = 0;
+}
+
+void CRawBlockCache::GetStats(uint64_t& nHitsRet,
+                              uint64_t& nMissesRet,
+                              size_t& nBlocksRet,
+                              size_t& nBytesRet) const
+{
+    LOCK(cs);
+    nHitsRet = nHits;
+    nMissesRet = nMisses;
+    nBlocksRet = mapBlocks.size();
+    nBytesRet = nBytes;
+}
+
+// cs must be held
+void CRawBlockCache::Trim()
+{
+    while ((nBytes > nMaxBytes) && !lruBlocks.empty())
+    {
+        map<uint256, pair<RawBlock, LruList::iterator> >::iterator mi =
+                                          mapBlocks.find(lruBlocks.back());
+        nBytes -= (*mi).second.first->size();
+        mapBlocks.erase(mi);
+        lruBlocks.pop_back();
+    }
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "uint256.h"
+#include "sync.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <list>
+#include <map>
+#include <vector>
+
+// Serialized blocks (network format), least recently used out first,
+//    bounded by total bytes. Used to answer getdata without reading
+//    and re-serializing the same block for every peer.
+class CRawBlockCache
+{
+public:
+    typedef boost::shared_ptr<const std::vector<char> > RawBlock;
+
+    CRawBlockCache();
+
+    void SetMaxBytes(size_t nMaxBytesIn);
+
+    // returns an empty pointer if the block is not cached
+    RawBlock Get(const uint256& hash);
+    void Put(const uint256& hash, const RawBlock& pvch);
+    void Erase(const uint256& hash);
+    void Clear();
+
+    void GetStats(uint64_t& nHitsRet,
+                  uint64_t& nMissesRet,
+                  size_t& nBlocksRet,
+                  size_t& nBytesRet) const;
+
+private:
+    typedef std::list<uint256> LruList;
+
+    mutable CCriticalSection cs;
+    std::map<uint256, std::pair<RawBlock, LruList::iterator> > mapBlocks;
+    // front is most recently used
+    LruList lruBlocks;
+    size_t nBytes;
+    size_t nMaxBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void Trim();
+};
+
+#endif  /* BLOCKCACHE_H */
@@ -0,0 +1,158 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfile.h"
+#include "main.h"
+#include "metrics.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+static CMetricCounter* GetBlockFileMapCounter(const char* pszResult)
+{
+    return GetMetricCounter("stealth_blockfile_map_total",
+                            "Block file mapping lookups, by whether a "
+                            "mapping was reused, made or couldn't be made",
+                            "result", pszResult);
+}
+
+CBlockFileMap::CBlockFileMap(const char* pbeginIn, size_t nSizeIn)
+{
+    pbegin = pbeginIn;
+    nSize = nSizeIn;
+}
+
+CBlockFileMap::~CBlockFileMap()
+{
+#ifndef WIN32
+    munmap((void*)pbegin, nSize);
+#endif
+}
+
+CBlockFileReader::CBlockFileReader()
+{
+    nMaxMaps = 0;
+}
+
+void CBlockFileReader::SetMaxMaps(unsigned int nMaxMapsIn)
+{
+    LOCK(cs);
+    nMaxMaps = nMaxMapsIn;
+    Trim();
+}
+
+bool CBlockFileReader::IsEnabled() const
+{
+    LOCK(cs);
+    return (nMaxMaps > 0);
+}
+
+CBlockFileReader::MapPtr CBlockFileReader::GetMap(unsigned int nFile,
+                                                  size_t nEnd)
+{
+    static CMetricCounter* pcountHits = GetBlockFileMapCounter("hit");
+    static CMetricCounter* pcountMaps = GetBlockFileMapCounter("map");
+    static CMetricCounter* pcountFails = GetBlockFileMapCounter("fail");
+
+#ifdef WIN32
+    return MapPtr();
+#else
+    if ((nFile < 1) || (nFile == (unsigned int) -1))
+    {
+        return MapPtr();
+    }
+
+    LOCK(cs);
+    if (nMaxMaps == 0)
+    {
+        return MapPtr();
+    }
+
+    map<unsigned int, CEntry>::iterator mi = mapMaps.find(nFile);
+    if (mi != mapMaps.end())
+    {
+        lruMaps.splice(lruMaps.begin(), lruMaps, (*mi).second.itLru);
+        if ((*mi).second.pmap->nSize >= nEnd)
+        {
+            pcountHits->Inc();
+            return (*mi).second.pmap;
+        }
+    }
+
+    // map the whole file as it is now
+    string strPath = BlockFilePath(nFile).string();
+    int fd = open(strPath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        pcountFails->Inc();
+        return MapPtr();
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < nEnd))
+    {
+        close(fd);
+        pcountFails->Inc();
+        return MapPtr();
+    }
+    size_t nSize = st.st_size;
+    void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        pcountFails->Inc();
+        error("CBlockFileReader::GetMap() : can't map %s", strPath.c_str());
+        return MapPtr();
+    }
+    pcountMaps->Inc();
+
+    MapPtr pmap(new CBlockFileMap((const char*)p, nSize));
+    if (mi == mapMaps.end())
+    {
+        lruMaps.push_front(nFile);
+        CEntry& entry = mapMaps[nFile];
+        entry.itLru = lruMaps.begin();
+        mi = mapMaps.find(nFile);
+    }
+    (*mi).second.pmap = pmap;
+    Trim();
+    return pmap;
+#endif
+}
+
+void CBlockFileReader::Close(unsigned int nFile)
+{
+    LOCK(cs);
+    map<unsigned int, CEntry>::iterator mi = mapMaps.find(nFile);
+    if (mi == mapMaps.end())
+    {
+        return;
+    }
+    lruMaps.erase((*mi).second.itLru);
+    mapMaps.erase(mi);
+}
+
+void CBlockFileReader::Clear()
+{
+    LOCK(cs);
+    mapMaps.clear();
+    lruMaps.clear();
+}
+
+// cs must be held
+void CBlockFileReader::Trim()
+{
+    while ((mapMaps.size() > nMaxMaps) && !lruMaps.empty())
+    {
+        mapMaps.erase(lruMaps.back());
+        lruMaps.pop_back();
+    }
+}
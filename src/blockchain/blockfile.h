@@ -0,0 +1,176 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOCKFILE_H
+#define BLOCKFILE_H
+
+#include "serialize.h"
+#include "sync.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <list>
+#include <map>
+
+// The read side of CDataStream over bytes it doesn't own, so a block or
+//    transaction can be deserialized where it lies in a mapped block file
+//    instead of being copied into a stream first.
+class CSpanReader
+{
+private:
+    const char* pcur;
+    const char* pend;
+
+public:
+    int nType;
+    int nVersion;
+
+    CSpanReader(const char* pbeginIn,
+                const char* pendIn,
+                int nTypeIn,
+                int nVersionIn)
+    {
+        pcur = pbeginIn;
+        pend = pendIn;
+        nType = nTypeIn;
+        nVersion = nVersionIn;
+    }
+
+    size_t size() const
+    {
+        return pend - pcur;
+    }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+        {
+            throw std::ios_base::failure("CSpanReader::read() : end of data");
+        }
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+        {
+            throw std::ios_base::failure(
+                        "CSpanReader::ignore() : end of data");
+        }
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+
+// One block file mapped read-only, unmapped when the last reader lets go.
+class CBlockFileMap
+{
+public:
+    const char* pbegin;
+    size_t nSize;
+
+    CBlockFileMap(const char* pbeginIn, size_t nSizeIn);
+    ~CBlockFileMap();
+
+private:
+    CBlockFileMap(const CBlockFileMap&);
+    CBlockFileMap& operator=(const CBlockFileMap&);
+};
+
+
+// Block files kept mapped for reading, least recently used out first,
+//    bounded by their count. Every CTransaction::ReadFromDisk used to take
+//    an fopen, a seek, stdio buffering and an fclose, which dominates
+//    FetchInputs, getrawtransaction and the explorer when the previous
+//    transactions aren't cached.
+//
+// Block files only grow, so a mapping stays valid. A read past the end of
+//    a mapping, into blocks appended after it was made, maps the file
+//    again at its current size. Readers hold the old mapping until they
+//    are done with it. Files that are going to be removed or rewritten
+//    must be closed first.
+//
+// Read() returns false when the file can't be mapped (or on WIN32), and
+//    the caller falls back to OpenBlockFile.
+class CBlockFileReader
+{
+public:
+    typedef boost::shared_ptr<const CBlockFileMap> MapPtr;
+
+    CBlockFileReader();
+
+    // 0 turns mapping off
+    void SetMaxMaps(unsigned int nMaxMapsIn);
+    bool IsEnabled() const;
+
+    // a mapping of nFile at least nEnd bytes long, NULL if there is none
+    MapPtr GetMap(unsigned int nFile, size_t nEnd);
+    void Close(unsigned int nFile);
+    void Clear();
+
+    // Deserializes obj from nPos in block file nFile. Throws like a
+    //    stream on bad data.
+    template<typename T>
+    bool Read(unsigned int nFile, size_t nPos, T& obj, int nType)
+    {
+        MapPtr pmap = GetMap(nFile, nPos + 1);
+        if (!pmap)
+        {
+            return false;
+        }
+        try
+        {
+            CSpanReader s(pmap->pbegin + nPos,
+                          pmap->pbegin + pmap->nSize,
+                          nType,
+                          CLIENT_VERSION);
+            s >> obj;
+            return true;
+        }
+        catch (std::ios_base::failure& e)
+        {
+            // ran off the mapping, the file may have grown since
+        }
+        pmap = GetMap(nFile, pmap->nSize + 1);
+        if (!pmap)
+        {
+            return false;
+        }
+        CSpanReader s(pmap->pbegin + nPos,
+                      pmap->pbegin + pmap->nSize,
+                      nType,
+                      CLIENT_VERSION);
+        s >> obj;
+        return true;
+    }
+
+private:
+    typedef std::list<unsigned int> LruList;
+
+    struct CEntry
+    {
+        MapPtr pmap;
+        LruList::iterator itLru;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<unsigned int, CEntry> mapMaps;
+    // front is most recently used
+    LruList lruMaps;
+    unsigned int nMaxMaps;
+
+    void Trim();
+};
+
+#endif  /* BLOCKFILE_H */
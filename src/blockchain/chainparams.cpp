@@ -324,6 +324,11 @@ ChainParams::ChainParams()
         (    23945000, uint256("0x1d792a3fa57481605c9840ba24dfd4a5898ec480eb7eb0dd96da42e53dbee883"))
            );
 
+    // Hashes of chain state snapshots (exportchainstate) that
+    //    -importchainstate trusts without -chainstatehash, by height.
+    //    None is published yet, so imports need -chainstatehash.
+    mapChainstateHashesMainNet = mapIntUInt256_t();
+
     // Hard checkpoints of stake modifiers to ensure they are deterministic
     mapStakeModifierCheckpoints = MakeMapIntUInt(
         boost::assign::map_list_of
@@ -347,8 +352,54 @@ ChainParams::ChainParams()
     // Minimum disk space required - used in CheckDiskSpace()
     nMinDiskSpace = 52428800;
 
+    // smallest -prune target (MB)
+    MIN_PRUNE_TARGET = 550;
+
+    // block files are started at this size when pruning, so old ones
+    //    can be deleted a piece at a time (bytes)
+    PRUNE_BLOCKFILE_SIZE = 134217728;
+
     GETBLOCKS_LIMIT = 2000;
 
+    // headers-first sync: max headers per "headers" message
+    MAX_HEADERS_RESULTS = 2000;
+
+    // headers-first sync: max headers held ahead of the best block
+    MAX_HEADERS_AHEAD = 50000;
+
+    // headers-first sync: max headers held, best chain and branches
+    MAX_SYNC_HEADERS = 60000;
+
+    // headers-first sync: max headers held from a peer that don't
+    //    extend the best header chain
+    MAX_SIDE_HEADERS_PER_PEER = 2000;
+
+    // headers-first sync: blocks past the first missing block that
+    //    may be requested (from all peers combined)
+    BLOCK_DOWNLOAD_WINDOW = 1024;
+
+    // headers-first sync: max outstanding block requests per peer
+    MAX_BLOCKS_IN_FLIGHT_PER_PEER = 16;
+
+    // headers-first sync: a peer that holds up the window this long
+    //    while later blocks are waiting is disconnected (seconds)
+    BLOCK_STALL_TIMEOUT = 10;
+
+    // headers-first sync: re-request a block from another peer (seconds)
+    BLOCK_DOWNLOAD_TIMEOUT = 120;
+
+    // headers-first sync: ask another peer for headers (seconds)
+    HEADERS_RESPONSE_TIMEOUT = 60;
+
+    // inventory a peer is remembered to know (rolling bloom filter)
+    MAX_INVENTORY_KNOWN = 20000;
+
+    // max pending getdata requests queued for a peer
+    MAX_ASKFOR_PER_PEER = 5000;
+
+    // max inventory remembered as requested from any peer
+    MAX_ALREADY_ASKED_FOR = 50000;
+
     MAX_OUTBOUND_CONNECTIONS = 12;
 
     // configuration file name
@@ -360,6 +411,27 @@ ChainParams::ChainParams()
     // leveldb default cashe size (MB)
     DEFAULT_DBCACHE = 25;
 
+    // leveldb cache size of the explore records (MB)
+    DEFAULT_EXPLORECACHE = 25;
+
+    // seconds an unused explore pagination cursor is kept
+    DEFAULT_EXPLORECURSORTTL = 300;
+
+    // explore pagination cursors kept at once
+    DEFAULT_MAXEXPLORECURSORS = 100;
+
+    // serialized block cache for getdata (MB)
+    DEFAULT_BLOCKCACHE = 16;
+
+    // previous transactions cached for FetchInputs (MB)
+    DEFAULT_TXCACHE = 32;
+
+    // block files kept memory mapped for reading (count)
+    DEFAULT_BLOCKFILEMAPS = 8;
+
+    // seconds between writes of mempool.dat
+    DEFAULT_MEMPOOLDUMPINTERVAL = 900;
+
     // bdb default log file lize (MB)
     DEFAULT_DBLOGSIZE = 100;
 
@@ -393,6 +465,27 @@ ChainParams::ChainParams()
 
     DEFAULT_RPCPORT_MAINNET = 46502;
 
+    // worker threads executing RPC requests
+    DEFAULT_RPCTHREADS = 4;
+
+    // RPC requests waiting for a worker before new ones get 503
+    DEFAULT_RPCWORKQUEUE = 16;
+
+    // threads one batch request may use for its read-only calls
+    DEFAULT_RPCBATCHTHREADS = 4;
+
+    // replies of one batch request (MB), calls past this fail
+    DEFAULT_RPCBATCHMAXSIZE = 32;
+
+    // data (MB) a notification subscriber may fall behind before losing frames
+    DEFAULT_NOTIFYQUEUESIZE = 16;
+
+    // lines per second one log message may write to debug.log
+    DEFAULT_LOGRATELIMIT = 1000;
+
+    // spans -tracebuffer may keep, about 50 bytes each
+    MAX_TRACEBUFFER = 1000000;
+
     // number of keys to generate for keypool refill
     DEFAULT_KEYPOOL = 100;
 
@@ -518,6 +611,8 @@ ChainParams::ChainParams()
         (        8974, uint256("0x00cd9141d0dedc9ed68739c4d0ff98367edafee810e9be8835a71523928e5908"))
            );
 
+    mapChainstateHashesTestNet = mapIntUInt256_t();
+
     DEFAULT_PORT_TESTNET = 4438;
 
     DEFAULT_PROXY_TESTNET = 19050;
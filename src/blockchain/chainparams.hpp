@@ -188,6 +188,8 @@ public:
 
     mapIntUInt256_t mapCheckpointsMainNet;
 
+    mapIntUInt256_t mapChainstateHashesMainNet;
+
     mapIntUInt_t mapStakeModifierCheckpoints;
 
     std::string strCheckpointMasterPubKey;
@@ -198,13 +200,37 @@ public:
 
     uint64_t nMinDiskSpace;
 
+    int MIN_PRUNE_TARGET;
+    int PRUNE_BLOCKFILE_SIZE;
+
     int GETBLOCKS_LIMIT;
 
+    int MAX_HEADERS_RESULTS;
+    int MAX_HEADERS_AHEAD;
+    int MAX_SYNC_HEADERS;
+    int MAX_SIDE_HEADERS_PER_PEER;
+    int BLOCK_DOWNLOAD_WINDOW;
+    int MAX_BLOCKS_IN_FLIGHT_PER_PEER;
+    int BLOCK_STALL_TIMEOUT;
+    int BLOCK_DOWNLOAD_TIMEOUT;
+    int HEADERS_RESPONSE_TIMEOUT;
+
+    unsigned int MAX_INVENTORY_KNOWN;
+    unsigned int MAX_ASKFOR_PER_PEER;
+    unsigned int MAX_ALREADY_ASKED_FOR;
+
     int MAX_OUTBOUND_CONNECTIONS;
 
     std::string DEFAULT_CONF;
     std::string DEFAULT_PID;
     int DEFAULT_DBCACHE;
+    int DEFAULT_EXPLORECACHE;
+    int DEFAULT_EXPLORECURSORTTL;
+    int DEFAULT_MAXEXPLORECURSORS;
+    int DEFAULT_BLOCKCACHE;
+    int DEFAULT_TXCACHE;
+    int DEFAULT_BLOCKFILEMAPS;
+    int DEFAULT_MEMPOOLDUMPINTERVAL;
     int DEFAULT_DBLOGSIZE;
     int DEFAULT_TIMEOUT;
     int DEFAULT_PORT_MAINNET;
@@ -218,6 +244,13 @@ public:
     int DEFAULT_MAXSENDBUFFER;
     int DEFAULT_BANTIME;
     int DEFAULT_RPCPORT_MAINNET;
+    int DEFAULT_RPCTHREADS;
+    int DEFAULT_RPCWORKQUEUE;
+    int DEFAULT_RPCBATCHTHREADS;
+    int DEFAULT_RPCBATCHMAXSIZE;
+    int DEFAULT_NOTIFYQUEUESIZE;
+    int DEFAULT_LOGRATELIMIT;
+    int MAX_TRACEBUFFER;
     int DEFAULT_KEYPOOL;
     int DEFAULT_CHECKBLOCKS;
     int DEFAULT_CHECKLEVEL;
@@ -284,6 +317,8 @@ public:
 
     mapIntUInt256_t mapCheckpointsTestNet;
 
+    mapIntUInt256_t mapChainstateHashesTestNet;
+
     int DEFAULT_PORT_TESTNET;
 
     int DEFAULT_PROXY_TESTNET;
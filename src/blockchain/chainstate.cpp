@@ -0,0 +1,773 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainstate.h"
+#include "main.h"
+#include "txdb-leveldb.h"
+#include "chainview.h"
+#include "prune.h"
+#include "QPConstants.hpp"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+static const int CHAINSTATE_VERSION = 2;
+
+// block index records written to the txdb per batch on import
+static const unsigned int CHAINSTATE_BATCH_SIZE = 10000;
+
+
+// What precedes the block index records. The records run from the best
+//    block down to genesis, then come the registry snapshot (if any)
+//    and the unspent transactions, grouped by block.
+class CChainstateHeader
+{
+public:
+    unsigned char pchMagic[4];
+    int nFileVersion;
+    int nHeight;
+    uint256 hashBlock;
+    int nSnapshotHeight;
+    unsigned int nGroups;
+
+    CChainstateHeader()
+    {
+        memset(pchMagic, 0, sizeof(pchMagic));
+        nFileVersion = 0;
+        nHeight = -1;
+        hashBlock = 0;
+        nSnapshotHeight = -1;
+        nGroups = 0;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(FLATDATA(pchMagic));
+        READWRITE(nFileVersion);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(nSnapshotHeight);
+        READWRITE(nGroups);
+    )
+};
+
+// The transactions of a block with unspent outputs, as pruning keeps
+//    them (see prune.h), each with the spent flags of its outputs.
+class CChainstateTxs
+{
+public:
+    CPrunedTxs record;
+    vector<vector<CDiskTxPos> > vvSpent;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(record);
+        if (fRead)
+        {
+            const_cast<CChainstateTxs*>(this)->vvSpent.resize(
+                                                        record.vtx.size());
+        }
+        for (unsigned int i = 0; i < record.vtx.size(); ++i)
+        {
+            READWRITE(REF(CSpentBitmap(vvSpent[i])));
+        }
+    )
+};
+
+// Writes to a file while hashing what is written, so a file much larger
+//    than memory gets its checksum without being read back.
+class CHashingFileWriter
+{
+private:
+    FILE* file;
+    CHashWriter hasher;
+
+public:
+    int nType;
+    int nVersion;
+
+    CHashingFileWriter(FILE* fileIn)
+        : file(fileIn),
+          hasher(SER_GETHASH, 0),
+          nType(SER_DISK),
+          nVersion(CLIENT_VERSION)
+    {
+    }
+
+    CHashingFileWriter& write(const char* pch, size_t nSize)
+    {
+        if (fwrite(pch, 1, nSize, file) != nSize)
+        {
+            throw std::ios_base::failure(
+                                "CHashingFileWriter::write : write failed");
+        }
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    template<typename T>
+    CHashingFileWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash()
+    {
+        return hasher.GetHash();
+    }
+};
+
+
+// orders unspent transactions as they lie in the block files
+static bool CompareUnspent(const pair<CDiskTxPos, uint256>& a,
+                           const pair<CDiskTxPos, uint256>& b)
+{
+    if (a.first.nFile != b.first.nFile)
+    {
+        return a.first.nFile < b.first.nFile;
+    }
+    if (a.first.nBlockPos != b.first.nBlockPos)
+    {
+        return a.first.nBlockPos < b.first.nBlockPos;
+    }
+    return a.first.nTxPos < b.first.nTxPos;
+}
+
+static void GetNetworkMagic(unsigned char pchMagicRet[4])
+{
+    // pchMessageStart is only switched to testnet by LoadBlockIndex
+    const unsigned char* pch = fTestNet ? chainParams.pchMessageStartTestNet
+                                        : chainParams.pchMessageStartMainNet;
+    memcpy(pchMagicRet, pch, 4);
+}
+
+// The latest viable registry snapshot below nHeight in the chain of view.
+static bool FindRegistrySnapshot(CTxDB& txdb,
+                                 int nHeight,
+                                 QPRegistry& registryRet,
+                                 int& nSnapshotHeightRet)
+{
+    nSnapshotHeightRet = -1;
+    if (nHeight < 1)
+    {
+        return false;
+    }
+    // LoadBlockIndex replays from the snapshot, so it must be below the tip
+    int nSnap = (nHeight - 1) - ((nHeight - 1) % BLOCKS_PER_SNAPSHOT);
+    while (nSnap >= GetPurchaseStart())
+    {
+        if (txdb.RegistrySnapshotIsViable(nSnap) &&
+            txdb.ReadRegistrySnapshot(nSnap, registryRet))
+        {
+            nSnapshotHeightRet = nSnap;
+            return true;
+        }
+        nSnap -= BLOCKS_PER_SNAPSHOT;
+    }
+    return false;
+}
+
+// The header of the block at pos and all its transactions with their
+//    merkle branches, or those pruning kept if the block is gone.
+static bool ReadBlockTxs(const CDiskTxPos& pos, CPrunedTxs& recordRet)
+{
+    if (IsPrunedTxPos(pos))
+    {
+        return recordRet.ReadFromDisk(pos.nFile, pos.nBlockPos);
+    }
+    CBlock block;
+    if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, true))
+    {
+        return false;
+    }
+    vector<int> vnIndex;
+    for (unsigned int i = 0; i < block.vtx.size(); ++i)
+    {
+        vnIndex.push_back(i);
+    }
+    recordRet.Set(block, vnIndex);
+    return true;
+}
+
+static bool ExportChainstateInternal(FILE* file,
+                                     CChainstateInfo& infoRet,
+                                     string& strErrorRet)
+{
+    // The view is a snapshot, but the block files it points at are not,
+    //    so none may be pruned until the export is done.
+    LOCK(cs_pruning);
+
+    ChainViewPtr pview = GetChainView();
+    if (!pview || !pview->pmemIndexBest)
+    {
+        strErrorRet = "No chain view yet";
+        return false;
+    }
+
+    CTxDB txdb("r");
+    pview->Attach(txdb);
+
+    CChainstateHeader header;
+    GetNetworkMagic(header.pchMagic);
+    header.nFileVersion = CHAINSTATE_VERSION;
+    header.nHeight = pview->nHeight;
+    header.hashBlock = pview->hashBest;
+
+    QPRegistry registry;
+    FindRegistrySnapshot(txdb, pview->nHeight,
+                         registry, header.nSnapshotHeight);
+
+    vector<pair<CDiskTxPos, uint256> > vUnspent;
+    if (!txdb.ReadUnspentTxIndexes(vUnspent))
+    {
+        strErrorRet = "Can't read the transaction index";
+        return false;
+    }
+    // in file order, so each block's transactions are together
+    sort(vUnspent.begin(), vUnspent.end(), CompareUnspent);
+    for (unsigned int i = 0; i < vUnspent.size(); ++i)
+    {
+        if ((i == 0) ||
+            (vUnspent[i].first.nFile != vUnspent[i - 1].first.nFile) ||
+            (vUnspent[i].first.nBlockPos != vUnspent[i - 1].first.nBlockPos))
+        {
+            header.nGroups += 1;
+        }
+    }
+
+    CHashingFileWriter fileout(file);
+    fileout << header;
+
+    // Records are taken from the best block down, following pprev,
+    //    which stays in the chain of the view while the tip moves.
+    uint256 hashNext = 0;
+    uint256 hashSnapshotBlock = 0;
+    int nExpected = pview->nHeight;
+    for (CBlockMemIndex* pmemIndex = pview->pmemIndexBest;
+         pmemIndex != NULL;
+         pmemIndex = pmemIndex->pprev)
+    {
+        if (fShutdown)
+        {
+            strErrorRet = "Shutting down";
+            return false;
+        }
+        uint256 hash = pmemIndex->GetBlockHash();
+        CDiskBlockIndex diskIndex;
+        if (!txdb.ReadBlockIndex(hash, diskIndex) ||
+            (diskIndex.GetBlockHash() != hash) ||
+            (diskIndex.nHeight != nExpected))
+        {
+            strErrorRet = strprintf("Can't read block index %s",
+                                    hash.ToString().c_str());
+            return false;
+        }
+        if (diskIndex.nHeight == header.nSnapshotHeight)
+        {
+            hashSnapshotBlock = hash;
+        }
+        // block file positions mean nothing to the importer
+        diskIndex.nFile = 0;
+        diskIndex.nBlockPos = 0;
+        diskIndex.hashNext = hashNext;
+        fileout << diskIndex;
+        hashNext = hash;
+        nExpected -= 1;
+        infoRet.nBlocks += 1;
+    }
+    if (nExpected != -1)
+    {
+        strErrorRet = "Best chain doesn't reach genesis";
+        return false;
+    }
+
+    if (header.nSnapshotHeight >= 0)
+    {
+        if (registry.GetBlockHash() != hashSnapshotBlock)
+        {
+            strErrorRet = strprintf("Registry snapshot at %d is not in the "
+                                    "best chain", header.nSnapshotHeight);
+            return false;
+        }
+        fileout << registry;
+    }
+
+    unsigned int i = 0;
+    while (i < vUnspent.size())
+    {
+        if (fShutdown)
+        {
+            strErrorRet = "Shutting down";
+            return false;
+        }
+        const CDiskTxPos posBlock = vUnspent[i].first;
+        CPrunedTxs recordAll;
+        if (!ReadBlockTxs(posBlock, recordAll))
+        {
+            strErrorRet = strprintf("Can't read block in blk%04u.dat",
+                                    posBlock.nFile);
+            return false;
+        }
+        map<uint256, unsigned int> mapIndex;
+        for (unsigned int n = 0; n < recordAll.vtx.size(); ++n)
+        {
+            mapIndex[recordAll.vtx[n].tx.GetHash()] = n;
+        }
+        CChainstateTxs txs;
+        txs.record.header = recordAll.header;
+        for (;
+             (i < vUnspent.size()) &&
+             (vUnspent[i].first.nFile == posBlock.nFile) &&
+             (vUnspent[i].first.nBlockPos == posBlock.nBlockPos);
+             ++i)
+        {
+            const uint256& hashTx = vUnspent[i].second;
+            map<uint256, unsigned int>::const_iterator mi;
+            mi = mapIndex.find(hashTx);
+            CTxIndex txindex;
+            if ((mi == mapIndex.end()) || !txdb.ReadTxIndex(hashTx, txindex))
+            {
+                strErrorRet = strprintf("Can't read transaction %s",
+                                        hashTx.ToString().c_str());
+                return false;
+            }
+            txs.record.vtx.push_back(recordAll.vtx[mi->second]);
+            txs.vvSpent.push_back(txindex.vSpent);
+            infoRet.nTransactions += 1;
+        }
+        fileout << txs;
+    }
+
+    uint256 hashSnapshot = fileout.GetHash();
+    if (fwrite(BEGIN(hashSnapshot), 1, sizeof(hashSnapshot), file) !=
+        sizeof(hashSnapshot))
+    {
+        strErrorRet = "Can't write the file";
+        return false;
+    }
+
+    infoRet.nHeight = header.nHeight;
+    infoRet.hashBlock = header.hashBlock;
+    infoRet.hashSnapshot = hashSnapshot;
+    return true;
+}
+
+bool ExportChainstate(const string& strFile,
+                      CChainstateInfo& infoRet,
+                      string& strErrorRet)
+{
+    int64_t nStart = GetTimeMillis();
+    infoRet = CChainstateInfo();
+
+    boost::filesystem::path pathDest(strFile);
+    boost::filesystem::path pathTmp(strFile + ".tmp");
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+    {
+        strErrorRet = "Can't open " + pathTmp.string();
+        return false;
+    }
+
+    bool fOK = false;
+    try
+    {
+        fOK = ExportChainstateInternal(file, infoRet, strErrorRet);
+    }
+    catch (std::exception& e)
+    {
+        strErrorRet = string("I/O error: ") + e.what();
+    }
+    if (fOK)
+    {
+        fflush(file);
+        FileCommit(file);
+    }
+    fclose(file);
+
+    if (!fOK || !RenameOver(pathTmp, pathDest))
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathTmp, ec);
+        if (fOK)
+        {
+            strErrorRet = "Can't rename into place " + pathDest.string();
+        }
+        return error("ExportChainstate() : %s", strErrorRet.c_str());
+    }
+
+    printf("ExportChainstate() : wrote height %d, %u blocks, "
+           "%u transactions, hash %s  %" PRId64 "ms\n",
+           infoRet.nHeight, infoRet.nBlocks, infoRet.nTransactions,
+           infoRet.hashSnapshot.ToString().c_str(),
+           GetTimeMillis() - nStart);
+    return true;
+}
+
+
+// the double SHA256 of the file up to its trailing hash
+static bool HashChainstateFile(FILE* file,
+                               uint64_t nDataSize,
+                               uint256& hashRet)
+{
+    CHashWriter hasher(SER_GETHASH, 0);
+    vector<char> vch(1 << 20);
+    uint64_t nLeft = nDataSize;
+    while (nLeft > 0)
+    {
+        if (fShutdown)
+        {
+            return false;
+        }
+        size_t nRead = (size_t)min(nLeft, (uint64_t)vch.size());
+        if (fread(&vch[0], 1, nRead, file) != nRead)
+        {
+            return false;
+        }
+        hasher.write(&vch[0], nRead);
+        nLeft -= nRead;
+    }
+    hashRet = hasher.GetHash();
+    return true;
+}
+
+static bool ImportChainstateInternal(CAutoFile& filein,
+                                     uint64_t nDataSize,
+                                     const string& strHash,
+                                     CChainstateInfo& infoRet,
+                                     string& strErrorRet)
+{
+    CTxDB txdb("cr+");
+    uint256 hashBestChain;
+    if (txdb.ReadHashBestChain(hashBestChain))
+    {
+        strErrorRet = "The data directory already has a block chain, "
+                      "import into an empty one";
+        return false;
+    }
+
+    CChainstateHeader header;
+    filein >> header;
+    unsigned char pchMagic[4];
+    GetNetworkMagic(pchMagic);
+    if (memcmp(header.pchMagic, pchMagic, sizeof(pchMagic)))
+    {
+        strErrorRet = "The snapshot is for another network";
+        return false;
+    }
+    if (header.nFileVersion != CHAINSTATE_VERSION)
+    {
+        strErrorRet = strprintf("Unknown snapshot version %d",
+                                header.nFileVersion);
+        return false;
+    }
+    if ((header.nHeight < 0) ||
+        (header.nSnapshotHeight >= header.nHeight))
+    {
+        strErrorRet = "Malformed snapshot";
+        return false;
+    }
+
+    // a snapshot is trusted by its hash alone, so one must be known,
+    //    from -chainstatehash or listed in chainparams
+    const mapIntUInt256_t& mapHashes =
+                                    fTestNet ?
+                                    chainParams.mapChainstateHashesTestNet :
+                                    chainParams.mapChainstateHashesMainNet;
+    uint256 hashExpected = 0;
+    mapIntUInt256_t::const_iterator mi = mapHashes.find(header.nHeight);
+    if (mi != mapHashes.end())
+    {
+        hashExpected = mi->second;
+    }
+    else if (!strHash.empty())
+    {
+        hashExpected.SetHex(strHash);
+    }
+    else
+    {
+        strErrorRet = strprintf("No hash is known for a snapshot at height "
+                                "%d, give one with -chainstatehash",
+                                header.nHeight);
+        return false;
+    }
+
+    if (fseek(filein, 0, SEEK_SET) != 0)
+    {
+        strErrorRet = "Can't read the snapshot";
+        return false;
+    }
+    uint256 hashFile;
+    uint256 hashTrailer;
+    if (!HashChainstateFile(filein, nDataSize, hashFile))
+    {
+        strErrorRet = "Can't read the snapshot";
+        return false;
+    }
+    filein >> hashTrailer;
+    if (hashFile != hashTrailer)
+    {
+        strErrorRet = "The snapshot is corrupted";
+        return false;
+    }
+    if (hashFile != hashExpected)
+    {
+        strErrorRet = strprintf("The snapshot hash %s is not the one "
+                                "expected", hashFile.ToString().c_str());
+        return false;
+    }
+    printf("ImportChainstate() : snapshot at height %d has hash %s\n",
+           header.nHeight, hashFile.ToString().c_str());
+
+    if (fseek(filein, 0, SEEK_SET) != 0)
+    {
+        strErrorRet = "Can't read the snapshot";
+        return false;
+    }
+    filein >> header;
+
+    // the hash is trusted, but the records must still form a chain
+    //    from the best block to this network's genesis
+    const uint256 hashGenesis = fTestNet ? chainParams.hashGenesisBlockTestNet
+                                         : hashGenesisBlock;
+    uint256 hashExpectedBlock = header.hashBlock;
+    uint256 hashSnapshotBlock = 0;
+    uint256 hashLast = 0;
+    if (!txdb.TxnBegin())
+    {
+        strErrorRet = "Can't write the block index";
+        return false;
+    }
+    for (int nHeight = header.nHeight; nHeight >= 0; --nHeight)
+    {
+        if (fShutdown)
+        {
+            txdb.TxnAbort();
+            strErrorRet = "Shutting down";
+            return false;
+        }
+        CDiskBlockIndex diskIndex;
+        filein >> diskIndex;
+        uint256 hash = diskIndex.GetBlockHash();
+        if ((hash != hashExpectedBlock) || (diskIndex.nHeight != nHeight))
+        {
+            txdb.TxnAbort();
+            strErrorRet = strprintf("Block index broken at height %d",
+                                    nHeight);
+            return false;
+        }
+        if (nHeight == header.nSnapshotHeight)
+        {
+            hashSnapshotBlock = hash;
+        }
+        diskIndex.nFile = 0;
+        diskIndex.nBlockPos = 0;
+        txdb.WriteBlockIndex(diskIndex);
+        hashExpectedBlock = diskIndex.hashPrev;
+        hashLast = hash;
+        infoRet.nBlocks += 1;
+
+        if ((infoRet.nBlocks % CHAINSTATE_BATCH_SIZE) == 0)
+        {
+            if (!txdb.TxnCommit() || !txdb.TxnBegin())
+            {
+                strErrorRet = "Can't write the block index";
+                return false;
+            }
+        }
+        if ((infoRet.nBlocks % 1000000) == 0)
+        {
+            printf("ImportChainstate() : imported %u block indices\n",
+                   infoRet.nBlocks);
+        }
+    }
+    if (!txdb.TxnCommit())
+    {
+        strErrorRet = "Can't write the block index";
+        return false;
+    }
+    if ((hashExpectedBlock != 0) || (hashLast != hashGenesis))
+    {
+        strErrorRet = "The snapshot is for another chain";
+        return false;
+    }
+
+    if (header.nSnapshotHeight >= 0)
+    {
+        QPRegistry registry;
+        filein >> registry;
+        if ((registry.GetBlockHeight() != header.nSnapshotHeight) ||
+            (registry.GetBlockHash() != hashSnapshotBlock))
+        {
+            strErrorRet = "Registry snapshot is not in the chain";
+            return false;
+        }
+        if (!txdb.WriteRegistrySnapshot(header.nSnapshotHeight, registry))
+        {
+            strErrorRet = "Can't write the registry snapshot";
+            return false;
+        }
+    }
+
+    // records as pruning leaves them, see prune.h
+    map<unsigned int, vector<unsigned int> > mapRecords;
+    if (!txdb.TxnBegin())
+    {
+        strErrorRet = "Can't write the transaction index";
+        return false;
+    }
+    unsigned int nBatch = 0;
+    for (unsigned int n = 0; n < header.nGroups; ++n)
+    {
+        if (fShutdown)
+        {
+            txdb.TxnAbort();
+            strErrorRet = "Shutting down";
+            return false;
+        }
+        CChainstateTxs txs;
+        filein >> txs;
+        const CPrunedTxs& record = txs.record;
+        for (unsigned int i = 0; i < record.vtx.size(); ++i)
+        {
+            // the branch is what later shows the tx is in the block
+            const CPrunedTx& ptx = record.vtx[i];
+            if ((txs.vvSpent[i].size() != ptx.tx.vout.size()) ||
+                (CBlock::CheckMerkleBranch(ptx.tx.GetHash(),
+                                           ptx.vMerkleBranch,
+                                           ptx.nIndex) !=
+                 record.header.hashMerkleRoot))
+            {
+                txdb.TxnAbort();
+                strErrorRet = "Malformed unspent transactions";
+                return false;
+            }
+        }
+        unsigned int nFile;
+        long int nRecordPos;
+        if (!record.WriteToDisk(nFile, nRecordPos))
+        {
+            txdb.TxnAbort();
+            strErrorRet = "Can't write the block files";
+            return false;
+        }
+        vector<CDiskTxPos> vTxPos;
+        record.GetTxPositions(nFile, nRecordPos, vTxPos);
+        for (unsigned int i = 0; i < record.vtx.size(); ++i)
+        {
+            CTxIndex txindex(vTxPos[i], 0);
+            txindex.vSpent = txs.vvSpent[i];
+            txdb.UpdateTxIndex(record.vtx[i].tx.GetHash(), txindex);
+        }
+        mapRecords[nFile].push_back(nRecordPos);
+        infoRet.nTransactions += record.vtx.size();
+        nBatch += record.vtx.size();
+
+        if (nBatch >= CHAINSTATE_BATCH_SIZE)
+        {
+            nBatch = 0;
+            if (!txdb.TxnCommit() || !txdb.TxnBegin())
+            {
+                strErrorRet = "Can't write the transaction index";
+                return false;
+            }
+        }
+    }
+    if (!txdb.TxnCommit())
+    {
+        strErrorRet = "Can't write the transaction index";
+        return false;
+    }
+
+    // the records must be on disk before the best chain is written
+    map<unsigned int, vector<unsigned int> >::const_iterator it;
+    for (it = mapRecords.begin(); it != mapRecords.end(); ++it)
+    {
+        FILE* file = OpenBlockFile(it->first, 0, "ab");
+        if (!file)
+        {
+            strErrorRet = strprintf("Can't open blk%04u.dat", it->first);
+            return false;
+        }
+        FileCommit(file);
+        fclose(file);
+    }
+
+    // The best chain is written last: until it is, the data directory
+    //    is not taken for a chain and the import can be run again.
+    if (!txdb.TxnBegin())
+    {
+        strErrorRet = "Can't write the best chain";
+        return false;
+    }
+    for (it = mapRecords.begin(); it != mapRecords.end(); ++it)
+    {
+        txdb.WritePrunedTxs(it->first, it->second);
+    }
+    txdb.WritePruneHeight(header.nHeight);
+    txdb.WriteHashBestChain(header.hashBlock);
+    if (!txdb.TxnCommit())
+    {
+        strErrorRet = "Can't write the best chain";
+        return false;
+    }
+
+    infoRet.nHeight = header.nHeight;
+    infoRet.hashBlock = header.hashBlock;
+    infoRet.hashSnapshot = hashFile;
+    return true;
+}
+
+bool ImportChainstate(const string& strFile,
+                      const string& strHash,
+                      CChainstateInfo& infoRet,
+                      string& strErrorRet)
+{
+    int64_t nStart = GetTimeMillis();
+    infoRet = CChainstateInfo();
+
+    boost::system::error_code ec;
+    uint64_t nFileSize = boost::filesystem::file_size(strFile, ec);
+    if (ec || (nFileSize < sizeof(uint256)))
+    {
+        strErrorRet = "Can't read " + strFile;
+        return false;
+    }
+
+    FILE* file = fopen(strFile.c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+    {
+        strErrorRet = "Can't open " + strFile;
+        return false;
+    }
+
+    bool fOK = false;
+    try
+    {
+        fOK = ImportChainstateInternal(filein,
+                                       nFileSize - sizeof(uint256),
+                                       strHash,
+                                       infoRet,
+                                       strErrorRet);
+    }
+    catch (std::exception& e)
+    {
+        strErrorRet = "The snapshot is truncated or malformed";
+    }
+    filein.fclose();
+
+    if (!fOK)
+    {
+        return error("ImportChainstate() : %s", strErrorRet.c_str());
+    }
+
+    printf("ImportChainstate() : imported height %d, %u blocks, "
+           "%u transactions  %" PRId64 "ms\n",
+           infoRet.nHeight, infoRet.nBlocks, infoRet.nTransactions,
+           GetTimeMillis() - nStart);
+    return true;
+}
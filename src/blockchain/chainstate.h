@@ -0,0 +1,57 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CHAINSTATE_H
+#define CHAINSTATE_H
+
+#include "uint256.h"
+
+#include <string>
+
+// A chain state snapshot lets a new node start at a recent block instead
+//    of validating the chain from genesis. It holds the best chain block
+//    index records, the latest registry snapshot below the tip, and every
+//    transaction with an unspent output, grouped under its block header.
+//    The file ends with the double SHA256 of everything before it. That
+//    hash is published with the snapshot and given with -chainstatehash.
+//
+// An imported node is pruned to the snapshot height (see prune.h): it
+//    has the block index and the registry, and the unspent transactions
+//    in records of pruned transactions in its block files, but no older
+//    blocks.
+
+class CChainstateInfo
+{
+public:
+    int nHeight;
+    uint256 hashBlock;
+    uint256 hashSnapshot;
+    unsigned int nBlocks;
+    unsigned int nTransactions;
+
+    CChainstateInfo()
+    {
+        nHeight = -1;
+        hashBlock = 0;
+        hashSnapshot = 0;
+        nBlocks = 0;
+        nTransactions = 0;
+    }
+};
+
+// Writes a snapshot of the published chain view to strFile.
+bool ExportChainstate(const std::string& strFile,
+                      CChainstateInfo& infoRet,
+                      std::string& strErrorRet);
+
+// Loads a snapshot into an empty data directory, before the block index
+//    is loaded. Its hash must match strHash, or the one chainparams lists
+//    for its height. A failed import leaves no best chain, so it can be
+//    run again.
+bool ImportChainstate(const std::string& strFile,
+                      const std::string& strHash,
+                      CChainstateInfo& infoRet,
+                      std::string& strErrorRet);
+
+#endif  /* CHAINSTATE_H */
@@ -0,0 +1,163 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainview.h"
+#include "txdb-leveldb.h"
+#include "explore.hpp"
+
+using namespace std;
+
+
+extern QPRegistry *pregistryMain;
+
+// guards pviewCurrent only, never held while taking another lock
+static CCriticalSection cs_chainview;
+static ChainViewPtr pviewCurrent;
+
+
+CChainView::CChainView()
+{
+    nHeight = -1;
+    pmemIndexBest = NULL;
+    nTimePublished = 0;
+    pSnapshot = NULL;
+    pSnapshotExplore = NULL;
+}
+
+CChainView::~CChainView()
+{
+    CTxDB::ReleaseSnapshot(pSnapshot);
+    CTxDB::ReleaseExploreSnapshot(pSnapshotExplore);
+}
+
+void CChainView::Attach(CTxDB& txdb) const
+{
+    txdb.UseSnapshot(pSnapshot);
+    txdb.UseExploreSnapshot(pSnapshotExplore);
+}
+
+
+CBlockMemIndex* CChainView::GetBlockByHeight(int nHeightIn) const
+{
+    if ((nHeightIn < 0) || (nHeightIn > nHeight))
+    {
+        return NULL;
+    }
+    {
+        // while the tip of this view is in the lookup, so is its chain
+        LOCK(cs_blockmaps);
+        CMapBlockLookup::const_iterator mi = mapBlockLookup.find(nHeight);
+        if ((mi != mapBlockLookup.end()) && ((*mi).second == pmemIndexBest))
+        {
+            mi = mapBlockLookup.find(nHeightIn);
+            return (mi == mapBlockLookup.end()) ? NULL : (*mi).second;
+        }
+    }
+    // the best chain has moved off this view, pprev never changes
+    CBlockMemIndex* pmemIndex = pmemIndexBest;
+    for (int i = nHeight; (i > nHeightIn) && pmemIndex; --i)
+    {
+        pmemIndex = pmemIndex->pprev;
+    }
+    return pmemIndex;
+}
+
+
+bool PublishChainView(bool fForce, QPRegistry* pregistryAdopt)
+{
+    // freed here unless a view takes it
+    boost::shared_ptr<const QPRegistry> pregistryView(pregistryAdopt);
+
+    if (pmemIndexBest == NULL)
+    {
+        return false;
+    }
+
+    ChainViewPtr pviewLast = GetChainView();
+    if (pviewLast && (pviewLast->hashBest == hashBestChain))
+    {
+        return true;
+    }
+
+    int64_t nNow = GetTimeMillis();
+    if (!fForce && pviewLast && IsInitialBlockDownload() &&
+        ((nNow - pviewLast->nTimePublished) < 1000))
+    {
+        return true;
+    }
+
+    CChainView* pview = new CChainView();
+    pview->hashBest = hashBestChain;
+    pview->nHeight = nBestHeight;
+    pview->pmemIndexBest = pmemIndexBest;
+    pview->nTimePublished = nNow;
+    if (!pregistryView)
+    {
+        pregistryView.reset(new QPRegistry(pregistryMain));
+    }
+    pview->pregistry = pregistryView;
+    if (fWithExploreAPI)
+    {
+        pview->pmapAddressBalances = GetAddressBalances();
+        pview->pSnapshotExplore = CTxDB::GetExploreSnapshot();
+    }
+    pview->pSnapshot = CTxDB::GetSnapshot();
+
+    ChainViewPtr pviewNew(pview);
+    {
+        LOCK(cs_chainview);
+        pviewCurrent.swap(pviewNew);
+    }
+    // the old view (now in pviewNew) is freed here unless an RPC holds it
+
+    return true;
+}
+
+ChainViewPtr GetChainView()
+{
+    LOCK(cs_chainview);
+    return pviewCurrent;
+}
+
+void ReleaseChainView()
+{
+    ChainViewPtr pviewOld;
+    {
+        LOCK(cs_chainview);
+        pviewCurrent.swap(pviewOld);
+    }
+}
+
+
+CBlockMemIndex* LookupBlockIndex(const uint256& hash)
+{
+    LOCK(cs_blockmaps);
+    CMapBlockIndex::const_iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+    {
+        return NULL;
+    }
+    return (*mi).second;
+}
+
+bool LookupInBestChain(const uint256& hash, int nHeight, int& nBestHeightRet)
+{
+    LOCK(cs_blockmaps);
+    nBestHeightRet = mapBlockLookup.empty() ? -1 :
+                                          (*mapBlockLookup.rbegin()).first;
+    CMapBlockLookup::const_iterator mi = mapBlockLookup.find(nHeight);
+    return ((mi != mapBlockLookup.end()) &&
+            ((*mi).second->GetBlockHash() == hash));
+}
+
+CBlockMemIndex* LookupBlockByHeight(int nHeight)
+{
+    LOCK(cs_blockmaps);
+    CMapBlockLookup::const_iterator mi = mapBlockLookup.find(nHeight);
+    if (mi == mapBlockLookup.end())
+    {
+        return NULL;
+    }
+    return (*mi).second;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CHAINVIEW_H
+#define CHAINVIEW_H
+
+#include "main.h"
+#include "ExploreConstants.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+class CTxDB;
+
+namespace leveldb
+{
+    class Snapshot;
+}
+
+// An immutable picture of the chain state taken under cs_main after a
+//    block is connected. Read-only RPCs use it without taking cs_main:
+//    the tip, a private copy of the registry, the rich list counts
+//    and LevelDB snapshots that pin every CTxDB read to this tip.
+// Block index entries are never freed, so pmemIndexBest stays valid.
+class CChainView
+{
+public:
+    uint256 hashBest;
+    int nHeight;
+    CBlockMemIndex* pmemIndexBest;
+    int64_t nTimePublished;
+    boost::shared_ptr<const QPRegistry> pregistry;
+    // empty unless the node runs with the Explore API
+    boost::shared_ptr<const MapBalanceCounts> pmapAddressBalances;
+
+    CChainView();
+    ~CChainView();
+
+    // reads through txdb will see the database as of this view
+    void Attach(CTxDB& txdb) const;
+
+    // The block at nHeight on the chain of this view, NULL above its tip.
+    CBlockMemIndex* GetBlockByHeight(int nHeightIn) const;
+
+private:
+    const leveldb::Snapshot* pSnapshot;
+    const leveldb::Snapshot* pSnapshotExplore;
+
+    friend bool PublishChainView(bool fForce, QPRegistry* pregistryAdopt);
+
+    // views are shared by pointer, never copied
+    CChainView(const CChainView&);
+    CChainView& operator=(const CChainView&);
+};
+
+typedef boost::shared_ptr<const CChainView> ChainViewPtr;
+
+// Takes a new view of the best chain. ** Caller must hold cs_main. **
+//    During initial block download views are taken at most once a second
+//    unless fForce is set. pregistryAdopt, if given, is a copy of the
+//    main registry as it is now, which the view takes over (or frees)
+//    instead of copying the registry again.
+bool PublishChainView(bool fForce=false, QPRegistry* pregistryAdopt=NULL);
+
+// The most recently published view, empty before the first one.
+ChainViewPtr GetChainView();
+
+// Drops the published view (shutdown).
+void ReleaseChainView();
+
+// Block map lookups for callers that do not hold cs_main.
+CBlockMemIndex* LookupBlockIndex(const uint256& hash);
+CBlockMemIndex* LookupBlockByHeight(int nHeight);
+// Whether the block is on the best chain, with the best height read
+//    at the same time.
+bool LookupInBestChain(const uint256& hash, int nHeight, int& nBestHeightRet);
+
+#endif  /* CHAINVIEW_H */
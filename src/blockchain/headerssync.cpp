@@ -0,0 +1,161 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "headerssync.h"
+
+using namespace std;
+
+
+CSyncHeaderChain::CSyncHeaderChain(unsigned int nMaxHeadersIn,
+                                   int nMaxSidePerPeerIn)
+{
+    nMaxHeaders = nMaxHeadersIn;
+    nMaxSidePerPeer = nMaxSidePerPeerIn;
+    nChainStart = 0;
+    pnodeSyncLast = NULL;
+}
+
+void CSyncHeaderChain::Clear()
+{
+    mapHeaders.clear();
+    deqChain.clear();
+    nChainStart = 0;
+    mapSideHeaders.clear();
+    pnodeSyncLast = NULL;
+}
+
+bool CSyncHeaderChain::Get(const uint256& hash, CSyncHeader& headerRet) const
+{
+    map<uint256, CSyncHeader>::const_iterator mi = mapHeaders.find(hash);
+    if (mi == mapHeaders.end())
+    {
+        return false;
+    }
+    headerRet = (*mi).second;
+    return true;
+}
+
+bool CSyncHeaderChain::CanAdd(const CNode* pfrom, bool fExtendsBest) const
+{
+    return (fExtendsBest || (GetSideHeaders(pfrom) < nMaxSidePerPeer));
+}
+
+bool CSyncHeaderChain::Add(const CNode* pfrom,
+                           const uint256& hash,
+                           const CSyncHeader& header,
+                           bool fExtendsBest)
+{
+    if (!CanAdd(pfrom, fExtendsBest) || (mapHeaders.size() >= nMaxHeaders))
+    {
+        return false;
+    }
+    mapHeaders[hash] = header;
+    if (!fExtendsBest)
+    {
+        mapSideHeaders[pfrom] += 1;
+    }
+    else if (!deqChain.empty() && (header.hashPrev == deqChain.back()))
+    {
+        deqChain.push_back(hash);
+    }
+    else
+    {
+        SetBest(hash);
+    }
+    return true;
+}
+
+void CSyncHeaderChain::SetBest(const uint256& hashBest)
+{
+    deqChain.clear();
+    uint256 hash = hashBest;
+    map<uint256, CSyncHeader>::const_iterator mi = mapHeaders.find(hash);
+    while (mi != mapHeaders.end())
+    {
+        deqChain.push_front(hash);
+        nChainStart = (*mi).second.nHeight;
+        hash = (*mi).second.hashPrev;
+        mi = mapHeaders.find(hash);
+    }
+}
+
+void CSyncHeaderChain::Trim(vector<uint256>& vDroppedRet)
+{
+    vDroppedRet.clear();
+    set<uint256> setChain(deqChain.begin(), deqChain.end());
+    map<uint256, CSyncHeader>::iterator mi = mapHeaders.begin();
+    while (mi != mapHeaders.end())
+    {
+        if (setChain.count((*mi).first))
+        {
+            ++mi;
+            continue;
+        }
+        vDroppedRet.push_back((*mi).first);
+        mapHeaders.erase(mi++);
+    }
+    // every side header is gone
+    mapSideHeaders.clear();
+}
+
+void CSyncHeaderChain::PopFront()
+{
+    if (deqChain.empty())
+    {
+        return;
+    }
+    mapHeaders.erase(deqChain.front());
+    deqChain.pop_front();
+    nChainStart += 1;
+    if (deqChain.empty())
+    {
+        // side branches that never became best
+        mapHeaders.clear();
+        mapSideHeaders.clear();
+    }
+}
+
+void CSyncHeaderChain::SetSyncPeer(const CNode* pnode)
+{
+    if (pnode != pnodeSyncLast)
+    {
+        mapSideHeaders.erase(pnode);
+        pnodeSyncLast = pnode;
+    }
+}
+
+void CSyncHeaderChain::EndSync(const CNode* pnode)
+{
+    mapSideHeaders.erase(pnode);
+    if (pnode == pnodeSyncLast)
+    {
+        pnodeSyncLast = NULL;
+    }
+}
+
+int CSyncHeaderChain::GetSideHeaders(const CNode* pnode) const
+{
+    map<const CNode*, int>::const_iterator mi = mapSideHeaders.find(pnode);
+    return (mi == mapSideHeaders.end()) ? 0 : (*mi).second;
+}
+
+void CSyncHeaderChain::KeepPeers(const set<CNode*>& setLive)
+{
+    map<const CNode*, int>::iterator mi = mapSideHeaders.begin();
+    while (mi != mapSideHeaders.end())
+    {
+        if (setLive.count(const_cast<CNode*>((*mi).first)))
+        {
+            ++mi;
+        }
+        else
+        {
+            mapSideHeaders.erase(mi++);
+        }
+    }
+    if (!setLive.count(const_cast<CNode*>(pnodeSyncLast)))
+    {
+        pnodeSyncLast = NULL;
+    }
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef HEADERSSYNC_H
+#define HEADERSSYNC_H
+
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+class CNode;
+
+// Header fields of a block that headers-first sync needs before the
+//    block is in the block index.
+class CSyncHeader
+{
+public:
+    uint256 hashPrev;
+    int nHeight;
+    // what the target of the next header depends on
+    unsigned int nBits;
+    int64_t nTime;
+    bool fProofOfStake;
+
+    CSyncHeader()
+    {
+        hashPrev = 0;
+        nHeight = 0;
+        nBits = 0;
+        nTime = 0;
+        fProofOfStake = false;
+    }
+};
+
+// The headers fetched ahead of the block chain, linked by hash. The best
+//    known header chain past the block index is kept in ascending order.
+//    Headers that don't extend it (side headers) are counted per peer,
+//    so made up branches can't fill the map. A peer's count starts over
+//    when it becomes the sync peer, when its sync ends, and whenever the
+//    side headers are dropped.
+//
+// Peers are for identity only and never dereferenced. Guarded by cs_main.
+class CSyncHeaderChain
+{
+public:
+    CSyncHeaderChain(unsigned int nMaxHeadersIn, int nMaxSidePerPeerIn);
+
+    void Clear();
+
+    unsigned int Size() const
+    {
+        return mapHeaders.size();
+    }
+
+    bool Get(const uint256& hash, CSyncHeader& headerRet) const;
+
+    // false if pfrom has too many side headers
+    bool CanAdd(const CNode* pfrom, bool fExtendsBest) const;
+
+    // Adds a header, which becomes the tip of the best chain if
+    //    fExtendsBest. False if it can't be added, see Trim().
+    bool Add(const CNode* pfrom,
+             const uint256& hash,
+             const CSyncHeader& header,
+             bool fExtendsBest);
+
+    // Drops the headers that are not on the best chain, and returns them.
+    void Trim(std::vector<uint256>& vDroppedRet);
+
+    // the best header chain
+    const std::deque<uint256>& GetChain() const
+    {
+        return deqChain;
+    }
+
+    // height of the first header of the best chain
+    int GetChainStart() const
+    {
+        return nChainStart;
+    }
+
+    // Drops the first header of the best chain, once it enters the block
+    //    index. Side headers go as well with the last one.
+    void PopFront();
+
+    // the peer asked for headers
+    void SetSyncPeer(const CNode* pnode);
+    // the peer has no more headers to send
+    void EndSync(const CNode* pnode);
+    int GetSideHeaders(const CNode* pnode) const;
+    // forgets the counts of peers that are gone
+    void KeepPeers(const std::set<CNode*>& setLive);
+
+private:
+    unsigned int nMaxHeaders;
+    int nMaxSidePerPeer;
+
+    std::map<uint256, CSyncHeader> mapHeaders;
+    // first element is at nChainStart
+    std::deque<uint256> deqChain;
+    int nChainStart;
+
+    std::map<const CNode*, int> mapSideHeaders;
+    const CNode* pnodeSyncLast;
+
+    // Rebuilds the best chain back from hashBest.
+    void SetBest(const uint256& hashBest);
+};
+
+#endif  /* HEADERSSYNC_H */
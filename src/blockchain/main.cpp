@@ -16,12 +16,24 @@
 #include "explore.hpp"
 #include "stealthaddress.h"
 #include "chainparams.hpp"
+#include "compactblock.h"
+#include "blockcache.h"
+#include "txcache.h"
+#include "mempoolfile.h"
+#include "prune.h"
+#include "chainview.h"
+#include "headerssync.h"
+#include "notifier.h"
+#include "metrics.h"
+#include "trace.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
+#include <deque>
+
 using namespace std;
 
 
@@ -51,6 +63,8 @@ unsigned int nTransactionsUpdated = 0;
 
 CMapBlockIndex mapBlockIndex;
 CMapBlockLookup mapBlockLookup;
+// writers also hold cs_main, readers without cs_main must take this
+CCriticalSection cs_blockmaps;
 
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 uint256 hashGenesisBlock = chainParams.hashGenesisBlockMainNet;
@@ -79,6 +93,17 @@ CMedianFilter<int> cPeerBlockCounts(5, 0); // Amount of blocks that other nodes
 
 
 
+CRawBlockCache rawBlockCache;
+CPrevTxCache prevTxCache;
+CBlockFileReader blockFileReader;
+bool fSpenderIndex = false;
+
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
+int nPruneHeight = -1;
+bool fCheckForPruning = false;
+unsigned int nBlocksDisconnected = 0;
+
 map<uint256, CBlock*> mapOrphanBlocks;
 multimap<uint256, CBlock*> mapOrphanBlocksByPrev;
 set<pair<COutPoint, unsigned int> > setStakeSeenOrphan;
@@ -1822,34 +1847,62 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     else
     {
         CBlock blockTmp;
-        if (pblock == NULL)
+        CTxIndex txindex;
+        if ((pblock == NULL) && !CTxDB("r").ReadTxIndex(GetHash(), txindex))
         {
-            // Load the block this tx is in
-            CTxIndex txindex;
-            if (!CTxDB("r").ReadTxIndex(GetHash(), txindex))
+            return 0;
+        }
+        if ((pblock == NULL) && IsPrunedTxPos(txindex.pos))
+        {
+            // the block is gone, but the tx was kept with its branch
+            CPrunedTxs record;
+            if (!record.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos))
                 return 0;
-            if (!blockTmp.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos))
+            hashBlock = record.header.GetHash();
+            unsigned int i = 0;
+            while ((i < record.vtx.size()) &&
+                   !(record.vtx[i].tx == *(CTransaction*)this))
+            {
+                ++i;
+            }
+            if (i == record.vtx.size())
+            {
+                vMerkleBranch.clear();
+                nIndex = -1;
+                printf("ERROR: SetMerkleBranch() : couldn't find pruned tx\n");
                 return 0;
-            pblock = &blockTmp;
+            }
+            nIndex = record.vtx[i].nIndex;
+            vMerkleBranch = record.vtx[i].vMerkleBranch;
         }
+        else
+        {
+            if (pblock == NULL)
+            {
+                // Load the block this tx is in
+                if (!blockTmp.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos))
+                    return 0;
+                pblock = &blockTmp;
+            }
 
-        // Update the tx's hashBlock
-        hashBlock = pblock->GetHash();
+            // Update the tx's hashBlock
+            hashBlock = pblock->GetHash();
 
-        // Locate the transaction
-        for (nIndex = 0; nIndex < (int)pblock->vtx.size(); nIndex++)
-            if (pblock->vtx[nIndex] == *(CTransaction*)this)
-                break;
-        if (nIndex == (int)pblock->vtx.size())
-        {
-            vMerkleBranch.clear();
-            nIndex = -1;
-            printf("ERROR: SetMerkleBranch() : couldn't find tx in block\n");
-            return 0;
-        }
+            // Locate the transaction
+            for (nIndex = 0; nIndex < (int)pblock->vtx.size(); nIndex++)
+                if (pblock->vtx[nIndex] == *(CTransaction*)this)
+                    break;
+            if (nIndex == (int)pblock->vtx.size())
+            {
+                vMerkleBranch.clear();
+                nIndex = -1;
+                printf("ERROR: SetMerkleBranch() : couldn't find tx in block\n");
+                return 0;
+            }
 
-        // Fill in merkle branch
-        vMerkleBranch = pblock->GetMerkleBranch(nIndex);
+            // Fill in merkle branch
+            vMerkleBranch = pblock->GetMerkleBranch(nIndex);
+        }
     }
 
     // Is the tx in a block that's in the main chain
@@ -2144,6 +2197,12 @@ bool CTransaction::CheckFeework(Feework &feework,
                                 bool fCheckDepth,
                                 bool fMiner) const
 {
+    static CMetricHistogram* phistFeework =
+        GetMetricHistogram("stealth_feework_check_seconds",
+                           "Time to check the feework of a transaction");
+    CMetricTimer timerFeework(phistFeework);
+    TRACE_SPAN("CheckFeework");
+
     if (vout.empty())
     {
         feework.status = Feework::EMPTY;
@@ -2285,22 +2344,6 @@ bool CTransaction::CheckFeework(Feework &feework,
         }
     }
 
-    // Temporary tx used as data for feework hash.
-    CTransaction txTmp(*this);
-
-    // Remove the last output (the feework)
-    txTmp.vout.pop_back();
-
-    // Blank the sigs.
-    // Each will sign the work by virtue of signing the tx hash.
-    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-    {
-        txTmp.vin[i].scriptSig = CScript();
-    }
-
-    CDataStream ss(SER_DISK, CLIENT_VERSION);
-    ss << *(pmemIndexFeeworkBlock->phashBlock) << txTmp;
-
     // dynamic difficulty
     // feework.mcost = chainParams.FEELESS_MCOST_MIN;
     // feework.limit = GetFeeworkLimit(nBlockSize, mode, feework.bytes);
@@ -2310,7 +2353,8 @@ bool CTransaction::CheckFeework(Feework &feework,
                        chainParams.TX_FEEWORK_LIMIT :
                        chainParams.RELAY_TX_FEEWORK_LIMIT;
 
-    feework.GetFeeworkHash(ss, buffer);
+    feework.pblockhash = pmemIndexFeeworkBlock->phashBlock;
+    HashFeework(feework, buffer);
 
     uint32_t mcost = GetFeeworkHardness(nBlockSize, mode, feework.bytes);
     if (!feework.Check(mcost))
@@ -2321,9 +2365,44 @@ bool CTransaction::CheckFeework(Feework &feework,
     return true;
 }
 
+void CTransaction::HashFeework(Feework& feework,
+                               FeeworkBuffer& buffer) const
+{
+    if (GetLoadedFeework(GetHash(), *(feework.pblockhash), feework.hash))
+    {
+        return;
+    }
+
+    // Temporary tx used as data for feework hash.
+    CTransaction txTmp(*this);
+
+    // Remove the last output (the feework)
+    txTmp.vout.pop_back();
+
+    // Blank the sigs.
+    // Each will sign the work by virtue of signing the tx hash.
+    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+    {
+        txTmp.vin[i].scriptSig = CScript();
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << *(feework.pblockhash) << txTmp;
+
+    feework.GetFeeworkHash(ss, buffer);
+}
+
 bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
                         bool fCheckInputs, bool* pfMissingInputs)
 {
+    static CMetricHistogram* phistAccept =
+        GetMetricHistogram("stealth_mempool_accept_seconds",
+                           "Time to check a transaction for the mempool");
+    static CMetricCounter* pcountAccepted =
+        GetMetricCounter("stealth_mempool_accepted_total",
+                         "Transactions accepted to the mempool");
+    CMetricTimer timerAccept(phistAccept);
+
     if (pfMissingInputs)
     {
         *pfMissingInputs = false;
@@ -2659,6 +2738,11 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
         if (feework.IsOK())
         {
             mempool.addFeeless(feework.height, hash);
+            if (feework.pblockhash)
+            {
+                mapFeework[hash] = CFeeworkResult(*feework.pblockhash,
+                                                  feework.hash);
+            }
         }
     }
 
@@ -2672,6 +2756,10 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
     printf("CTxMemPool::accept() : accepted %s (poolsz %" PRIszu ")\n",
            hash.ToString().c_str(),
            mapTx.size());
+    pcountAccepted->Inc();
+
+    NotifyTransaction(tx);
+
     return true;
 }
 
@@ -2680,6 +2768,14 @@ bool CTransaction::AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs, bool* pfMi
     return mempool.accept(txdb, *this, fCheckInputs, pfMissingInputs);
 }
 
+static CMetricGauge* GetMempoolSizeGauge()
+{
+    static CMetricGauge* pgauge =
+        GetMetricGauge("stealth_mempool_transactions",
+                       "Transactions in the mempool");
+    return pgauge;
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
 {
     // Add to memory pool without checking anything.  Don't call this directly,
@@ -2689,6 +2785,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
         nTransactionsUpdated++;
+        GetMempoolSizeGauge()->Set(mapTx.size());
     }
     return true;
 }
@@ -2718,6 +2815,7 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
             }
             mapTx.erase(hash);
             nTransactionsUpdated++;
+            GetMempoolSizeGauge()->Set(mapTx.size());
         }
         // The following are cheap and non recursive
         //   so they are done without checking mapTx, etc.
@@ -2726,6 +2824,7 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
         //    require expensive all v. all checking.
         mapClaims.erase(hash);
         mapRegistrations.erase(hash);
+        mapFeework.erase(hash);
     }
     return true;
 }
@@ -2751,7 +2850,9 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapFeework.clear();
     ++nTransactionsUpdated;
+    GetMempoolSizeGauge()->Set(0);
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -3072,6 +3173,115 @@ bool CBlock::ReadFromDisk(const CBlockMemIndex* pmemIndex,
     return ReadFromDisk(&diskIndex, fReadTransactions);
 }
 
+// The serialized block as stored, which is also its network encoding
+//    (nothing in a block serializes differently for SER_DISK).
+static bool CheckRawBlockHeader(const char* pchStart, unsigned int nSize)
+{
+    if (memcmp(pchStart, pchMessageStart, sizeof(pchMessageStart)) != 0)
+    {
+        return error("ReadRawBlockFromDisk() : bad index header");
+    }
+    if (nSize > MAX_SIZE)
+    {
+        return error("ReadRawBlockFromDisk() : bad block size %u", nSize);
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(unsigned int nFile,
+                          long int nBlockPos,
+                          vector<char>& vchRet)
+{
+    // index header is message start and size
+    static const long int nHeaderSize = sizeof(pchMessageStart) +
+                                        sizeof(unsigned int);
+    if (nBlockPos < nHeaderSize)
+    {
+        return error("ReadRawBlockFromDisk() : bad block position %ld",
+                     nBlockPos);
+    }
+
+    // copied straight out of the mapped file when it can be mapped
+    CBlockFileReader::MapPtr pmap = blockFileReader.GetMap(nFile, nBlockPos);
+    if (pmap)
+    {
+        try
+        {
+            const char* pchStart = pmap->pbegin + nBlockPos - nHeaderSize;
+            CSpanReader s(pchStart + sizeof(pchMessageStart),
+                          pmap->pbegin + nBlockPos,
+                          SER_DISK,
+                          CLIENT_VERSION);
+            unsigned int nSize;
+            s >> nSize;
+            if (!CheckRawBlockHeader(pchStart, nSize))
+            {
+                return false;
+            }
+            if (pmap->nSize - nBlockPos < nSize)
+            {
+                pmap = blockFileReader.GetMap(nFile, nBlockPos + nSize);
+            }
+            if (pmap)
+            {
+                const char* pbegin = pmap->pbegin + nBlockPos;
+                vchRet.assign(pbegin, pbegin + nSize);
+                return true;
+            }
+        }
+        catch (std::exception& e)
+        {
+            return error("%s() : I/O error", __PRETTY_FUNCTION__);
+        }
+    }
+
+    CAutoFile filein = CAutoFile(OpenBlockFile(nFile,
+                                               nBlockPos - nHeaderSize,
+                                               "rb"),
+                                 SER_DISK,
+                                 CLIENT_VERSION);
+    if (!filein)
+    {
+        return error("ReadRawBlockFromDisk() : OpenBlockFile failed");
+    }
+    try
+    {
+        unsigned char pchStart[sizeof(pchMessageStart)];
+        unsigned int nSize;
+        filein >> FLATDATA(pchStart) >> nSize;
+        if (!CheckRawBlockHeader((const char*)pchStart, nSize))
+        {
+            return false;
+        }
+        vchRet.resize(nSize);
+        filein.read(&vchRet[0], nSize);
+    }
+    catch (std::exception& e)
+    {
+        return error("%s() : I/O error", __PRETTY_FUNCTION__);
+    }
+    return true;
+}
+
+CRawBlockCache::RawBlock GetRawBlock(const CBlockMemIndex* pmemIndex)
+{
+    const uint256& hash = pmemIndex->GetBlockHash();
+    CRawBlockCache::RawBlock pvch = rawBlockCache.Get(hash);
+    if (pvch)
+    {
+        return pvch;
+    }
+    CDiskBlockIndex diskIndex;
+    ReadDiskBlockIndex("GetRawBlock", pmemIndex, diskIndex);
+    boost::shared_ptr<vector<char> > pvchRead(new vector<char>());
+    if (!ReadRawBlockFromDisk(diskIndex.nFile, diskIndex.nBlockPos, *pvchRead))
+    {
+        return CRawBlockCache::RawBlock();
+    }
+    rawBlockCache.Put(hash, pvchRead);
+    return pvchRead;
+}
+
 
 uint256 static GetOrphanRoot(const CBlock* pblock)
 {
@@ -3315,6 +3525,55 @@ void GetLastBlockIndex(const CBlockMemIndex* pmemIndex,
 }
 
 
+// The retarget of GetNextTargetRequired, given the last block (of either
+//    type) and the last two blocks of the type of the next block.
+static unsigned int ComputeNextTarget(const CBigNum& bnTargetLimit,
+                                      bool fProofOfStake,
+                                      int nLastHeight,
+                                      int nPrevHeight,
+                                      unsigned int nPrevBits,
+                                      int64_t nPrevTime,
+                                      int64_t nPrevPrevTime)
+{
+    int64_t nActualSpacing = nPrevTime - nPrevPrevTime;
+
+    if (nActualSpacing < 0)
+    {
+        // printf(">> nActualSpacing = %" PRI64d " corrected to 1.\n",
+        // nActualSpacing);
+        nActualSpacing = 1;
+    }
+    else if (nActualSpacing > nTargetTimespan)
+    {
+        // printf(">> nActualSpacing = %" PRI64d " corrected to nTargetTimespan
+        // (900).\n", nActualSpacing);
+        nActualSpacing = nTargetTimespan;
+    }
+
+    // ppcoin: target change every block
+    // ppcoin: retarget with exponential moving toward target spacing
+    CBigNum bnNew;
+    bnNew.SetCompact(nPrevBits);
+
+    int64_t nTargetSpacing = fProofOfStake
+                                 ? nStakeTargetSpacing
+                                 : min(nTargetSpacingWorkMax,
+                                       ((int64_t) nStakeTargetSpacing *
+                                        (1 + nLastHeight - nPrevHeight)));
+
+    int64_t nInterval = nTargetTimespan / nTargetSpacing;
+    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing +
+              nActualSpacing);
+    bnNew /= ((nInterval + 1) * nTargetSpacing);
+
+    if (bnNew > bnTargetLimit)
+    {
+        bnNew = bnTargetLimit;
+    }
+
+    return bnNew.GetCompact();
+}
+
 unsigned int GetNextTargetRequired(const CBlockMemIndex* pmemIndexLast,
                                    bool fProofOfStake)
 {
@@ -3365,44 +3624,13 @@ unsigned int GetNextTargetRequired(const CBlockMemIndex* pmemIndexLast,
                        diskIndexPrevPrev,
                        &txdb);
 
-    int64_t nActualSpacing = diskIndexPrev.GetBlockTime() - diskIndexPrevPrev.GetBlockTime();
-
-    if (nActualSpacing < 0)
-    {
-        // printf(">> nActualSpacing = %" PRI64d " corrected to 1.\n",
-        // nActualSpacing);
-        nActualSpacing = 1;
-    }
-    else if (nActualSpacing > nTargetTimespan)
-    {
-        // printf(">> nActualSpacing = %" PRI64d " corrected to nTargetTimespan
-        // (900).\n", nActualSpacing);
-        nActualSpacing = nTargetTimespan;
-    }
-
-    // ppcoin: target change every block
-    // ppcoin: retarget with exponential moving toward target spacing
-    CBigNum bnNew;
-    bnNew.SetCompact(diskIndexPrev.nBits);
-
-    int64_t nTargetSpacing = fProofOfStake
-                                 ? nStakeTargetSpacing
-                                 : min(nTargetSpacingWorkMax,
-                                       ((int64_t) nStakeTargetSpacing *
-                                        (1 + diskIndexLast.nHeight -
-                                         diskIndexPrev.nHeight)));
-
-    int64_t nInterval = nTargetTimespan / nTargetSpacing;
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing +
-              nActualSpacing);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
-
-    if (bnNew > bnTargetLimit)
-    {
-        bnNew = bnTargetLimit;
-    }
-
-    return bnNew.GetCompact();
+    return ComputeNextTarget(bnTargetLimit,
+                             fProofOfStake,
+                             diskIndexLast.nHeight,
+                             diskIndexPrev.nHeight,
+                             diskIndexPrev.nBits,
+                             diskIndexPrev.GetBlockTime(),
+                             diskIndexPrevPrev.GetBlockTime());
 }
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits)
@@ -3493,6 +3721,27 @@ void CBlock::UpdateTime()
 }
 
 
+void CBlockUndo::AddTx(const CTransaction& tx,
+                       const MapPrevTx& mapInputs,
+                       const map<uint256, CTxIndex>& mapQueuedChanges)
+{
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        vSpent.push_back(GetOutputFor(txin, mapInputs));
+
+        // Txindexes already queued were made or spent from by this block,
+        // so they were either not there before it or are already noted.
+        const uint256& hashPrev = txin.prevout.hash;
+        if (mapQueuedChanges.count(hashPrev) ||
+            !setPrevTx.insert(hashPrev).second)
+        {
+            continue;
+        }
+        MapPrevTx::const_iterator mi = mapInputs.find(hashPrev);
+        vPrevTxIndex.push_back(make_pair(hashPrev, (*mi).second.first));
+    }
+}
+
 bool CTransaction::DisconnectInputs(CTxDB& txdb)
 {
     // Relinquish previous transactions' spent pointers
@@ -3540,6 +3789,7 @@ bool CTransaction::DisconnectInputs(CTxDB& txdb)
 bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTestPool,
                                bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid) const
 {
+    TRACE_SPAN("FetchInputs");
     // FetchInputs can return false either because we just haven't seen some inputs
     // (in which case the transaction should be stored as an orphan)
     // or because the transaction is malformed (in which case the transaction should
@@ -3561,12 +3811,19 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
 
         // Read txindex
         CTxIndex& txindex = inputsRet[prevout.hash].first;
+        CTransaction& txPrev = inputsRet[prevout.hash].second;
         bool fFound = true;
+        bool fCached = false;
         if ((fBlock || fMiner) && mapTestPool.count(prevout.hash))
         {
             // Get txindex from current proposed changes
             txindex = mapTestPool.find(prevout.hash)->second;
         }
+        else if (prevTxCache.Get(prevout.hash, txPrev, txindex))
+        {
+            // both from the cache, which follows the txindexes written
+            fCached = true;
+        }
         else
         {
             // Read txindex from txdb
@@ -3581,7 +3838,10 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
         }
 
         // Read txPrev
-        CTransaction& txPrev = inputsRet[prevout.hash].second;
+        if (fCached)
+        {
+            continue;
+        }
         if (!fFound || txindex.pos == CDiskTxPos(1,1,1))
         {
             // Get prev tx from single transactions in memory
@@ -3604,6 +3864,10 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
                 return error("FetchInputs() : %s ReadFromDisk prev tx %s failed",
                              GetHash().ToString().c_str(),
                              prevout.hash.ToString().c_str());
+            if (!(fBlock || fMiner) || !mapTestPool.count(prevout.hash))
+            {
+                prevTxCache.Put(prevout.hash, txPrev, txindex);
+            }
         }
     }
 
@@ -3703,6 +3967,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                                  Feework& feework,
                                  bool fInBlock)
 {
+    TRACE_SPAN("ConnectInputs");
     CDiskBlockIndex diskIndex;
     ReadDiskBlockIndex("ConnectInputs", pmemIndexBlock, diskIndex, &txdb);
     // Take over previous transactions' spent pointers
@@ -3805,6 +4070,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
             if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
                 // Verify signature
+                TRACE_SPAN("VerifySignature");
                 if (!VerifySignature(txPrev, *this, i, flags, 0))
                 {
                     return DoS(100,error("ConnectInputs() : %s VerifySignature failed",
@@ -3958,12 +4224,36 @@ bool CTransaction::ClientConnectInputs()
 
 bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
-    // Disconnect in reverse order
-    for (int i = vtx.size() - 1; i >= 0; --i)
+    // outputs spent by the block may be unspent again, see prune.cpp
+    nBlocksDisconnected += 1;
+
+    uint256 hashBlock = GetHash();
+
+    // Blocks connected before undo records were written don't have one.
+    CBlockUndo undo;
+    bool fUndo = txdb.ReadBlockUndo(hashBlock, undo);
+    if (fUndo)
     {
-        if (!vtx[i].DisconnectInputs(txdb))
+        // Put back the txindexes of the spent transactions as they were
+        for (unsigned int i = 0; i < undo.vPrevTxIndex.size(); ++i)
         {
-            return false;
+            const pair<uint256, CTxIndex>& prev = undo.vPrevTxIndex[i];
+            if (!txdb.UpdateTxIndex(prev.first, prev.second))
+            {
+                return error("DisconnectBlock() : UpdateTxIndex failed\n %s",
+                             prev.first.ToString().c_str());
+            }
+        }
+    }
+    else
+    {
+        // Disconnect in reverse order
+        for (int i = vtx.size() - 1; i >= 0; --i)
+        {
+            if (!vtx[i].DisconnectInputs(txdb))
+            {
+                return false;
+            }
         }
     }
 
@@ -3994,7 +4284,7 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 
     if (fWithExploreAPI)
     {
-        ExploreDisconnectBlock(txdb, this);
+        ExploreDisconnectBlock(txdb, this, fUndo ? &undo.vSpent : NULL);
     }
 
     // Defer removing tx indexes until after block is fully disconnected.
@@ -4005,6 +4295,17 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
         // reorganized away. This is only possible if this transaction was completely
         // spent, so erasing it would be a no-op anyway.
         txdb.EraseTxIndex(tx);
+        // as ConnectBlock wrote them: a spender index that was off for
+        //    a while is incomplete anyway, and only -reindex mends it
+        if (fSpenderIndex)
+        {
+            txdb.EraseSpenders(tx);
+        }
+    }
+
+    if (fUndo)
+    {
+        txdb.EraseBlockUndo(hashBlock);
     }
 
     if (fDebugExplore)
@@ -4018,6 +4319,13 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockMemIndex* pmemIndex,
                           QPRegistry *pregistryTemp, bool fJustCheck)
 {
+    static CMetricHistogram* phistConnect =
+        GetMetricHistogram("stealth_block_stage_seconds",
+                           "Time spent in each stage of processing a block",
+                           "stage", "connect");
+    CMetricTimer timerConnect(phistConnect);
+    CTraceSpan traceConnect("ConnectBlock", "height", nHeight);
+
     vector<QPTxDetails> vDeets;
 
     CDiskBlockIndex diskIndex;
@@ -4091,9 +4399,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockMemIndex* pmemIndex,
     int64_t nValuePurchases = 0;
     int64_t nValueClaims = 0;
     unsigned int nSigOps = 0;
+    vector<uint256> vTxHashes;
+    vTxHashes.reserve(vtx.size());
+    CBlockUndo undo;
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
         uint256 hashTx = tx.GetHash();
+        vTxHashes.push_back(hashTx);
 
         if (fEnforceBIP30) {
             CTxIndex txindexOld;
@@ -4179,6 +4491,15 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockMemIndex* pmemIndex,
                 nFees += nTxValueIn - (nTxValueOut + nTxValuePurchases);
             }
 
+            if (!fJustCheck)
+            {
+                undo.AddTx(tx, mapInputs, mapQueuedChanges);
+                if (fSpenderIndex && !txdb.WriteSpenders(tx, posThisTx))
+                {
+                    return error("ConnectBlock() : WriteSpenders failed");
+                }
+            }
+
             Feework feework;
             if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges,
                                   posThisTx, pmemIndex, true, false,
@@ -4257,6 +4578,23 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockMemIndex* pmemIndex,
         }
     }
 
+    if (!txdb.WriteBlockUndo(pmemIndex->GetBlockHash(), undo))
+    {
+        return error("ConnectBlock() : WriteBlockUndo failed");
+    }
+
+    // The block that this one buries past GetPruneKeepDepth() can no longer
+    //    be disconnected, so its undo record goes in the same batch.
+    int nUndoExpired = diskIndex.nHeight - GetPruneKeepDepth();
+    if (nUndoExpired > 0)
+    {
+        CBlockMemIndex* pmemIndexExpired = FindBlockByHeight(nUndoExpired);
+        if (!txdb.EraseBlockUndo(pmemIndexExpired->GetBlockHash()))
+        {
+            return error("ConnectBlock() : EraseBlockUndo failed");
+        }
+    }
+
     // Update block index on disk for hash next without changing the block
     // index in memory.
     if (pmemIndex->pprev)
@@ -4278,6 +4616,16 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockMemIndex* pmemIndex,
         SyncWithWallets(tx, this, true);
     }
 
+    // the outputs of new transactions are the likeliest to be spent next
+    if (prevTxCache.IsEnabled())
+    {
+        for (unsigned int i = 0; i < vtx.size(); ++i)
+        {
+            prevTxCache.Put(vTxHashes[i], vtx[i],
+                            mapQueuedChanges[vTxHashes[i]]);
+        }
+    }
+
     if (fDebugExplore)
     {
         printf("ConnectBlock(): %s done\n",
@@ -4287,6 +4635,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockMemIndex* pmemIndex,
 
     if (fWithExploreAPI)
     {
+        TRACE_SPAN("ExploreConnectBlock");
         ExploreConnectBlock(txdb, this);
     }
 
@@ -4387,6 +4736,10 @@ bool static Reorganize(CTxDB& txdb,
 
     // Disconnect shorter branch
     list<CTransaction> vResurrect;
+    // events are held until the reorganization is committed
+    bool fNotify = IsNotifierActive();
+    vector<pair<uint256, int> > vNotifyDisconnect;
+    vector<pair<CBlock, int> > vNotifyConnect;
     // iterate from top down
 
     BOOST_FOREACH(CBlockMemIndex* pmemIndex, vDisconnect)
@@ -4407,6 +4760,12 @@ bool static Reorganize(CTxDB& txdb,
                          diskIndex.GetBlockHash().ToString().c_str());
         }
 
+        if (fNotify)
+        {
+            vNotifyDisconnect.push_back(make_pair(diskIndex.GetBlockHash(),
+                                                  diskIndex.nHeight));
+        }
+
         // Queue memory transactions to resurrect
         BOOST_REVERSE_FOREACH(const CTransaction& tx, block.vtx)
         {
@@ -4463,6 +4822,11 @@ bool static Reorganize(CTxDB& txdb,
         CDiskBlockIndex diskIndex;
         ReadDiskBlockIndex("Reorganize", pmemIndex, diskIndex, &txdb);
 
+        if (fNotify)
+        {
+            vNotifyConnect.push_back(make_pair(block, diskIndex.nHeight));
+        }
+
         if (!pregistryTemp->UpdateOnNewBlock(&diskIndex,
                                              QPRegistry::ALL_SNAPS,
                                              true))
@@ -4494,6 +4858,7 @@ bool static Reorganize(CTxDB& txdb,
             pmemIndex->pprev->pnext = NULL;
         }
         int nHeight = GetMemIndexHeight("Reorganize", pmemIndex, &txdb);
+        LOCK(cs_blockmaps);
         mapBlockLookup.erase(nHeight);
     }
 
@@ -4518,9 +4883,21 @@ bool static Reorganize(CTxDB& txdb,
             pmemIndex->pprev->pnext = pmemIndex;
         }
         int nHeight = GetMemIndexHeight("Reorganize", pmemIndex, &txdb);
+        LOCK(cs_blockmaps);
         mapBlockLookup[nHeight] = pmemIndex;
     }
 
+    for (unsigned int i = 0; i < vNotifyDisconnect.size(); ++i)
+    {
+        NotifyBlockDisconnected(vNotifyDisconnect[i].first,
+                                vNotifyDisconnect[i].second);
+    }
+    for (unsigned int i = 0; i < vNotifyConnect.size(); ++i)
+    {
+        NotifyBlockConnected(vNotifyConnect[i].first,
+                             vNotifyConnect[i].second);
+    }
+
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
     {
@@ -4544,6 +4921,7 @@ bool CBlock::SetBestChainInner(CTxDB& txdb,
                                CBlockMemIndex* pmemIndexNew,
                                QPRegistry* pregistryTemp)
 {
+    TRACE_SPAN("SetBestChainInner");
     uint256 hash = GetHash();
 
     // Adding to current best branch
@@ -4576,7 +4954,12 @@ bool CBlock::SetBestChainInner(CTxDB& txdb,
     int nHeight = GetMemIndexHeight("CBlock::SetBestChainInner",
                                     pmemIndexNew,
                                     &txdb);
-    mapBlockLookup[nHeight] = pmemIndexNew;
+    {
+        LOCK(cs_blockmaps);
+        mapBlockLookup[nHeight] = pmemIndexNew;
+    }
+
+    NotifyBlockConnected(*this, nHeight);
 
     // Delete redundant memory transactions
     BOOST_FOREACH (CTransaction& tx, vtx)
@@ -4592,6 +4975,7 @@ bool CBlock::SetBestChain(CTxDB& txdb,
                           QPRegistry *pregistryTemp,
                           bool &fReorganizedRet)
 {
+    CTraceSpan traceBest("SetBestChain", "height", nHeight);
     static const uint256 GENESIS_HASH = fTestNet ?
                              chainParams.hashGenesisBlockTestNet :
                              hashGenesisBlock;
@@ -5066,8 +5450,11 @@ bool CBlock::AddToBlockIndex(unsigned int nFile,
 
     // Add to mapBlockIndex
     CBlockMemIndex* pmemIndexNew = new CBlockMemIndex(&indexNew);
-    CMapBlockIndex::iterator
+    CMapBlockIndex::iterator mi;
+    {
+        LOCK(cs_blockmaps);
         mi = mapBlockIndex.insert(make_pair(hash, pmemIndexNew)).first;
+    }
 
     pmemIndexNew->phashBlock = &((*mi).first);
     indexNew.phashBlock = pmemIndexNew->phashBlock;
@@ -5174,6 +5561,7 @@ bool CBlock::CheckBlock(QPRegistry *pregistryTemp,
                         bool fCheckSig,
                         bool fCheckQPoS) const
 {
+    CTraceSpan traceCheck("CheckBlock", "height", nHeight);
     CDiskBlockIndex diskIndexPrev;
     ReadDiskBlockIndex("CheckBlock", pmemIndexPrev, diskIndexPrev);
 
@@ -5519,6 +5907,7 @@ bool CBlock::AcceptBlock(QPRegistry* pregistryTemp,
                          bool fIsMine,
                          bool fIsBootstrap)
 {
+    CTraceSpan traceAccept("AcceptBlock", "height", nHeight);
     int nFork = GetFork(nBestHeight + 1);
 
     // Check for duplicate
@@ -5778,9 +6167,34 @@ bool CBlock::AcceptBlock(QPRegistry* pregistryTemp,
     //    2. don't relay blocks we produce that should be rolled back
     if (hashBestChain == hash)
     {
+        // peers will ask for the new tip
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << *this;
+        rawBlockCache.Put(hash,
+                          CRawBlockCache::RawBlock(
+                              new vector<char>(ssBlock.begin(),
+                                               ssBlock.end())));
+
+        CInv inv(MSG_BLOCK, hash);
+        AUTO_PTR<CCompactBlock> pcmpctblock;
         LOCK(cs_vNodes);
         BOOST_FOREACH(CNode* pnode, vNodes)
         {
+            // push straight to peers that asked for compact blocks
+            if (fCompactBlocks && pnode->fSendCompact &&
+                !IsInitialBlockDownload())
+            {
+                if (!pnode->HasInventoryKnown(inv))
+                {
+                    if (!pcmpctblock.get())
+                    {
+                        pcmpctblock.reset(new CCompactBlock(*this));
+                    }
+                    pnode->PushMessage("cmpctblock", *pcmpctblock);
+                    pnode->AddInventoryKnown(inv);
+                }
+                continue;
+            }
             if (nBestHeight > (pnode->nStartingHeight - 2000))
             {
                 if (fDebugNet)
@@ -5849,13 +6263,35 @@ bool ProcessBlock(CNode* pfrom,
                   bool fJustCheck,
                   bool fIsMine)
 {
+    static CMetricHistogram* phistProcess =
+        GetMetricHistogram("stealth_block_process_seconds",
+                           "Time to process a block, orphans included");
+    static CMetricHistogram* phistCheck =
+        GetMetricHistogram("stealth_block_stage_seconds",
+                           "Time spent in each stage of processing a block",
+                           "stage", "check");
+    static CMetricHistogram* phistAccept =
+        GetMetricHistogram("stealth_block_stage_seconds",
+                           "Time spent in each stage of processing a block",
+                           "stage", "accept");
+    static CMetricHistogram* phistRegistry =
+        GetMetricHistogram("stealth_block_stage_seconds",
+                           "Time spent in each stage of processing a block",
+                           "stage", "registry");
+    CMetricTimer timerProcess(phistProcess);
+    CTraceSpan traceProcess("ProcessBlock", "height", pblock->nHeight);
+
     CTxDB txdb("r");
 
     fProcessOK = true;
     bool fAllowDuplicateStake = (fIsBootstrap &&
                                  GetBoolArg("-permitdirtybootstrap", false));
     // Check for duplicate
-    uint256 hash = pblock->GetHash();
+    uint256 hash;
+    {
+        TRACE_SPAN("GetHash");
+        hash = pblock->GetHash();
+    }
     if (hash ==
         (fTestNet ? chainParams.hashGenesisBlockTestNet : hashGenesisBlock))
     {
@@ -5865,9 +6301,10 @@ bool ProcessBlock(CNode* pfrom,
         return false;
     }
 
-    if (mapBlockIndex.count(hash))
+    CMapBlockIndex::iterator miKnown = mapBlockIndex.find(hash);
+    if (miKnown != mapBlockIndex.end())
     {
-        CBlockMemIndex* pmemIndex = mapBlockIndex[hash];
+        CBlockMemIndex* pmemIndex = (*miKnown).second;
         // not an error, but return false because it was not processed
         printf("ProcessBlock() : already have block at %d\n  %s\n",
                GetMemIndexHeight("ProcessBlock", pmemIndex, &txdb),
@@ -5878,6 +6315,7 @@ bool ProcessBlock(CNode* pfrom,
             //    was not properly constructed before storage.
             printf("    REPROCESSING\n");
             // Erase it since it is probably incomplete.
+            LOCK(cs_blockmaps);
             mapBlockIndex.erase(hash);
             pmemIndex = nullptr;
         }
@@ -5932,7 +6370,12 @@ bool ProcessBlock(CNode* pfrom,
     // registry must be used to be advanced by the block then check the
     // block. If the block is valid using this registry, then the local
     // clock can be advanced when the block is added to the growing chain.
-    AUTO_PTR<QPRegistry> pregistryTemp(new QPRegistry(pregistryMain));
+    int64_t nCheckStart = GetTimeMicros();
+    AUTO_PTR<QPRegistry> pregistryTemp;
+    {
+        TRACE_SPAN("CopyRegistry");
+        pregistryTemp.reset(new QPRegistry(pregistryMain));
+    }
     if (!pregistryTemp.get())
     {
         fProcessOK = false;
@@ -5962,6 +6405,7 @@ bool ProcessBlock(CNode* pfrom,
                                       vDeets,
                                       pmemIndexBest);
     }
+    phistCheck->Observe(GetTimeMicros() - nCheckStart);
 
     if (!fCheckOK)
     {
@@ -6170,7 +6614,14 @@ bool ProcessBlock(CNode* pfrom,
         printf("  temp: %s\n  prev: %s\n",
                pregistryTemp->GetBlockHash().ToString().c_str(),
                pblock->hashPrevBlock.ToString().c_str());
-        pmemIndexDeepestRewind = mapBlockIndex[pblock->hashPrevBlock];
+        CMapBlockIndex::iterator miPrev =
+                                   mapBlockIndex.find(pblock->hashPrevBlock);
+        if (miPrev == mapBlockIndex.end())
+        {
+            fProcessOK = false;
+            return error("ProcessBlock() : prev block not in index");
+        }
+        pmemIndexDeepestRewind = (*miPrev).second;
         CBlockMemIndex *pmemIndexFork;
         CBlockMemIndex *pmemIndexCurrent;
         pregistryTemp->SetNull();
@@ -6189,11 +6640,13 @@ bool ProcessBlock(CNode* pfrom,
     }
 
     // Store to disk
+    int64_t nAcceptStart = GetTimeMicros();
     if (!pblock->AcceptBlock(pregistryTemp.get(), fIsMine, fIsBootstrap))
     {
         fProcessOK = false;
         return error("ProcessBlock() : AcceptBlock FAILED %s", hash.ToString().c_str());
     }
+    phistAccept->Observe(GetTimeMicros() - nAcceptStart);
 
     // Recursively process any orphan blocks that depended on this one
     vector<uint256> vWorkQueue;
@@ -6286,8 +6739,13 @@ bool ProcessBlock(CNode* pfrom,
     }
 
     // Only update main registry if on best chain
+    // the chain view takes the checked registry when the main registry
+    //    is copied from it, rather than copying the main one again
+    QPRegistry* pregistryView = NULL;
     if (hashBestChain == pregistryTemp->GetBlockHash())
     {
+        CMetricTimer timerRegistry(phistRegistry);
+        TRACE_SPAN("UpdateRegistry");
         if (pmemIndexDeepestRewind)
         {
             // We need to replay registry from deepest rewind to best
@@ -6340,7 +6798,9 @@ bool ProcessBlock(CNode* pfrom,
                 pregistryMain->ExitReplayMode();
             }
             pregistryMain->CheckSynced();
+            pregistryView = pregistryTemp.release();
         }
+        NotifyQPoSSlot(pregistryMain);
     }
 
     // Clear mempool of purchases that have aged so much that
@@ -6360,6 +6820,8 @@ bool ProcessBlock(CNode* pfrom,
                nFeelessRemoved);
     }
 
+    PublishChainView(false, pregistryView);
+
     printf("ProcessBlock: ACCEPTED %s\n", hash.ToString().c_str());
 
     // ppcoin: if responsible for sync-checkpoint send it
@@ -6562,7 +7024,7 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes)
 }
 
 
-static boost::filesystem::path BlockFilePath(unsigned int nFile)
+boost::filesystem::path BlockFilePath(unsigned int nFile)
 {
     string strBlockFn = strprintf("blk%04u.dat", nFile);
     return GetDataDir() / strBlockFn;
@@ -6588,7 +7050,9 @@ FILE* OpenBlockFile(unsigned int nFile, long int nBlockPos, const char* pszMode)
 }
 
 
-static unsigned int nCurrentBlockFile = 1;
+unsigned int nCurrentBlockFile = 1;
+// pruning appends to the block files without cs_main
+CCriticalSection cs_appendblockfile;
 
 FILE* AppendBlockFile(unsigned int& nFileRet)
 {
@@ -6601,13 +7065,20 @@ FILE* AppendBlockFile(unsigned int& nFileRet)
         if (fseek(file, 0, SEEK_END) != 0)
             return NULL;
         // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
-        if (ftell(file) < (long)(0x7F000000 - MAX_SIZE))
+        long nMaxPos = (long)(0x7F000000 - MAX_SIZE);
+        if (fPruneMode)
+        {
+            nMaxPos = chainParams.PRUNE_BLOCKFILE_SIZE;
+        }
+        if (ftell(file) < nMaxPos)
         {
             nFileRet = nCurrentBlockFile;
             return file;
         }
         fclose(file);
         nCurrentBlockFile++;
+        // a full file may let the oldest ones go
+        fCheckForPruning = fPruneMode;
     }
 }
 
@@ -6706,7 +7177,10 @@ bool LoadBlockIndex(bool fAllowNew)
         if (!block.AddToBlockIndex(nFile, (unsigned int)nBlockPos, hashGenesisBlock, pregistryMain))
             return error("LoadBlockIndex() : genesis block not accepted");
 
-        mapBlockLookup[0] = mapBlockIndex[block.GetHash()];
+        {
+            LOCK(cs_blockmaps);
+            mapBlockLookup[0] = (*mapBlockIndex.find(block.GetHash())).second;
+        }
 
         // ppcoin: initialize synchronized checkpoint
         if (!Checkpoints::WriteSyncCheckpoint(fTestNet ?
@@ -6963,6 +7437,615 @@ string GetWarnings(string strFor)
 
 
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Headers-first sync
+//
+// Headers are fetched ahead of the block chain and linked by hash into
+// syncHeaders, whose best chain runs past the block index. Bodies
+// on that chain are requested from all capable peers within a sliding
+// window that starts at the first missing block. Bodies that arrive ahead
+// of their parent are held in mapSyncBlocks (not the orphan pool) and are
+// connected in order as the best chain reaches them.
+//
+// Everything here is guarded by cs_main.
+//
+
+bool fHeadersFirst = true;
+int nBestHeaderHeight = -1;
+
+static CSyncHeaderChain syncHeaders(chainParams.MAX_SYNC_HEADERS,
+                                    chainParams.MAX_SIDE_HEADERS_PER_PEER);
+// requesting node, only dereferenced once known to be in vNodes
+static map<uint256, CNode*> mapBlocksInFlight;
+static map<uint256, CBlock*> mapSyncBlocks;
+// node with the outstanding getheaders (identity only)
+static CNode* pnodeHeadersSync = NULL;
+static int64_t nHeadersSyncTime = 0;
+
+
+static void ResetHeadersSync()
+{
+    syncHeaders.Clear();
+    nBestHeaderHeight = nBestHeight;
+    mapBlocksInFlight.clear();
+    for (map<uint256, CBlock*>::iterator mi = mapSyncBlocks.begin();
+         mi != mapSyncBlocks.end(); ++mi)
+    {
+        delete (*mi).second;
+    }
+    mapSyncBlocks.clear();
+    pnodeHeadersSync = NULL;
+    nHeadersSyncTime = 0;
+    // per-node requests are dropped by the next sweep
+}
+
+// Drop the front of the header chain as it enters the block index.
+static void PruneSyncChain()
+{
+    const deque<uint256>& deqChain = syncHeaders.GetChain();
+    while (!deqChain.empty() && mapBlockIndex.count(deqChain.front()))
+    {
+        map<uint256, CBlock*>::iterator mi =
+                                     mapSyncBlocks.find(deqChain.front());
+        if (mi != mapSyncBlocks.end())
+        {
+            delete (*mi).second;
+            mapSyncBlocks.erase(mi);
+        }
+        syncHeaders.PopFront();
+    }
+    if (deqChain.empty())
+    {
+        nBestHeaderHeight = nBestHeight;
+    }
+}
+
+// Drops the headers (and held blocks) that are not on the best header
+//    chain, when syncHeaders is full.
+static void TrimSyncHeaders()
+{
+    vector<uint256> vDropped;
+    syncHeaders.Trim(vDropped);
+    BOOST_FOREACH(const uint256& hash, vDropped)
+    {
+        map<uint256, CBlock*>::iterator mi = mapSyncBlocks.find(hash);
+        if (mi != mapSyncBlocks.end())
+        {
+            delete (*mi).second;
+            mapSyncBlocks.erase(mi);
+        }
+    }
+}
+
+// True if the best header chain builds on the best block.
+static bool SyncChainOnBestBlock()
+{
+    const deque<uint256>& deqChain = syncHeaders.GetChain();
+    CSyncHeader first;
+    return (!deqChain.empty() &&
+            syncHeaders.Get(deqChain.front(), first) &&
+            (first.hashPrev == hashBestChain));
+}
+
+// Header fields of a block that is a sync header or in the block index.
+static bool GetSyncChainHeader(const uint256& hash, CSyncHeader& headerRet)
+{
+    if (syncHeaders.Get(hash, headerRet))
+    {
+        return true;
+    }
+    CMapBlockIndex::const_iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+    {
+        return false;
+    }
+    CDiskBlockIndex diskIndex;
+    ReadDiskBlockIndex("GetSyncChainHeader", (*mi).second, diskIndex);
+    headerRet.hashPrev = diskIndex.hashPrev;
+    headerRet.nHeight = diskIndex.nHeight;
+    headerRet.nBits = diskIndex.nBits;
+    headerRet.nTime = diskIndex.GetBlockTime();
+    headerRet.fProofOfStake = diskIndex.IsProofOfStake();
+    return true;
+}
+
+// Last header of type fProofOfStake up to and including header, or
+//    genesis, like GetLastBlockIndex.
+static bool GetLastSyncHeader(CSyncHeader& header, bool fProofOfStake)
+{
+    while ((header.hashPrev != 0) && (header.fProofOfStake != fProofOfStake))
+    {
+        if (!GetSyncChainHeader(header.hashPrev, header))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// GetNextTargetRequired for a header after hashPrev, which may itself
+//    be a sync header not yet in the block index.
+static bool GetSyncTargetRequired(const uint256& hashPrev,
+                                  bool fProofOfStake,
+                                  unsigned int& nBitsRet)
+{
+    CBigNum bnTargetLimit = fProofOfStake ? bnProofOfStakeLimit
+                                          : bnProofOfWorkLimit;
+    nBitsRet = bnTargetLimit.GetCompact();
+
+    CSyncHeader last;
+    if (!GetSyncChainHeader(hashPrev, last))
+    {
+        return false;
+    }
+    CSyncHeader prev = last;
+    if (!GetLastSyncHeader(prev, fProofOfStake))
+    {
+        return false;
+    }
+    if (prev.hashPrev == 0)
+    {
+        return true;  // first block
+    }
+    CSyncHeader prevprev;
+    if (!GetSyncChainHeader(prev.hashPrev, prevprev) ||
+        !GetLastSyncHeader(prevprev, fProofOfStake))
+    {
+        return false;
+    }
+    if (prevprev.hashPrev == 0)
+    {
+        return true;  // second block
+    }
+
+    nBitsRet = ComputeNextTarget(bnTargetLimit,
+                                 fProofOfStake,
+                                 last.nHeight,
+                                 prev.nHeight,
+                                 prev.nBits,
+                                 prev.nTime,
+                                 prevprev.nTime);
+    return true;
+}
+
+// Checks a header at nHeight whose parent is a sync header or in the
+//    block index, as far as AcceptBlock can without the block. Returns
+//    false if it is invalid (header.nDoS).
+static bool CheckSyncHeader(CBlock& header,
+                            const uint256& hash,
+                            int nHeight,
+                            bool& fProofOfStakeRet)
+{
+    if ((GetFork(nHeight) >= XST_FORKQPOS) &&
+        (header.nVersion < CBlock::QPOS_VERSION))
+    {
+        return header.DoS(100, error("CheckSyncHeader() : bad version %d "
+                                     "at height %d", header.nVersion, nHeight));
+    }
+    if ((header.nVersion >= CBlock::QPOS_VERSION) &&
+        (header.nHeight != nHeight))
+    {
+        return header.DoS(100, error("CheckSyncHeader() : height %d "
+                                     "should be %d", header.nHeight, nHeight));
+    }
+    if (header.GetBlockTime() > FutureDrift(GetAdjustedTime()))
+    {
+        return error("CheckSyncHeader() : header timestamp too far in "
+                     "the future");
+    }
+    if (!Checkpoints::CheckHardened(nHeight, hash))
+    {
+        return header.DoS(100, error("CheckSyncHeader() : rejected by "
+                                     "hardened checkpoint at %d", nHeight));
+    }
+
+    // Before qPoS the target is checked as AcceptBlock will. A header
+    //    doesn't say if its block is proof-of-stake, so it is taken to
+    //    be of the type whose target it has, and proof-of-work is
+    //    checked if that is work. qPoS blocks have no target.
+    fProofOfStakeRet = true;
+    if (GetFork(nHeight) < XST_FORKQPOS)
+    {
+        unsigned int nBitsWork;
+        unsigned int nBitsStake;
+        if (!GetSyncTargetRequired(header.hashPrevBlock, false, nBitsWork) ||
+            !GetSyncTargetRequired(header.hashPrevBlock, true, nBitsStake))
+        {
+            return error("CheckSyncHeader() : can't find target for %s",
+                         hash.ToString().c_str());
+        }
+        if ((header.nBits == nBitsWork) &&
+            CheckProofOfWork(hash, header.nBits))
+        {
+            fProofOfStakeRet = false;
+        }
+        else if (header.nBits != nBitsStake)
+        {
+            return header.DoS(100, error("CheckSyncHeader() : incorrect "
+                                         "target at height %d", nHeight));
+        }
+    }
+    return true;
+}
+
+// Returns false if the header does not connect or is invalid (header.nDoS).
+static bool AcceptSyncHeader(CNode* pfrom, CBlock& header, int& nHeightRet)
+{
+    uint256 hash = header.GetHash();
+
+    CMapBlockIndex::iterator mi = mapBlockIndex.find(hash);
+    if (mi != mapBlockIndex.end())
+    {
+        nHeightRet = GetMemIndexHeight("AcceptSyncHeader", (*mi).second);
+        return true;
+    }
+    CSyncHeader syncHeader;
+    if (syncHeaders.Get(hash, syncHeader))
+    {
+        nHeightRet = syncHeader.nHeight;
+        return true;
+    }
+
+    int nPrevHeight;
+    mi = mapBlockIndex.find(header.hashPrevBlock);
+    if (mi != mapBlockIndex.end())
+    {
+        nPrevHeight = GetMemIndexHeight("AcceptSyncHeader", (*mi).second);
+    }
+    else
+    {
+        CSyncHeader prev;
+        if (!syncHeaders.Get(header.hashPrevBlock, prev))
+        {
+            return error("AcceptSyncHeader() : unconnected header %s",
+                         hash.ToString().c_str());
+        }
+        nPrevHeight = prev.nHeight;
+    }
+
+    int nHeight = nPrevHeight + 1;
+    bool fProofOfStake;
+    if (!CheckSyncHeader(header, hash, nHeight, fProofOfStake))
+    {
+        return false;
+    }
+
+    // Headers that don't extend the best known chain are limited per
+    //    peer, and all headers together, so made up branches can't grow
+    //    the map. Longer forks are left to getblocks.
+    bool fExtendsBest = (nHeight > max(nBestHeight, nBestHeaderHeight));
+    if (!syncHeaders.CanAdd(pfrom, fExtendsBest))
+    {
+        return error("AcceptSyncHeader() : too many side headers from %s",
+                     pfrom->addrName.c_str());
+    }
+    if (syncHeaders.Size() >= (unsigned int)chainParams.MAX_SYNC_HEADERS)
+    {
+        TrimSyncHeaders();
+    }
+
+    syncHeader.hashPrev = header.hashPrevBlock;
+    syncHeader.nHeight = nHeight;
+    syncHeader.nBits = header.nBits;
+    syncHeader.nTime = header.GetBlockTime();
+    syncHeader.fProofOfStake = fProofOfStake;
+    if (!syncHeaders.Add(pfrom, hash, syncHeader, fExtendsBest))
+    {
+        return error("AcceptSyncHeader() : too many headers held");
+    }
+    nHeightRet = nHeight;
+    if (fExtendsBest)
+    {
+        nBestHeaderHeight = nHeight;
+    }
+    return true;
+}
+
+static void RequestHeaders(CNode* pnode)
+{
+    // locator from the best header back into the block index
+    vector<uint256> vHashes;
+    int nStep = 1;
+    const deque<uint256>& deqChain = syncHeaders.GetChain();
+    for (int i = (int)deqChain.size() - 1; i >= 0; i -= nStep)
+    {
+        vHashes.push_back(deqChain[i]);
+        if (vHashes.size() >= 10)
+        {
+            nStep *= 2;
+        }
+    }
+    CBlockLocator locator(pmemIndexBest);
+    locator.PushFront(vHashes);
+    pnode->PushGetHeaders(locator, uint256(0));
+    syncHeaders.SetSyncPeer(pnode);
+    pnodeHeadersSync = pnode;
+    nHeadersSyncTime = GetTime();
+}
+
+// Releases requests of departed peers and requests that timed out,
+// and disconnects a peer that holds up the download window.
+static void SweepBlocksInFlight(int64_t nNow)
+{
+    static const int64_t nStallTimeout =
+                (int64_t)chainParams.BLOCK_STALL_TIMEOUT * 1000000;
+    static const int64_t nDownloadTimeout =
+                (int64_t)chainParams.BLOCK_DOWNLOAD_TIMEOUT * 1000000;
+
+    LOCK(cs_vNodes);
+    set<CNode*> setLive(vNodes.begin(), vNodes.end());
+    syncHeaders.KeepPeers(setLive);
+
+    map<uint256, CNode*>::iterator mi = mapBlocksInFlight.begin();
+    while (mi != mapBlocksInFlight.end())
+    {
+        CNode* pnode = (*mi).second;
+        if (!setLive.count(pnode) || pnode->fDisconnect ||
+            !pnode->mapBlocksInFlight.count((*mi).first))
+        {
+            mapBlocksInFlight.erase(mi++);
+        }
+        else
+        {
+            ++mi;
+        }
+    }
+
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        map<uint256, int64_t>::iterator it = pnode->mapBlocksInFlight.begin();
+        while (it != pnode->mapBlocksInFlight.end())
+        {
+            mi = mapBlocksInFlight.find((*it).first);
+            if ((mi == mapBlocksInFlight.end()) || ((*mi).second != pnode))
+            {
+                pnode->mapBlocksInFlight.erase(it++);
+            }
+            else if ((nNow - (*it).second) > nDownloadTimeout)
+            {
+                printf("block %s from %s timed out\n",
+                       (*it).first.ToString().c_str(),
+                       pnode->addrName.c_str());
+                mapBlocksInFlight.erase(mi);
+                pnode->mapBlocksInFlight.erase(it++);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // The first missing block holds up everything behind it.
+    if (syncHeaders.GetChain().empty() || mapSyncBlocks.empty())
+    {
+        return;
+    }
+    mi = mapBlocksInFlight.find(syncHeaders.GetChain().front());
+    if (mi == mapBlocksInFlight.end())
+    {
+        return;
+    }
+    CNode* pnodeStaller = (*mi).second;
+    if ((nNow - pnodeStaller->mapBlocksInFlight[(*mi).first]) > nStallTimeout)
+    {
+        printf("peer %s is stalling block download, disconnecting\n",
+               pnodeStaller->addrName.c_str());
+        pnodeStaller->fDisconnect = true;
+        BOOST_FOREACH(const PAIRTYPE(uint256, int64_t)& item,
+                      pnodeStaller->mapBlocksInFlight)
+        {
+            mapBlocksInFlight.erase(item.first);
+        }
+        pnodeStaller->mapBlocksInFlight.clear();
+    }
+}
+
+static void SendSyncRequests(CNode* pto)
+{
+    if (!fHeadersFirst || pto->fClient || pto->fOneShot ||
+        pto->fDisconnect || !pto->fSuccessfullyConnected ||
+        ((pto->nVersion >= NOBLKS_VERSION_START) &&
+         (pto->nVersion < NOBLKS_VERSION_END)))
+    {
+        return;
+    }
+
+    int64_t nNow = GetTimeMicros();
+    static int64_t nLastSweep = 0;
+    if ((nNow - nLastSweep) > 1000000)
+    {
+        PruneSyncChain();
+        SweepBlocksInFlight(nNow);
+        nLastSweep = nNow;
+    }
+
+    // Headers: one outstanding request at a time, bounded lead.
+    if (((pnodeHeadersSync == NULL) ||
+         ((GetTime() - nHeadersSyncTime) >
+                          chainParams.HEADERS_RESPONSE_TIMEOUT)) &&
+        (pto->nSyncHeight > max(nBestHeight, nBestHeaderHeight)) &&
+        ((nBestHeaderHeight - nBestHeight) < chainParams.MAX_HEADERS_AHEAD))
+    {
+        RequestHeaders(pto);
+    }
+
+    // Bodies: only while the header chain builds on the best chain,
+    // otherwise the legacy getblocks path handles the fork.
+    if (!SyncChainOnBestBlock())
+    {
+        return;
+    }
+
+    const deque<uint256>& deqChain = syncHeaders.GetChain();
+    int nChainStart = syncHeaders.GetChainStart();
+    vector<CInv> vGetData;
+    unsigned int nInFlight = pto->mapBlocksInFlight.size();
+    int nWindow = min((int)deqChain.size(),
+                      chainParams.BLOCK_DOWNLOAD_WINDOW);
+    for (int i = 0; i < nWindow; i++)
+    {
+        if ((nInFlight >= (unsigned int)
+                             chainParams.MAX_BLOCKS_IN_FLIGHT_PER_PEER) ||
+            ((nChainStart + i) > pto->nSyncHeight))
+        {
+            break;
+        }
+        const uint256& hash = deqChain[i];
+        if (mapBlocksInFlight.count(hash) || mapSyncBlocks.count(hash) ||
+            mapOrphanBlocks.count(hash))
+        {
+            continue;
+        }
+        mapBlocksInFlight[hash] = pto;
+        pto->mapBlocksInFlight[hash] = nNow;
+        vGetData.push_back(CInv(MSG_BLOCK, hash));
+        nInFlight += 1;
+    }
+    if (!vGetData.empty())
+    {
+        if (fDebugNet)
+        {
+            printf("requesting %" PRIszu " blocks from %s (window %d-%d)\n",
+                   vGetData.size(),
+                   pto->addrName.c_str(),
+                   nChainStart,
+                   nChainStart + nWindow - 1);
+        }
+        pto->PushMessage("getdata", vGetData);
+    }
+}
+
+// Returns true if the block was held to be connected later.
+static bool ReceiveSyncBlock(CNode* pfrom, const CBlock& block)
+{
+    uint256 hash = block.GetHash();
+
+    map<uint256, CNode*>::iterator mi = mapBlocksInFlight.find(hash);
+    if (mi != mapBlocksInFlight.end())
+    {
+        mapBlocksInFlight.erase(mi);
+    }
+    pfrom->mapBlocksInFlight.erase(hash);
+
+    CSyncHeader syncHeader;
+    if (!syncHeaders.Get(hash, syncHeader))
+    {
+        return false;
+    }
+    pfrom->nSyncHeight = max(pfrom->nSyncHeight, syncHeader.nHeight);
+    if (mapBlockIndex.count(block.hashPrevBlock))
+    {
+        return false;
+    }
+    if (!mapSyncBlocks.count(hash))
+    {
+        mapSyncBlocks[hash] = new CBlock(block);
+    }
+    return true;
+}
+
+// Connect held blocks in order while they extend the best chain.
+static void ConnectSyncBlocks(CNode* pfrom)
+{
+    LOOP
+    {
+        PruneSyncChain();
+        if (syncHeaders.GetChain().empty())
+        {
+            break;
+        }
+        map<uint256, CBlock*>::iterator mi =
+                         mapSyncBlocks.find(syncHeaders.GetChain().front());
+        if ((mi == mapSyncBlocks.end()) ||
+            ((*mi).second->hashPrevBlock != hashBestChain))
+        {
+            break;
+        }
+        CBlock* pblock = (*mi).second;
+        mapSyncBlocks.erase(mi);
+        bool fProcessOK = false;
+        ProcessBlock(pfrom, pblock, fProcessOK);
+        if (!fProcessOK)
+        {
+            printf("ConnectSyncBlocks(): block %s failed, "
+                   "restarting header sync\n",
+                   pblock->GetHash().ToString().c_str());
+            delete pblock;
+            ResetHeadersSync();
+            break;
+        }
+        delete pblock;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Compact block relay
+//
+// Guarded by cs_main.
+//
+
+bool fCompactBlocks = true;
+
+static const unsigned int MAX_PARTIAL_BLOCKS = 8;
+
+// blocks waiting for "blocktxn", the node is for identity only
+static map<uint256, pair<CNode*, CPartialBlock> > mapPartialBlocks;
+
+bool static ProcessMessage(CNode* pfrom,
+                           string strCommand,
+                           CDataStream& vRecv);
+
+static void RequestFullBlock(CNode* pfrom, const uint256& hash)
+{
+    vector<CInv> vGetData(1, CInv(MSG_BLOCK, hash));
+    pfrom->PushMessage("getdata", vGetData);
+}
+
+// Finish a compact block and hand it to the "block" handler.
+static bool ProcessCompactBlock(CNode* pfrom,
+                                const CPartialBlock& partial,
+                                const vector<CTransaction>& vtxMissing)
+{
+    CBlock block;
+    CPartialBlock::ReadStatus status = partial.Fill(vtxMissing, block);
+    uint256 hash = partial.header.GetHash();
+    if (status == CPartialBlock::READ_INVALID)
+    {
+        pfrom->Misbehaving(100);
+        return error("ProcessCompactBlock() : invalid transactions for %s",
+                     hash.ToString().c_str());
+    }
+    if (status == CPartialBlock::READ_FAILED)
+    {
+        printf("ProcessCompactBlock(): could not rebuild %s, "
+               "requesting full block\n", hash.ToString().c_str());
+        RequestFullBlock(pfrom, hash);
+        return true;
+    }
+
+    int64_t nNow = GetTimeMicros();
+    printf("compact block %s from %s: %" PRIszu " txs (%u prefilled, "
+           "%u from mempool, %" PRIszu " requested), rebuilt in %" PRId64
+           " us, %" PRId64 " ms after its timestamp\n",
+           hash.ToString().c_str(),
+           pfrom->addrName.c_str(),
+           block.vtx.size(),
+           partial.nPrefilled,
+           partial.nFromPool,
+           vtxMissing.size(),
+           nNow - partial.nTimeReceived,
+           (nNow / 1000) - (block.GetBlockTime() * 1000));
+
+    CDataStream ssBlock(SER_NETWORK, pfrom->nVersion);
+    ssBlock << block;
+    return ProcessMessage(pfrom, "block", ssBlock);
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Messages
@@ -6987,7 +8070,9 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
 
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash) ||
-               mapOrphanBlocks.count(inv.hash);
+               mapOrphanBlocks.count(inv.hash) ||
+               mapSyncBlocks.count(inv.hash) ||
+               mapBlocksInFlight.count(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -7087,7 +8172,9 @@ bool Rollback()
         {
             pmemIndex->pprev->pnext = NULL;
         }
-        mapBlockLookup.erase(GetMemIndexHeight("Rollback", pmemIndex, &txdb));
+        int nHeight = GetMemIndexHeight("Rollback", pmemIndex, &txdb);
+        LOCK(cs_blockmaps);
+        mapBlockLookup.erase(nHeight);
     }
 
     // Resurrect memory transactions that were in the disconnected branch
@@ -7153,6 +8240,8 @@ bool Rollback()
            pindexBest->GetBlockTime(),
            DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()).c_str());
 
+    PublishChainView(true);
+
     printf("ROLLBACK: done\n");
 
     return true;
@@ -7266,6 +8355,11 @@ int ReadAddrOfUnknownSize(CDataStream& stream,
 //   getblocks
 //   checkpoint
 //   getheaders
+//   headers
+//   sendcmpct
+//   cmpctblock
+//   getblocktxn
+//   blocktxn
 //   tx
 //   block
 //   getaddr
@@ -7291,6 +8385,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                vRecv.size());
         if ((strCommand != "block") &&
             (strCommand != "getblocks") &&
+            (strCommand != "headers") &&
+            (strCommand != "cmpctblock") &&
+            (strCommand != "blocktxn") &&
             (strCommand != "inv"))
         {
             string strHex = HexStr(vRecv.begin(), vRecv.end(), true);
@@ -7511,9 +8608,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             }
         }
 
+        // With headers-first sync, SendMessages asks every peer for
+        // headers and blocks as needed.
+        pfrom->nSyncHeight = pfrom->nStartingHeight;
+
         // Ask the first connected node for block updates
         static int nAskedForBlocks = 0;
-        if (!pfrom->fClient && !pfrom->fOneShot &&
+        if (!fHeadersFirst && !pfrom->fClient && !pfrom->fOneShot &&
             (pfrom->nStartingHeight > (nBestHeight - 720)) &&
             (pfrom->nVersion < NOBLKS_VERSION_START ||
              pfrom->nVersion >= NOBLKS_VERSION_END) &&
@@ -7544,6 +8645,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
         pfrom->fSuccessfullyConnected = true;
 
+        if (fCompactBlocks && (pfrom->nVersion >= COMPACT_BLOCKS_VERSION))
+        {
+            pfrom->PushMessage("sendcmpct",
+                               true,
+                               CCompactBlock::COMPACT_VERSION);
+        }
+
         printf(("receive version message: %s: version %d, blocks=%d, us=%s, "
                 "them=%s, peer=%s, verification=%" PRId64 "\n"),
                pfrom->cleanSubVer.c_str(),
@@ -7793,7 +8901,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 // response to getblocks. Try to detect this situation and push
                 // another getblocks to continue.
 
-                pfrom->PushGetBlocks(mapBlockIndex[inv.hash], uint256(0));
+                CMapBlockIndex::iterator mi = mapBlockIndex.find(inv.hash);
+                if (mi != mapBlockIndex.end())
+                {
+                    pfrom->PushGetBlocks((*mi).second, uint256(0));
+                }
                 if (fDebugNet)
                 {
                     printf("   force request: %s\n", inv.ToString().c_str());
@@ -7842,15 +8954,24 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 CMapBlockIndex::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
+                    // serialized bytes go straight into the send buffer
+                    CRawBlockCache::RawBlock pvch = GetRawBlock((*mi).second);
+                    if (!pvch || pvch->empty())
+                    {
+                        printf("   could not read block %s\n",
+                               inv.hash.ToString().c_str());
+                        continue;
+                    }
                     if (fDebugNet)
                     {
                         printf("   pushing block message to %s\n     %s\n",
                                pfrom->addrName.c_str(),
-                               block.GetHash().ToString().c_str());
+                               inv.hash.ToString().c_str());
                     }
-                    pfrom->PushMessage("block", block);
+                    pfrom->PushMessage("block",
+                                       CFlatData((void*)&(*pvch)[0],
+                                                 (void*)(&(*pvch)[0] +
+                                                         pvch->size())));
 
                     // Trigger them to send a getblocks request for the next
                     // batch of inventory
@@ -7977,6 +9098,20 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         {
             pmemIndex = pmemIndex->pnext;
         }
+
+        // don't announce blocks that were pruned, they couldn't be sent
+        if (pmemIndex &&
+            IsBlockPruned(GetMemIndexHeight("getblocks", pmemIndex)))
+        {
+            if (fDebugNet)
+            {
+                printf("getblocks %s: blocks to %d are pruned\n",
+                       pfrom->addrName.c_str(),
+                       nPruneHeight);
+            }
+            return true;
+        }
+
         int nLimit = chainParams.GETBLOCKS_LIMIT;
 
         if (fDebugNet)
@@ -8110,6 +9245,208 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         pfrom->PushMessage("headers", vHeaders);
     }
 
+    else if (strCommand == "headers")
+    {
+        vector<CBlock> vHeaders;
+        vRecv >> vHeaders;
+        if (vHeaders.size() > (unsigned int)chainParams.MAX_HEADERS_RESULTS)
+        {
+            pfrom->Misbehaving(20);
+            return error("message headers size() = %" PRIszu "",
+                         vHeaders.size());
+        }
+        bool fSyncPeer = (pfrom == pnodeHeadersSync);
+        if (fSyncPeer)
+        {
+            pnodeHeadersSync = NULL;
+        }
+        if (!fHeadersFirst)
+        {
+            return true;
+        }
+
+        unsigned int nAccepted = 0;
+        BOOST_FOREACH(CBlock& header, vHeaders)
+        {
+            int nHeight;
+            if (!AcceptSyncHeader(pfrom, header, nHeight))
+            {
+                if (header.nDoS)
+                {
+                    pfrom->Misbehaving(header.nDoS);
+                    return false;
+                }
+                break;
+            }
+            pfrom->nSyncHeight = max(pfrom->nSyncHeight, nHeight);
+            nAccepted += 1;
+        }
+
+        if (fDebugNet)
+        {
+            printf("headers: accepted %u of %" PRIszu " from %s, "
+                   "best header %d\n",
+                   nAccepted, vHeaders.size(),
+                   pfrom->addrName.c_str(),
+                   nBestHeaderHeight);
+        }
+
+        bool fMore = false;
+        if (!syncHeaders.GetChain().empty() && !SyncChainOnBestBlock())
+        {
+            // headers fork below our best block, let getblocks sort it out
+            pfrom->PushGetBlocks(pmemIndexBest, uint256(0));
+        }
+        else if ((nAccepted == vHeaders.size()) &&
+                 (nAccepted == (unsigned int)chainParams.MAX_HEADERS_RESULTS) &&
+                 ((nBestHeaderHeight - nBestHeight) <
+                                         chainParams.MAX_HEADERS_AHEAD))
+        {
+            // full batch, the peer has more
+            RequestHeaders(pfrom);
+            fMore = true;
+        }
+        if (fSyncPeer && !fMore)
+        {
+            syncHeaders.EndSync(pfrom);
+        }
+    }
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounce = false;
+        uint64_t nCompactVersion = 0;
+        vRecv >> fAnnounce >> nCompactVersion;
+        if (nCompactVersion == CCompactBlock::COMPACT_VERSION)
+        {
+            pfrom->fSendCompact = fAnnounce;
+        }
+    }
+
+    else if (strCommand == "cmpctblock")
+    {
+        int64_t nTimeReceived = GetTimeMicros();
+        CCompactBlock cmpctblock;
+        vRecv >> cmpctblock;
+
+        uint256 hash = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hash);
+        pfrom->AddInventoryKnown(inv);
+
+        CTxDB txdb("r");
+        if (AlreadyHave(txdb, inv) || mapPartialBlocks.count(hash))
+        {
+            return true;
+        }
+
+        // The header is checked as the headers path does before anything
+        //    is looked up or requested for it.
+        CSyncHeader prev;
+        if (!GetSyncChainHeader(cmpctblock.header.hashPrevBlock, prev))
+        {
+            // unconnected, getblocks finds what is in between
+            pfrom->PushGetBlocks(pmemIndexBest, uint256(0));
+            return true;
+        }
+        bool fProofOfStake;
+        if (!CheckSyncHeader(cmpctblock.header, hash, prev.nHeight + 1,
+                             fProofOfStake))
+        {
+            if (cmpctblock.header.nDoS)
+            {
+                pfrom->Misbehaving(cmpctblock.header.nDoS);
+            }
+            return error("message cmpctblock bad header %s",
+                         hash.ToString().c_str());
+        }
+
+        // only a block on our tip can be rebuilt from the mempool
+        if (cmpctblock.header.hashPrevBlock != hashBestChain)
+        {
+            RequestFullBlock(pfrom, hash);
+            return true;
+        }
+
+        CPartialBlock partial;
+        CPartialBlock::ReadStatus status = partial.Init(cmpctblock, mempool);
+        if (status == CPartialBlock::READ_INVALID)
+        {
+            pfrom->Misbehaving(100);
+            return error("message cmpctblock invalid");
+        }
+        if (status == CPartialBlock::READ_FAILED)
+        {
+            RequestFullBlock(pfrom, hash);
+            return true;
+        }
+        partial.nTimeReceived = nTimeReceived;
+
+        vector<unsigned int> vMissing;
+        partial.GetMissing(vMissing);
+        if (vMissing.empty())
+        {
+            return ProcessCompactBlock(pfrom, partial, vector<CTransaction>());
+        }
+
+        if (mapPartialBlocks.size() >= MAX_PARTIAL_BLOCKS)
+        {
+            mapPartialBlocks.erase(mapPartialBlocks.begin());
+        }
+        mapPartialBlocks[hash] = make_pair(pfrom, partial);
+
+        CBlockTransactionsRequest req;
+        req.hashBlock = hash;
+        req.vIndexes = vMissing;
+        pfrom->PushMessage("getblocktxn", req);
+    }
+
+    else if (strCommand == "getblocktxn")
+    {
+        CBlockTransactionsRequest req;
+        vRecv >> req;
+
+        CMapBlockIndex::iterator mi = mapBlockIndex.find(req.hashBlock);
+        if (mi == mapBlockIndex.end())
+        {
+            return true;
+        }
+        CBlock block;
+        if (!block.ReadFromDisk((*mi).second))
+        {
+            return error("getblocktxn: ReadFromDisk failed");
+        }
+
+        CBlockTransactions resp;
+        resp.hashBlock = req.hashBlock;
+        BOOST_FOREACH(unsigned int nIndex, req.vIndexes)
+        {
+            if (nIndex >= block.vtx.size())
+            {
+                pfrom->Misbehaving(100);
+                return error("message getblocktxn index %u out of range",
+                             nIndex);
+            }
+            resp.vtx.push_back(block.vtx[nIndex]);
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+    else if (strCommand == "blocktxn")
+    {
+        CBlockTransactions resp;
+        vRecv >> resp;
+
+        map<uint256, pair<CNode*, CPartialBlock> >::iterator mi =
+                                       mapPartialBlocks.find(resp.hashBlock);
+        if ((mi == mapPartialBlocks.end()) || ((*mi).second.first != pfrom))
+        {
+            return true;
+        }
+        CPartialBlock partial = (*mi).second.second;
+        mapPartialBlocks.erase(mi);
+        return ProcessCompactBlock(pfrom, partial, resp.vtx);
+    }
+
     else if (strCommand == "tx")
     {
         vector<uint256> vWorkQueue;
@@ -8208,6 +9545,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         CInv inv(MSG_BLOCK, block.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        if (fHeadersFirst && ReceiveSyncBlock(pfrom, block))
+        {
+            // held until the best chain reaches its parent
+            return true;
+        }
+
         bool fProcessOK = false;
         bool fCheck = true;
 
@@ -8233,7 +9576,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         }
         else if (mapBlockIndex.count(block.hashPrevBlock))
         {
-            CBlockMemIndex* pmemIndexPrev = mapBlockIndex[block.hashPrevBlock];
+            CBlockMemIndex* pmemIndexPrev =
+                      (*mapBlockIndex.find(block.hashPrevBlock)).second;
             printf("Previous of new nonsequential block %d is known:\n"
                    "  Prev: %s\n  This: %s\n",
                    GetMemIndexHeight("block", pmemIndexPrev) + 1,
@@ -8385,6 +9729,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             printf("Node has exceeded max net init download orphans.\n");
             pfrom->Misbehaving(100);
         }
+
+        if (fHeadersFirst)
+        {
+            ConnectSyncBlocks(pfrom);
+        }
     }
 
     else if (strCommand == "getaddr")
@@ -8526,9 +9875,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         {
             // Get blocks at a polite rate if it seems we are falling behind.
             int64_t nTimeNow = GetTime();
-            if (((pfrom->nVersion < NOBLKS_VERSION_START) ||
-                 (pfrom->nVersion >= NOBLKS_VERSION_END))       &&
-                ((nTimeNow - pindexBest->nTime) > 720)          &&
+            if (!(fHeadersFirst && !syncHeaders.GetChain().empty()) &&
+                ((pfrom->nVersion < NOBLKS_VERSION_START) ||
+                 (pfrom->nVersion >= NOBLKS_VERSION_END))           &&
+                ((nTimeNow - pindexBest->nTime) > 720)              &&
                 ((nTimeNow - nTimeLastPushGetBlocks) > 60))
             {
                 pfrom->PushGetBlocks(pmemIndexBest, uint256(0));
@@ -8541,6 +9891,68 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     return true;
 }
 
+// the metrics kept for each message command
+struct CMessageMetrics
+{
+    CMetricCounter* pcounterBytes;
+    CMetricHistogram* phistSeconds;
+};
+
+// the commands ProcessMessage handles, each with its own series
+static const char* vMessageCommands[] =
+{
+    "version", "verack", "addr", "inv", "getdata", "getblocks",
+    "getheaders", "headers", "tx", "block", "sendcmpct", "cmpctblock",
+    "getblocktxn", "blocktxn", "getaddr", "mempool", "checkorder", "reply",
+    "ping", "alert", "checkpoint"
+};
+
+static CMessageMetrics MakeMessageMetrics(const string& strLabel)
+{
+    CMessageMetrics metrics;
+    metrics.pcounterBytes =
+        GetMetricCounter("stealth_net_message_bytes_total",
+                         "Bytes of messages received, by command",
+                         "command", strLabel);
+    metrics.phistSeconds =
+        GetMetricHistogram("stealth_net_message_seconds",
+                           "Time to process a message, by command",
+                           "command", strLabel);
+    return metrics;
+}
+
+// Looks up the metrics of a command without taking cs_metrics. The
+//    commands come from peers, so only the known ones get a series and
+//    any other is counted as "unknown". Only the message handler thread
+//    calls this, and the map is filled on the first call.
+static CMessageMetrics GetMessageMetrics(const string& strCommand)
+{
+    static map<string, CMessageMetrics> mapMessageMetrics;
+    static CMessageMetrics metricsUnknown;
+    static bool fInit = false;
+
+    if (!fInit)
+    {
+        for (unsigned int i = 0;
+             i < (sizeof(vMessageCommands) / sizeof(vMessageCommands[0]));
+             ++i)
+        {
+            mapMessageMetrics[vMessageCommands[i]] =
+                                    MakeMessageMetrics(vMessageCommands[i]);
+        }
+        metricsUnknown = MakeMessageMetrics("unknown");
+        fInit = true;
+    }
+
+    map<string, CMessageMetrics>::const_iterator it =
+                                       mapMessageMetrics.find(strCommand);
+    if (it == mapMessageMetrics.end())
+    {
+        return metricsUnknown;
+    }
+    return it->second;
+}
+
 bool ProcessMessages(CNode* pfrom)
 {
     CDataStream& vRecv = pfrom->vRecv;
@@ -8675,12 +10087,16 @@ bool ProcessMessages(CNode* pfrom)
                    e.what());
         }
 
+        CMessageMetrics metrics = GetMessageMetrics(strCommand);
+        metrics.pcounterBytes->Inc(nMessageSize);
+
         // Process message
         bool fRet = false;
         try
         {
             {
                 LOCK(cs_main);
+                CMetricTimer timerMessage(metrics.phistSeconds);
                 fRet = ProcessMessage(pfrom, strCommand, vMsg);
             }
             if (fShutdown)
@@ -8830,7 +10246,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
+                if (pto->filterInventoryKnown.contains(inv.hash))
                     continue;
 
                 // trickle out tx inv to protect privacy
@@ -8860,15 +10276,12 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
+                pto->filterInventoryKnown.insert(inv.hash);
+                vInv.push_back(inv);
+                if (vInv.size() >= 1000)
                 {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
+                    pto->PushMessage("inv", vInv);
+                    vInv.clear();
                 }
             }
             pto->vInventoryToSend = vInvWait;
@@ -8883,10 +10296,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         vector<CInv> vGetData;
         int64_t nNow = GetTime() * 1000000;
         CTxDB txdb("r");
-        while (!pto->mapAskFor.empty())
+        while (!pto->queueAskFor.empty())
         {
-            int64_t nRequestTime = (*pto->mapAskFor.begin()).first;
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
+            int64_t nRequestTime = pto->queueAskFor.top().first;
+            const CInv inv = pto->queueAskFor.top().second;
 
             if (nRequestTime > nNow)
             {
@@ -8926,12 +10339,26 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     pto->PushMessage("getdata", vGetData);
                     vGetData.clear();
                 }
-                mapAlreadyAskedFor[inv] = nNow;
+                limitedmap<CInv, int64_t>::const_iterator it =
+                                               mapAlreadyAskedFor.find(inv);
+                if (it == mapAlreadyAskedFor.end())
+                {
+                    mapAlreadyAskedFor.insert(make_pair(inv, nNow));
+                }
+                else
+                {
+                    mapAlreadyAskedFor.update(it, nNow);
+                }
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
+            pto->queueAskFor.pop();
         }
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
+
+        //
+        // Message: getheaders, getdata (headers-first sync)
+        //
+        SendSyncRequests(pto);
     }
     return true;
 }
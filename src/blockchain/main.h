@@ -18,6 +18,8 @@
 
 #include "feeless.hpp"
 
+#include "blockfile.h"
+
 #include <list>
 
 
@@ -87,6 +89,7 @@ extern CCriticalSection cs_main;
 
 extern CMapBlockIndex mapBlockIndex;
 extern CMapBlockLookup mapBlockLookup;
+extern CCriticalSection cs_blockmaps;
 
 extern std::set<std::pair<COutPoint, unsigned int>> setStakeSeen;
 extern uint256 hashGenesisBlock;
@@ -112,6 +115,30 @@ extern std::set<CWallet*> setpwalletRegistered;
 
 extern std::map<uint256, CBlock*> mapOrphanBlocks;
 
+class CRawBlockCache;
+extern CRawBlockCache rawBlockCache;
+class CPrevTxCache;
+extern CPrevTxCache prevTxCache;
+extern CBlockFileReader blockFileReader;
+extern bool fSpenderIndex;
+
+// -prune: block files are deleted once they hold only blocks deeper than
+//    GetPruneKeepDepth() and the files take more than nPruneTarget bytes
+extern bool fPruneMode;
+extern uint64_t nPruneTarget;
+// blocks at or below this height may not be on disk, -1 if none were pruned
+extern int nPruneHeight;
+extern bool fCheckForPruning;
+// blocks disconnected from the best chain since start
+extern unsigned int nBlocksDisconnected;
+extern unsigned int nCurrentBlockFile;
+// held while appending to the block files
+extern CCriticalSection cs_appendblockfile;
+
+extern bool fHeadersFirst;
+extern bool fCompactBlocks;
+extern int nBestHeaderHeight;
+
 // Settings
 extern int64_t nTransactionFee;
 extern unsigned int nDerivationMethodIndex;
@@ -159,10 +186,15 @@ bool ProcessBlock(CNode* pfrom,
                   bool fJustCheck = false,
                   bool fIsMine = false);
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
+boost::filesystem::path BlockFilePath(unsigned int nFile);
 FILE* OpenBlockFile(unsigned int nFile,
                     long int nBlockPos,
                     const char* pszMode = "rb");
+// ** Caller must hold cs_appendblockfile. **
 FILE* AppendBlockFile(unsigned int& nFileRet);
+bool ReadRawBlockFromDisk(unsigned int nFile,
+                          long int nBlockPos,
+                          std::vector<char>& vchRet);
 bool LoadBlockIndex(bool fAllowNew = true);
 void PrintBlockTree();
 CBlockMemIndex* FindBlockByHeight(int nHeight);
@@ -250,6 +282,11 @@ public:
     void SetNull() { nFile = (unsigned int) -1; nBlockPos = 0; nTxPos = 0; }
     bool IsNull() const { return (nFile == (unsigned int) -1); }
 
+    // A position that wasn't kept, like the spender of an output in a
+    // compact txindex record. Block files start at 1.
+    void SetUnknown() { nFile = 0; nBlockPos = 0; nTxPos = 0; }
+    bool IsUnknown() const { return (nFile == 0); }
+
     friend bool operator==(const CDiskTxPos& a, const CDiskTxPos& b)
     {
         return (a.nFile     == b.nFile &&
@@ -267,6 +304,8 @@ public:
     {
         if (IsNull())
             return "null";
+        else if (IsUnknown())
+            return "unknown";
         else
             return strprintf("(nFile=%u, nBlockPos=%u, nTxPos=%u)", nFile, nBlockPos, nTxPos);
     }
@@ -790,8 +829,29 @@ public:
                       bool fCheckDepth = true,
                       bool fMiner = false) const;
 
+    // Fills feework.hash for the block at feework.pblockhash. Needs no
+    //    chain lock, only the (self locking) buffer.
+    void HashFeework(Feework& feework, FeeworkBuffer& buffer) const;
+
     bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet = NULL)
     {
+        if (!pfileRet)
+        {
+            try
+            {
+                if (blockFileReader.Read(pos.nFile, pos.nTxPos,
+                                         *this, SER_DISK))
+                {
+                    return true;
+                }
+            }
+            catch (std::exception& e)
+            {
+                return error("%s() : deserialize error",
+                             __PRETTY_FUNCTION__);
+            }
+        }
+
         CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile,
                                                    0,
                                                    pfileRet ? "rb+" : "rb"),
@@ -1079,13 +1139,80 @@ public:
 
 
 
-/**  A txdb record that contains the disk location of a transaction and the
- * locations of transactions that spend its outputs.  vSpent is really only
- * used as a flag, but having the location is very helpful for debugging.
+/** The vSpent of a CTxIndex as its output count and a bit per output, set
+ * if the output is spent.  Spent outputs read back with unknown positions.
+ */
+class CSpentBitmap
+{
+protected:
+    std::vector<CDiskTxPos>* pvSpent;
+
+public:
+    CSpentBitmap(const std::vector<CDiskTxPos>& vSpentIn)
+    {
+        pvSpent = const_cast<std::vector<CDiskTxPos>*>(&vSpentIn);
+    }
+
+    unsigned int GetSerializeSize(int, int = 0) const
+    {
+        return GetSizeOfCompactSize(pvSpent->size()) +
+               (pvSpent->size() + 7) / 8;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int, int = 0) const
+    {
+        std::vector<unsigned char> vch((pvSpent->size() + 7) / 8, 0);
+        for (unsigned int i = 0; i < pvSpent->size(); ++i)
+        {
+            if (!(*pvSpent)[i].IsNull())
+            {
+                vch[i / 8] |= (1 << (i % 8));
+            }
+        }
+        WriteCompactSize(s, pvSpent->size());
+        if (!vch.empty())
+        {
+            s.write((char*)&vch[0], vch.size());
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int, int = 0)
+    {
+        unsigned int nOutputs = ReadCompactSize(s);
+        std::vector<unsigned char> vch((nOutputs + 7) / 8);
+        if (!vch.empty())
+        {
+            s.read((char*)&vch[0], vch.size());
+        }
+        pvSpent->assign(nOutputs, CDiskTxPos());
+        for (unsigned int i = 0; i < nOutputs; ++i)
+        {
+            if (vch[i / 8] & (1 << (i % 8)))
+            {
+                (*pvSpent)[i].SetUnknown();
+            }
+        }
+    }
+};
+
+
+/**  A txdb record that contains the disk location of a transaction and
+ * which of its outputs are spent.  Records used to keep the location of
+ * every spender in vSpent, which made a transaction with many outputs
+ * rewrite a large record for every spend.  They are written with a bitmap
+ * now (COMPACT_SER in the stored version), and only -spenderindex keeps
+ * the locations, in records of their own.  vSpent is really only used as
+ * a flag, so in memory it stays as it was, with unknown positions for the
+ * spenders of a compact record.
  */
 class CTxIndex
 {
 public:
+    // set in the stored version of compact records
+    static const int COMPACT_SER = (1 << 30);
+
     CDiskTxPos pos;
     std::vector<CDiskTxPos> vSpent;
 
@@ -1102,12 +1229,23 @@ public:
 
     IMPLEMENT_SERIALIZE
     (
+        bool fCompact = false;
         if (!(nType & SER_GETHASH))
         {
-            READWRITE(nSerVersion);
+            int nRecordVersion = nSerVersion | COMPACT_SER;
+            READWRITE(nRecordVersion);
+            fCompact = (nRecordVersion & COMPACT_SER);
+            nSerVersion = (nRecordVersion & ~COMPACT_SER);
         }
         READWRITE(pos);
-        READWRITE(vSpent);
+        if (fCompact)
+        {
+            READWRITE(REF(CSpentBitmap(vSpent)));
+        }
+        else
+        {
+            READWRITE(vSpent);
+        }
     )
 
     void SetNull()
@@ -1136,6 +1274,45 @@ public:
 };
 
 
+/** What disconnecting a block has to put back, written to the txdb with the
+ * block's txindex changes when it connects.  With it, DisconnectBlock reads
+ * one record instead of the txindex and the transaction behind every input.
+ * A record is erased once its block is GetPruneKeepDepth() deep.
+ */
+class CBlockUndo
+{
+public:
+    // txindexes of the earlier transactions the block spends, as they were
+    // before it connected
+    std::vector<std::pair<uint256, CTxIndex> > vPrevTxIndex;
+    // outputs spent by the block's inputs, in order
+    std::vector<CTxOut> vSpent;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nSerVersion);
+        READWRITE(vPrevTxIndex);
+        READWRITE(vSpent);
+    )
+
+    void SetNull()
+    {
+        vPrevTxIndex.clear();
+        vSpent.clear();
+        setPrevTx.clear();
+    }
+
+    // Call before ConnectInputs marks the inputs of tx spent.
+    void AddTx(const CTransaction& tx,
+               const MapPrevTx& mapInputs,
+               const std::map<uint256, CTxIndex>& mapQueuedChanges);
+
+private:
+    // not serialized
+    std::set<uint256> setPrevTx;
+};
+
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -1447,6 +1624,8 @@ public:
 
     bool WriteToDisk(unsigned int& nFileRet, long int& nBlockPosRet)
     {
+        LOCK(cs_appendblockfile);
+
         // Open history file to append
         CAutoFile fileout = CAutoFile(AppendBlockFile(nFileRet),
                                       SER_DISK,
@@ -1485,28 +1664,48 @@ public:
     {
         SetNull();
 
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"),
-                                     SER_DISK,
-                                     CLIENT_VERSION);
-        if (!filein)
-        {
-            return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
-        }
+        int nType = SER_DISK;
         if (!fReadTransactions)
         {
-            filein.nType |= SER_BLOCKHEADERONLY;
+            nType |= SER_BLOCKHEADERONLY;
         }
 
-        // Read block
+        // Read block where it lies in the mapped file
+        bool fMapped = false;
         try
         {
-            filein >> *this;
+            fMapped = blockFileReader.Read(nFile, nBlockPos, *this, nType);
         }
         catch (std::exception& e)
         {
-            return error("%s() : deserialize or I/O error",
-                         __PRETTY_FUNCTION__);
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+
+        if (!fMapped)
+        {
+            SetNull();
+
+            // Open history file to read
+            CAutoFile filein = CAutoFile(OpenBlockFile(nFile,
+                                                       nBlockPos,
+                                                       "rb"),
+                                         nType,
+                                         CLIENT_VERSION);
+            if (!filein)
+            {
+                return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+            }
+
+            // Read block
+            try
+            {
+                filein >> *this;
+            }
+            catch (std::exception& e)
+            {
+                return error("%s() : deserialize or I/O error",
+                             __PRETTY_FUNCTION__);
+            }
         }
 
         // Check the header
@@ -2250,6 +2449,12 @@ public:
         return vHave.empty();
     }
 
+    // prepend hashes not yet in the block index (e.g. sync headers)
+    void PushFront(const std::vector<uint256>& vHashes)
+    {
+        vHave.insert(vHave.begin(), vHashes.begin(), vHashes.end());
+    }
+
     void Set(const CBlockMemIndex* pmemIndex)
     {
         static const uint256 HASH_GENESIS = fTestNet ?
@@ -2386,6 +2591,43 @@ public:
 
 typedef std::map<int, std::set<uint256> > MapFeeless;
 
+// The argon2 hash of a checked feework, with the block the work is bound
+//    to, kept so mempool.dat can be reloaded without redoing the work.
+class CFeeworkResult
+{
+public:
+    uint256 hashBlock;
+    uint64_t hash;
+
+    CFeeworkResult()
+    {
+        SetNull();
+    }
+
+    CFeeworkResult(const uint256& hashBlockIn, uint64_t hashIn)
+    {
+        hashBlock = hashBlockIn;
+        hash = hashIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(hash);
+    )
+
+    void SetNull()
+    {
+        hashBlock = 0;
+        hash = 0;
+    }
+
+    bool IsNull() const
+    {
+        return (hashBlock == 0);
+    }
+};
+
 class CTxMemPool
 {
 public:
@@ -2405,6 +2647,9 @@ public:
     // key is the height hashed into the feework
     MapFeeless mapFeeless;
 
+    // checked feework of the feeless transactions in the mempool
+    std::map<uint256, CFeeworkResult> mapFeework;
+
 
     bool accept(CTxDB& txdb, CTransaction &tx,
                 bool fCheckInputs, bool* pfMissingInputs = NULL);
@@ -0,0 +1,322 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempoolfile.h"
+#include "main.h"
+#include "txdb-leveldb.h"
+#include "net.h"
+#include "chainparams.hpp"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+static const int MEMPOOL_FILE_VERSION = 1;
+
+
+// a mempool transaction as kept in mempool.dat
+class CMempoolFileTx
+{
+public:
+    CTransaction tx;
+    CFeeworkResult feework;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(tx);
+        READWRITE(feework);
+    )
+};
+
+// serializes writers of mempool.dat
+static CCriticalSection cs_mempoolFile;
+
+// feework read from mempool.dat, only while it is being loaded
+static CCriticalSection cs_mapLoadedFeework;
+static map<uint256, CFeeworkResult> mapLoadedFeework;
+
+// the mempool is not written until mempool.dat has been read back,
+//    so a node shut down early doesn't lose the file
+static bool fMempoolLoaded = false;
+
+
+static boost::filesystem::path GetMempoolPath()
+{
+    return GetDataDir() / "mempool.dat";
+}
+
+bool DumpMempool()
+{
+    if (!fMempoolLoaded)
+    {
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+
+    vector<CMempoolFileTx> vTxs;
+    {
+        LOCK(mempool.cs);
+        vTxs.reserve(mempool.mapTx.size());
+        map<uint256, CTransaction>::const_iterator mi;
+        for (mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        {
+            CMempoolFileTx txFile;
+            txFile.tx = mi->second;
+            map<uint256, CFeeworkResult>::const_iterator it =
+                                        mempool.mapFeework.find(mi->first);
+            if (it != mempool.mapFeework.end())
+            {
+                txFile.feework = it->second;
+            }
+            vTxs.push_back(txFile);
+        }
+    }
+
+    // serialize the transactions, checksum data up to that point,
+    //    then append the checksum
+    CDataStream ssMempool(SER_DISK, CLIENT_VERSION);
+    ssMempool << FLATDATA(pchMessageStart);
+    ssMempool << MEMPOOL_FILE_VERSION;
+    ssMempool << vTxs;
+    uint256 hash = Hash(ssMempool.begin(), ssMempool.end());
+    ssMempool << hash;
+
+    LOCK(cs_mempoolFile);
+
+    string strTmp = strprintf("mempool.dat.%04x", GetRandInt(0x10000));
+    boost::filesystem::path pathTmp = GetDataDir() / strTmp;
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+    {
+        return error("DumpMempool() : open failed");
+    }
+
+    try
+    {
+        fileout << ssMempool;
+    }
+    catch (std::exception &e)
+    {
+        return error("DumpMempool() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, GetMempoolPath()))
+    {
+        return error("DumpMempool() : rename into place failed");
+    }
+
+    printf("Flushed %" PRIszu " mempool transactions to mempool.dat  %" PRId64 "ms\n",
+           vTxs.size(), GetTimeMillis() - nStart);
+
+    return true;
+}
+
+static bool ReadMempool(vector<CMempoolFileTx>& vTxsRet)
+{
+    FILE *file = fopen(GetMempoolPath().string().c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+    {
+        // no file is not an error, e.g. the first run
+        return false;
+    }
+
+    // use file size to size memory buffer
+    int nFileSize = GetFilesize(filein);
+    int nDataSize = nFileSize - sizeof(uint256);
+    if (nDataSize < (int)sizeof(pchMessageStart))
+    {
+        return error("ReadMempool() : file too short");
+    }
+    vector<unsigned char> vchData;
+    vchData.resize(nDataSize);
+    uint256 hashIn;
+
+    try
+    {
+        filein.read((char *)&vchData[0], nDataSize);
+        filein >> hashIn;
+    }
+    catch (std::exception &e)
+    {
+        return error("ReadMempool() : I/O error or stream data corrupted");
+    }
+    filein.fclose();
+
+    CDataStream ssMempool(vchData, SER_DISK, CLIENT_VERSION);
+
+    // verify stored checksum matches input data
+    uint256 hashTmp = Hash(ssMempool.begin(), ssMempool.end());
+    if (hashIn != hashTmp)
+    {
+        return error("ReadMempool() : checksum mismatch; data corrupted");
+    }
+
+    unsigned char pchMsgTmp[4];
+    try
+    {
+        ssMempool >> FLATDATA(pchMsgTmp);
+        if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)))
+        {
+            return error("ReadMempool() : invalid network magic number");
+        }
+        int nVersion;
+        ssMempool >> nVersion;
+        if (nVersion != MEMPOOL_FILE_VERSION)
+        {
+            return error("ReadMempool() : unknown version %d", nVersion);
+        }
+        ssMempool >> vTxsRet;
+    }
+    catch (std::exception &e)
+    {
+        return error("ReadMempool() : I/O error or stream data corrupted");
+    }
+
+    return true;
+}
+
+bool LoadMempool()
+{
+    int64_t nStart = GetTimeMillis();
+
+    vector<CMempoolFileTx> vTxs;
+    bool fRead = ReadMempool(vTxs);
+
+    {
+        LOCK(cs_mapLoadedFeework);
+        BOOST_FOREACH(const CMempoolFileTx& txFile, vTxs)
+        {
+            if (!txFile.feework.IsNull())
+            {
+                mapLoadedFeework[txFile.tx.GetHash()] = txFile.feework;
+            }
+        }
+    }
+
+    // A transaction may spend another one in the file, which isn't
+    //    ordered, so those missing inputs are tried again until a pass
+    //    accepts nothing more.
+    unsigned int nAccepted = 0;
+    while (!vTxs.empty() && !fShutdown)
+    {
+        vector<CMempoolFileTx> vMissing;
+        unsigned int nPass = 0;
+        BOOST_FOREACH(CMempoolFileTx& txFile, vTxs)
+        {
+            if (fShutdown)
+            {
+                break;
+            }
+            bool fMissingInputs = false;
+            {
+                LOCK(cs_main);
+                CTxDB txdb("r");
+                if (txFile.tx.AcceptToMemoryPool(txdb, true, &fMissingInputs))
+                {
+                    nPass += 1;
+                }
+            }
+            if (fMissingInputs)
+            {
+                vMissing.push_back(txFile);
+            }
+        }
+        nAccepted += nPass;
+        if (nPass == 0)
+        {
+            break;
+        }
+        vTxs.swap(vMissing);
+    }
+
+    {
+        LOCK(cs_mapLoadedFeework);
+        mapLoadedFeework.clear();
+    }
+
+    if (fShutdown)
+    {
+        return false;
+    }
+
+    fMempoolLoaded = true;
+
+    if (fRead)
+    {
+        printf("Loaded %u mempool transactions from mempool.dat  %" PRId64 "ms\n",
+               nAccepted, GetTimeMillis() - nStart);
+    }
+
+    return fRead;
+}
+
+bool GetLoadedFeework(const uint256& txid,
+                      const uint256& hashBlock,
+                      uint64_t& hashRet)
+{
+    LOCK(cs_mapLoadedFeework);
+    if (mapLoadedFeework.empty())
+    {
+        return false;
+    }
+    map<uint256, CFeeworkResult>::const_iterator it =
+                                                mapLoadedFeework.find(txid);
+    if ((it == mapLoadedFeework.end()) || (it->second.hashBlock != hashBlock))
+    {
+        return false;
+    }
+    hashRet = it->second.hash;
+    return true;
+}
+
+static void ThreadMempoolFile2(void* parg)
+{
+    vnThreadsRunning[THREAD_DUMPMEMPOOL]++;
+
+    LoadMempool();
+
+    int64_t nInterval = GetArg("-mempooldumpinterval",
+                               (int64_t)chainParams.DEFAULT_MEMPOOLDUMPINTERVAL);
+    if (nInterval <= 0)
+    {
+        vnThreadsRunning[THREAD_DUMPMEMPOOL]--;
+        return;
+    }
+
+    int64_t nLastDump = GetTime();
+    while (!fShutdown)
+    {
+        if (GetTime() - nLastDump >= nInterval)
+        {
+            DumpMempool();
+            nLastDump = GetTime();
+        }
+        vnThreadsRunning[THREAD_DUMPMEMPOOL]--;
+        MilliSleep(1000);
+        vnThreadsRunning[THREAD_DUMPMEMPOOL]++;
+    }
+    vnThreadsRunning[THREAD_DUMPMEMPOOL]--;
+}
+
+void ThreadMempoolFile(void* parg)
+{
+    // Make this thread recognisable as the mempool file thread
+    RenameThread("stealth-mempool");
+
+    try
+    {
+        ThreadMempoolFile2(parg);
+    }
+    catch (std::exception& e)
+    {
+        vnThreadsRunning[THREAD_DUMPMEMPOOL]--;
+        PrintException(&e, "ThreadMempoolFile()");
+    }
+    printf("ThreadMempoolFile exited\n");
+}
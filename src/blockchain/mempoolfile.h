@@ -0,0 +1,31 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MEMPOOLFILE_H
+#define MEMPOOLFILE_H
+
+#include "uint256.h"
+
+// The mempool is kept in mempool.dat across restarts: written at shutdown
+//    and every few minutes, and read back in the background after the
+//    node starts. Feeless transactions would otherwise be lost until a
+//    peer announces them again, and their argon2 work redone when one
+//    does. With each feeless transaction the file keeps the hash of its
+//    checked feework. While the file is read back, CheckFeework takes
+//    that hash if the feework is still bound to the same block, so only
+//    the depth and the hardness are checked again.
+
+bool DumpMempool();
+bool LoadMempool();
+
+// The feework hash kept in mempool.dat for txid, if the mempool is being
+//    loaded and the work is bound to hashBlock.
+bool GetLoadedFeework(const uint256& txid,
+                      const uint256& hashBlock,
+                      uint64_t& hashRet);
+
+// loads mempool.dat then writes it every -mempooldumpinterval seconds
+void ThreadMempoolFile(void* parg);
+
+#endif  /* MEMPOOLFILE_H */
@@ -0,0 +1,563 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "prune.h"
+#include "main.h"
+#include "txdb-leveldb.h"
+#include "blockfile.h"
+#include "net.h"
+#include "QPConstants.hpp"
+
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+
+// frames a record of pruned transactions where a block has pchMessageStart
+static const unsigned char pchPrunedStart[4] = { 0x70, 0x72, 0x75, 0x6e };
+static const unsigned int PRUNED_FRAME_SIZE = sizeof(pchPrunedStart) +
+                                              sizeof(unsigned int);
+
+CCriticalSection cs_pruning;
+
+
+void CPrunedTxs::Set(const CBlock& block, const vector<int>& vnIndex)
+{
+    header.nVersion = block.nVersion;
+    header.hashPrevBlock = block.hashPrevBlock;
+    header.hashMerkleRoot = block.hashMerkleRoot;
+    header.nTime = block.nTime;
+    header.nBits = block.nBits;
+    header.nNonce = block.nNonce;
+    header.nHeight = block.nHeight;
+    header.nStakerID = block.nStakerID;
+
+    vtx.clear();
+    BOOST_FOREACH(int nIndex, vnIndex)
+    {
+        CPrunedTx ptx;
+        ptx.tx = block.vtx[nIndex];
+        ptx.nIndex = nIndex;
+        ptx.vMerkleBranch = block.GetMerkleBranch(nIndex);
+        vtx.push_back(ptx);
+    }
+}
+
+bool CPrunedTxs::WriteToDisk(unsigned int& nFileRet,
+                             long int& nRecordPosRet) const
+{
+    LOCK(cs_appendblockfile);
+
+    CAutoFile fileout = CAutoFile(AppendBlockFile(nFileRet),
+                                  SER_DISK,
+                                  CLIENT_VERSION);
+    if (!fileout)
+    {
+        return error("CPrunedTxs::WriteToDisk() : AppendBlockFile failed");
+    }
+
+    unsigned int nSize = fileout.GetSerializeSize(*this);
+    fileout << FLATDATA(pchPrunedStart) << nSize;
+
+    long int fileOutPos = ftell(fileout);
+    if (fileOutPos < 0)
+    {
+        return error("CPrunedTxs::WriteToDisk() : ftell failed");
+    }
+    nRecordPosRet = fileOutPos;
+    fileout << *this;
+
+    // committed to disk by the caller, once for all its records
+    fflush(fileout);
+    return true;
+}
+
+bool CPrunedTxs::ReadFromDisk(unsigned int nFile, unsigned int nRecordPos)
+{
+    if (nRecordPos < PRUNED_FRAME_SIZE)
+    {
+        return error("CPrunedTxs::ReadFromDisk() : bad record position %u",
+                     nRecordPos);
+    }
+    CAutoFile filein = CAutoFile(OpenBlockFile(nFile,
+                                               nRecordPos - PRUNED_FRAME_SIZE,
+                                               "rb"),
+                                 SER_DISK,
+                                 CLIENT_VERSION);
+    if (!filein)
+    {
+        return error("CPrunedTxs::ReadFromDisk() : OpenBlockFile failed");
+    }
+    try
+    {
+        unsigned char pchStart[sizeof(pchPrunedStart)];
+        unsigned int nSize;
+        filein >> FLATDATA(pchStart) >> nSize;
+        if (memcmp(pchStart, pchPrunedStart, sizeof(pchStart)))
+        {
+            return error("CPrunedTxs::ReadFromDisk() : no record at %u "
+                         "in blk%04u.dat", nRecordPos, nFile);
+        }
+        filein >> *this;
+    }
+    catch (std::exception& e)
+    {
+        return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+    }
+    return true;
+}
+
+void CPrunedTxs::GetTxPositions(unsigned int nFile,
+                                unsigned int nRecordPos,
+                                vector<CDiskTxPos>& vTxPosRet) const
+{
+    unsigned int nTxPos = nRecordPos +
+                          ::GetSerializeSize(header,
+                                             SER_DISK | SER_BLOCKHEADERONLY,
+                                             CLIENT_VERSION) +
+                          GetSizeOfCompactSize(vtx.size());
+    vTxPosRet.clear();
+    BOOST_FOREACH(const CPrunedTx& ptx, vtx)
+    {
+        vTxPosRet.push_back(CDiskTxPos(nFile, nRecordPos, nTxPos));
+        nTxPos += ::GetSerializeSize(ptx, SER_DISK, CLIENT_VERSION);
+    }
+}
+
+
+int GetPruneKeepDepth()
+{
+    // Reorganizations read the blocks they disconnect and registry rewinds
+    //    start from a recent snapshot, so blocks are kept as far back as
+    //    recent snapshots are. That is well past the feework depth and
+    //    coinbase maturity.
+    int nDepth = RECENT_SNAPSHOTS * BLOCKS_PER_SNAPSHOT;
+    nDepth = max(nDepth, chainParams.FEELESS_MAX_DEPTH + 1);
+    nDepth = max(nDepth, nCoinbaseMaturity + 1);
+    return nDepth;
+}
+
+bool IsBlockPruned(int nHeight)
+{
+    return (nHeight <= nPruneHeight);
+}
+
+bool IsPrunedTxPos(const CDiskTxPos& pos)
+{
+    // there are no records until something is pruned or imported
+    if ((nPruneHeight < 0) || (pos.nBlockPos < PRUNED_FRAME_SIZE))
+    {
+        return false;
+    }
+    FILE* file = OpenBlockFile(pos.nFile,
+                               pos.nBlockPos - PRUNED_FRAME_SIZE,
+                               "rb");
+    if (!file)
+    {
+        return false;
+    }
+    unsigned char pchStart[sizeof(pchPrunedStart)];
+    bool fPruned = (fread(pchStart, 1, sizeof(pchStart), file) ==
+                    sizeof(pchStart)) &&
+                   (memcmp(pchStart, pchPrunedStart, sizeof(pchStart)) == 0);
+    fclose(file);
+    return fPruned;
+}
+
+bool InitBlockPruning(CTxDB& txdb)
+{
+    if (!txdb.ReadPruneHeight(nPruneHeight))
+    {
+        nPruneHeight = -1;
+    }
+    if (!fPruneMode && (nPruneHeight < 0))
+    {
+        return true;
+    }
+
+    // Appends would otherwise start at blk0001.dat, which may be gone,
+    //    and recreating it would put new blocks where the txindexes of
+    //    pruned transactions still point.
+    unsigned int nFileMax = 1;
+    CMapBlockIndex::const_iterator mi;
+    for (mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    {
+        nFileMax = max(nFileMax, mi->second->nFile);
+    }
+    while (boost::filesystem::exists(BlockFilePath(nFileMax + 1)))
+    {
+        nFileMax += 1;
+    }
+    nCurrentBlockFile = nFileMax;
+
+    if (nPruneHeight >= 0)
+    {
+        printf("InitBlockPruning() : blocks to height %d are pruned\n",
+               nPruneHeight);
+    }
+
+    fCheckForPruning = fPruneMode;
+    return true;
+}
+
+
+// A block file to prune, with the position and hash of each of its best
+//    chain blocks, found under cs_main.
+class CPruneFile
+{
+public:
+    unsigned int nFile;
+    int nMaxHeight;
+    vector<pair<unsigned int, uint256> > vBlocks;
+
+    CPruneFile()
+    {
+        nFile = 0;
+        nMaxHeight = -1;
+    }
+};
+
+// true if the txindex of hashTx points at nFile and nBlockPos (copies it
+//    doesn't point at are left behind) and an output is unspent
+static bool IsRetained(CTxDB& txdb,
+                       const uint256& hashTx,
+                       unsigned int nFile,
+                       unsigned int nBlockPos)
+{
+    CTxIndex txindex;
+    if (!txdb.ReadTxIndex(hashTx, txindex) ||
+        (txindex.pos.nFile != nFile) ||
+        (txindex.pos.nBlockPos != nBlockPos))
+    {
+        return false;
+    }
+    BOOST_FOREACH(const CDiskTxPos& posSpent, txindex.vSpent)
+    {
+        if (posSpent.IsNull())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writes record, if it has transactions, and notes where they went.
+static bool WriteRecord(const CPrunedTxs& record,
+                        unsigned int nFile,
+                        map<uint256, CDiskTxPos>& mapTxPosRet,
+                        map<unsigned int, vector<unsigned int> >& mapRecordsRet)
+{
+    if (record.vtx.empty())
+    {
+        return true;
+    }
+
+    unsigned int nFileRecord;
+    long int nRecordPos;
+    if (!record.WriteToDisk(nFileRecord, nRecordPos))
+    {
+        return error("WriteRecord() : writing record failed");
+    }
+    if (nFileRecord == nFile)
+    {
+        // never, the file being pruned isn't the one appended to
+        return error("WriteRecord() : record written to pruned file");
+    }
+
+    vector<CDiskTxPos> vTxPos;
+    record.GetTxPositions(nFileRecord, nRecordPos, vTxPos);
+    for (unsigned int i = 0; i < record.vtx.size(); ++i)
+    {
+        mapTxPosRet[record.vtx[i].tx.GetHash()] = vTxPos[i];
+    }
+    mapRecordsRet[nFileRecord].push_back(nRecordPos);
+    return true;
+}
+
+// Deletes a block file, after copying its transactions with unspent
+//    outputs to records. Only moving the txindexes takes cs_main. A block
+//    disconnected meanwhile may have left unspent an output found spent,
+//    so then the file is left for the next try.
+static bool PruneBlockFile(const CPruneFile& prune,
+                           unsigned int nDisconnectedStart)
+{
+    const unsigned int nFile = prune.nFile;
+    CTxDB txdb;
+    map<uint256, CDiskTxPos> mapTxPos;
+    map<unsigned int, vector<unsigned int> > mapRecords;
+
+    for (unsigned int n = 0; n < prune.vBlocks.size(); ++n)
+    {
+        if (fShutdown)
+        {
+            return true;
+        }
+        unsigned int nBlockPos = prune.vBlocks[n].first;
+        CBlock block;
+        if (!block.ReadFromDisk(nFile, nBlockPos, true))
+        {
+            return error("PruneBlockFile() : can't read block %s",
+                         prune.vBlocks[n].second.ToString().c_str());
+        }
+        vector<int> vnIndex;
+        for (unsigned int i = 0; i < block.vtx.size(); ++i)
+        {
+            if (IsRetained(txdb, block.vtx[i].GetHash(), nFile, nBlockPos))
+            {
+                vnIndex.push_back(i);
+            }
+        }
+        CPrunedTxs record;
+        record.Set(block, vnIndex);
+        if (!WriteRecord(record, nFile, mapTxPos, mapRecords))
+        {
+            return false;
+        }
+    }
+
+    // records of files pruned earlier are carried forward
+    vector<unsigned int> vRecordPos;
+    txdb.ReadPrunedTxs(nFile, vRecordPos);
+    BOOST_FOREACH(unsigned int nRecordPos, vRecordPos)
+    {
+        CPrunedTxs recordOld;
+        if (!recordOld.ReadFromDisk(nFile, nRecordPos))
+        {
+            return error("PruneBlockFile() : can't read record at %u",
+                         nRecordPos);
+        }
+        CPrunedTxs record;
+        record.header = recordOld.header;
+        BOOST_FOREACH(const CPrunedTx& ptx, recordOld.vtx)
+        {
+            if (IsRetained(txdb, ptx.tx.GetHash(), nFile, nRecordPos))
+            {
+                record.vtx.push_back(ptx);
+            }
+        }
+        if (!WriteRecord(record, nFile, mapTxPos, mapRecords))
+        {
+            return false;
+        }
+    }
+
+    // the records must be on disk before the txindexes point at them
+    map<unsigned int, vector<unsigned int> >::iterator it;
+    for (it = mapRecords.begin(); it != mapRecords.end(); ++it)
+    {
+        FILE* file = OpenBlockFile(it->first, 0, "ab");
+        if (!file)
+        {
+            return error("PruneBlockFile() : can't open blk%04u.dat",
+                         it->first);
+        }
+        FileCommit(file);
+        fclose(file);
+    }
+
+    {
+        LOCK(cs_main);
+        if (nBlocksDisconnected != nDisconnectedStart)
+        {
+            // what was written is left unlisted, and never read
+            printf("PruneBlockFile() : blocks were disconnected, "
+                   "blk%04u.dat is left for later\n", nFile);
+            fCheckForPruning = true;
+            return true;
+        }
+
+        if (!txdb.TxnBegin())
+        {
+            return error("PruneBlockFile() : TxnBegin failed");
+        }
+        map<uint256, CDiskTxPos>::const_iterator mi;
+        for (mi = mapTxPos.begin(); mi != mapTxPos.end(); ++mi)
+        {
+            // re-read, as outputs may have been spent since
+            CTxIndex txindex;
+            if (!txdb.ReadTxIndex(mi->first, txindex) ||
+                (txindex.pos.nFile != nFile))
+            {
+                continue;
+            }
+            txindex.pos = mi->second;
+            txdb.UpdateTxIndex(mi->first, txindex);
+        }
+        for (it = mapRecords.begin(); it != mapRecords.end(); ++it)
+        {
+            vector<unsigned int> vRecords;
+            txdb.ReadPrunedTxs(it->first, vRecords);
+            vRecords.insert(vRecords.end(),
+                            it->second.begin(),
+                            it->second.end());
+            txdb.WritePrunedTxs(it->first, vRecords);
+        }
+        txdb.ErasePrunedTxs(nFile);
+        // these blocks are too deep to disconnect
+        for (unsigned int n = 0; n < prune.vBlocks.size(); ++n)
+        {
+            txdb.EraseBlockUndo(prune.vBlocks[n].second);
+        }
+        int nPruneHeightNew = max(nPruneHeight, prune.nMaxHeight);
+        txdb.WritePruneHeight(nPruneHeightNew);
+        if (!txdb.TxnCommit())
+        {
+            return error("PruneBlockFile() : TxnCommit failed");
+        }
+        nPruneHeight = nPruneHeightNew;
+    }
+
+    blockFileReader.Close(nFile);
+    boost::system::error_code ec;
+    boost::filesystem::remove(BlockFilePath(nFile), ec);
+    if (ec)
+    {
+        return error("PruneBlockFile() : can't remove blk%04u.dat: %s",
+                     nFile, ec.message().c_str());
+    }
+
+    printf("PruneBlockFile() : removed blk%04u.dat, pruned to height %d,"
+           " kept %" PRIszu " unspent transactions\n",
+           nFile, nPruneHeight, mapTxPos.size());
+    return true;
+}
+
+// ** Caller must hold cs_main. **
+static void FindPrunableFiles(const map<unsigned int, uint64_t>& mapFileSize,
+                              uint64_t nTotal,
+                              vector<CPruneFile>& vPruneRet)
+{
+    int nLastPrunable = nBestHeight - GetPruneKeepDepth();
+    if (nLastPrunable <= nPruneHeight)
+    {
+        return;
+    }
+
+    // best chain blocks by file, from the last prune point
+    map<unsigned int, CPruneFile> mapPrune;
+    CMapBlockLookup::const_iterator mi;
+    for (mi = mapBlockLookup.upper_bound(nPruneHeight);
+         mi != mapBlockLookup.end();
+         ++mi)
+    {
+        const CBlockMemIndex* pmemIndex = mi->second;
+        CPruneFile& prune = mapPrune[pmemIndex->nFile];
+        prune.vBlocks.push_back(make_pair(pmemIndex->nBlockPos,
+                                          pmemIndex->GetBlockHash()));
+        prune.nMaxHeight = mi->first;
+    }
+
+    // oldest first, up to the first file that must be kept
+    map<unsigned int, uint64_t>::const_iterator it;
+    for (it = mapFileSize.begin(); it != mapFileSize.end(); ++it)
+    {
+        if (nTotal <= nPruneTarget)
+        {
+            break;
+        }
+        unsigned int nFile = it->first;
+        if (nFile >= nCurrentBlockFile)
+        {
+            break;
+        }
+        CPruneFile& prune = mapPrune[nFile];
+        if (prune.nMaxHeight > nLastPrunable)
+        {
+            break;
+        }
+        prune.nFile = nFile;
+        vPruneRet.push_back(prune);
+        nTotal -= it->second;
+    }
+}
+
+bool PruneBlockFiles()
+{
+    if (!fPruneMode || !fCheckForPruning)
+    {
+        return true;
+    }
+    // a chain state export holds it for as long as it runs
+    TRY_LOCK(cs_pruning, lockPruning);
+    if (!lockPruning)
+    {
+        return true;
+    }
+    fCheckForPruning = false;
+
+    unsigned int nLastFile;
+    {
+        LOCK(cs_appendblockfile);
+        nLastFile = nCurrentBlockFile;
+    }
+    map<unsigned int, uint64_t> mapFileSize;
+    uint64_t nTotal = 0;
+    for (unsigned int nFile = 1; nFile <= nLastFile; ++nFile)
+    {
+        boost::system::error_code ec;
+        uint64_t nSize = boost::filesystem::file_size(BlockFilePath(nFile),
+                                                      ec);
+        if (!ec)
+        {
+            mapFileSize[nFile] = nSize;
+            nTotal += nSize;
+        }
+    }
+    if (nTotal <= nPruneTarget)
+    {
+        return true;
+    }
+
+    vector<CPruneFile> vPrune;
+    unsigned int nDisconnectedStart;
+    {
+        LOCK(cs_main);
+        FindPrunableFiles(mapFileSize, nTotal, vPrune);
+        nDisconnectedStart = nBlocksDisconnected;
+    }
+
+    BOOST_FOREACH(const CPruneFile& prune, vPrune)
+    {
+        if (fShutdown || fCheckForPruning)
+        {
+            break;
+        }
+        if (!PruneBlockFile(prune, nDisconnectedStart))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ThreadPruneBlockFiles2(void* parg)
+{
+    vnThreadsRunning[THREAD_PRUNE]++;
+    while (!fShutdown)
+    {
+        PruneBlockFiles();
+        vnThreadsRunning[THREAD_PRUNE]--;
+        MilliSleep(1000);
+        vnThreadsRunning[THREAD_PRUNE]++;
+    }
+    vnThreadsRunning[THREAD_PRUNE]--;
+}
+
+void ThreadPruneBlockFiles(void* parg)
+{
+    // Make this thread recognisable as the pruning thread
+    RenameThread("stealth-prune");
+
+    try
+    {
+        ThreadPruneBlockFiles2(parg);
+    }
+    catch (std::exception& e)
+    {
+        vnThreadsRunning[THREAD_PRUNE]--;
+        PrintException(&e, "ThreadPruneBlockFiles()");
+    }
+    printf("ThreadPruneBlockFiles exited\n");
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include "main.h"
+
+#include <vector>
+
+class CTxDB;
+
+// With -prune=<MB>, the oldest block files are deleted once the block
+//    files take more than the target, but only files whose blocks in the
+//    best chain are all deeper than GetPruneKeepDepth(). The block index,
+//    txindexes and registry snapshots stay.
+//
+// Inputs are still checked against the transactions they spend, so the
+//    transactions of a pruned file that have unspent outputs are first
+//    copied to the end of the newest block file, each group in a record
+//    of its block (CPrunedTxs), and their txindexes moved there. The
+//    records in a file are listed in the txdb, so they are carried forward
+//    when that file is pruned in turn.
+//
+// A pruned node doesn't serve the blocks it no longer has, doesn't
+//    announce NODE_NETWORK, and can't run the Explore API or rescan
+//    below nPruneHeight.
+
+// A transaction kept from a pruned block, with its merkle branch, so it
+//    can still be shown to be in the block.
+class CPrunedTx
+{
+public:
+    CTransaction tx;
+    int nIndex;
+    std::vector<uint256> vMerkleBranch;
+
+    CPrunedTx()
+    {
+        nIndex = -1;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(tx);
+        READWRITE(nIndex);
+        READWRITE(vMerkleBranch);
+    )
+};
+
+// The transactions of a pruned block that have unspent outputs. A record
+//    starts with the header of the block, so reading a block header at a
+//    txindex position works the same for a record. Records are framed by
+//    their own magic, not pchMessageStart, so nothing reading the block
+//    files in sequence takes them for blocks, and CBlock::ReadFromDisk
+//    must never read one with its transactions.
+class CPrunedTxs
+{
+public:
+    // the header fields only
+    CBlock header;
+    std::vector<CPrunedTx> vtx;
+
+    IMPLEMENT_SERIALIZE
+    (
+        nSerSize += ::SerReadWrite(s,
+                                   header,
+                                   nType | SER_BLOCKHEADERONLY,
+                                   nSerVersion,
+                                   ser_action);
+        READWRITE(vtx);
+    )
+
+    // the transactions of block at the positions in vnIndex
+    void Set(const CBlock& block, const std::vector<int>& vnIndex);
+
+    bool WriteToDisk(unsigned int& nFileRet, long int& nRecordPosRet) const;
+    bool ReadFromDisk(unsigned int nFile, unsigned int nRecordPos);
+
+    // disk positions of the transactions, written at nRecordPos
+    void GetTxPositions(unsigned int nFile,
+                        unsigned int nRecordPos,
+                        std::vector<CDiskTxPos>& vTxPosRet) const;
+};
+
+// Held while pruning. Whatever reads the block files at positions from a
+//    chain view, which pruning may move and delete meanwhile, holds it.
+extern CCriticalSection cs_pruning;
+
+// depth below the best block that is never pruned
+int GetPruneKeepDepth();
+
+// true if the block at nHeight in the best chain may have been pruned
+bool IsBlockPruned(int nHeight);
+
+// true if pos is in a record of pruned transactions, not in a block
+bool IsPrunedTxPos(const CDiskTxPos& pos);
+
+// Reads the prune height and starts appending at the newest block file.
+//    Call after the block index is loaded, before any block is written.
+bool InitBlockPruning(CTxDB& txdb);
+
+// Prunes as many of the oldest block files as it may. Takes cs_main to
+//    find the files and to move the txindexes, but reads and writes the
+//    block files without it, so call without cs_main.
+bool PruneBlockFiles();
+
+// prunes whenever a block file fills, with -prune
+void ThreadPruneBlockFiles(void* parg);
+
+#endif  /* PRUNE_H */
@@ -0,0 +1,150 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txcache.h"
+#include "main.h"
+#include "metrics.h"
+
+using namespace std;
+
+
+static CMetricCounter* GetTxCacheCounter(const char* pszResult)
+{
+    return GetMetricCounter("stealth_prevtx_cache_total",
+                            "Previous tx lookups of FetchInputs, "
+                            "by whether the cache had them",
+                            "result", pszResult);
+}
+
+static CMetricGauge* GetTxCacheBytesGauge()
+{
+    static CMetricGauge* pgaugeBytes =
+        GetMetricGauge("stealth_prevtx_cache_bytes",
+                       "Approximate memory held by the previous tx cache");
+    return pgaugeBytes;
+}
+
+CPrevTxCache::CPrevTxCache()
+{
+    nBytes = 0;
+    nMaxBytes = 0;
+}
+
+void CPrevTxCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+bool CPrevTxCache::IsEnabled() const
+{
+    LOCK(cs);
+    return (nMaxBytes > 0);
+}
+
+bool CPrevTxCache::Get(const uint256& hash,
+                       CTransaction& txRet,
+                       CTxIndex& txindexRet)
+{
+    static CMetricCounter* pcountHits = GetTxCacheCounter("hit");
+    static CMetricCounter* pcountMisses = GetTxCacheCounter("miss");
+
+    TxPtr ptx;
+    TxIndexPtr ptxindex;
+    {
+        LOCK(cs);
+        map<uint256, CEntry>::iterator mi = mapTx.find(hash);
+        if (mi == mapTx.end())
+        {
+            pcountMisses->Inc();
+            return false;
+        }
+        lruTx.splice(lruTx.begin(), lruTx, (*mi).second.itLru);
+        ptx = (*mi).second.ptx;
+        ptxindex = (*mi).second.ptxindex;
+    }
+    pcountHits->Inc();
+    // copied outside the lock, entries are replaced, never changed
+    txRet = *ptx;
+    txindexRet = *ptxindex;
+    return true;
+}
+
+void CPrevTxCache::Put(const uint256& hash,
+                       const CTransaction& tx,
+                       const CTxIndex& txindex)
+{
+    size_t nSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION) +
+                   ::GetSerializeSize(txindex, SER_DISK, CLIENT_VERSION) +
+                   TXCACHE_ENTRY_OVERHEAD;
+    TxIndexPtr ptxindex(new CTxIndex(txindex));
+    LOCK(cs);
+    if (nSize > nMaxBytes)
+    {
+        return;
+    }
+    map<uint256, CEntry>::iterator mi = mapTx.find(hash);
+    if (mi != mapTx.end())
+    {
+        lruTx.splice(lruTx.begin(), lruTx, (*mi).second.itLru);
+        (*mi).second.ptxindex = ptxindex;
+        return;
+    }
+    lruTx.push_front(hash);
+    CEntry& entry = mapTx[hash];
+    entry.ptx = TxPtr(new CTransaction(tx));
+    entry.ptxindex = ptxindex;
+    entry.nSize = nSize;
+    entry.itLru = lruTx.begin();
+    nBytes += nSize;
+    Trim();
+}
+
+void CPrevTxCache::UpdateTxIndex(const uint256& hash, const CTxIndex& txindex)
+{
+    LOCK(cs);
+    map<uint256, CEntry>::iterator mi = mapTx.find(hash);
+    if (mi == mapTx.end())
+    {
+        return;
+    }
+    (*mi).second.ptxindex = TxIndexPtr(new CTxIndex(txindex));
+}
+
+void CPrevTxCache::Erase(const uint256& hash)
+{
+    LOCK(cs);
+    map<uint256, CEntry>::iterator mi = mapTx.find(hash);
+    if (mi == mapTx.end())
+    {
+        return;
+    }
+    nBytes -= (*mi).second.nSize;
+    lruTx.erase((*mi).second.itLru);
+    mapTx.erase(mi);
+    GetTxCacheBytesGauge()->Set(nBytes);
+}
+
+void CPrevTxCache::Clear()
+{
+    LOCK(cs);
+    mapTx.clear();
+    lruTx.clear();
+    nBytes = 0;
+    GetTxCacheBytesGauge()->Set(nBytes);
+}
+
+// cs must be held
+void CPrevTxCache::Trim()
+{
+    while ((nBytes > nMaxBytes) && !lruTx.empty())
+    {
+        map<uint256, CEntry>::iterator mi = mapTx.find(lruTx.back());
+        nBytes -= (*mi).second.nSize;
+        mapTx.erase(mi);
+        lruTx.pop_back();
+    }
+    GetTxCacheBytesGauge()->Set(nBytes);
+}
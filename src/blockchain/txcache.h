@@ -0,0 +1,77 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TXCACHE_H
+#define TXCACHE_H
+
+#include "uint256.h"
+#include "sync.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <list>
+#include <map>
+
+class CTransaction;
+class CTxIndex;
+
+// map node, list node and shared_ptr control blocks of an entry, roughly
+static const size_t TXCACHE_ENTRY_OVERHEAD = 160;
+
+// Transactions whose outputs are being spent, with their txindexes, least
+//    recently used out first, bounded by their serialized size. FetchInputs
+//    looks here before it reads the txindex from the database and the
+//    previous transaction from the block files, which takes an fopen, a
+//    seek and a parse for every input.
+//
+// A transaction doesn't change once it is in a block. Its txindex does,
+//    so CTxDB passes on every txindex it writes, and the cache holds what
+//    the database will hold once the batch commits. An aborted batch
+//    clears the cache. The transactions of a disconnected block are
+//    erased with their txindexes, also because a tx hash doesn't cover the
+//    signatures of every tx version.
+//
+// Hits, misses and the bytes held are in getmetrics.
+class CPrevTxCache
+{
+public:
+    typedef boost::shared_ptr<const CTransaction> TxPtr;
+    typedef boost::shared_ptr<const CTxIndex> TxIndexPtr;
+
+    CPrevTxCache();
+
+    void SetMaxBytes(size_t nMaxBytesIn);
+    bool IsEnabled() const;
+
+    // false if the transaction is not cached
+    bool Get(const uint256& hash, CTransaction& txRet, CTxIndex& txindexRet);
+    void Put(const uint256& hash, const CTransaction& tx,
+             const CTxIndex& txindex);
+    // the txindex of hash was written, kept if its tx is cached
+    void UpdateTxIndex(const uint256& hash, const CTxIndex& txindex);
+    void Erase(const uint256& hash);
+    void Clear();
+
+private:
+    typedef std::list<uint256> LruList;
+
+    struct CEntry
+    {
+        TxPtr ptx;
+        TxIndexPtr ptxindex;
+        size_t nSize;
+        LruList::iterator itLru;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<uint256, CEntry> mapTx;
+    // front is most recently used
+    LruList lruTx;
+    size_t nBytes;
+    size_t nMaxBytes;
+
+    void Trim();
+};
+
+#endif  /* TXCACHE_H */
@@ -39,10 +39,11 @@ enum ForkNumbers
 //
 // network protocol versioning
 //
-static const int CLIENT_PROTOCOL_VERSION = 64200;
+static const int CLIENT_PROTOCOL_VERSION = 64300;
 
 // proto   version   notes
 // -----   -------    ----------------------------------------------------------
+// 64300 :          : Compact block relay
 //       : 3.3.5.0  : Clean logging spam in block download & snapshot support
 //       : 3.3.4.0  : Fixed transaction relay bug
 //       : 3.3.3.0  : Added support for -minpicopower
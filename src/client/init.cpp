@@ -12,6 +12,15 @@
 #include "checkpoints.h"
 #include "explore.hpp"
 #include "feeless.hpp"
+#include "blockcache.h"
+#include "txcache.h"
+#include "mempoolfile.h"
+#include "prune.h"
+#include "chainstate.h"
+#include "chainview.h"
+#include "notifier.h"
+#include "debuglog.h"
+#include "trace.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -85,14 +94,18 @@ void Shutdown(void* parg)
         nTransactionsUpdated++;
         bitdb.Flush(false);
         StopNode();
+        DumpMempool();
+        StopNotifier();
         bitdb.Flush(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
         delete pwalletMain;
+        ReleaseChainView();
         delete pregistryMain;
         NewThread(ExitTimeout, NULL);
         MilliSleep(50);
         printf("Stealth exited\n\n");
+        StopDebugLog();
         fExit = true;
 #ifndef QT_GUI
         // ensure non-UI client gets exited here, but let Bitcoin-Qt reach 'return 0;' in bitcoin.cpp
@@ -118,7 +131,7 @@ void HandleSIGTERM(int signum)
 
 void HandleSIGHUP(int)
 {
-    fReopenDebugLog = true;
+    ReopenDebugLog();
 }
 
 
@@ -186,6 +199,7 @@ bool AppInit(int argc, char* argv[])
     return fRet;
 }
 
+#if !defined(BENCH_STEALTH)
 extern void noui_connect();
 int main(int argc, char* argv[])
 {
@@ -201,6 +215,7 @@ int main(int argc, char* argv[])
 
     return 1;
 }
+#endif  /* !BENCH_STEALTH */
 #endif
 
 bool static InitError(const std::string &str)
@@ -246,6 +261,19 @@ std::string HelpMessage()
         "  -wallet=<file>          " + _("Specify wallet file (within data directory)") + "\n" +
         "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (default: %d)"),
                                             cp.DEFAULT_DBCACHE) + "\n" +
+        "  -blockcache=<n>        " + strprintf(_("Set cache of serialized blocks served to peers in megabytes (default: %d)"),
+                                            cp.DEFAULT_BLOCKCACHE) + "\n" +
+        "  -txcache=<n>           " + strprintf(_("Set cache of previous transactions for checking inputs in megabytes (default: %d)"),
+                                            cp.DEFAULT_TXCACHE) + "\n" +
+        "  -blockfilemaps=<n>     " + strprintf(_("Keep up to <n> block files memory mapped for reading, 0 to read them with stdio (default: %d)"),
+                                            cp.DEFAULT_BLOCKFILEMAPS) + "\n" +
+        "  -prune=<n>             " + strprintf(_("Delete old block files to keep them under <n> MB, at least %d; turns off -exploreapi (default: 0, keep all blocks)"),
+                                            cp.MIN_PRUNE_TARGET) + "\n" +
+        "  -importchainstate=<file> " + _("Start an empty data directory from a chain state snapshot (see exportchainstate), pruned to its height") + "\n" +
+        "  -chainstatehash=<hash> " + _("Hash of the -importchainstate snapshot, as published with it") + "\n" +
+        "  -persistmempool        " + _("Keep the mempool in mempool.dat across restarts (default: 1)") + "\n" +
+        "  -mempooldumpinterval=<n> " + strprintf(_("Write mempool.dat every <n> seconds, 0 only at shutdown (default: %d)"),
+                                            cp.DEFAULT_MEMPOOLDUMPINTERVAL) + "\n" +
         "  -dblogsize=<n>         " + strprintf(_("Set database disk log size in megabytes (default: %d)"),
                                             cp.DEFAULT_DBLOGSIZE) + "\n" +
         "  -timeout=<n>           " + strprintf(_("Specify connection timeout in milliseconds (default: %d)"),
@@ -277,6 +305,8 @@ std::string HelpMessage()
         "  -listen                " + _("Accept connections from outside (default: 1 if no -proxy or -connect)") + "\n" +
         "  -bind=<addr>           " + _("Bind to given address. Use [host]:port notation for IPv6") + "\n" +
         "  -dnsseed               " + _("Find peers using DNS lookup (default: 1)") + "\n" +
+        "  -headersfirst          " + _("Sync headers first, then download blocks from several peers (default: 1)") + "\n" +
+        "  -compactblocks         " + _("Relay new blocks as compact blocks to peers that support them (default: 1)") + "\n" +
         "  -staking               " + _("Stake your coins to support network and gain reward (default: 1)") + "\n" +
         "  -qposminting           " + _("Turn off qPoS minting with =0 (default: 1, qPoS minting on)") + "\n" +
         "  -banscore=<n>          " + strprintf(_("Threshold for disconnecting misbehaving peers (default: %d)"),
@@ -309,7 +339,13 @@ std::string HelpMessage()
         "  -debugqpos             " + _("Output extra qPoS debugging information") + "\n" +
         "  -debugexplore          " + _("Output extra explore API debugging information") + "\n" +
         "  -logtimestamps         " + _("Prepend debug output with timestamp") + "\n" +
+        "  -profilelocks          " + _("Count waits and hold times of each lock site, see getlockstats") + "\n" +
+        "  -tracebuffer=<n>       " + strprintf(_("Keep the last <n> spans of block processing for dumptrace, at most %d (default: 0)"),
+                                            cp.MAX_TRACEBUFFER) + "\n" +
         "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n" +
+        "  -asynclog              " + _("Write debug.log from a background thread (default: 1)") + "\n" +
+        "  -logratelimit=<n>      " + strprintf(_("Max lines per second one log message writes to debug.log, 0 for no limit (default: %d)"),
+                                            cp.DEFAULT_LOGRATELIMIT) + "\n" +
         "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n" +
 #ifdef WIN32
         "  -printtodebugger       " + _("Send trace/debug info to debugger") + "\n" +
@@ -322,6 +358,19 @@ std::string HelpMessage()
                                             cp.DEFAULT_RPCPORT_MAINNET, cp.DEFAULT_RPCPORT_TESTNET) + "\n" +
         "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n" +
         "  -rpcconnect=<ip>       " + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n" +
+        "  -rpcthreads=<n>        " + strprintf(_("Number of threads to service RPC calls (default: %d)"),
+                                            cp.DEFAULT_RPCTHREADS) + "\n" +
+        "  -rpcworkqueue=<n>      " + strprintf(_("Max RPC requests waiting for a thread (default: %d)"),
+                                            cp.DEFAULT_RPCWORKQUEUE) + "\n" +
+        "  -rpcbatchthreads=<n>   " + strprintf(_("Threads one batch request may use for read-only calls (default: %d)"),
+                                            cp.DEFAULT_RPCBATCHTHREADS) + "\n" +
+        "  -rpcbatchmaxsize=<n>   " + strprintf(_("Max size of one batch reply, in megabytes (default: %d)"),
+                                            cp.DEFAULT_RPCBATCHMAXSIZE) + "\n" +
+        "  -rpcmetrics            " + _("Serve metrics for Prometheus at /metrics on the RPC port") + "\n" +
+        "  -notifysocket=<addr>   " + _("Publish block, transaction and qPoS events on <addr> (port, host:port or Unix socket path, a port alone binds 127.0.0.1)") + "\n" +
+        "  -notifyallowip=<ip>    " + _("Allow notification subscribers from specified IP address") + "\n" +
+        "  -notifyqueuesize=<n>   " + strprintf(_("Max data queued for one notification subscriber, in megabytes (default: %d)"),
+                                            cp.DEFAULT_NOTIFYQUEUESIZE) + "\n" +
         "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n" +
         "  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n" +
         "  -upgradewallet         " + _("Upgrade wallet to latest format") + "\n" +
@@ -357,6 +406,13 @@ std::string HelpMessage()
 
         "  -exploreapi=1          " + _("enable the expolore API (default: false") + "\n" +
         "  -reindexexplore=1      " + _("reindex all explore API information on start (default: false") + "\n" +
+        "  -explorecache=<n>      " + strprintf(_("Set explore API database cache size in megabytes (default: %d)"),
+                                            cp.DEFAULT_EXPLORECACHE) + "\n" +
+        "  -explorecursorttl=<n>  " + strprintf(_("Keep explore API pagination cursors <n> seconds after their last use, 0 for none (default: %d)"),
+                                            cp.DEFAULT_EXPLORECURSORTTL) + "\n" +
+        "  -maxexplorecursors=<n> " + strprintf(_("Keep at most <n> explore API pagination cursors (default: %d)"),
+                                            cp.DEFAULT_MAXEXPLORECURSORS) + "\n" +
+        "  -spenderindex          " + _("Keep the position of the transaction that spends each output (default: 0)") + "\n" +
         "  -maxdust               " + strprintf(_("Maximum coin value considered \"dust\" (default: %" PRId64 ")"),
                                             cp.DEFAULT_MAXDUST) + "\n"
         "  -maxhdchildren         " + strprintf(_("Maximum children (addresses) for an HD account (default: %d)"),
@@ -480,6 +536,20 @@ bool AppInit2()
 
     fTestFeature = GetBoolArg("-testfeature", false);
     fDebug = GetBoolArg("-debug", false);
+    fProfileLocks = GetBoolArg("-profilelocks", false);
+    int64_t nTraceBuffer = GetArg("-tracebuffer", (int64_t)0);
+    if (nTraceBuffer < 0)
+    {
+        return InitError(strprintf(_("Invalid -tracebuffer=<n>: '%s'"),
+                                   mapArgs["-tracebuffer"].c_str()));
+    }
+    if (nTraceBuffer > chainParams.MAX_TRACEBUFFER)
+    {
+        InitWarning(strprintf(_("Warning: -tracebuffer is limited to %d spans."),
+                              chainParams.MAX_TRACEBUFFER));
+        nTraceBuffer = chainParams.MAX_TRACEBUFFER;
+    }
+    StartTrace(nTraceBuffer);
 
     // -debug implies fDebug*
     if (fDebug)
@@ -595,6 +665,8 @@ bool AppInit2()
 
     if (GetBoolArg("-shrinkdebugfile", !fDebug))
         ShrinkDebugFile();
+    if (GetBoolArg("-asynclog", true))
+        StartDebugLog(GetArg("-logratelimit", (int64_t) chainParams.DEFAULT_LOGRATELIMIT));
     printf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     printf("Stealth version %s (%s)\n", FormatFullVersion().c_str(), CLIENT_DATE.c_str());
     printf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
@@ -835,6 +907,33 @@ bool AppInit2()
     fNoListen = !GetBoolArg("-listen", true);
     fDiscover = GetBoolArg("-discover", true);
     fNameLookup = GetBoolArg("-dns", true);
+    fHeadersFirst = GetBoolArg("-headersfirst", true);
+    fCompactBlocks = GetBoolArg("-compactblocks", true);
+    rawBlockCache.SetMaxBytes(
+        (size_t)GetArg("-blockcache",
+                       (int64_t)chainParams.DEFAULT_BLOCKCACHE) << 20);
+    prevTxCache.SetMaxBytes(
+        (size_t)GetArg("-txcache",
+                       (int64_t)chainParams.DEFAULT_TXCACHE) << 20);
+    blockFileReader.SetMaxMaps(
+        (unsigned int)GetArg("-blockfilemaps",
+                             (int64_t)chainParams.DEFAULT_BLOCKFILEMAPS));
+
+    int64_t nPruneArg = GetArg("-prune", (int64_t)0);
+    if (nPruneArg < 0)
+    {
+        return InitError(_("-prune can't be negative."));
+    }
+    if (nPruneArg > 0)
+    {
+        if (nPruneArg < chainParams.MIN_PRUNE_TARGET)
+        {
+            return InitError(strprintf(_("-prune must be at least %d MB."),
+                                       chainParams.MIN_PRUNE_TARGET));
+        }
+        fPruneMode = true;
+        nPruneTarget = (uint64_t)nPruneArg << 20;
+    }
 
     bool fBound = false;
 
@@ -966,6 +1065,12 @@ bool AppInit2()
     nMaxHeight = GetArg("-maxheight", (int64_t) -1);
 
     fWithExploreAPI = GetBoolArg("-exploreapi", false);
+    if (fWithExploreAPI && fPruneMode)
+    {
+        InitWarning(_("Warning: the Explore API needs every block, -exploreapi is off with -prune."));
+        fWithExploreAPI = false;
+    }
+    fSpenderIndex = GetBoolArg("-spenderindex", false);
 
 
     if (mapArgs.count("-maxdust")) // ppcoin: reserve balance amount
@@ -1006,6 +1111,27 @@ bool AppInit2()
         return false;
     }
 
+    if (mapArgs.count("-importchainstate"))
+    {
+        uiInterface.InitMessage(_("Importing chain state..."));
+        printf("AppInit2(): Importing chain state...\n");
+        CChainstateInfo info;
+        string strError;
+        if (!ImportChainstate(GetArg("-importchainstate", ""),
+                              GetArg("-chainstatehash", ""),
+                              info,
+                              strError))
+        {
+            // see ImportChainstateInternal(), a failed import can be rerun
+            return InitError(strprintf(_("Error importing chain state: %s. "
+                                         "The chain is not used until an "
+                                         "import completes, so start again "
+                                         "with -importchainstate."),
+                                       strError.c_str()));
+        }
+        printf(" chain state imported to height %d\n", info.nHeight);
+    }
+
     uiInterface.InitMessage(_("Loading block index..."));
     printf("AppInit2(): Loading block index...\n");
     nStart = GetTimeMillis();
@@ -1014,6 +1140,24 @@ bool AppInit2()
 
     printf("Block index loaded successfully.\n");
 
+    {
+        CTxDB txdb("r");
+        InitBlockPruning(txdb);
+    }
+    if (nPruneHeight >= 0)
+    {
+        if (fWithExploreAPI)
+        {
+            InitWarning(_("Warning: blocks have been pruned, the Explore API is off."));
+            fWithExploreAPI = false;
+        }
+    }
+    if (fPruneMode || (nPruneHeight >= 0))
+    {
+        // peers can't download the whole chain from us
+        nLocalServices &= ~NODE_NETWORK;
+    }
+
     // as LoadBlockIndex can take several minutes, it's possible the user
     // requested to kill bitcoin-qt during the last operation. If so, exit.
     // As the program has not fully started yet, Shutdown() is possibly overkill.
@@ -1149,6 +1293,11 @@ bool AppInit2()
     if (GetBoolArg("-rescan"))
     {
         pmemIndexRescan = pmemIndexGenesisBlock;
+        if (nPruneHeight >= 0)
+        {
+            InitWarning(strprintf(_("Warning: blocks to %d are pruned, -rescan starts after them."),
+                                  nPruneHeight));
+        }
     }
     else
     {
@@ -1178,10 +1327,44 @@ bool AppInit2()
 
     // ********************************************************* Step 9: import blocks
 
-    fReindexExplore = (GetBoolArg("-reindexexplore", false) && fWithExploreAPI);
+    if (GetBoolArg("-reindexexplore", false) && fWithExploreAPI)
+    {
+        fReindexExplore = true;
+    }
+    if (fWithExploreAPI && !fReindexExplore)
+    {
+        int nExploreSchema;
+        CTxDB txdb("r");
+        if (txdb.ReadExploreSentinel(nExploreSchema) &&
+            (nExploreSchema < EXPLORE_SCHEMA_VERSION))
+        {
+            printf("Explore API records have schema %d, reindexing for "
+                   "schema %d.\n", nExploreSchema, EXPLORE_SCHEMA_VERSION);
+            fReindexExplore = true;
+        }
+    }
+    // records a crash left behind the chain
+    if (fWithExploreAPI && !fReindexExplore)
+    {
+        CTxDB txdb;
+        if (!ExploreCatchUp(txdb))
+        {
+            printf("Explore API records can't be caught up with the best "
+                   "chain, reindexing.\n");
+            // the balances LoadBlockIndex() loaded with them
+            GetAddressBalancesForWrite().clear();
+            fReindexExplore = true;
+        }
+    }
     if (fReindexExplore)
     {
         uiInterface.InitMessage(_("Clearing existing Explore API records for reindex."));
+        uint64_t nExploreSize;
+        if (CTxDB::GetExploreSize(nExploreSize, true))
+        {
+            printf("Explore API records take %" PRIu64 " bytes before "
+                   "reindex.\n", nExploreSize);
+        }
         printf("Clearing existing Explore API records for reindex.\n");
         string strSentinel = DBKeyToString(EXPLORE_SENTINEL);
         CTxDB txdb;
@@ -1257,6 +1440,12 @@ bool AppInit2()
             Shutdown(NULL);
         }
         fReindexExplore = false;
+        uint64_t nExploreSize;
+        if (CTxDB::GetExploreSize(nExploreSize, true))
+        {
+            printf("Explore API records take %" PRIu64 " bytes after "
+                   "reindex.\n", nExploreSize);
+        }
     }
 
 
@@ -1289,9 +1478,24 @@ bool AppInit2()
     printf("mapWallet.size() = %" PRIszu "\n",       pwalletMain->mapWallet.size());
     printf("mapAddressBook.size() = %" PRIszu "\n",  pwalletMain->mapAddressBook.size());
 
+    // read-only RPCs need a view of the chain from the start
+    {
+        LOCK(cs_main);
+        PublishChainView(true);
+    }
+
+    if (!StartNotifier())
+        InitWarning(_("Warning: could not listen on -notifysocket"));
+
     if (!NewThread(StartNode, NULL))
         InitError(_("Error: could not start node"));
 
+    if (GetBoolArg("-persistmempool", true))
+        NewThread(ThreadMempoolFile, NULL);
+
+    if (fPruneMode)
+        NewThread(ThreadPruneBlockFiles, NULL);
+
     if (fServer)
         NewThread(ThreadRPCServer, NULL);
 
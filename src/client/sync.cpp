@@ -7,6 +7,10 @@
 
 #include <boost/foreach.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -126,3 +130,160 @@ void LeaveCritical()
 }
 
 #endif /* DEBUG_LOCKORDER */
+
+
+bool fProfileLocks = false;
+
+class CLockSite
+{
+public:
+    // 0 free, 1 being claimed, 2 ready
+    std::atomic<int> nState;
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+    std::atomic<uint64_t> nAcquisitions;
+    std::atomic<uint64_t> nContended;
+    std::atomic<uint64_t> nWaitTotal;
+    std::atomic<uint64_t> nWaitMax;
+    std::atomic<uint64_t> nHoldTotal;
+};
+
+// Sites are found by open addressing without a lock, so the profiler
+//    doesn't add contention of its own. If the table fills, the last slot
+//    takes every new site.
+static const unsigned int LOCK_SITES = 4096;
+static CLockSite vLockSites[LOCK_SITES + 1];
+
+CLockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine)
+{
+    unsigned int nHash = (unsigned int)(((uintptr_t)pszFile >> 3) ^
+                                        ((unsigned int)nLine * 2654435761U));
+    for (unsigned int i = 0; i < LOCK_SITES; ++i)
+    {
+        CLockSite& site = vLockSites[(nHash + i) % LOCK_SITES];
+        int nState = site.nState.load(std::memory_order_acquire);
+        if (nState == 0)
+        {
+            if (site.nState.compare_exchange_strong(nState, 1))
+            {
+                site.pszName = pszName;
+                site.pszFile = pszFile;
+                site.nLine = nLine;
+                site.nState.store(2, std::memory_order_release);
+                return &site;
+            }
+        }
+        while (nState == 1)
+        {
+            boost::this_thread::yield();
+            nState = site.nState.load(std::memory_order_acquire);
+        }
+        if ((site.pszFile == pszFile) && (site.nLine == nLine) &&
+            (site.pszName == pszName))
+        {
+            return &site;
+        }
+    }
+    CLockSite& site = vLockSites[LOCK_SITES];
+    if (site.nState.load(std::memory_order_acquire) != 2)
+    {
+        // every thread that gets here writes the same
+        site.pszName = "other";
+        site.pszFile = "";
+        site.nLine = 0;
+        site.nState.store(2, std::memory_order_release);
+    }
+    return &site;
+}
+
+int64_t GetLockProfileTime()
+{
+    return GetTimeMicros();
+}
+
+void RecordLockAcquired(CLockSite* psite, int64_t nWait)
+{
+    psite->nAcquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (nWait <= 0)
+    {
+        return;
+    }
+    psite->nContended.fetch_add(1, std::memory_order_relaxed);
+    psite->nWaitTotal.fetch_add(nWait, std::memory_order_relaxed);
+    uint64_t nMax = psite->nWaitMax.load(std::memory_order_relaxed);
+    while (((uint64_t)nWait > nMax) &&
+           !psite->nWaitMax.compare_exchange_weak(nMax, nWait,
+                                                  std::memory_order_relaxed))
+    {
+    }
+}
+
+void RecordLockReleased(CLockSite* psite, int64_t nHold)
+{
+    if (nHold > 0)
+    {
+        psite->nHoldTotal.fetch_add(nHold, std::memory_order_relaxed);
+    }
+}
+
+static bool CompareLockWait(const CLockStats& a, const CLockStats& b)
+{
+    return a.nWaitTotal > b.nWaitTotal;
+}
+
+void GetLockStats(std::vector<CLockStats>& vStatsRet)
+{
+    // one header compiled into several files has a __FILE__ for each
+    std::map<std::string, CLockStats> mapStats;
+    for (unsigned int i = 0; i <= LOCK_SITES; ++i)
+    {
+        const CLockSite& site = vLockSites[i];
+        if (site.nState.load(std::memory_order_acquire) != 2)
+        {
+            continue;
+        }
+        std::string strKey = strprintf("%s %s:%d", site.pszName,
+                                       site.pszFile, site.nLine);
+        CLockStats& stats = mapStats[strKey];
+        if (stats.strName.empty())
+        {
+            stats.strName = site.pszName;
+            stats.strFile = site.pszFile;
+            stats.nLine = site.nLine;
+            stats.nAcquisitions = 0;
+            stats.nContended = 0;
+            stats.nWaitTotal = 0;
+            stats.nWaitMax = 0;
+            stats.nHoldTotal = 0;
+        }
+        stats.nAcquisitions += site.nAcquisitions.load();
+        stats.nContended += site.nContended.load();
+        stats.nWaitTotal += site.nWaitTotal.load();
+        stats.nWaitMax = std::max(stats.nWaitMax, site.nWaitMax.load());
+        stats.nHoldTotal += site.nHoldTotal.load();
+    }
+
+    vStatsRet.clear();
+    vStatsRet.reserve(mapStats.size());
+    std::map<std::string, CLockStats>::const_iterator it;
+    for (it = mapStats.begin(); it != mapStats.end(); ++it)
+    {
+        vStatsRet.push_back(it->second);
+    }
+    std::stable_sort(vStatsRet.begin(), vStatsRet.end(), CompareLockWait);
+}
+
+// Sites stay in the table, only their counts start again.
+void ResetLockStats()
+{
+    for (unsigned int i = 0; i <= LOCK_SITES; ++i)
+    {
+        CLockSite& site = vLockSites[i];
+        site.nAcquisitions.store(0);
+        site.nContended.store(0);
+        site.nWaitTotal.store(0);
+        site.nWaitMax.store(0);
+        site.nHoldTotal.store(0);
+    }
+}
@@ -10,6 +10,9 @@
 #include <boost/thread/locks.hpp>
 #include <boost/thread/condition_variable.hpp>
 
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 
 
@@ -31,12 +34,69 @@ void static inline LeaveCritical() {}
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Lock contention profiling (-profilelocks).
+ *  Counts acquisitions, waits and hold times of each LOCK site. When it is
+ *  off, taking a lock costs one test of fProfileLocks, which is set once at
+ *  startup. A lock taken again by the thread holding it is counted again,
+ *  so hold times of nested sites overlap. */
+extern bool fProfileLocks;
+
+class CLockSite;
+
+struct CLockStats
+{
+    std::string strName;
+    std::string strFile;
+    int nLine;
+    uint64_t nAcquisitions;
+    uint64_t nContended;
+    // microseconds
+    uint64_t nWaitTotal;
+    uint64_t nWaitMax;
+    uint64_t nHoldTotal;
+};
+
+CLockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine);
+int64_t GetLockProfileTime();
+void RecordLockAcquired(CLockSite* psite, int64_t nWait);
+void RecordLockReleased(CLockSite* psite, int64_t nHold);
+// every site, sorted by total wait, longest first
+void GetLockStats(std::vector<CLockStats>& vStatsRet);
+void ResetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template<typename Mutex>
 class CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    // set while a profiled lock is held
+    CLockSite* psite;
+    int64_t nAcquired;
+
+    void EnterProfiled(const char* pszName, const char* pszFile, int nLine)
+    {
+        int64_t nWait = 0;
+        if (!lock.try_lock())
+        {
+            int64_t nStart = GetLockProfileTime();
+            lock.lock();
+            nWait = GetLockProfileTime() - nStart;
+        }
+        psite = GetLockSite(pszName, pszFile, nLine);
+        RecordLockAcquired(psite, nWait);
+        nAcquired = GetLockProfileTime();
+    }
+
+    void LeaveProfiled()
+    {
+        if (psite)
+        {
+            RecordLockReleased(psite, GetLockProfileTime() - nAcquired);
+            psite = NULL;
+        }
+    }
+
 public:
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
@@ -44,6 +104,11 @@ public:
         if (!lock.owns_lock())
         {
             EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+            if (fProfileLocks)
+            {
+                EnterProfiled(pszName, pszFile, nLine);
+                return;
+            }
 #ifdef DEBUG_LOCKCONTENTION
             if (!lock.try_lock())
             {
@@ -60,6 +125,7 @@ public:
     {
         if (lock.owns_lock())
         {
+            LeaveProfiled();
             lock.unlock();
             LeaveCritical();
         }
@@ -73,11 +139,17 @@ public:
             lock.try_lock();
             if (!lock.owns_lock())
                 LeaveCritical();
+            else if (fProfileLocks)
+            {
+                psite = GetLockSite(pszName, pszFile, nLine);
+                RecordLockAcquired(psite, 0);
+                nAcquired = GetLockProfileTime();
+            }
         }
         return lock.owns_lock();
     }
 
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, boost::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, boost::defer_lock), psite(NULL), nAcquired(0)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -88,7 +160,10 @@ public:
     ~CMutexLock()
     {
         if (lock.owns_lock())
+        {
+            LeaveProfiled();
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -63,6 +63,9 @@ static const int BIP0031_VERSION = 60000;
 // "mempool" command, enhanced "getdata" behavior starts with this version:
 static const int MEMPOOL_GD_VERSION = 60002;
 
+// "sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn" start with this version
+static const int COMPACT_BLOCKS_VERSION = 64300;
+
 // 61201: Original version -- never used -- no bnChainTrust in blockindex
 //        Default version for databases that don't have a "version" record
 static const int LEGACY_DATABASE_VERSION = 61201;
@@ -70,6 +73,10 @@ static const int LEGACY_DATABASE_VERSION = 61201;
 // 63300: blockindex is now stored with bnChainTrust and nStakeModifierChecksum
 static const int EXTENDED_BLOCKINDEX_DATABASE_VERSION = 63300;
 
-static const int DATABASE_VERSION = EXTENDED_BLOCKINDEX_DATABASE_VERSION;
+// 63500: txindex records keep a bitmap of spent outputs instead of the
+//        position of every spender (see CTxIndex in main.h)
+static const int COMPACT_TXINDEX_DATABASE_VERSION = 63500;
+
+static const int DATABASE_VERSION = COMPACT_TXINDEX_DATABASE_VERSION;
 
 #endif
@@ -18,8 +18,11 @@
 #include "txdb-leveldb.h"
 #include "util.h"
 #include "main.h"
+#include "txcache.h"
 
 #include "explore.hpp"
+#include "metrics.h"
+#include "trace.h"
 
 
 using namespace std;
@@ -29,6 +32,9 @@ extern QPRegistry *pregistryMain;
 
 // global pointer for LevelDB object instance
 leveldb::DB *txdb;
+// global pointer for the explore LevelDB, see CTxDB::pdbExplore
+leveldb::DB *exploredb;
+static leveldb::Options optionsExplore;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -46,6 +52,14 @@ static CCriticalSection cs_mapCache;
 static BlockIndexCache_t mapCache;
 static CacheLookup_t setLookup;
 
+// Interned explore addresses, see CTxDB::AddAddrID(). The map is a cache
+//    of the ADDR_ID records, cleared when it holds MAX_ADDR_ID_CACHE.
+static const size_t MAX_ADDR_ID_CACHE = 1 << 20;
+static CCriticalSection cs_mapAddrIDs;
+static map<string, unsigned int> mapAddrIDs;
+// 0: not read from the db yet
+static unsigned int nNextAddrID = 0;
+
 // Helper: Remove an entry from the cache by hash.
 // Returns true if an entry was removed.
 // ** Caller must hold cs_mapCache. **
@@ -119,6 +133,15 @@ bool ReadDiskBlockIndex(const char* caller,
                         CTxDB* ptxdb,
                         bool fStrict)
 {
+    static CMetricCounter* pcountHits =
+        GetMetricCounter("stealth_blockindex_cache_total",
+                         "Block index reads, by whether the cache had them",
+                         "result", "hit");
+    static CMetricCounter* pcountMisses =
+        GetMetricCounter("stealth_blockindex_cache_total",
+                         "Block index reads, by whether the cache had them",
+                         "result", "miss");
+
     assert(pmemIndex != nullptr);
 
     uint256 hash = pmemIndex->GetBlockHash();
@@ -135,10 +158,12 @@ bool ReadDiskBlockIndex(const char* caller,
                 RemoveFromCacheLocked(hash);
                 InsertIntoCacheLocked(hash, blockIndex);
                 blockIndex.UpdatePointers(pmemIndex);
+                pcountHits->Inc();
                 return true;
             }
         }
     }
+    pcountMisses->Inc();
 
     AUTO_PTR<CTxDB> localTxDB;
     if (ptxdb == nullptr)
@@ -341,6 +366,39 @@ static leveldb::Options GetOptions()
     return options;
 }
 
+// Explore reindexes write far more than the chain does, so the explore db
+//    buffers more before it writes a table, and writes bigger tables to
+//    have fewer of them to compact.
+static leveldb::Options GetExploreOptions()
+{
+    leveldb::Options options;
+    int nCacheSizeMB = GetArg("-explorecache",
+                              (int64_t) chainParams.DEFAULT_EXPLORECACHE);
+    options.block_cache = leveldb::NewLRUCache(nCacheSizeMB * 1048576);
+    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.write_buffer_size = 16 * 1048576;
+    options.max_file_size = 8 * 1048576;
+    options.create_if_missing = true;
+    return options;
+}
+
+void init_exploredb()
+{
+    boost::filesystem::path directory = GetDataDir() / "exploreleveldb";
+    boost::filesystem::create_directory(directory);
+    printf("Opening LevelDB in %s\n", directory.string().c_str());
+    optionsExplore = GetExploreOptions();
+    leveldb::Status status = leveldb::DB::Open(optionsExplore,
+                                               directory.string(),
+                                               &exploredb);
+    if (!status.ok())
+    {
+        throw runtime_error(strprintf(
+            "init_exploredb(): error opening database environment %s",
+            status.ToString().c_str()));
+    }
+}
+
 void init_blockindex(leveldb::Options& options, bool fRemoveOld = false)
 {
     // First time init.
@@ -350,23 +408,26 @@ void init_blockindex(leveldb::Options& options, bool fRemoveOld = false)
     {
         // remove directory
         boost::filesystem::remove_all(directory);
-        unsigned int nFile = 1;
-
-        while (true)
+        // Every block file goes, not just those up to the first one
+        //    missing, which is blk0001.dat if blocks were pruned.
+        vector<boost::filesystem::path> vBlockFiles;
+        boost::filesystem::directory_iterator itEnd;
+        for (boost::filesystem::directory_iterator it(GetDataDir());
+             it != itEnd;
+             ++it)
         {
-            boost::filesystem::path strBlockFile = GetDataDir() /
-                                                   strprintf("blk%04u.dat",
-                                                             nFile);
-
-            // Break if no such file
-            if (!boost::filesystem::exists(strBlockFile))
+            string strName = it->path().filename().string();
+            if ((strName.size() >= 11) &&
+                (strName.compare(0, 3, "blk") == 0) &&
+                (strName.compare(strName.size() - 4, 4, ".dat") == 0))
             {
-                break;
+                vBlockFiles.push_back(it->path());
             }
-
-            boost::filesystem::remove(strBlockFile);
-
-            nFile++;
+        }
+        BOOST_FOREACH(const boost::filesystem::path& pathBlockFile,
+                      vBlockFiles)
+        {
+            boost::filesystem::remove(pathBlockFile);
         }
     }
 
@@ -389,10 +450,15 @@ CTxDB::CTxDB(const char* pszMode)
 {
     assert(pszMode);
     activeBatch = NULL;
+    activeBatchExplore = NULL;
+    pSnapshot = NULL;
+    pSnapshotExplore = NULL;
+    nNextAddrIDPending = 0;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
 
     if (txdb) {
         pdb = txdb;
+        pdbExplore = exploredb;
         return;
     }
 
@@ -405,6 +471,12 @@ CTxDB::CTxDB(const char* pszMode)
     // Init directory
     init_blockindex(options);
     pdb = txdb;
+    init_exploredb();
+    pdbExplore = exploredb;
+    if (!fReadOnly)
+    {
+        MoveExploreRecords();
+    }
 
     if (Exists(string("version")))
     {
@@ -472,6 +544,159 @@ CTxDB::CTxDB(const char* pszMode)
     printf("Opened LevelDB successfully\n");
 }
 
+const leveldb::Snapshot* CTxDB::GetSnapshot()
+{
+    if (txdb == NULL)
+    {
+        return NULL;
+    }
+    return txdb->GetSnapshot();
+}
+
+void CTxDB::ReleaseSnapshot(const leveldb::Snapshot* pSnapshotIn)
+{
+    if ((txdb != NULL) && (pSnapshotIn != NULL))
+    {
+        txdb->ReleaseSnapshot(pSnapshotIn);
+    }
+}
+
+bool CTxDB::GetExploreSize(uint64_t& nSizeRet, bool fCompact)
+{
+    nSizeRet = 0;
+    if (exploredb == NULL)
+    {
+        return false;
+    }
+    // every explore key starts with the serialized EXPLORE_KEY
+    string strStart = DBKeyToString(EXPLORE_KEY);
+    string strLimit = strStart + string(1, '\xff');
+    leveldb::Slice sliceStart(strStart);
+    leveldb::Slice sliceLimit(strLimit);
+    if (fCompact)
+    {
+        exploredb->CompactRange(&sliceStart, &sliceLimit);
+    }
+    leveldb::Range range(sliceStart, sliceLimit);
+    exploredb->GetApproximateSizes(&range, 1, &nSizeRet);
+    return true;
+}
+
+const leveldb::Snapshot* CTxDB::GetExploreSnapshot()
+{
+    if (exploredb == NULL)
+    {
+        return NULL;
+    }
+    return exploredb->GetSnapshot();
+}
+
+void CTxDB::ReleaseExploreSnapshot(const leveldb::Snapshot* pSnapshotIn)
+{
+    if ((exploredb != NULL) && (pSnapshotIn != NULL))
+    {
+        exploredb->ReleaseSnapshot(pSnapshotIn);
+    }
+}
+
+bool CTxDB::CompactDB(const string& strName)
+{
+    vector<pair<string, leveldb::DB*> > vDBs;
+    if ((strName == "index") || (strName == "all"))
+    {
+        vDBs.push_back(make_pair(string("index"), txdb));
+    }
+    if ((strName == "explore") || (strName == "all"))
+    {
+        vDBs.push_back(make_pair(string("explore"), exploredb));
+    }
+    if (vDBs.empty())
+    {
+        return error("CompactDB() : unknown database %s", strName.c_str());
+    }
+    for (unsigned int i = 0; i < vDBs.size(); ++i)
+    {
+        if (vDBs[i].second == NULL)
+        {
+            return error("CompactDB() : %s database is closed",
+                         vDBs[i].first.c_str());
+        }
+        int64_t nStart = GetTimeMillis();
+        vDBs[i].second->CompactRange(NULL, NULL);
+        printf("CompactDB(): compacted %s database in %" PRId64 "ms\n",
+               vDBs[i].first.c_str(), GetTimeMillis() - nStart);
+    }
+    return true;
+}
+
+// Explore records written when they shared the block index db are moved to
+//    the explore db. The sentinel goes last, so an interrupted move starts
+//    over.
+bool CTxDB::MoveExploreRecords()
+{
+    string strSentinel = DBKeyToString(EXPLORE_SENTINEL);
+    leveldb::Iterator *iter = pdb->NewIterator(leveldb::ReadOptions());
+    iter->Seek(strSentinel);
+    if (!iter->Valid() || (iter->key().ToString() != strSentinel))
+    {
+        delete iter;
+        return true;
+    }
+    printf("Moving Explore API records to their own database...\n");
+    int64_t nCount = 0;
+    leveldb::WriteBatch batchIndex;
+    leveldb::WriteBatch batchExplore;
+    leveldb::Status status;
+    while (iter->Valid())
+    {
+        CDataStream ssKey(iter->key().data(),
+                          iter->key().data() + iter->key().size(),
+                          SER_DISK, CLIENT_VERSION);
+        if (!IsExploreKey(ssKey))
+        {
+            break;
+        }
+        batchExplore.Put(iter->key(), iter->value());
+        if (nCount > 0)
+        {
+            batchIndex.Delete(iter->key());
+        }
+        nCount += 1;
+        if ((nCount % 10000) == 0)
+        {
+            status = pdbExplore->Write(leveldb::WriteOptions(), &batchExplore);
+            if (status.ok())
+            {
+                status = pdb->Write(leveldb::WriteOptions(), &batchIndex);
+            }
+            if (!status.ok())
+            {
+                break;
+            }
+            batchExplore.Clear();
+            batchIndex.Clear();
+            printf("Moved %" PRId64 " Explore API records\n", nCount);
+        }
+        iter->Next();
+    }
+    delete iter;
+    batchIndex.Delete(strSentinel);
+    if (status.ok())
+    {
+        status = pdbExplore->Write(leveldb::WriteOptions(), &batchExplore);
+    }
+    if (status.ok())
+    {
+        status = pdb->Write(leveldb::WriteOptions(), &batchIndex);
+    }
+    if (!status.ok())
+    {
+        return error("MoveExploreRecords() : %s", status.ToString().c_str());
+    }
+    printf("Moved %" PRId64 " Explore API records\n", nCount);
+    return true;
+}
+
 void CTxDB::Close()
 {
     delete txdb;
@@ -482,28 +707,116 @@ void CTxDB::Close()
     options.block_cache = NULL;
     delete activeBatch;
     activeBatch = NULL;
+    delete exploredb;
+    exploredb = pdbExplore = NULL;
+    delete optionsExplore.filter_policy;
+    optionsExplore.filter_policy = NULL;
+    delete optionsExplore.block_cache;
+    optionsExplore.block_cache = NULL;
+    delete activeBatchExplore;
+    activeBatchExplore = NULL;
+}
+
+static void CacheAddrIDs(const map<string, unsigned int>& mapIDs,
+                         unsigned int nNext)
+{
+    LOCK(cs_mapAddrIDs);
+    if (mapAddrIDs.size() + mapIDs.size() > MAX_ADDR_ID_CACHE)
+    {
+        mapAddrIDs.clear();
+    }
+    mapAddrIDs.insert(mapIDs.begin(), mapIDs.end());
+    if (nNext != 0)
+    {
+        nNextAddrID = nNext;
+    }
+}
+
+static void ClearAddrIDs()
+{
+    LOCK(cs_mapAddrIDs);
+    mapAddrIDs.clear();
+    nNextAddrID = 0;
+}
+
+bool CTxDB::IsExploreKey(const CDataStream& ssKey)
+{
+    static const string strPrefix = DBKeyToString(EXPLORE_KEY);
+    return ((ssKey.size() >= strPrefix.size()) &&
+            (memcmp(&ssKey[0], strPrefix.data(), strPrefix.size()) == 0));
 }
 
 bool CTxDB::TxnBegin()
 {
     assert(!activeBatch);
     activeBatch = new leveldb::WriteBatch();
+    activeBatchExplore = new leveldb::WriteBatch();
     return true;
 }
 
+// The explore batch is written after the other, so a crash in between
+//    leaves the explore records behind the chain. Their tip (EXPLORE_TIP)
+//    then differs from the best chain and ExploreCatchUp() brings them
+//    up to it on the next start. Once the index batch is written the
+//    commit succeeded, even if the explore batch fails. After a failure
+//    no explore batch is written, so a later tip can't hide the missing
+//    records.
+static bool fExploreBatchFailed = false;
+
 bool CTxDB::TxnCommit()
 {
-    assert(activeBatch);
+    TRACE_SPAN("TxnCommit");
+    assert(activeBatch && activeBatchExplore);
     leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+    if (status.ok() && !fExploreBatchFailed)
+    {
+        leveldb::Status statusExplore = pdbExplore->Write(
+                                                leveldb::WriteOptions(),
+                                                activeBatchExplore);
+        if (!statusExplore.ok())
+        {
+            printf("LevelDB explore batch commit failure: %s\n"
+                   "  Explore records are behind the chain until they are "
+                   "reindexed on the next start.\n",
+                   statusExplore.ToString().c_str());
+            fExploreBatchFailed = true;
+        }
+    }
     delete activeBatch;
     activeBatch = NULL;
+    delete activeBatchExplore;
+    activeBatchExplore = NULL;
+    if (status.ok() && !fExploreBatchFailed && (nNextAddrIDPending != 0))
+    {
+        CacheAddrIDs(mapAddrIDsPending, nNextAddrIDPending);
+    }
+    mapAddrIDsPending.clear();
+    nNextAddrIDPending = 0;
     if (!status.ok()) {
         printf("LevelDB batch commit failure: %s\n", status.ToString().c_str());
+        // it has the txindexes of the lost batch
+        prevTxCache.Clear();
         return false;
     }
     return true;
 }
 
+bool CTxDB::TxnAbort()
+{
+    if (activeBatch)
+    {
+        // it has the txindexes of the abandoned batch
+        prevTxCache.Clear();
+    }
+    delete activeBatch;
+    activeBatch = NULL;
+    delete activeBatchExplore;
+    activeBatchExplore = NULL;
+    mapAddrIDsPending.clear();
+    nNextAddrIDPending = 0;
+    return true;
+}
+
 class CBatchScanner : public leveldb::WriteBatch::Handler {
 public:
     std::string needle;
@@ -535,13 +848,14 @@ public:
 // to change that assumption in future and avoid the performance hit, though in
 // practice it does not appear to be large.
 bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
-    assert(activeBatch);
+    leveldb::WriteBatch* batch = GetBatch(key);
+    assert(batch);
     *deleted = false;
     CBatchScanner scanner;
     scanner.needle = key.str();
     scanner.deleted = deleted;
     scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
+    leveldb::Status status = batch->Iterate(&scanner);
     if (!status.ok()) {
         throw runtime_error(status.ToString());
     }
@@ -558,7 +872,11 @@ bool CTxDB::EraseStartsWith(const string& strSentinel,
     }
     int count = 0;
     int xcount = 0;
-    leveldb::Iterator *iter = pdb->NewIterator(leveldb::ReadOptions());
+    CDataStream ssSentinel(strSentinel.data(),
+                           strSentinel.data() + strSentinel.size(),
+                           SER_DISK, CLIENT_VERSION);
+    leveldb::DB* pdbErase = GetDB(ssSentinel);
+    leveldb::Iterator *iter = pdbErase->NewIterator(GetReadOptions(pdbErase));
     iter->Seek(strSentinel);
     // don't erase the sentinel
     iter->Next();
@@ -614,13 +932,14 @@ bool CTxDB::EraseStartsWith(const string& strSentinel,
         }
         count += 1;
         string strKeyDel(ssKey.full_str());
-        if (activeBatch)
+        leveldb::WriteBatch* batch = GetBatch(ssSentinel);
+        if (batch)
         {
-            activeBatch->Delete(strKeyDel);
+            batch->Delete(strKeyDel);
         }
         else
         {
-            leveldb::Status status = pdb->Delete(leveldb::WriteOptions(), strKeyDel);
+            leveldb::Status status = pdbErase->Delete(leveldb::WriteOptions(), strKeyDel);
             if (!status.ok())
             {
                 return error("TSNH: Can't erase record type \"%s\".",
@@ -633,26 +952,135 @@ bool CTxDB::EraseStartsWith(const string& strSentinel,
     {
         return error("EraseStartsWith() : final TxnCommit failed");
     }
+    // the ADDR_ID records may be gone
+    ClearAddrIDs();
     return true;
 }
 
+bool CTxDB::ReadExploreSentinel(int& valueRet)
+{
+    valueRet = 0;
+    return Read(EXPLORE_SENTINEL, valueRet);
+}
+
 bool CTxDB::WriteExploreSentinel(int value)
 {
     return Write(EXPLORE_SENTINEL, value);
 }
 
+bool CTxDB::ReadExploreTip(uint256& hashRet)
+{
+    hashRet = 0;
+    return Read(EXPLORE_TIP, hashRet);
+}
+
+bool CTxDB::WriteExploreTip(const uint256& hash)
+{
+    return Write(EXPLORE_TIP, hash);
+}
+
+/*  AddrID
+ *  Parameters - addr:address, nID:interned ID
+ */
+bool CTxDB::ReadAddrID(const string& addr, unsigned int& nIDRet)
+{
+    map<string, unsigned int>::const_iterator mi;
+    mi = mapAddrIDsPending.find(addr);
+    if (mi != mapAddrIDsPending.end())
+    {
+        nIDRet = (*mi).second;
+        return true;
+    }
+    {
+        LOCK(cs_mapAddrIDs);
+        mi = mapAddrIDs.find(addr);
+        if (mi != mapAddrIDs.end())
+        {
+            nIDRet = (*mi).second;
+            return true;
+        }
+    }
+    if (!Read(make_pair(ADDR_ID, addr), nIDRet))
+    {
+        return false;
+    }
+    // IDs are never reassigned, so what is in the db can be cached
+    map<string, unsigned int> mapID;
+    mapID[addr] = nIDRet;
+    CacheAddrIDs(mapID, 0);
+    return true;
+}
+
+// Gives addr the next ID if it has none. In a batch the new IDs are only
+//    visible to this CTxDB until TxnCommit. Explore records are written
+//    under cs_main, so only one CTxDB adds IDs at a time.
+bool CTxDB::AddAddrID(const string& addr, unsigned int& nIDRet)
+{
+    if (ReadAddrID(addr, nIDRet))
+    {
+        return true;
+    }
+    if (nNextAddrIDPending == 0)
+    {
+        LOCK(cs_mapAddrIDs);
+        if (nNextAddrID == 0)
+        {
+            if (!Read(ADDR_ID_NEXT, nNextAddrID))
+            {
+                nNextAddrID = 1;
+            }
+        }
+        nNextAddrIDPending = nNextAddrID;
+    }
+    nIDRet = nNextAddrIDPending;
+    if (!Write(make_pair(ADDR_ID, addr), nIDRet) ||
+        !Write(ADDR_ID_NEXT, nIDRet + 1))
+    {
+        return error("AddAddrID() : can't write ID of %s", addr.c_str());
+    }
+    nNextAddrIDPending += 1;
+    mapAddrIDsPending[addr] = nIDRet;
+    if (!activeBatch)
+    {
+        CacheAddrIDs(mapAddrIDsPending, nNextAddrIDPending);
+        mapAddrIDsPending.clear();
+        nNextAddrIDPending = 0;
+    }
+    return true;
+}
+
+bool CTxDB::GetAddrKey(const string& addr, bool fAdd, CExploreKey& key)
+{
+    unsigned int nID;
+    if (!(fAdd ? AddAddrID(addr, nID) : ReadAddrID(addr, nID)))
+    {
+        return false;
+    }
+    key.PushCompactSize(nID);
+    return true;
+}
+
 /*  AddrQty
  *  Parameters - t:type, addr:address, qty:quantity
  */
 bool CTxDB::ReadAddrQty(const exploreKey_t& t, const string& addr, int& qtyRet)
 {
     qtyRet = 0;
-    ss_key_t key = make_pair(t, addr);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return true;
+    }
     return ReadRecord(key, qtyRet);
 }
 bool CTxDB::WriteAddrQty(const exploreKey_t& t, const string& addr, const int& qty)
 {
-    return Write(make_pair(t, addr), qty);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, true, key))
+    {
+        return false;
+    }
+    return Write(key, qty);
 }
 
 /*  AddrTx
@@ -661,12 +1089,22 @@ bool CTxDB::WriteAddrQty(const exploreKey_t& t, const string& addr, const int& q
  */
 bool CTxDB::RemoveAddrTx(const exploreKey_t& t, const string& addr, const int& qty)
 {
-    pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return false;
+    }
+    key.PushUInt32(qty);
     return RemoveRecord(key);
 }
 bool CTxDB::AddrTxIsViable(const exploreKey_t& t, const string& addr, const int& qty)
 {
-    pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return false;
+    }
+    key.PushUInt32(qty);
     return IsViable(key);
 }
 
@@ -675,12 +1113,22 @@ bool CTxDB::AddrTxIsViable(const exploreKey_t& t, const string& addr, const int&
  */
 bool CTxDB::RemoveAddrList(const exploreKey_t& t, const string& addr, const int& qty)
 {
-    pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return false;
+    }
+    key.PushUInt32(qty);
     return RemoveRecord(key);
 }
 bool CTxDB::AddrListIsViable(const exploreKey_t& t, const string& addr, const int& qty)
 {
-    pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return false;
+    }
+    key.PushUInt32(qty);
     return IsViable(key);
 }
 
@@ -694,26 +1142,50 @@ bool CTxDB::ReadAddrLookup(const exploreKey_t& t, const string& addr,
                            int& qtyRet)
 {
    qtyRet = -1;
-   lookup_key_t key = make_pair(make_pair(t, addr), make_pair(txid, n));
+   CExploreKey key(t);
+   if (!GetAddrKey(addr, false, key))
+   {
+       return true;
+   }
+   key.PushHash(txid);
+   key.PushUInt32(n);
    return ReadRecord(key, qtyRet);
 }
 bool CTxDB::WriteAddrLookup(const exploreKey_t& t, const string& addr,
                             const uint256& txid, const int& n,
                             const int& qty)
 {
-   lookup_key_t key = make_pair(make_pair(t, addr), make_pair(txid, n));
+   CExploreKey key(t);
+   if (!GetAddrKey(addr, true, key))
+   {
+       return false;
+   }
+   key.PushHash(txid);
+   key.PushUInt32(n);
    return Write(key, qty);
 }
 bool CTxDB::RemoveAddrLookup(const exploreKey_t& t, const string& addr,
                              const uint256& txid, const int& n)
 {
-   lookup_key_t key = make_pair(make_pair(t, addr), make_pair(txid, n));
+   CExploreKey key(t);
+   if (!GetAddrKey(addr, false, key))
+   {
+       return false;
+   }
+   key.PushHash(txid);
+   key.PushUInt32(n);
    return RemoveRecord(key);
 }
 bool CTxDB::AddrLookupIsViable(const exploreKey_t& t, const string& addr,
                                const uint256& txid, const int& n)
 {
-   lookup_key_t key = make_pair(make_pair(t, addr), make_pair(txid, n));
+   CExploreKey key(t);
+   if (!GetAddrKey(addr, false, key))
+   {
+       return false;
+   }
+   key.PushHash(txid);
+   key.PushUInt32(n);
    return IsViable(key);
 }
 
@@ -725,18 +1197,30 @@ bool CTxDB::ReadAddrValue(const exploreKey_t& t, const string& addr,
                           int64_t& vRet)
 {
     vRet = 0;
-    ss_key_t key = make_pair(t, addr);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return true;
+    }
     return ReadRecord(key, vRet);
 }
 bool CTxDB::WriteAddrValue(const exploreKey_t& t, const string& addr,
                            const int64_t& v)
 {
-    ss_key_t key = make_pair(t, addr);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, true, key))
+    {
+        return false;
+    }
     return Write(key, v);
 }
 bool CTxDB::AddrValueIsViable(const exploreKey_t& t, const std::string& addr)
 {
-    ss_key_t key = make_pair(t, addr);
+    CExploreKey key(t);
+    if (!GetAddrKey(addr, false, key))
+    {
+        return false;
+    }
     return IsViable(key);
 }
 
@@ -746,17 +1230,20 @@ bool CTxDB::AddrValueIsViable(const exploreKey_t& t, const std::string& addr)
 bool CTxDB::ReadAddrSet(const exploreKey_t& t, const int64_t b, set<string>& sRet)
 {
     sRet.clear();
-    pair<exploreKey_t, int64_t> key = make_pair(t, b);
+    CExploreKey key(t);
+    key.PushUInt64(b);
     return ReadRecord(key, sRet);
 }
 bool CTxDB::WriteAddrSet(const exploreKey_t& t, const int64_t b, const set<string>& s)
 {
-    pair<exploreKey_t, int64_t> key = make_pair(t, b);
+    CExploreKey key(t);
+    key.PushUInt64(b);
     return Write(key, s);
 }
 bool CTxDB::RemoveAddrSet(const exploreKey_t& t, const int64_t b)
 {
-    pair<exploreKey_t, int64_t> key = make_pair(t, b);
+    CExploreKey key(t);
+    key.PushUInt64(b);
     return RemoveRecord(key);
 }
 
@@ -789,7 +1276,21 @@ bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
 
 bool CTxDB::UpdateTxIndex(uint256 hash, const CTxIndex& txindex)
 {
-    return Write(make_pair(string("tx"), hash), txindex);
+    // bytes per write is the write amplification of spending an output
+    static CMetricCounter* pcountWrites =
+        GetMetricCounter("stealth_txindex_writes_total",
+                         "Txindex records written");
+    static CMetricCounter* pcountBytes =
+        GetMetricCounter("stealth_txindex_write_bytes_total",
+                         "Bytes of txindex records written");
+    pcountWrites->Inc();
+    pcountBytes->Inc(::GetSerializeSize(txindex, SER_DISK, CLIENT_VERSION));
+    if (!Write(make_pair(string("tx"), hash), txindex))
+    {
+        return false;
+    }
+    prevTxCache.UpdateTxIndex(hash, txindex);
+    return true;
 }
 
 bool CTxDB::AddTxIndex(const CTransaction& tx,
@@ -799,15 +1300,288 @@ bool CTxDB::AddTxIndex(const CTransaction& tx,
     // Add to tx index
     uint256 hash = tx.GetHash();
     CTxIndex txindex(pos, tx.vout.size());
-    return Write(make_pair(string("tx"), hash), txindex);
+    if (!Write(make_pair(string("tx"), hash), txindex))
+    {
+        return false;
+    }
+    prevTxCache.UpdateTxIndex(hash, txindex);
+    return true;
 }
 
 bool CTxDB::EraseTxIndex(const CTransaction& tx)
 {
     uint256 hash = tx.GetHash();
+    prevTxCache.Erase(hash);
     return Erase(make_pair(string("tx"), hash));
 }
 
+bool CTxDB::ReadSpender(const COutPoint& prevout, CDiskTxPos& posRet)
+{
+    posRet.SetNull();
+    return Read(make_pair(string("spender"), prevout), posRet);
+}
+
+bool CTxDB::WriteSpenders(const CTransaction& tx, const CDiskTxPos& pos)
+{
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (!Write(make_pair(string("spender"), txin.prevout), pos))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CTxDB::EraseSpenders(const CTransaction& tx)
+{
+    if (tx.IsCoinBase())
+    {
+        return true;
+    }
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        Erase(make_pair(string("spender"), txin.prevout));
+    }
+    return true;
+}
+
+// Rewrites every txindex record that still has the position of each
+// spender as a compact record. With -spenderindex the positions move to
+// spender records.
+//
+// Each batch also writes a "txmigrate" record: whether spender records are
+// written, and the last txindex record done. An interrupted migration
+// carries on from there the same way, because the records it already made
+// compact have lost their spender positions. For that reason it refuses to
+// carry on with -spenderindex if it started without it. The record is
+// erased when the database version is written.
+bool CTxDB::MigrateTxIndexes()
+{
+    if (activeBatch)
+    {
+        return error("MigrateTxIndexes() : active batch not allowed");
+    }
+
+    bool fMigrateSpenders = fSpenderIndex;
+    uint256 hashResume = 0;
+    pair<bool, uint256> state;
+    if (Read(string("txmigrate"), state))
+    {
+        fMigrateSpenders = state.first;
+        hashResume = state.second;
+        if (fSpenderIndex && !fMigrateSpenders)
+        {
+            return error("MigrateTxIndexes() : an interrupted migration "
+                         "started without -spenderindex, the spender "
+                         "positions it compacted are gone. Restart without "
+                         "-spenderindex, or with -reindex.");
+        }
+        printf("MigrateTxIndexes(): resuming after %s\n",
+               hashResume.ToString().c_str());
+    }
+
+    printf("MigrateTxIndexes(): writing compact txindex records%s...\n",
+           fMigrateSpenders ? " and the spender index" : "");
+    printf("MigrateTxIndexes(): WARNING: versions before %d misread the "
+           "compact records, to go back to one run it with -reindex\n",
+           COMPACT_TXINDEX_DATABASE_VERSION);
+
+    leveldb::Iterator *iterator = pdb->NewIterator(GetReadOptions());
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("tx"), hashResume);
+    iterator->Seek(ssStartKey.str());
+
+    int64_t nRecords = 0;
+    int64_t nSpenders = 0;
+    uint64_t nBytesBefore = 0;
+    uint64_t nBytesAfter = 0;
+    if (!TxnBegin())
+    {
+        delete iterator;
+        return error("MigrateTxIndexes() : TxnBegin failed");
+    }
+    while (iterator->Valid())
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        string strType;
+        ssKey >> strType;
+        if (fRequestShutdown || strType != "tx")
+        {
+            break;
+        }
+        uint256 hash;
+        ssKey >> hash;
+
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue.write(iterator->value().data(), iterator->value().size());
+        CTxIndex txindex;
+        ssValue >> txindex;
+
+        if (fMigrateSpenders)
+        {
+            for (unsigned int n = 0; n < txindex.vSpent.size(); ++n)
+            {
+                const CDiskTxPos& posSpender = txindex.vSpent[n];
+                if (posSpender.IsNull() || posSpender.IsUnknown())
+                {
+                    continue;
+                }
+                Write(make_pair(string("spender"), COutPoint(hash, n)),
+                      posSpender);
+                ++nSpenders;
+            }
+        }
+
+        nBytesBefore += iterator->value().size();
+        nBytesAfter += ::GetSerializeSize(txindex, SER_DISK, CLIENT_VERSION);
+        Write(make_pair(string("tx"), hash), txindex);
+        ++nRecords;
+
+        if ((nRecords % 10000) == 0)
+        {
+            Write(string("txmigrate"), make_pair(fMigrateSpenders, hash));
+            if (!TxnCommit() || !TxnBegin())
+            {
+                delete iterator;
+                return error("MigrateTxIndexes() : batch commit failed");
+            }
+        }
+        if ((nRecords % 1000000) == 0)
+        {
+            printf("Migrated %" PRId64 " txindex records\n", nRecords);
+        }
+        iterator->Next();
+    }
+    delete iterator;
+    if (!fRequestShutdown)
+    {
+        // past every txindex record, a rerun before the version is written
+        //    has nothing to do
+        Write(string("txmigrate"), make_pair(fMigrateSpenders, ~uint256(0)));
+    }
+    if (!TxnCommit())
+    {
+        return error("MigrateTxIndexes() : TxnCommit failed");
+    }
+
+    if (fRequestShutdown)
+    {
+        printf("MigrateTxIndexes(): interrupted after %" PRId64 " records\n",
+               nRecords);
+        return true;
+    }
+
+    // Spending one output rewrites the whole record, so the mean record
+    // size is also the bytes written per spend.
+    printf("MigrateTxIndexes(): %" PRId64 " records, %" PRIu64 " bytes "
+           "before, %" PRIu64 " bytes after, %" PRId64 " spender records\n",
+           nRecords, nBytesBefore, nBytesAfter, nSpenders);
+    if (nRecords > 0)
+    {
+        printf("MigrateTxIndexes(): mean bytes written per spend %.1f "
+               "before, %.1f after\n",
+               (double)nBytesBefore / nRecords,
+               (double)nBytesAfter / nRecords);
+    }
+    return true;
+}
+
+// The position and hash of every transaction with an unspent output,
+//    read through the active snapshot, if any.
+bool CTxDB::ReadUnspentTxIndexes(
+                        vector<pair<CDiskTxPos, uint256> >& vUnspentRet)
+{
+    vUnspentRet.clear();
+
+    leveldb::Iterator *iterator = pdb->NewIterator(GetReadOptions());
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("tx"), uint256(0));
+    iterator->Seek(ssStartKey.str());
+
+    while (iterator->Valid())
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        string strType;
+        ssKey >> strType;
+        if (fRequestShutdown || strType != "tx")
+        {
+            break;
+        }
+        uint256 hash;
+        ssKey >> hash;
+
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue.write(iterator->value().data(), iterator->value().size());
+        CTxIndex txindex;
+        ssValue >> txindex;
+
+        BOOST_FOREACH(const CDiskTxPos& posSpent, txindex.vSpent)
+        {
+            if (posSpent.IsNull())
+            {
+                vUnspentRet.push_back(make_pair(txindex.pos, hash));
+                break;
+            }
+        }
+        iterator->Next();
+    }
+    bool fOK = iterator->status().ok();
+    delete iterator;
+    if (!fOK || fRequestShutdown)
+    {
+        return error("ReadUnspentTxIndexes() : iteration stopped");
+    }
+    return true;
+}
+
+bool CTxDB::ReadBlockUndo(const uint256& hash, CBlockUndo& undo)
+{
+    undo.SetNull();
+    return Read(make_pair(string("blockundo"), hash), undo);
+}
+
+bool CTxDB::WriteBlockUndo(const uint256& hash, const CBlockUndo& undo)
+{
+    return Write(make_pair(string("blockundo"), hash), undo);
+}
+
+bool CTxDB::EraseBlockUndo(const uint256& hash)
+{
+    return Erase(make_pair(string("blockundo"), hash));
+}
+
+bool CTxDB::ReadPruneHeight(int& nPruneHeightRet)
+{
+    return Read(string("pruneHeight"), nPruneHeightRet);
+}
+
+bool CTxDB::WritePruneHeight(int nPruneHeightIn)
+{
+    return Write(string("pruneHeight"), nPruneHeightIn);
+}
+
+// positions of the records written into block file nFile for the
+//    unspent transactions of pruned files, see prune.h
+bool CTxDB::ReadPrunedTxs(unsigned int nFile, vector<unsigned int>& vRecordPosRet)
+{
+    vRecordPosRet.clear();
+    return Read(make_pair(string("prunedtxs"), nFile), vRecordPosRet);
+}
+
+bool CTxDB::WritePrunedTxs(unsigned int nFile,
+                           const vector<unsigned int>& vRecordPos)
+{
+    return Write(make_pair(string("prunedtxs"), nFile), vRecordPos);
+}
+
+bool CTxDB::ErasePrunedTxs(unsigned int nFile)
+{
+    return Erase(make_pair(string("prunedtxs"), nFile));
+}
+
 bool CTxDB::ContainsTx(uint256 hash)
 {
     return Exists(make_pair(string("tx"), hash));
@@ -912,7 +1686,10 @@ static CBlockMemIndex* InsertBlockIndex(uint256 hash)
         throw runtime_error("InsertBlockIndex() : new CBlockMemIndex failed");
     }
 
-    mi = mapBlockIndex.insert(make_pair(hash, pmemIndexNew)).first;
+    {
+        LOCK(cs_blockmaps);
+        mi = mapBlockIndex.insert(make_pair(hash, pmemIndexNew)).first;
+    }
 
     pmemIndexNew->phashBlock = &((*mi).first);
 
@@ -936,10 +1713,32 @@ bool CTxDB::LoadBlockIndex()
         ReadVersion(nDatabaseVersion);
     }
 
+    // A newer version may store records this one would misread.
+    if (nDatabaseVersion > DATABASE_VERSION)
+    {
+        return error("CTxDB::LoadBlockIndex() : database version %d is newer "
+                     "than %d, run with -reindex", nDatabaseVersion,
+                     DATABASE_VERSION);
+    }
+
+    // Compact the txindex records before anything reads them. Until the
+    // version is written at the end of a clean load, it runs again.
+    if (nDatabaseVersion < COMPACT_TXINDEX_DATABASE_VERSION)
+    {
+        if (!MigrateTxIndexes())
+        {
+            return error("CTxDB::LoadBlockIndex() : MigrateTxIndexes failed");
+        }
+        if (fRequestShutdown)
+        {
+            return true;
+        }
+    }
+
     // The block index is an in-memory structure that maps hashes to on-disk
     // locations where the contents of the block can be found. Here, we scan it
     // out of the DB and into mapBlockIndex.
-    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator *iterator = pdb->NewIterator(GetReadOptions());
 
     // Seek to start key.
     CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
@@ -1051,8 +1850,15 @@ bool CTxDB::LoadBlockIndex()
 
     assert (nCountInventoried == nCountLoaded);
 
-    // Re-indexing Explore
-    if (fWithExploreAPI && !GetBoolArg("-reindexexplore", false))
+    // Re-indexing Explore, also done for records of an older schema.
+    //    Records behind the chain are loaded as they are and caught up
+    //    once the chain is (ExploreCatchUp).
+    int nExploreSchema;
+    bool fLoadExplore = (fWithExploreAPI &&
+                         !GetBoolArg("-reindexexplore", false) &&
+                         ReadExploreSentinel(nExploreSchema) &&
+                         (nExploreSchema >= EXPLORE_SCHEMA_VERSION));
+    if (fLoadExplore)
     {
         printf("==\n== Loading Explore API Data\n==\n");
         printf("Loading balance address sets...\n");
@@ -1060,10 +1866,12 @@ bool CTxDB::LoadBlockIndex()
         // The mapAddressBalances is an in-memory structure that maps balances
         // to the number of addresses (accounts) with that balance.
         // It is useful for iterating over the rich list by account value.
-        leveldb::Iterator *iter = pdb->NewIterator(leveldb::ReadOptions());
+        MapBalanceCounts& mapAddressBalances = GetAddressBalancesForWrite();
+        leveldb::Iterator *iter = pdbExplore->NewIterator(
+                                            GetReadOptions(pdbExplore));
         // Seek to start key.
         CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
-        ssStartKey << make_pair(ADDR_SET_BAL, 0);
+        ssStartKey << CExploreKey(ADDR_SET_BAL);
         iter->Seek(ssStartKey.str());
         int nCountSets = 0;
         // Now read each entry.
@@ -1096,8 +1904,14 @@ bool CTxDB::LoadBlockIndex()
             {
                 break;
             }
-            int64_t nBalance;
-            ssKey >> nBalance;
+            // big endian, see CExploreKey
+            unsigned char pchBalance[8];
+            ssKey.read((char*)pchBalance, sizeof(pchBalance));
+            int64_t nBalance = 0;
+            for (unsigned int i = 0; i < sizeof(pchBalance); ++i)
+            {
+                nBalance = (nBalance << 8) | pchBalance[i];
+            }
             set<string> setAddr;
             ssValue >> setAddr;
             unsigned int sizeSetAddr = setAddr.size();
@@ -1605,6 +2419,12 @@ bool CTxDB::LoadBlockIndex()
     {
         nCheckDepth = nBestHeight - 1;
     }
+    // pruned blocks can't be verified
+    int nPrunedTo;
+    if (ReadPruneHeight(nPrunedTo) && (nCheckDepth > (nBestHeight - nPrunedTo)))
+    {
+        nCheckDepth = nBestHeight - nPrunedTo;
+    }
     printf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
 
     // backtrack from best to check start
@@ -1754,8 +2574,15 @@ bool CTxDB::LoadBlockIndex()
                     unsigned int nOutput = 0;
                     if (nCheckLevel > 3)
                     {
-                        BOOST_FOREACH (const CDiskTxPos& txpos, txindex.vSpent)
+                        BOOST_FOREACH (CDiskTxPos txpos, txindex.vSpent)
                         {
+                            // compact records only know that it's spent
+                            if (txpos.IsUnknown() &&
+                                !ReadSpender(COutPoint(hashTx, nOutput),
+                                             txpos))
+                            {
+                                txpos.SetNull();
+                            }
                             if (!txpos.IsNull())
                             {
                                 pair<unsigned int, unsigned int>
@@ -1880,7 +2707,10 @@ bool CTxDB::LoadBlockIndex()
         {
             return error("LoadBlockIndex() : unexpected null index");
         }
-        mapBlockLookup[i] = pmemIndexLookup;
+        {
+            LOCK(cs_blockmaps);
+            mapBlockLookup[i] = pmemIndexLookup;
+        }
         if (progress % 100000 == 0)
         {
             printf("LoadBlockIndex(): created %d lookups\n", progress);
@@ -1916,6 +2746,7 @@ bool CTxDB::LoadBlockIndex()
     // Require a full clean load with verification before the database
     // gets certified with the latest version.
     WriteVersion(DATABASE_VERSION);
+    Erase(string("txmigrate"));
 
     return true;
 }
@@ -22,13 +22,69 @@ class ExploreTx;
 ///////////////////////////////////////////////////////////////////////////////
 // LevelDB Keys
 ///////////////////////////////////////////////////////////////////////////////
-// generalized explore keys
-typedef pair<exploreKey_t, string> ss_key_t;
-// amount key (e.g. balances)
-typedef pair<ss_key_t, int64_t> amount_key_t;
-// in-out lookup key
-typedef pair<uint256, int> txidn_key_t;
-typedef pair<ss_key_t, txidn_key_t> lookup_key_t;
+// Explore record key: the record type, then fixed width big endian
+//    fields, so the records of an address sort by their index and
+//    balances sort by value. Addresses are interned to an ID, see
+//    CTxDB::AddAddrID(), pushed as a compact size so no two IDs share
+//    a prefix.
+class CExploreKey
+{
+private:
+    const exploreKey_t& t;
+    std::vector<unsigned char> vchFields;
+
+public:
+    explicit CExploreKey(const exploreKey_t& tIn) : t(tIn)
+    {
+        vchFields.reserve(48);
+    }
+
+    void PushUInt32(uint32_t n)
+    {
+        for (int i = 24; i >= 0; i -= 8)
+        {
+            vchFields.push_back((n >> i) & 0xff);
+        }
+    }
+
+    void PushUInt64(uint64_t n)
+    {
+        PushUInt32(n >> 32);
+        PushUInt32(n & 0xffffffff);
+    }
+
+    void PushCompactSize(uint64_t n)
+    {
+        WriteCompactSize(*this, n);
+    }
+
+    void PushHash(const uint256& hash)
+    {
+        const unsigned char* pch = (const unsigned char*)&hash;
+        vchFields.insert(vchFields.end(), pch, pch + sizeof(hash));
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return ::GetSerializeSize(t, nType, nVersion) + vchFields.size();
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, t, nType, nVersion);
+        if (!vchFields.empty())
+        {
+            s.write((const char*)&vchFields[0], vchFields.size());
+        }
+    }
+
+    // the stream interface of WriteCompactSize()
+    void write(const char* pch, size_t nSize)
+    {
+        vchFields.insert(vchFields.end(), pch, pch + nSize);
+    }
+};
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -59,8 +115,8 @@ public:
     CTxDB(const char* pszMode="r+");
     ~CTxDB() {
         // Note that this is not the same as Close() because it deletes only
-        // data scoped to this TxDB object.
-        delete activeBatch;
+        // data scoped to this TxDB object. A batch still open is abandoned.
+        TxnAbort();
     }
 
     bool ActiveBatchIsNull()
@@ -71,19 +127,82 @@ public:
     // Destroys the underlying shared global state accessed by this TxDB.
     void Close();
 
+    // Reads through this TxDB see the database as of the given snapshot
+    // (NULL reads the latest state). The snapshot must outlive the reads.
+    void UseSnapshot(const leveldb::Snapshot* pSnapshotIn)
+    {
+        pSnapshot = pSnapshotIn;
+    }
+
+    // the same for the explore db
+    void UseExploreSnapshot(const leveldb::Snapshot* pSnapshotIn)
+    {
+        pSnapshotExplore = pSnapshotIn;
+    }
+
+    // Snapshots of the global instance, see CChainView.
+    static const leveldb::Snapshot* GetSnapshot();
+    static void ReleaseSnapshot(const leveldb::Snapshot* pSnapshotIn);
+    static const leveldb::Snapshot* GetExploreSnapshot();
+    static void ReleaseExploreSnapshot(const leveldb::Snapshot* pSnapshotIn);
+
+    // Compacts the block index db, the explore db or both ("all").
+    static bool CompactDB(const std::string& strName);
+    // Approximate bytes on disk of the explore records, compacted first
+    //    if fCompact so the size compares between runs.
+    static bool GetExploreSize(uint64_t& nSizeRet, bool fCompact=false);
+
 private:
     leveldb::DB *pdb;  // Points to the global instance.
+    // The explore records (keys that start with EXPLORE_KEY) are in a
+    // database of their own, with its own cache and write buffer, so
+    // explore reindexes and compactions don't evict the block index.
+    leveldb::DB *pdbExplore;
 
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
+    // The explore batch is committed after the other one.
     leveldb::WriteBatch *activeBatch;
+    leveldb::WriteBatch *activeBatchExplore;
     leveldb::Options options;
     bool fReadOnly;
     int nVersion;
+    const leveldb::Snapshot* pSnapshot;
+    const leveldb::Snapshot* pSnapshotExplore;
+
+    // address IDs added in activeBatch, published on TxnCommit
+    std::map<std::string, unsigned int> mapAddrIDsPending;
+    unsigned int nNextAddrIDPending;
 
 protected:
-    // Returns true and sets (value,false) if activeBatch contains the given key
-    // or leaves value alone and sets deleted = true if activeBatch contains a
+    leveldb::ReadOptions GetReadOptions(const leveldb::DB* pdbRead) const
+    {
+        leveldb::ReadOptions readOptions;
+        readOptions.snapshot = (pdbRead == pdbExplore) ? pSnapshotExplore :
+                                                         pSnapshot;
+        return readOptions;
+    }
+
+    leveldb::ReadOptions GetReadOptions() const
+    {
+        return GetReadOptions(pdb);
+    }
+
+    static bool IsExploreKey(const CDataStream& ssKey);
+    bool MoveExploreRecords();
+
+    leveldb::DB* GetDB(const CDataStream& ssKey) const
+    {
+        return IsExploreKey(ssKey) ? pdbExplore : pdb;
+    }
+
+    leveldb::WriteBatch* GetBatch(const CDataStream& ssKey) const
+    {
+        return IsExploreKey(ssKey) ? activeBatchExplore : activeBatch;
+    }
+
+    // Returns true and sets (value,false) if the batch of the key contains it
+    // or leaves value alone and sets deleted = true if the batch contains a
     // delete for it.
     bool ScanBatch(const CDataStream &key, std::string *value, bool *deleted) const;
 
@@ -97,7 +216,8 @@ protected:
         std::string strValue;
 
         bool readFromDb = true;
-        if (activeBatch) {
+        leveldb::DB* pdbRead = GetDB(ssKey);
+        if (GetBatch(ssKey)) {
             // First we must search for it in the currently pending set of
             // changes to the db. If not found in the batch, go on to read disk.
             bool deleted = false;
@@ -107,8 +227,8 @@ protected:
             }
         }
         if (readFromDb) {
-            leveldb::Status status = pdb->Get(leveldb::ReadOptions(),
-                                              ssKey.str(), &strValue);
+            leveldb::Status status = pdbRead->Get(GetReadOptions(pdbRead),
+                                                  ssKey.str(), &strValue);
             if (!status.ok())
             {
                 if (status.IsNotFound())
@@ -154,11 +274,12 @@ protected:
         ssValue.reserve(10000);
         ssValue << value;
 
-        if (activeBatch) {
-            activeBatch->Put(ssKey.str(), ssValue.str());
+        leveldb::WriteBatch* batch = GetBatch(ssKey);
+        if (batch) {
+            batch->Put(ssKey.str(), ssValue.str());
             return true;
         }
-        leveldb::Status status = pdb->Put(leveldb::WriteOptions(), ssKey.str(), ssValue.str());
+        leveldb::Status status = GetDB(ssKey)->Put(leveldb::WriteOptions(), ssKey.str(), ssValue.str());
         if (!status.ok()) {
             printf("LevelDB write failure: %s\n", status.ToString().c_str());
             return false;
@@ -179,12 +300,13 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        if (activeBatch)
+        leveldb::WriteBatch* batch = GetBatch(ssKey);
+        if (batch)
         {
-            activeBatch->Delete(ssKey.str());
+            batch->Delete(ssKey.str());
             return true;
         }
-        leveldb::Status status = pdb->Delete(leveldb::WriteOptions(), ssKey.str());
+        leveldb::Status status = GetDB(ssKey)->Delete(leveldb::WriteOptions(), ssKey.str());
         if (!status.ok())
         {
             if (status.IsNotFound())
@@ -208,14 +330,15 @@ protected:
         ssKey << key;
         std::string unused;
 
-        if (activeBatch) {
+        if (GetBatch(ssKey)) {
             bool deleted;
             if (ScanBatch(ssKey, &unused, &deleted) && !deleted) {
                 return true;
             }
         }
 
-        leveldb::Status status = pdb->Get(leveldb::ReadOptions(), ssKey.str(), &unused);
+        leveldb::DB* pdbRead = GetDB(ssKey);
+        leveldb::Status status = pdbRead->Get(GetReadOptions(pdbRead), ssKey.str(), &unused);
         return status.IsNotFound() == false;
     }
 
@@ -232,7 +355,7 @@ protected:
         ssKey << key;
         std::string unused;
 
-        if (activeBatch)
+        if (GetBatch(ssKey))
         {
             bool deleted;
             if (ScanBatch(ssKey, &unused, &deleted))
@@ -248,7 +371,8 @@ protected:
             }
         }
 
-        leveldb::Status status = pdb->Get(leveldb::ReadOptions(),ssKey.str(), &unused);
+        leveldb::DB* pdbRead = GetDB(ssKey);
+        leveldb::Status status = pdbRead->Get(GetReadOptions(pdbRead),ssKey.str(), &unused);
         return status.IsNotFound() == false;
     }
 
@@ -273,12 +397,7 @@ protected:
 public:
     bool TxnBegin();
     bool TxnCommit();
-    bool TxnAbort()
-    {
-        delete activeBatch;
-        activeBatch = NULL;
-        return true;
-    }
+    bool TxnAbort();
 
     bool ReadVersion(int& nVersion)
     {
@@ -295,7 +414,18 @@ public:
                          const string& strSearch,
                          bool fActiveBatchOK);
 
-    bool WriteExploreSentinel(int value=0);
+    bool ReadExploreSentinel(int& valueRet);
+    bool WriteExploreSentinel(int value=EXPLORE_SCHEMA_VERSION);
+    bool ReadExploreTip(uint256& hashRet);
+    bool WriteExploreTip(const uint256& hash);
+
+    // interned explore addresses
+    bool ReadAddrID(const std::string& addr, unsigned int& nIDRet);
+    bool AddAddrID(const std::string& addr, unsigned int& nIDRet);
+    // Pushes the ID of addr onto key, adding an ID if fAdd. False if
+    //    the address has none.
+    bool GetAddrKey(const std::string& addr, bool fAdd, CExploreKey& key);
+
     bool ReadAddrQty(const exploreKey_t& t, const std::string& addr, int& qtyRet);
     bool WriteAddrQty(const exploreKey_t& t, const std::string& addr, const int& qty);
 
@@ -306,14 +436,24 @@ public:
                     T& value)
     {
         value.SetNull();
-        pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+        CExploreKey key(t);
+        if (!GetAddrKey(addr, false, key))
+        {
+            return true;
+        }
+        key.PushUInt32(qty);
         return ReadRecord(key, value);
     }
     template<typename T>
     bool WriteAddrTx(const exploreKey_t& t, const string& addr, const int& qty,
                      const T& value)
     {
-        pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+        CExploreKey key(t);
+        if (!GetAddrKey(addr, true, key))
+        {
+            return false;
+        }
+        key.PushUInt32(qty);
         return Write(key, value);
     }
 
@@ -325,14 +465,24 @@ public:
                       T& value)
     {
         value.SetNull();
-        pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+        CExploreKey key(t);
+        if (!GetAddrKey(addr, false, key))
+        {
+            return true;
+        }
+        key.PushUInt32(qty);
         return ReadRecord(key, value);
     }
     template<typename T>
     bool WriteAddrList(const exploreKey_t& t, const string& addr, const int& qty,
                        const T& value)
     {
-        pair<ss_key_t, int> key = make_pair(make_pair(t, addr), qty);
+        CExploreKey key(t);
+        if (!GetAddrKey(addr, true, key))
+        {
+            return false;
+        }
+        key.PushUInt32(qty);
         return Write(key, value);
     }
 
@@ -367,6 +517,22 @@ public:
     bool UpdateTxIndex(uint256 hash, const CTxIndex& txindex);
     bool AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeight);
     bool EraseTxIndex(const CTransaction& tx);
+    bool ReadSpender(const COutPoint& prevout, CDiskTxPos& posRet);
+    bool WriteSpenders(const CTransaction& tx, const CDiskTxPos& pos);
+    bool EraseSpenders(const CTransaction& tx);
+    bool MigrateTxIndexes();
+    bool ReadUnspentTxIndexes(
+                std::vector<std::pair<CDiskTxPos, uint256> >& vUnspentRet);
+    bool ReadBlockUndo(const uint256& hash, CBlockUndo& undo);
+    bool WriteBlockUndo(const uint256& hash, const CBlockUndo& undo);
+    bool EraseBlockUndo(const uint256& hash);
+    bool ReadPruneHeight(int& nPruneHeightRet);
+    bool WritePruneHeight(int nPruneHeightIn);
+    bool ReadPrunedTxs(unsigned int nFile,
+                       std::vector<unsigned int>& vRecordPosRet);
+    bool WritePrunedTxs(unsigned int nFile,
+                        const std::vector<unsigned int>& vRecordPos);
+    bool ErasePrunedTxs(unsigned int nFile);
     bool ContainsTx(uint256 hash);
     bool ReadDiskTx(uint256 hash, CTransaction& tx, CTxIndex& txindex);
     bool ReadDiskTx(uint256 hash, CTransaction& tx);
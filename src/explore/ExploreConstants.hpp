@@ -36,6 +36,25 @@ const std::string EXPLORE_KEY = "EXPK";
 const std::string EXPLORE_SENTINEL_LABEL = "";
 const exploreKey_t EXPLORE_SENTINEL(EXPLORE_KEY, EXPLORE_SENTINEL_LABEL);
 
+// The value of the sentinel is the schema of the explore records.
+//    Schema 0 keyed records by address string, schema 1 by interned
+//    address ID with fixed width big endian fields. Records of an older
+//    schema are reindexed on start.
+const int EXPLORE_SCHEMA_VERSION = 1;
+
+// Explore Tip, the hash of the last block the records were connected to.
+//    It is written in the explore batch, so if it differs from the best
+//    chain on start, the records are reindexed.
+const std::string EXPLORE_TIP_LABEL = "ETIP";
+const exploreKey_t EXPLORE_TIP(EXPLORE_KEY, EXPLORE_TIP_LABEL);
+
+// Addr ID (interned addresses)
+const std::string ADDR_ID_LABEL = "AID";
+const exploreKey_t ADDR_ID(EXPLORE_KEY, ADDR_ID_LABEL);
+
+const std::string ADDR_ID_NEXT_LABEL = "AIDN";
+const exploreKey_t ADDR_ID_NEXT(EXPLORE_KEY, ADDR_ID_NEXT_LABEL);
+
 // Addr Qty
 const std::string ADDR_QTY_INPUT_LABEL = "AQI";
 const exploreKey_t ADDR_QTY_INPUT(EXPLORE_KEY, ADDR_QTY_INPUT_LABEL);
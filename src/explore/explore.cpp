@@ -26,7 +26,8 @@ int64_t nMaxDust = chainParams.DEFAULT_MAXDUST;
 // and are used to lookup addresses with these balances in the database.
 // Values are the number of addresses for each balance. This allows to iterate
 // over the balances to find, say, the top 100 addresses.
-MapBalanceCounts mapAddressBalances;
+static boost::shared_ptr<MapBalanceCounts> pmapAddressBalances(
+                                                   new MapBalanceCounts());
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -95,6 +96,22 @@ void ExploreGetDestinations(const vector<CTxOut>& vout, VecDest& vret)
 }
 
 
+boost::shared_ptr<const MapBalanceCounts> GetAddressBalances()
+{
+    return pmapAddressBalances;
+}
+
+MapBalanceCounts& GetAddressBalancesForWrite()
+{
+    // views only ever drop their references without cs_main
+    if (pmapAddressBalances.use_count() > 1)
+    {
+        pmapAddressBalances.reset(
+                         new MapBalanceCounts(*pmapAddressBalances));
+    }
+    return *pmapAddressBalances;
+}
+
 void UpdateMapAddressBalances(const MapBalanceCounts& mapAddressBalancesAdd,
                               const set<int64_t>& setAddressBalancesRemove,
                               MapBalanceCounts& mapAddressBalancesRet)
@@ -1113,7 +1130,7 @@ bool ExploreConnectTx(CTxDB& txdb,
 
     UpdateMapAddressBalances(mapAddressBalancesAdd,
                              setAddressBalancesRemove,
-                             mapAddressBalances);
+                             GetAddressBalancesForWrite());
 
     return true;
 }
@@ -1155,7 +1172,7 @@ bool ExploreConnectBlock(CTxDB& txdb, const CBlock *const block)
         }
         nVtx += 1;
     }
-    return true;
+    return txdb.WriteExploreTip(h);
 }
 
 bool ExploreDisconnectOutput(CTxDB& txdb,
@@ -1534,13 +1551,12 @@ bool ExploreDisconnectOutput(CTxDB& txdb,
 bool ExploreDisconnectInput(CTxDB& txdb,
                             const CTransaction& tx,
                             const unsigned int n,
-                            const MapPrevTx& mapInputs,
+                            const CTxOut& txOut,
                             const uint256& txid,
                             MapBalanceCounts& mapAddressBalancesAddRet,
                             set<int64_t>& setAddressBalancesRemoveRet)
 {
     const CTxIn& txIn = tx.vin[n];
-    const CTxOut txOut = GetOutputFor(txIn, mapInputs);
     const int64_t nValue = txOut.nValue;
     const CScript &script = txOut.scriptPubKey;
     txnouttype typetxo;
@@ -1964,18 +1980,30 @@ bool ExploreDisconnectInput(CTxDB& txdb,
     return true;
 }
 
-bool ExploreDisconnectTx(CTxDB& txdb, const CTransaction &tx)
+bool ExploreDisconnectTx(CTxDB& txdb,
+                         const CTransaction &tx,
+                         const vector<CTxOut>* pvSpent)
 {
     MapBalanceCounts mapAddressBalancesAdd;
     set<int64_t> setAddressBalancesRemove;
 
-    map<uint256, CTxIndex> mapUnused;
-    bool fInvalid;
-    MapPrevTx mapInputs;
-    if (!tx.FetchInputs(txdb, mapUnused, true, false, mapInputs, fInvalid))
+    // without an undo record, look up the outputs the inputs spent
+    vector<CTxOut> vSpentFetched;
+    if (!pvSpent && !tx.IsCoinBase())
     {
-        // This should never happen: couldn't fetch inputs
-        return error("ExploreDisconnectTx() : TSNH couldn't fetch inputs");
+        map<uint256, CTxIndex> mapUnused;
+        bool fInvalid;
+        MapPrevTx mapInputs;
+        if (!tx.FetchInputs(txdb, mapUnused, true, false, mapInputs, fInvalid))
+        {
+            // This should never happen: couldn't fetch inputs
+            return error("ExploreDisconnectTx() : TSNH couldn't fetch inputs");
+        }
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            vSpentFetched.push_back(GetOutputFor(txin, mapInputs));
+        }
+        pvSpent = &vSpentFetched;
     }
 
     uint256 txid = tx.GetHash();
@@ -1991,10 +2019,16 @@ bool ExploreDisconnectTx(CTxDB& txdb, const CTransaction &tx)
 
     if (!tx.IsCoinBase())
     {
+        if (pvSpent->size() != tx.vin.size())
+        {
+            // This should never happen: undo record doesn't match the tx
+            return error("ExploreDisconnectTx() : TSNH %" PRIszu " spent outputs "
+                         "for %" PRIszu " inputs", pvSpent->size(), tx.vin.size());
+        }
         // inputs (iterate backwards)
         for (int n = tx.vin.size() - 1; n >= 0; --n)
         {
-            ExploreDisconnectInput(txdb, tx, (unsigned int)n, mapInputs, txid,
+            ExploreDisconnectInput(txdb, tx, (unsigned int)n, (*pvSpent)[n], txid,
                                    mapAddressBalancesAdd,
                                    setAddressBalancesRemove);
         }
@@ -2004,22 +2038,111 @@ bool ExploreDisconnectTx(CTxDB& txdb, const CTransaction &tx)
 
     UpdateMapAddressBalances(mapAddressBalancesAdd,
                              setAddressBalancesRemove,
-                             mapAddressBalances);
+                             GetAddressBalancesForWrite());
 
     return true;
 }
 
 
-bool ExploreDisconnectBlock(CTxDB& txdb, const CBlock *const block)
+bool ExploreDisconnectBlock(CTxDB& txdb,
+                            const CBlock *const block,
+                            const vector<CTxOut>* pvSpent)
 {
+    // the spent outputs of the block's txs end here, in block order
+    unsigned int nEnd = pvSpent ? pvSpent->size() : 0;
+
     // iterate backwards through everything on the disconnect
     BOOST_REVERSE_FOREACH(const CTransaction& tx, block->vtx)
     {
-        if (!ExploreDisconnectTx(txdb, tx))
+        if (!pvSpent)
+        {
+            if (!ExploreDisconnectTx(txdb, tx))
+            {
+                return false;
+            }
+            continue;
+        }
+        unsigned int nInputs = tx.IsCoinBase() ? 0 : tx.vin.size();
+        if (nInputs > nEnd)
+        {
+            // This should never happen: undo record doesn't match the block
+            return error("ExploreDisconnectBlock() : TSNH too few spent outputs");
+        }
+        vector<CTxOut> vSpentTx(pvSpent->begin() + (nEnd - nInputs),
+                                pvSpent->begin() + nEnd);
+        nEnd -= nInputs;
+        if (!ExploreDisconnectTx(txdb, tx, &vSpentTx))
         {
             return false;
         }
     }
-    return true;
+    return txdb.WriteExploreTip(block->hashPrevBlock);
 }
 
+// After a crash between the index batch and the explore batch, the records
+//    are a few blocks behind, or on a branch the index left in a reorg.
+//    The blocks of that branch are disconnected down to the fork, then the
+//    best chain is connected from there. Blocks of the branch have no undo
+//    record any more, so their spent outputs are looked up again, which
+//    fails if they spent each other.
+bool ExploreCatchUp(CTxDB& txdb)
+{
+    uint256 hashExploreTip;
+    if (!txdb.ReadExploreTip(hashExploreTip))
+    {
+        return error("ExploreCatchUp() : no explore tip");
+    }
+    if (hashExploreTip == hashBestChain)
+    {
+        return true;
+    }
+    CMapBlockIndex::const_iterator mi = mapBlockIndex.find(hashExploreTip);
+    if ((mi == mapBlockIndex.end()) || !(*mi).second)
+    {
+        return error("ExploreCatchUp() : explore tip %s not in the index",
+                     hashExploreTip.ToString().c_str());
+    }
+    CBlockMemIndex* pmemIndex = (*mi).second;
+
+    int nDisconnected = 0;
+    while (!pmemIndex->IsInMainChain())
+    {
+        CBlock block;
+        if (!block.ReadFromDisk(pmemIndex, true))
+        {
+            return error("ExploreCatchUp() : can't read block %s",
+                         pmemIndex->GetBlockHash().ToString().c_str());
+        }
+        CBlockUndo undo;
+        bool fUndo = txdb.ReadBlockUndo(pmemIndex->GetBlockHash(), undo);
+        if (!ExploreDisconnectBlock(txdb, &block, fUndo ? &undo.vSpent : NULL))
+        {
+            return error("ExploreCatchUp() : can't disconnect block %s",
+                         pmemIndex->GetBlockHash().ToString().c_str());
+        }
+        pmemIndex = pmemIndex->pprev;
+        nDisconnected += 1;
+    }
+
+    int nConnected = 0;
+    while (pmemIndex != pmemIndexBest)
+    {
+        pmemIndex = pmemIndex->pnext;
+        CBlock block;
+        if (!block.ReadFromDisk(pmemIndex, true))
+        {
+            return error("ExploreCatchUp() : can't read block %s",
+                         pmemIndex->GetBlockHash().ToString().c_str());
+        }
+        if (!ExploreConnectBlock(txdb, &block))
+        {
+            return error("ExploreCatchUp() : can't connect block %s",
+                         pmemIndex->GetBlockHash().ToString().c_str());
+        }
+        nConnected += 1;
+    }
+
+    printf("ExploreCatchUp(): disconnected %d and connected %d blocks\n",
+           nDisconnected, nConnected);
+    return true;
+}
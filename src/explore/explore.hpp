@@ -12,8 +12,11 @@
 #include "ExploreInOutList.hpp"
 #include "ExploreTx.hpp"
 
+#include <boost/shared_ptr.hpp>
+
 class CBlock;
 class CTransaction;
+class CTxOut;
 
 
 extern int64_t nMaxDust;
@@ -22,7 +25,11 @@ extern bool fWithExploreAPI;
 extern bool fDebugExplore;
 extern bool fReindexExplore;
 
-extern MapBalanceCounts mapAddressBalances;
+// The rich list counts, shared with chain views. ** Caller must hold
+//    cs_main. ** The map is copied before a write only while a view
+//    still holds it.
+boost::shared_ptr<const MapBalanceCounts> GetAddressBalances();
+MapBalanceCounts& GetAddressBalancesForWrite();
 
 
 void UpdateMapAddressBalances(const MapBalanceCounts& mapAddressBalancesAdd,
@@ -54,7 +61,7 @@ bool ExploreDisconnectOutput(CTxDB& txdb,
 bool ExploreDisconnectInput(CTxDB& txdb,
                             const CTransaction& tx,
                             const unsigned int n,
-                            const MapPrevTx& mapInputs,
+                            const CTxOut& txOut,
                             const uint256& txid,
                             MapBalanceCounts& mapAddressBalancesAddRet,
                             std::set<int64_t>& setAddressBalancesRemoveRet);
@@ -62,8 +69,18 @@ bool ExploreDisconnectInput(CTxDB& txdb,
 bool ExploreConnectTx(CTxDB& txdb, const CTransaction &tx);
 bool ExploreConnectBlock(CTxDB& txdb, const CBlock *const block);
 
-bool ExploreDisconnectTx(CTxDB& txdb, const CTransaction &tx);
-bool ExploreDisconnectBlock(CTxDB& txdb, const CBlock *const block);
+// pvSpent are the outputs spent by the inputs, from the block's undo
+// record, looked up again when NULL
+bool ExploreDisconnectTx(CTxDB& txdb,
+                         const CTransaction &tx,
+                         const std::vector<CTxOut>* pvSpent = NULL);
+bool ExploreDisconnectBlock(CTxDB& txdb,
+                            const CBlock *const block,
+                            const std::vector<CTxOut>* pvSpent = NULL);
+
+// Brings the records from their tip (EXPLORE_TIP) to the best chain.
+//    False if they must be reindexed instead.
+bool ExploreCatchUp(CTxDB& txdb);
 
 
 #endif  // _STEALTHEXPLORE_H_
@@ -0,0 +1,238 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "compactblock.h"
+
+#include <map>
+
+using namespace std;
+
+
+#define SIPROUND                                                    \
+    do                                                              \
+    {                                                               \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                    \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                    \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+    } while (0)
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+// SipHash-2-4 of a 32 byte value
+static uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
+{
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t m = val.Get64(i);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    uint64_t m = ((uint64_t)32) << 59;
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#undef SIPROUND
+#undef ROTL64
+
+
+CCompactBlock::CCompactBlock(const CBlock& block)
+{
+    header = block;
+    header.vtx.clear();
+    header.vMerkleTree.clear();
+    nNonce = GetRand(std::numeric_limits<uint64_t>::max());
+
+    uint64_t k0, k1;
+    GetKeys(k0, k1);
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction& tx = block.vtx[i];
+        // the coinbase and coinstake are never in a mempool
+        if (tx.IsCoinBase() || tx.IsCoinStake())
+        {
+            vPrefilled.push_back(CPrefilledTransaction(i, tx));
+        }
+        else
+        {
+            vShortIDs.push_back(GetShortID(k0, k1, tx.GetHash()));
+        }
+    }
+}
+
+void CCompactBlock::GetKeys(uint64_t& k0Ret, uint64_t& k1Ret) const
+{
+    uint256 hashBlock = header.GetHash();
+    uint256 hashKey = Hash(BEGIN(hashBlock), END(hashBlock),
+                           BEGIN(nNonce), END(nNonce));
+    k0Ret = hashKey.Get64(0);
+    k1Ret = hashKey.Get64(1);
+}
+
+uint64_t CCompactBlock::GetShortID(uint64_t k0,
+                                   uint64_t k1,
+                                   const uint256& txid)
+{
+    return SipHashUint256(k0, k1, txid);
+}
+
+
+CPartialBlock::ReadStatus CPartialBlock::Init(const CCompactBlock& cmpctblock,
+                                              CTxMemPool& pool)
+{
+    // each transaction is more than 60 bytes
+    static const unsigned int nMaxTx = chainParams.MAX_BLOCK_SIZE / 60;
+
+    unsigned int nTx = cmpctblock.GetTransactionCount();
+    if (cmpctblock.header.IsNull() || (nTx > nMaxTx))
+    {
+        return READ_INVALID;
+    }
+
+    header = cmpctblock.header;
+    vtx.assign(nTx, CTransaction());
+    vHave.assign(nTx, false);
+    nPrefilled = 0;
+    nFromPool = 0;
+
+    BOOST_FOREACH(const CPrefilledTransaction& prefilled,
+                  cmpctblock.vPrefilled)
+    {
+        if ((prefilled.nIndex >= nTx) || vHave[prefilled.nIndex])
+        {
+            return READ_INVALID;
+        }
+        vtx[prefilled.nIndex] = prefilled.tx;
+        vHave[prefilled.nIndex] = true;
+        nPrefilled += 1;
+    }
+
+    // short ids fill the remaining positions in order
+    map<uint64_t, unsigned int> mapShortIDs;
+    unsigned int nShortID = 0;
+    for (unsigned int i = 0; i < nTx; i++)
+    {
+        if (vHave[i])
+        {
+            continue;
+        }
+        if (!mapShortIDs.insert(make_pair(cmpctblock.vShortIDs[nShortID],
+                                          i)).second)
+        {
+            // two transactions of the block share a short id
+            return READ_FAILED;
+        }
+        nShortID += 1;
+    }
+
+    if (mapShortIDs.empty())
+    {
+        return READ_OK;
+    }
+
+    uint64_t k0, k1;
+    cmpctblock.GetKeys(k0, k1);
+
+    // positions claimed by more than one mempool transaction
+    vector<bool> vCollided(nTx, false);
+    {
+        LOCK(pool.cs);
+        map<uint256, CTransaction>::const_iterator it;
+        for (it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it)
+        {
+            uint64_t nShort = CCompactBlock::GetShortID(k0, k1, (*it).first);
+            map<uint64_t, unsigned int>::const_iterator mi =
+                                                   mapShortIDs.find(nShort);
+            if (mi == mapShortIDs.end())
+            {
+                continue;
+            }
+            unsigned int nIndex = (*mi).second;
+            if (vCollided[nIndex])
+            {
+                continue;
+            }
+            if (vHave[nIndex])
+            {
+                // ask the peer instead of guessing
+                vHave[nIndex] = false;
+                vtx[nIndex] = CTransaction();
+                vCollided[nIndex] = true;
+                nFromPool -= 1;
+                continue;
+            }
+            vtx[nIndex] = (*it).second;
+            vHave[nIndex] = true;
+            nFromPool += 1;
+        }
+    }
+
+    return READ_OK;
+}
+
+void CPartialBlock::GetMissing(vector<unsigned int>& vIndexesRet) const
+{
+    vIndexesRet.clear();
+    for (unsigned int i = 0; i < vHave.size(); i++)
+    {
+        if (!vHave[i])
+        {
+            vIndexesRet.push_back(i);
+        }
+    }
+}
+
+CPartialBlock::ReadStatus CPartialBlock::Fill(
+                                  const vector<CTransaction>& vtxMissing,
+                                  CBlock& blockRet) const
+{
+    blockRet = header;
+    blockRet.vtx = vtx;
+
+    unsigned int nMissing = 0;
+    for (unsigned int i = 0; i < vHave.size(); i++)
+    {
+        if (vHave[i])
+        {
+            continue;
+        }
+        if (nMissing >= vtxMissing.size())
+        {
+            return READ_INVALID;
+        }
+        blockRet.vtx[i] = vtxMissing[nMissing];
+        nMissing += 1;
+    }
+    if (nMissing != vtxMissing.size())
+    {
+        return READ_INVALID;
+    }
+
+    // a short id matched the wrong mempool transaction
+    if (blockRet.BuildMerkleTree() != header.hashMerkleRoot)
+    {
+        return READ_FAILED;
+    }
+
+    return READ_OK;
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COMPACTBLOCK_H
+#define COMPACTBLOCK_H
+
+#include "main.h"
+
+#include <vector>
+
+//
+// Compact block relay
+//
+// A compact block carries the block header and signature, the coinbase and
+// coinstake in full, and a keyed 64 bit short id for every other
+// transaction. The receiver rebuilds the block from its memory pool and asks
+// for whatever it is missing with "getblocktxn".
+//
+//   sendcmpct    : peer wants new blocks pushed as "cmpctblock"
+//   cmpctblock   : CCompactBlock
+//   getblocktxn  : CBlockTransactionsRequest
+//   blocktxn     : CBlockTransactions
+//
+
+class CPrefilledTransaction
+{
+public:
+    // position in the block
+    unsigned int nIndex;
+    CTransaction tx;
+
+    CPrefilledTransaction()
+    {
+        nIndex = 0;
+    }
+
+    CPrefilledTransaction(unsigned int nIndexIn, const CTransaction& txIn)
+    {
+        nIndex = nIndexIn;
+        tx = txIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nIndex);
+        READWRITE(tx);
+    )
+};
+
+
+class CCompactBlock
+{
+public:
+    static const uint64_t COMPACT_VERSION = 1;
+
+    // header and vchBlockSig, vtx is empty
+    CBlock header;
+    uint64_t nNonce;
+    std::vector<uint64_t> vShortIDs;
+    std::vector<CPrefilledTransaction> vPrefilled;
+
+    CCompactBlock()
+    {
+        nNonce = 0;
+    }
+
+    explicit CCompactBlock(const CBlock& block);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(header);
+        READWRITE(nNonce);
+        READWRITE(vShortIDs);
+        READWRITE(vPrefilled);
+    )
+
+    unsigned int GetTransactionCount() const
+    {
+        return vShortIDs.size() + vPrefilled.size();
+    }
+
+    // SipHash keys, derived from the block hash and nNonce
+    void GetKeys(uint64_t& k0Ret, uint64_t& k1Ret) const;
+
+    static uint64_t GetShortID(uint64_t k0, uint64_t k1, const uint256& txid);
+};
+
+
+class CBlockTransactionsRequest
+{
+public:
+    uint256 hashBlock;
+    std::vector<unsigned int> vIndexes;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vIndexes);
+    )
+};
+
+
+class CBlockTransactions
+{
+public:
+    uint256 hashBlock;
+    std::vector<CTransaction> vtx;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vtx);
+    )
+};
+
+
+// A block being rebuilt from a compact block.
+class CPartialBlock
+{
+public:
+    enum ReadStatus
+    {
+        READ_OK,
+        READ_INVALID,     // peer sent something malformed
+        READ_FAILED       // short id collision, fall back to full block
+    };
+
+    CBlock header;
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vHave;
+    unsigned int nPrefilled;
+    unsigned int nFromPool;
+    int64_t nTimeReceived;
+
+    CPartialBlock()
+    {
+        nPrefilled = 0;
+        nFromPool = 0;
+        nTimeReceived = 0;
+    }
+
+    ReadStatus Init(const CCompactBlock& cmpctblock, CTxMemPool& pool);
+
+    void GetMissing(std::vector<unsigned int>& vIndexesRet) const;
+
+    ReadStatus Fill(const std::vector<CTransaction>& vtxMissing,
+                    CBlock& blockRet) const;
+};
+
+#endif  /* COMPACTBLOCK_H */
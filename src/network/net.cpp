@@ -79,7 +79,7 @@ CCriticalSection cs_vNodes;
 map<CInv, CDataStream> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
-map<CInv, int64_t> mapAlreadyAskedFor;
+limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
 static deque<string> vOneShots;
 CCriticalSection cs_vOneShots;
@@ -138,6 +138,17 @@ void CNode::PushGetBlocks(CBlockMemIndex* pmemIndexBegin, uint256 hashEnd)
     PushMessage("getblocks", locator, hashEnd);
 }
 
+void CNode::PushGetHeaders(const CBlockLocator& locator, uint256 hashEnd)
+{
+    if (fDebugNet)
+    {
+        printf("PushGetHeaders(): %s to %s\n",
+               addrName.c_str(),
+               hashEnd.ToString().c_str());
+    }
+    PushMessage("getheaders", locator, hashEnd);
+}
+
 // find 'best' local address for a particular peer
 bool GetLocal(CService& addr, const CNetAddr* paddrPeer)
 {
@@ -877,6 +888,25 @@ void CNode::copyStats(CNodeStats &stats)
     X(nReleaseTime);
     X(nStartingHeight);
     X(nMisbehavior);
+    // The sync state and getdata queue are guarded by cs_main, which the
+    //    message handler holds while it works, so they are left out
+    //    rather than waited for.
+    stats.fSyncStats = false;
+    stats.nSyncHeight = -1;
+    stats.nBlocksInFlight = 0;
+    stats.nAskFor = 0;
+    stats.nInventoryBytes = GetInventoryMemoryUsage();
+    {
+        TRY_LOCK(cs_main, lockMain);
+        if (lockMain)
+        {
+            stats.fSyncStats = true;
+            X(nSyncHeight);
+            stats.nBlocksInFlight = mapBlocksInFlight.size();
+            stats.nAskFor = queueAskFor.size();
+            stats.nInventoryBytes += queueAskFor.size() * sizeof(AskForEntry);
+        }
+    }
 }
 #undef X
 
@@ -2619,6 +2649,9 @@ void StartNode(void* parg)
     printf("StartNode(): pnodeLocalHost addr: %s\n",
            pnodeLocalHost->addr.ToString().c_str());
 
+    // no message threads yet, so cs_main isn't needed
+    mapAlreadyAskedFor.max_size(chainParams.MAX_ALREADY_ASKED_FOR);
+
     Discover();
 
     //
@@ -2795,6 +2828,18 @@ bool StopNode()
     {
         printf("ThreadStakeMinter still running\n");
     }
+    if (vnThreadsRunning[THREAD_NOTIFIER] > 0)
+    {
+        printf("ThreadNotifier still running\n");
+    }
+    if (vnThreadsRunning[THREAD_DUMPMEMPOOL] > 0)
+    {
+        printf("ThreadMempoolFile still running\n");
+    }
+    if (vnThreadsRunning[THREAD_PRUNE] > 0)
+    {
+        printf("ThreadPruneBlockFiles still running\n");
+    }
 
     while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 ||
            vnThreadsRunning[THREAD_RPCHANDLER] > 0)
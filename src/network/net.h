@@ -6,6 +6,7 @@
 #define BITCOIN_NET_H
 
 #include <deque>
+#include <queue>
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
 #include <openssl/rand.h>
@@ -14,7 +15,8 @@
 #include <arpa/inet.h>
 #endif
 
-#include "mruset.h"
+#include "bloom.h"
+#include "limitedmap.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
@@ -23,6 +25,7 @@
 class CRequestTracker;
 class CNode;
 class CBlockMemIndex;
+class CBlockLocator;
 
 extern const CAddress CADDR_NULL;
 
@@ -126,6 +129,9 @@ enum threadId
     THREAD_RPCHANDLER,
     THREAD_STAKEMINTER,
     THREAD_QPOSMINTER,
+    THREAD_NOTIFIER,
+    THREAD_DUMPMEMPOOL,
+    THREAD_PRUNE,
 
     THREAD_MAX
 };
@@ -144,7 +150,7 @@ extern CCriticalSection cs_vNodes;
 extern std::map<CInv, CDataStream> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
-extern std::map<CInv, int64_t> mapAlreadyAskedFor;
+extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
 
 
@@ -163,6 +169,12 @@ public:
     int64_t nReleaseTime;
     int nStartingHeight;
     int nMisbehavior;
+    // false if cs_main was busy, then the fields it guards are not set
+    bool fSyncStats;
+    int nSyncHeight;
+    int nBlocksInFlight;
+    int nAskFor;
+    uint64_t nInventoryBytes;
 };
 
 
@@ -228,6 +240,15 @@ public:
     int64_t nLastGetBlocks;
     int nStartingHeight;
 
+    // headers-first sync (guarded by cs_main)
+    // highest block height this peer is known to have
+    int nSyncHeight;
+    // blocks requested from this peer: hash -> request time (micros)
+    std::map<uint256, int64_t> mapBlocksInFlight;
+
+    // peer asked for new blocks as "cmpctblock" (set by sendcmpct)
+    bool fSendCompact;
+
     // flood relay
     std::vector<CAddress> vAddrToSend;
     std::set<CAddress> setAddrKnown;
@@ -236,12 +257,16 @@ public:
     uint256 hashCheckpointKnown; // ppcoin: known sent sync-checkpoint
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
-    std::multimap<int64_t, CInv> mapAskFor;
+    // getdata requests ordered by the earliest time they may be sent
+    typedef std::pair<int64_t, CInv> AskForEntry;
+    std::priority_queue<AskForEntry,
+                        std::vector<AskForEntry>,
+                        std::greater<AskForEntry> > queueAskFor;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK,  INIT_PROTO_VERSION), vRecv(SER_NETWORK, INIT_PROTO_VERSION)
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK,  INIT_PROTO_VERSION), vRecv(SER_NETWORK, INIT_PROTO_VERSION), filterInventoryKnown(chainParams.MAX_INVENTORY_KNOWN, 0.000001)
     {
         nServices = 0;
         hSocket = hSocketIn;
@@ -271,10 +296,11 @@ public:
         hashLastGetBlocksEnd = 0;
         nLastGetBlocks = 0;
         nStartingHeight = -1;
+        nSyncHeight = -1;
+        fSendCompact = false;
         fGetAddr = false;
         nMisbehavior = 0;
         hashCheckpointKnown = 0;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
 
         printf("CNode(): %s-bound pfrom-addr %s\n",
                fInbound ? "in" : "out",
@@ -340,16 +366,31 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.hash);
         }
     }
 
+    bool HasInventoryKnown(const CInv& inv)
+    {
+        LOCK(cs_inventory);
+        return filterInventoryKnown.contains(inv.hash);
+    }
+
+    // bytes held for inventory relay, without the pending getdata
+    //    requests in queueAskFor, which is guarded by cs_main
+    uint64_t GetInventoryMemoryUsage()
+    {
+        LOCK(cs_inventory);
+        return filterInventoryKnown.GetMemoryUsage() +
+               vInventoryToSend.capacity() * sizeof(CInv);
+    }
+
     bool PushInventory(const CInv& inv)
     {
         static const size_t nMaxInvSize = (size_t)(2 * chainParams.GETBLOCKS_LIMIT);
         {
             LOCK(cs_inventory);
-            if (setInventoryKnown.count(inv))
+            if (filterInventoryKnown.contains(inv.hash))
             {
                 if (fDebugNet)
                 {
@@ -379,9 +420,23 @@ public:
     void AskFor(const CInv& inv)
     {
         static int64_t nLastTime;
-        // We're using mapAskFor as a priority queue,
-        // the key is the earliest time the request can be sent
-        int64_t nRequestTime = mapAlreadyAskedFor[inv];
+        if (queueAskFor.size() >= chainParams.MAX_ASKFOR_PER_PEER)
+        {
+            if (fDebugNet)
+            {
+                printf("AskFor(): %s queue full, dropping %s\n",
+                       addrName.c_str(), inv.ToString().c_str());
+            }
+            return;
+        }
+        // The key of queueAskFor is the earliest time the request can be sent
+        int64_t nRequestTime = 0;
+        limitedmap<CInv, int64_t>::const_iterator it =
+                                               mapAlreadyAskedFor.find(inv);
+        if (it != mapAlreadyAskedFor.end())
+        {
+            nRequestTime = (*it).second;
+        }
         // Make sure not to reuse time indexes to keep things in the same order
         // Wait at least 1 second
         int64_t nNow = (GetTime() - 1) * 1000000;
@@ -405,7 +460,7 @@ public:
         // Each retry is half of target spacing
         int nSpacing = GetTargetSpacing(nBestHeight);
         nRequestTime = std::max(nRequestTime + (nSpacing * 1000000)/2, nNow);
-        mapAskFor.insert(std::make_pair(nRequestTime, inv));
+        queueAskFor.push(std::make_pair(nRequestTime, inv));
     }
 
 
@@ -695,6 +750,7 @@ public:
 
 
     void PushGetBlocks(CBlockMemIndex* pmemIndexBegin, uint256 hashEnd);
+    void PushGetHeaders(const CBlockLocator& locator, uint256 hashEnd);
     bool IsSubscribed(unsigned int nChannel);
     void Subscribe(unsigned int nChannel, unsigned int nHops=0);
     void CancelSubscribe(unsigned int nChannel);
@@ -0,0 +1,656 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notifier.h"
+#include "main.h"
+#include "net.h"
+#include "netbase.h"
+#include "QPRegistry.hpp"
+
+#undef printf
+#include <boost/asio.hpp>
+#if BOOST_VERSION >= 106500
+    #include <boost/bind/bind.hpp>
+#else
+    #include <boost/bind.hpp>
+#endif
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <list>
+#include <set>
+
+#define printf OutputDebugStringF
+
+using namespace std;
+namespace asio = boost::asio;
+
+#define BOOST_ASIO_HAS_IO_SERVICE (BOOST_ASIO_VERSION < 102803)
+#define BOOST_ASIO_HAS_MAX_CONNECTIONS (BOOST_ASIO_VERSION < 102803)
+
+#if BOOST_ASIO_HAS_MAX_CONNECTIONS
+static const int NOTIFY_BACKLOG = asio::socket_base::max_connections;
+#else
+static const int NOTIFY_BACKLOG = asio::socket_base::max_listen_connections;
+#endif
+
+#if BOOST_ASIO_HAS_IO_SERVICE
+typedef asio::io_service NotifyIOContext;
+#else
+typedef asio::io_context NotifyIOContext;
+#endif
+
+typedef boost::shared_ptr<const string> FramePtr;
+
+
+class CNotifySubscriber
+{
+public:
+    virtual ~CNotifySubscriber() {}
+    virtual void Deliver(const string& strTopic, const FramePtr& pframe) = 0;
+    virtual void Close() = 0;
+};
+
+typedef boost::shared_ptr<CNotifySubscriber> SubscriberPtr;
+
+// guards the members below, never held while taking another lock
+static CCriticalSection cs_notifier;
+static NotifyIOContext* pioNotify = NULL;
+static int nSubscribers = 0;
+static map<string, uint32_t> mapSequence;
+static unsigned int nLastQPoSRound = 0;
+static unsigned int nLastQPoSSlot = 0;
+
+// only touched on the notifier thread
+static list<SubscriberPtr> listSubscribers;
+static size_t nNotifyMaxQueue = 0;
+
+
+static void AddSubscriber(const SubscriberPtr& psub)
+{
+    listSubscribers.push_back(psub);
+    LOCK(cs_notifier);
+    nSubscribers = listSubscribers.size();
+}
+
+static void RemoveSubscriber(const CNotifySubscriber* psub)
+{
+    list<SubscriberPtr>::iterator it;
+    for (it = listSubscribers.begin(); it != listSubscribers.end(); ++it)
+    {
+        if ((*it).get() == psub)
+        {
+            listSubscribers.erase(it);
+            break;
+        }
+    }
+    LOCK(cs_notifier);
+    nSubscribers = listSubscribers.size();
+}
+
+static void DeliverFrame(const string& strTopic, const FramePtr& pframe)
+{
+    BOOST_FOREACH(const SubscriberPtr& psub, listSubscribers)
+    {
+        psub->Deliver(strTopic, pframe);
+    }
+}
+
+
+/**
+ * One subscriber. Frames wait in a queue of at most nNotifyMaxQueue bytes
+ * and are written one at a time, frames that do not fit are dropped.
+ */
+template <typename Protocol>
+class CNotifySession :
+        public CNotifySubscriber,
+        public boost::enable_shared_from_this< CNotifySession<Protocol> >
+{
+public:
+    typename Protocol::socket socket;
+
+    CNotifySession(NotifyIOContext& io) :
+        socket(io),
+        buf(1024)
+    {
+        nQueued = 0;
+        nDropped = 0;
+        fWriting = false;
+        fAllTopics = true;
+    }
+
+    void Start()
+    {
+        ReadTopics();
+    }
+
+    void Deliver(const string& strTopic, const FramePtr& pframe)
+    {
+        if (!fAllTopics && !setTopics.count(strTopic))
+        {
+            return;
+        }
+        if ((nQueued + pframe->size()) > nNotifyMaxQueue)
+        {
+            if (nDropped++ == 0)
+            {
+                printf("Notifier: subscriber is behind, dropping frames\n");
+            }
+            return;
+        }
+        if (nDropped > 0)
+        {
+            printf("Notifier: subscriber caught up, %u frames dropped\n",
+                   nDropped);
+            nDropped = 0;
+        }
+        queueFrames.push_back(pframe);
+        nQueued += pframe->size();
+        if (!fWriting)
+        {
+            Write();
+        }
+    }
+
+    void Close()
+    {
+        boost::system::error_code ec;
+        socket.close(ec);
+    }
+
+private:
+    std::deque<FramePtr> queueFrames;
+    size_t nQueued;
+    unsigned int nDropped;
+    bool fWriting;
+    set<string> setTopics;
+    bool fAllTopics;
+    asio::streambuf buf;
+
+    void Write()
+    {
+        fWriting = true;
+        asio::async_write(
+                socket, asio::buffer(*queueFrames.front()),
+                boost::bind(&CNotifySession::HandleWrite,
+                            this->shared_from_this(),
+                            boost::asio::placeholders::error));
+    }
+
+    void HandleWrite(const boost::system::error_code& error)
+    {
+        nQueued -= queueFrames.front()->size();
+        queueFrames.pop_front();
+        if (error)
+        {
+            queueFrames.clear();
+            nQueued = 0;
+            fWriting = false;
+            Close();
+            RemoveSubscriber(this);
+            return;
+        }
+        if (queueFrames.empty())
+        {
+            fWriting = false;
+            return;
+        }
+        Write();
+    }
+
+    void ReadTopics()
+    {
+        asio::async_read_until(
+                socket, buf, '\n',
+                boost::bind(&CNotifySession::HandleReadTopics,
+                            this->shared_from_this(),
+                            boost::asio::placeholders::error));
+    }
+
+    void HandleReadTopics(const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            // the subscriber is gone, or sent a line that is too long
+            Close();
+            RemoveSubscriber(this);
+            return;
+        }
+        std::istream stream(&buf);
+        string strLine;
+        std::getline(stream, strLine);
+        std::istringstream streamTopics(strLine);
+        setTopics.clear();
+        string strTopic;
+        while (streamTopics >> strTopic)
+        {
+            setTopics.insert(strTopic);
+        }
+        fAllTopics = setTopics.empty();
+        ReadTopics();
+    }
+};
+
+
+// Like -rpcallowip: subscribers on loopback are always allowed,
+//    others only if they match a -notifyallowip pattern.
+static bool NotifyAddressAllowed(const asio::ip::address& address)
+{
+    // CNetAddr treats IPv4-mapped IPv6 addresses as IPv4
+    CNetAddr addr(address.to_string());
+    if (addr.IsLocal())
+    {
+        return true;
+    }
+    const string strAddress = addr.ToStringIP();
+    BOOST_FOREACH(const string& strAllow, mapMultiArgs["-notifyallowip"])
+    {
+        if (WildcardMatch(strAddress, strAllow))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool SubscriberAllowed(const asio::ip::tcp::socket& socket)
+{
+    boost::system::error_code ec;
+    asio::ip::tcp::endpoint endpoint = socket.remote_endpoint(ec);
+    if (ec)
+    {
+        return false;
+    }
+    if (!NotifyAddressAllowed(endpoint.address()))
+    {
+        printf("Notifier: refused subscriber from %s\n",
+               endpoint.address().to_string().c_str());
+        return false;
+    }
+    return true;
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+// the permissions of the socket file decide who may connect
+static bool SubscriberAllowed(const asio::local::stream_protocol::socket&)
+{
+    return true;
+}
+#endif
+
+
+template <typename Protocol>
+class CNotifyListener :
+        public boost::enable_shared_from_this< CNotifyListener<Protocol> >
+{
+public:
+    typename Protocol::acceptor acceptor;
+
+    CNotifyListener(NotifyIOContext& ioIn) :
+        acceptor(ioIn),
+        io(ioIn)
+    {
+    }
+
+    void Accept()
+    {
+        boost::shared_ptr< CNotifySession<Protocol> > psession(
+                new CNotifySession<Protocol>(io));
+        acceptor.async_accept(
+                psession->socket,
+                boost::bind(&CNotifyListener::HandleAccept,
+                            this->shared_from_this(),
+                            psession,
+                            boost::asio::placeholders::error));
+    }
+
+private:
+    NotifyIOContext& io;
+
+    void HandleAccept(boost::shared_ptr< CNotifySession<Protocol> > psession,
+                      const boost::system::error_code& error)
+    {
+        if (error == asio::error::operation_aborted || !acceptor.is_open())
+        {
+            return;
+        }
+        if (!error)
+        {
+            if (SubscriberAllowed(psession->socket))
+            {
+                AddSubscriber(psession);
+                psession->Start();
+            }
+            else
+            {
+                psession->Close();
+            }
+        }
+        Accept();
+    }
+};
+
+
+static bool ListenTCP(NotifyIOContext& io, const string& strAddress)
+{
+    int nPort = 0;
+    string strHost;
+    // a port without a host listens on loopback only
+    if (strAddress.find(':') == string::npos)
+    {
+        SplitHostPort(":" + strAddress, nPort, strHost);
+    }
+    else
+    {
+        SplitHostPort(strAddress, nPort, strHost);
+    }
+    if (strHost.empty())
+    {
+        strHost = "127.0.0.1";
+    }
+    CService addr;
+    if ((nPort <= 0) || !Lookup(strHost.c_str(), addr, nPort, false))
+    {
+        return error("ListenTCP() : bad -notifysocket %s", strAddress.c_str());
+    }
+    boost::system::error_code ec;
+#if BOOST_VERSION >= 106600
+    asio::ip::address bindAddress = asio::ip::make_address(addr.ToStringIP(), ec);
+#else
+    asio::ip::address bindAddress = asio::ip::address::from_string(addr.ToStringIP(), ec);
+#endif
+    if (ec)
+    {
+        return error("ListenTCP() : bad -notifysocket %s", strAddress.c_str());
+    }
+    asio::ip::tcp::endpoint endpoint(bindAddress, nPort);
+
+    boost::shared_ptr< CNotifyListener<asio::ip::tcp> > plistener(
+            new CNotifyListener<asio::ip::tcp>(io));
+    plistener->acceptor.open(endpoint.protocol(), ec);
+    if (!ec)
+    {
+        plistener->acceptor.set_option(
+                asio::ip::tcp::acceptor::reuse_address(true), ec);
+        plistener->acceptor.bind(endpoint, ec);
+    }
+    if (!ec)
+    {
+        plistener->acceptor.listen(NOTIFY_BACKLOG, ec);
+    }
+    if (ec)
+    {
+        return error("ListenTCP() : can't listen on %s: %s",
+                     strAddress.c_str(), ec.message().c_str());
+    }
+    plistener->Accept();
+    printf("Notifier: listening on %s\n", strAddress.c_str());
+    return true;
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+static bool ListenUnix(NotifyIOContext& io, const string& strPath)
+{
+    asio::local::stream_protocol::endpoint endpoint(strPath);
+
+    // A socket file left by an earlier run would make bind fail, so it is
+    //    removed. Anything that is not a socket, or a socket someone is
+    //    still listening on, is left alone.
+    boost::system::error_code ecStatus;
+    boost::filesystem::file_status status =
+            boost::filesystem::symlink_status(strPath, ecStatus);
+    if (boost::filesystem::exists(status))
+    {
+        if (status.type() != boost::filesystem::socket_file)
+        {
+            return error("ListenUnix() : %s exists and is not a socket",
+                         strPath.c_str());
+        }
+        asio::local::stream_protocol::socket probe(io);
+        boost::system::error_code ecProbe;
+        probe.connect(endpoint, ecProbe);
+        if (!ecProbe)
+        {
+            return error("ListenUnix() : %s is in use", strPath.c_str());
+        }
+        boost::system::error_code ecRemove;
+        boost::filesystem::remove(strPath, ecRemove);
+    }
+    boost::shared_ptr< CNotifyListener<asio::local::stream_protocol> > plistener(
+            new CNotifyListener<asio::local::stream_protocol>(io));
+    boost::system::error_code ec;
+    plistener->acceptor.open(endpoint.protocol(), ec);
+    if (!ec)
+    {
+        plistener->acceptor.bind(endpoint, ec);
+    }
+    if (!ec)
+    {
+        plistener->acceptor.listen(NOTIFY_BACKLOG, ec);
+    }
+    if (ec)
+    {
+        return error("ListenUnix() : can't listen on %s: %s",
+                     strPath.c_str(), ec.message().c_str());
+    }
+    plistener->Accept();
+    printf("Notifier: listening on %s\n", strPath.c_str());
+    return true;
+}
+#endif
+
+void ThreadNotifier(void* parg)
+{
+    // Make this thread recognisable as the notifier
+    RenameThread("stealth-notify");
+
+    NotifyIOContext* pio = (NotifyIOContext*)parg;
+    vnThreadsRunning[THREAD_NOTIFIER]++;
+    try
+    {
+#if BOOST_VERSION >= 106600
+        asio::executor_work_guard<NotifyIOContext::executor_type> work =
+                                          asio::make_work_guard(*pio);
+#else
+        NotifyIOContext::work work(*pio);
+#endif
+        pio->run();
+    }
+    catch (std::exception& e)
+    {
+        PrintException(&e, "ThreadNotifier()");
+    }
+    catch (...)
+    {
+        PrintException(NULL, "ThreadNotifier()");
+    }
+    BOOST_FOREACH(const SubscriberPtr& psub, listSubscribers)
+    {
+        psub->Close();
+    }
+    listSubscribers.clear();
+    vnThreadsRunning[THREAD_NOTIFIER]--;
+    printf("ThreadNotifier exited\n");
+}
+
+
+bool StartNotifier()
+{
+    if (!mapMultiArgs.count("-notifysocket"))
+    {
+        return true;
+    }
+
+    nNotifyMaxQueue = (size_t)max(GetArg("-notifyqueuesize",
+                             (int64_t) chainParams.DEFAULT_NOTIFYQUEUESIZE),
+                             (int64_t)1) << 20;
+
+    NotifyIOContext* pio = new NotifyIOContext();
+    bool fListening = false;
+    BOOST_FOREACH(const string& strAddress, mapMultiArgs["-notifysocket"])
+    {
+        bool fUnix = (strAddress.find('/') != string::npos);
+        if (fUnix)
+        {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+            fListening |= ListenUnix(*pio, strAddress);
+#else
+            printf("StartNotifier() : no Unix-domain sockets for %s\n",
+                   strAddress.c_str());
+#endif
+        }
+        else
+        {
+            fListening |= ListenTCP(*pio, strAddress);
+        }
+    }
+    if (!fListening)
+    {
+        delete pio;
+        return false;
+    }
+
+    {
+        LOCK(cs_notifier);
+        pioNotify = pio;
+    }
+    if (!NewThread(ThreadNotifier, pio))
+    {
+        printf("Error: NewThread(ThreadNotifier) failed\n");
+        LOCK(cs_notifier);
+        pioNotify = NULL;
+        return false;
+    }
+    return true;
+}
+
+void StopNotifier()
+{
+    NotifyIOContext* pio;
+    {
+        LOCK(cs_notifier);
+        pio = pioNotify;
+        pioNotify = NULL;
+        nSubscribers = 0;
+    }
+    if (pio == NULL)
+    {
+        return;
+    }
+    pio->stop();
+    while (vnThreadsRunning[THREAD_NOTIFIER] > 0)
+    {
+        MilliSleep(20);
+    }
+    // destroys the handlers still pending, and the sockets they hold
+    delete pio;
+}
+
+bool IsNotifierActive()
+{
+    LOCK(cs_notifier);
+    return (nSubscribers > 0);
+}
+
+
+// frames the payload and hands it to the notifier thread
+static void Publish(const string& strTopic, const CDataStream& ssPayload)
+{
+    LOCK(cs_notifier);
+    if ((pioNotify == NULL) || (nSubscribers == 0))
+    {
+        return;
+    }
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << strTopic << mapSequence[strTopic]++;
+
+    uint32_t nLen = ss.size() + ssPayload.size();
+    string* pstr = new string();
+    pstr->reserve(4 + nLen);
+    for (int i = 0; i < 4; i++)
+    {
+        pstr->push_back((char)((nLen >> (8 * i)) & 0xff));
+    }
+    pstr->append(ss.begin(), ss.end());
+    pstr->append(ssPayload.begin(), ssPayload.end());
+    FramePtr pframe(pstr);
+
+#if BOOST_VERSION >= 106600
+    asio::post(*pioNotify, boost::bind(&DeliverFrame, strTopic, pframe));
+#else
+    pioNotify->post(boost::bind(&DeliverFrame, strTopic, pframe));
+#endif
+}
+
+void NotifyBlockConnected(const CBlock& block, int nHeight)
+{
+    if (!IsNotifierActive())
+    {
+        return;
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << nHeight << block;
+    Publish(NOTIFY_RAWBLOCK, ss);
+}
+
+void NotifyBlockDisconnected(const uint256& hash, int nHeight)
+{
+    if (!IsNotifierActive())
+    {
+        return;
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hash << nHeight;
+    Publish(NOTIFY_DISCONNECT, ss);
+}
+
+void NotifyTransaction(const CTransaction& tx)
+{
+    if (!IsNotifierActive())
+    {
+        return;
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    Publish(NOTIFY_RAWTX, ss);
+}
+
+void NotifyQPoSSlot(const QPRegistry* pregistry)
+{
+    unsigned int nRound = pregistry->GetRound();
+    unsigned int nSlot = pregistry->GetCurrentSlot();
+    if (nRound == 0)
+    {
+        // qPoS has not started
+        return;
+    }
+    {
+        LOCK(cs_notifier);
+        if ((nRound == nLastQPoSRound) && (nSlot == nLastQPoSSlot))
+        {
+            return;
+        }
+        nLastQPoSRound = nRound;
+        nLastQPoSSlot = nSlot;
+    }
+    if (!IsNotifierActive())
+    {
+        return;
+    }
+    unsigned int nID = pregistry->GetCurrentID();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << pregistry->GetBlockHeight()
+       << pregistry->GetBlockHash()
+       << nRound
+       << nSlot
+       << pregistry->GetCurrentSlotStart()
+       << pregistry->GetCurrentSlotEnd()
+       << nID
+       << pregistry->GetAliasForID(nID);
+    Publish(NOTIFY_QPOSSLOT, ss);
+}
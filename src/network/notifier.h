@@ -0,0 +1,66 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include "uint256.h"
+
+#include <string>
+
+class CBlock;
+class CTransaction;
+class QPRegistry;
+
+//
+// Push notifications for local integrations.
+//
+// Subscribers connect to a socket given with -notifysocket, either a TCP
+// address (host:port) or a Unix-domain socket path. A port without a host
+// binds 127.0.0.1. TCP subscribers from other than loopback must match a
+// -notifyallowip pattern. Every event is sent as one frame:
+//
+//     uint32   length of the rest of the frame
+//     string   topic (compact size, then the characters)
+//     uint32   sequence number, counted per topic
+//     ...      payload
+//
+// All integers are little endian. The topics and their payloads are:
+//
+//     rawblock    int32 height, serialized block
+//     rawtx       serialized transaction, sent when it enters the mempool
+//     disconnect  uint256 block hash, int32 height
+//     qposslot    int32 height, uint256 block hash, uint32 round,
+//                 uint32 slot, uint32 slot start, uint32 slot end,
+//                 uint32 staker ID, string staker alias
+//
+// A subscriber gets every topic until it writes a line naming the topics it
+// wants, separated by spaces. Each line replaces the one before.
+//
+// Publishing never waits for the network. A subscriber that falls more than
+// -notifyqueuesize MB behind misses frames, which shows as a gap in the
+// sequence numbers of a topic.
+//
+
+#define NOTIFY_RAWBLOCK   "rawblock"
+#define NOTIFY_RAWTX      "rawtx"
+#define NOTIFY_DISCONNECT "disconnect"
+#define NOTIFY_QPOSSLOT   "qposslot"
+
+// starts the notifier thread if any -notifysocket is given
+bool StartNotifier();
+void StopNotifier();
+
+// true while anyone is subscribed, so callers can skip building events
+bool IsNotifierActive();
+
+// after the block is committed as part of the best chain
+void NotifyBlockConnected(const CBlock& block, int nHeight);
+// after the block is committed as no longer part of the best chain
+void NotifyBlockDisconnected(const uint256& hash, int nHeight);
+void NotifyTransaction(const CTransaction& tx);
+// after the main registry is updated, sent when the slot changes
+void NotifyQPoSSlot(const QPRegistry* pregistry);
+
+#endif  /* NOTIFIER_H */
@@ -0,0 +1,182 @@
+// Copyright (c) 2012-2015 The Bitcoin Core developers
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bloom.h"
+
+#include "util.h"
+
+#include <cmath>
+
+using namespace std;
+
+
+#define ROTL32(x, r) (uint32_t)(((x) << (r)) | ((x) >> (32 - (r))))
+
+// MurmurHash3 (x86, 32 bit) of a byte range
+static uint32_t MurmurHash3(uint32_t nSeed,
+                            const unsigned char* pbegin,
+                            const unsigned char* pend)
+{
+    static const uint32_t c1 = 0xcc9e2d51;
+    static const uint32_t c2 = 0x1b873593;
+
+    const int nLen = pend - pbegin;
+    const int nBlocks = nLen / 4;
+
+    uint32_t h1 = nSeed;
+
+    for (int i = 0; i < nBlocks; i++)
+    {
+        const unsigned char* p = pbegin + i * 4;
+        uint32_t k1 = ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) |
+                      ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = ROTL32(h1, 13);
+        h1 = h1 * 5 + 0xe6546b64;
+    }
+
+    const unsigned char* tail = pbegin + nBlocks * 4;
+    uint32_t k1 = 0;
+    switch (nLen & 3)
+    {
+    case 3:
+        k1 ^= tail[2] << 16;
+        // fall through
+    case 2:
+        k1 ^= tail[1] << 8;
+        // fall through
+    case 1:
+        k1 ^= tail[0];
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+
+    h1 ^= nLen;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+
+    return h1;
+}
+
+#undef ROTL32
+
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements,
+                                         double nFPRate)
+{
+    double dLogFPRate = log(nFPRate);
+    // optimal number of hash functions for the rate, each sets one bit
+    nHashFuncs = (int)floor(dLogFPRate / log(0.5) + 0.5);
+    nHashFuncs = max(1, min(nHashFuncs, 50));
+    nEntriesPerGeneration = (nElements + 1) / 2;
+    // up to three generations are in the filter at once
+    uint32_t nMaxElements = nEntriesPerGeneration * 3;
+    uint32_t nFilterBits = (uint32_t)ceil(
+                    -1.0 * nHashFuncs * nMaxElements /
+                    log(1.0 - exp(dLogFPRate / nHashFuncs)));
+    // each filter position is a pair of words (two generation bits)
+    vData.assign(((nFilterBits + 63) / 64) << 1, 0);
+    reset();
+}
+
+void CRollingBloomFilter::insert(const unsigned char* pbegin,
+                                 const unsigned char* pend)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration)
+    {
+        nEntriesThisGeneration = 0;
+        nGeneration += 1;
+        if (nGeneration == 4)
+        {
+            nGeneration = 1;
+        }
+        // clear every position owned by the generation being reused
+        uint64_t nMask1 = 0 - (uint64_t)(nGeneration & 1);
+        uint64_t nMask2 = 0 - (uint64_t)(nGeneration >> 1);
+        for (unsigned int p = 0; p < vData.size(); p += 2)
+        {
+            uint64_t p1 = vData[p];
+            uint64_t p2 = vData[p + 1];
+            uint64_t mask = (p1 ^ nMask1) | (p2 ^ nMask2);
+            vData[p] = p1 & mask;
+            vData[p + 1] = p2 & mask;
+        }
+    }
+    nEntriesThisGeneration += 1;
+
+    for (int n = 0; n < nHashFuncs; n++)
+    {
+        uint32_t h = MurmurHash3(n * 0xFBA4C795 + nTweak, pbegin, pend);
+        int nBit = h & 0x3F;
+        // map h onto [0, vData.size()) without a division
+        uint32_t nPos = ((uint64_t)h * vData.size()) >> 32;
+        nPos &= ~1U;
+        vData[nPos] &= ~(((uint64_t)1) << nBit);
+        vData[nPos] |= ((uint64_t)(nGeneration & 1)) << nBit;
+        vData[nPos + 1] &= ~(((uint64_t)1) << nBit);
+        vData[nPos + 1] |= ((uint64_t)(nGeneration >> 1)) << nBit;
+    }
+}
+
+bool CRollingBloomFilter::contains(const unsigned char* pbegin,
+                                   const unsigned char* pend) const
+{
+    for (int n = 0; n < nHashFuncs; n++)
+    {
+        uint32_t h = MurmurHash3(n * 0xFBA4C795 + nTweak, pbegin, pend);
+        int nBit = h & 0x3F;
+        uint32_t nPos = ((uint64_t)h * vData.size()) >> 32;
+        nPos &= ~1U;
+        // a position is set if any generation owns it
+        if (!(((vData[nPos] | vData[nPos + 1]) >> nBit) & 1))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CRollingBloomFilter::insert(const vector<unsigned char>& vKey)
+{
+    insert(vKey.data(), vKey.data() + vKey.size());
+}
+
+void CRollingBloomFilter::insert(const uint256& hash)
+{
+    const unsigned char* pbegin = (const unsigned char*)&hash;
+    insert(pbegin, pbegin + sizeof(hash));
+}
+
+bool CRollingBloomFilter::contains(const vector<unsigned char>& vKey) const
+{
+    return contains(vKey.data(), vKey.data() + vKey.size());
+}
+
+bool CRollingBloomFilter::contains(const uint256& hash) const
+{
+    const unsigned char* pbegin = (const unsigned char*)&hash;
+    return contains(pbegin, pbegin + sizeof(hash));
+}
+
+void CRollingBloomFilter::reset()
+{
+    nTweak = (unsigned int)GetRand(numeric_limits<unsigned int>::max());
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+    fill(vData.begin(), vData.end(), 0);
+}
+
+size_t CRollingBloomFilter::GetMemoryUsage() const
+{
+    return vData.capacity() * sizeof(uint64_t);
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2012-2015 The Bitcoin Core developers
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "uint256.h"
+
+#include <vector>
+
+/** Fixed memory filter that remembers (at least) the last nElements
+ *  entries inserted.
+ *
+ *  Entries are kept in three generations of nElements / 2 each. Every
+ *  position holds two bits naming the generation that last set it, so a
+ *  whole generation can be dropped in one pass when the oldest one is
+ *  reused. False positives happen at about nFPRate, false negatives never
+ *  happen for the most recent nElements entries.
+ */
+class CRollingBloomFilter
+{
+public:
+    CRollingBloomFilter(unsigned int nElements, double nFPRate);
+
+    void insert(const std::vector<unsigned char>& vKey);
+    void insert(const uint256& hash);
+    bool contains(const std::vector<unsigned char>& vKey) const;
+    bool contains(const uint256& hash) const;
+
+    void reset();
+
+    // bytes used by the filter, fixed at construction
+    size_t GetMemoryUsage() const;
+
+private:
+    void insert(const unsigned char* pbegin, const unsigned char* pend);
+    bool contains(const unsigned char* pbegin,
+                  const unsigned char* pend) const;
+
+    int nEntriesPerGeneration;
+    int nEntriesThisGeneration;
+    int nGeneration;
+    std::vector<uint64_t> vData;
+    unsigned int nTweak;
+    int nHashFuncs;
+};
+
+#endif  /* BLOOM_H */
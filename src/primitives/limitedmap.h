@@ -0,0 +1,114 @@
+// Copyright (c) 2012-2015 The Bitcoin Core developers
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LIMITEDMAP_H
+#define LIMITEDMAP_H
+
+#include <assert.h>
+#include <map>
+
+/** STL-like map container that only keeps the N elements with the highest
+ *  value. The value is indexed, so this suits maps of key -> time where the
+ *  oldest entries are the ones to drop. */
+template <typename K, typename V> class limitedmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef typename std::map<K, V>::const_iterator const_iterator;
+    typedef typename std::map<K, V>::size_type size_type;
+
+protected:
+    std::map<K, V> map;
+    typedef typename std::map<K, V>::iterator iterator;
+    std::multimap<V, iterator> rmap;
+    typedef typename std::multimap<V, iterator>::iterator rmap_iterator;
+    size_type nMaxSize;
+
+public:
+    limitedmap(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
+    const_iterator begin() const { return map.begin(); }
+    const_iterator end() const { return map.end(); }
+    size_type size() const { return map.size(); }
+    bool empty() const { return map.empty(); }
+    const_iterator find(const key_type& k) const { return map.find(k); }
+    size_type count(const key_type& k) const { return map.count(k); }
+    void insert(const value_type& x)
+    {
+        std::pair<iterator, bool> ret = map.insert(x);
+        if (ret.second)
+        {
+            if (nMaxSize && map.size() > nMaxSize)
+            {
+                map.erase(rmap.begin()->second);
+                rmap.erase(rmap.begin());
+            }
+            rmap.insert(std::make_pair(x.second, ret.first));
+        }
+    }
+    void erase(const key_type& k)
+    {
+        iterator itTarget = map.find(k);
+        if (itTarget == map.end())
+        {
+            return;
+        }
+        std::pair<rmap_iterator, rmap_iterator> itPair =
+                                         rmap.equal_range(itTarget->second);
+        for (rmap_iterator it = itPair.first; it != itPair.second; ++it)
+        {
+            if (it->second == itTarget)
+            {
+                rmap.erase(it);
+                map.erase(itTarget);
+                return;
+            }
+        }
+        // shouldn't ever get here
+        assert(0);
+    }
+    void update(const_iterator itIn, const mapped_type& v)
+    {
+        // map::erase with an empty range turns a const_iterator into an
+        // iterator in constant time
+        iterator itTarget = map.erase(itIn, itIn);
+
+        if (itTarget == map.end())
+        {
+            return;
+        }
+        std::pair<rmap_iterator, rmap_iterator> itPair =
+                                         rmap.equal_range(itTarget->second);
+        for (rmap_iterator it = itPair.first; it != itPair.second; ++it)
+        {
+            if (it->second == itTarget)
+            {
+                rmap.erase(it);
+                itTarget->second = v;
+                rmap.insert(std::make_pair(v, itTarget));
+                return;
+            }
+        }
+        // shouldn't ever get here
+        assert(0);
+    }
+    size_type max_size() const { return nMaxSize; }
+    size_type max_size(size_type s)
+    {
+        if (s)
+        {
+            while (map.size() > s)
+            {
+                map.erase(rmap.begin()->second);
+                rmap.erase(rmap.begin());
+            }
+        }
+        nMaxSize = s;
+        return nMaxSize;
+    }
+};
+
+#endif  /* LIMITEDMAP_H */
@@ -5,12 +5,11 @@
 #include "QPStaker.hpp"
 
 #include "txdb-leveldb.h"
+#include "chainview.h"
 
 using namespace json_spirit;
 using namespace std;
 
-extern CBlockIndex* pindexBest;
-
 extern Value ValueFromAmount(int64_t amount);
 
 void BlockAsJSONLite(const CBlockIndex* pindex, Object& objRet)
@@ -27,17 +26,18 @@ void BlockAsJSONLite(const CBlockIndex* pindex, Object& objRet)
         objRet.push_back(Pair("datetime",
                               DateTimeStrFormat("%x %H:%M:%S",
                                                 pindex->nTime)));
-        CMapBlockIndex::const_iterator it = mapBlockIndex.find(hash);
-        if (it == mapBlockIndex.end() || it->second == nullptr)
+        // getstakerinfo runs without cs_main
+        int nTipHeight;
+        if (LookupBlockIndex(hash) == nullptr)
         {
             objRet.push_back(
                 Pair("isinmainchain", "ERROR: TSNH no such block"));
         }
-        else if (it->second->IsInMainChain())
+        else if (LookupInBestChain(hash, pindex->nHeight, nTipHeight))
         {
             objRet.push_back(Pair("isinmainchain", true));
             objRet.push_back(Pair("confirmations",
-                                  pindexBest->nHeight + 1 - pindex->nHeight));
+                                  nTipHeight + 1 - pindex->nHeight));
         }
         else
         {
@@ -136,11 +136,10 @@ uint256 QPStaker::GetHashBlockCreated() const
 
 bool QPStaker::GetBlockCreated(CDiskBlockIndex& diskIndex) const
 {
-    CMapBlockIndex::iterator mi =
-                         mapBlockIndex.find(hashBlockCreated);
-    if (mi != mapBlockIndex.end())
+    CBlockMemIndex* pmemIndex = LookupBlockIndex(hashBlockCreated);
+    if (pmemIndex != nullptr)
     {
-        ReadDiskBlockIndex("GetBlockCreated", mi->second, diskIndex);
+        ReadDiskBlockIndex("GetBlockCreated", pmemIndex, diskIndex);
         return true;
     }
     printf("GetBlockCreated(): TSNH No such block\n  %s",
@@ -204,11 +203,10 @@ uint256 QPStaker::GetHashBlockMostRecent() const
 
 bool QPStaker::GetBlockMostRecent(CDiskBlockIndex& diskIndex) const
 {
-    CMapBlockIndex::iterator mi =
-                         mapBlockIndex.find(hashBlockMostRecent);
-    if (mi != mapBlockIndex.end())
+    CBlockMemIndex* pmemIndex = LookupBlockIndex(hashBlockMostRecent);
+    if (pmemIndex != nullptr)
     {
-        ReadDiskBlockIndex("GetBlockMostRecent", mi->second, diskIndex);
+        ReadDiskBlockIndex("GetBlockMostRecent", pmemIndex, diskIndex);
         return true;
     }
     printf("GetBlockMostRecent(): TSNH No such block\n  %s",
@@ -10,9 +10,14 @@
 #include "base58.h"
 #include "bitcoinrpc.h"
 #include "db.h"
+#include "chainview.h"
+#include "jsonreader.h"
+#include "jsonstream.h"
+#include "metrics.h"
 
 #undef printf
 #include <boost/asio/ip/v6_only.hpp>
+#include <boost/asio/deadline_timer.hpp>
 #if BOOST_VERSION >= 106500
     #include <boost/bind/bind.hpp>
 #else
@@ -28,6 +33,9 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <deque>
 #include <list>
 
 #define printf OutputDebugStringF
@@ -48,7 +56,27 @@ static std::string strRPCUserColonPass;
 
 const Object emptyobj;
 
-void ThreadRPCServer3(void* parg);
+static CCriticalSection cs_THREAD_RPCHANDLER;
+
+// Sends part of a reply ahead of the rest, false if the client is gone
+//    or too slow. With fWait it first waits for earlier parts to go out,
+//    without it only once RPC_STREAM_MAX_PENDING parts are unwritten.
+typedef boost::function<bool (const string& strData, bool fWait)> ReplySender;
+
+// streamed replies go out in HTTP chunks of about this size
+static const size_t RPC_STREAM_CHUNK_SIZE = 64 * 1024;
+// Parts of a reply not waiting for the client (run under cs_main) that
+//    may queue up, and how long (ms) such a reply waits for the client
+//    once they have before it gives up.
+static const int RPC_STREAM_MAX_PENDING = 64;
+static const int64_t RPC_STREAM_MAX_WAIT = 30000;
+
+static string ExecHTTPRequest(map<string, string>& mapHeaders,
+                              const string& strRequest,
+                              bool& fKeepAliveRet,
+                              const ReplySender& sendReply);
+static string ExecHTTPMetrics(map<string, string>& mapHeaders,
+                              bool& fKeepAliveRet);
 
 
 static inline unsigned short GetDefaultRPCPort()
@@ -66,6 +94,16 @@ Object JSONRPCError(int code, const string& message)
     return error;
 }
 
+ChainViewPtr GetRPCChainView()
+{
+    ChainViewPtr pview = GetChainView();
+    if (!pview)
+    {
+        throw JSONRPCError(RPC_IN_WARMUP, "Chain view not yet available");
+    }
+    return pview;
+}
+
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
                   bool fAllowNull)
@@ -336,147 +374,174 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                        function                    safemd  unlocked
-  //  ------------------------    -----------------------     ------  --------
-    { "help",                     &help,                      true,   true  },
-    { "stop",                     &stop,                      true,   true  },
-    { "getbestblockhash",         &getbestblockhash,          true,   false },
-    { "getblockcount",            &getblockcount,             true,   false },
-    { "getconnectioncount",       &getconnectioncount,        true,   false },
-    { "getadjustedtime",          &getadjustedtime,           true,   false },
-    { "getpeerinfo",              &getpeerinfo,               true,   false },
-    { "getdifficulty",            &getdifficulty,             true,   false },
+{ //  name                        function                    safemd  unlocked  readonly
+  //  ------------------------    -----------------------     ------  --------  --------
+    { "help",                     &help,                      true,   true,     false },
+    { "stop",                     &stop,                      true,   true,     false },
+    { "getbestblockhash",         &getbestblockhash,          true,   true,     true  },
+    { "getblockcount",            &getblockcount,             true,   true,     true  },
+    { "getconnectioncount",       &getconnectioncount,        true,   false,    false },
+    { "getadjustedtime",          &getadjustedtime,           true,   false,    false },
+    { "getpeerinfo",              &getpeerinfo,               true,   false,    false },
+    { "getmetrics",               &getmetrics,                true,   true,     true  },
+    { "getlockstats",             &getlockstats,              true,   true,     false },
+    { "dumptrace",                &dumptrace,                 true,   true,     false },
+    { "compactdb",                &compactdb,                 true,   true,     false },
+    { "exportchainstate",         &exportchainstate,          true,   true,     false },
+    { "getdifficulty",            &getdifficulty,             true,   false,    false },
 #ifdef WITH_MINER
-    { "getgenerate",              &getgenerate,               true,   false },
-    { "setgenerate",              &setgenerate,               true,   false },
+    { "getgenerate",              &getgenerate,               true,   false,    false },
+    { "setgenerate",              &setgenerate,               true,   false,    false },
 #endif  /* WITH_MINER */
-    { "gethashespersec",          &gethashespersec,           true,   false },
-    { "getinfo",                  &getinfo,                   true,   false },
-    { "getsubsidy",               &getsubsidy,                true,   false },
-    { "getmininginfo",            &getmininginfo,             true,   false },
-    { "getnewaddress",            &getnewaddress,             true,   false },
-    { "getnewpubkey",             &getnewpubkey,              true,   false },
-    { "getaccountaddress",        &getaccountaddress,         true,   false },
-    { "setaccount",               &setaccount,                true,   false },
-    { "getaccount",               &getaccount,                false,  false },
-    { "getaddressesbyaccount",    &getaddressesbyaccount,     true,   false },
-    { "sendtoaddress",            &sendtoaddress,             false,  false },
-    { "getreceivedbyaddress",     &getreceivedbyaddress,      false,  false },
-    { "getreceivedbyaccount",     &getreceivedbyaccount,      false,  false },
-    { "listreceivedbyaddress",    &listreceivedbyaddress,     false,  false },
-    { "listreceivedbyaccount",    &listreceivedbyaccount,     false,  false },
-    { "backupwallet",             &backupwallet,              true,   false },
-    { "keypoolrefill",            &keypoolrefill,             true,   false },
-    { "walletpassphrase",         &walletpassphrase,          true,   false },
-    { "walletpassphrasechange",   &walletpassphrasechange,    false,  false },
-    { "walletlock",               &walletlock,                true,   false },
-    { "encryptwallet",            &encryptwallet,             false,  false },
-    { "validateaddress",          &validateaddress,           true,   false },
-    { "validatepubkey",           &validatepubkey,            true,   false },
-    { "getbalance",               &getbalance,                false,  false },
-    { "move",                     &movecmd,                   false,  false },
-    { "sendfrom",                 &sendfrom,                  false,  false },
-    { "sendmany",                 &sendmany,                  false,  false },
-    { "addmultisigaddress",       &addmultisigaddress,        false,  false },
-    { "getrawmempool",            &getrawmempool,             true,   false },
-    { "getblock",                 &getblock,                  false,  false },
-    { "getblockbynumber",         &getblockbynumber,          false,  false },
-    { "getbestblock",             &getbestblock,              false,  false },
-    { "getnewestblockbeforetime", &getnewestblockbeforetime,  false,  false },
-    { "getblockhash",             &getblockhash,              false,  false },
-    { "getblockhash9",            &getblockhash9,             false,  false },
-    { "gettransaction",           &gettransaction,            false,  false },
-    { "listtransactions",         &listtransactions,          false,  false },
-    { "listaddressgroupings",     &listaddressgroupings,      false,  false },
-    { "signmessage",              &signmessage,               false,  false },
-    { "verifymessage",            &verifymessage,             false,  false },
+    { "gethashespersec",          &gethashespersec,           true,   false,    false },
+    { "getinfo",                  &getinfo,                   true,   false,    false },
+    { "getsubsidy",               &getsubsidy,                true,   false,    false },
+    { "getmininginfo",            &getmininginfo,             true,   false,    false },
+    { "getnewaddress",            &getnewaddress,             true,   false,    false },
+    { "getnewpubkey",             &getnewpubkey,              true,   false,    false },
+    { "getaccountaddress",        &getaccountaddress,         true,   false,    false },
+    { "setaccount",               &setaccount,                true,   false,    false },
+    { "getaccount",               &getaccount,                false,  false,    false },
+    { "getaddressesbyaccount",    &getaddressesbyaccount,     true,   false,    false },
+    { "sendtoaddress",            &sendtoaddress,             false,  false,    false },
+    { "getreceivedbyaddress",     &getreceivedbyaddress,      false,  false,    false },
+    { "getreceivedbyaccount",     &getreceivedbyaccount,      false,  false,    false },
+    { "listreceivedbyaddress",    &listreceivedbyaddress,     false,  false,    false },
+    { "listreceivedbyaccount",    &listreceivedbyaccount,     false,  false,    false },
+    { "backupwallet",             &backupwallet,              true,   false,    false },
+    { "keypoolrefill",            &keypoolrefill,             true,   false,    false },
+    { "walletpassphrase",         &walletpassphrase,          true,   false,    false },
+    { "walletpassphrasechange",   &walletpassphrasechange,    false,  false,    false },
+    { "walletlock",               &walletlock,                true,   false,    false },
+    { "encryptwallet",            &encryptwallet,             false,  false,    false },
+    { "validateaddress",          &validateaddress,           true,   false,    false },
+    { "validatepubkey",           &validatepubkey,            true,   false,    false },
+    { "getbalance",               &getbalance,                false,  false,    false },
+    { "move",                     &movecmd,                   false,  false,    false },
+    { "sendfrom",                 &sendfrom,                  false,  false,    false },
+    { "sendmany",                 &sendmany,                  false,  false,    false },
+    { "addmultisigaddress",       &addmultisigaddress,        false,  false,    false },
+    { "getrawmempool",            &getrawmempool,             true,   false,    false },
+    { "getblock",                 &getblock,                  false,  true,     true  },
+    { "getblockbynumber",         &getblockbynumber,          false,  true,     true  },
+    { "getbestblock",             &getbestblock,              false,  false,    false },
+    { "getnewestblockbeforetime", &getnewestblockbeforetime,  false,  false,    false },
+    { "getblockhash",             &getblockhash,              false,  true,     true  },
+    { "getblockhash9",            &getblockhash9,             false,  false,    false },
+    { "gettransaction",           &gettransaction,            false,  false,    false },
+    { "listtransactions",         &listtransactions,          false,  false,    false },
+    { "listaddressgroupings",     &listaddressgroupings,      false,  false,    false },
+    { "signmessage",              &signmessage,               false,  false,    false },
+    { "verifymessage",            &verifymessage,             false,  false,    false },
 #ifdef WITH_MINER
-    { "getwork",                  &getwork,                   true,   false },
-    { "getworkex",                &getworkex,                 true,   false },
+    { "getwork",                  &getwork,                   true,   false,    false },
+    { "getworkex",                &getworkex,                 true,   false,    false },
 #endif  /* WITH_MINER */
-    { "listaccounts",             &listaccounts,              false,  false },
-    { "settxfee",                 &settxfee,                  false,  false },
+    { "listaccounts",             &listaccounts,              false,  false,    false },
+    { "settxfee",                 &settxfee,                  false,  false,    false },
 #ifdef WITH_MINER
-    { "getblocktemplate",         &getblocktemplate,          true,   false },
-    { "submitblock",              &submitblock,               false,  false },
+    { "getblocktemplate",         &getblocktemplate,          true,   false,    false },
+    { "submitblock",              &submitblock,               false,  false,    false },
 #endif  /* WITH_MINER */
-    { "listsinceblock",           &listsinceblock,            false,  false },
-    { "dumpprivkey",              &dumpprivkey,               false,  false },
-    { "importprivkey",            &importprivkey,             false,  false },
-    { "importaddress",            &importaddress,             false,  false },
-    { "listunspent",              &listunspent,               false,  false },
-    { "getrawtransaction",        &getrawtransaction,         false,  false },
-    { "createrawtransaction",     &createrawtransaction,      false,  false },
-    { "decoderawtransaction",     &decoderawtransaction,      false,  false },
-    { "signrawtransaction",       &signrawtransaction,        false,  false },
-    { "sendrawtransaction",       &sendrawtransaction,        false,  false },
+    { "listsinceblock",           &listsinceblock,            false,  false,    false },
+    { "dumpprivkey",              &dumpprivkey,               false,  false,    false },
+    { "importprivkey",            &importprivkey,             false,  false,    false },
+    { "importaddress",            &importaddress,             false,  false,    false },
+    { "listunspent",              &listunspent,               false,  false,    false },
+    { "getrawtransaction",        &getrawtransaction,         false,  true,     true  },
+    { "createrawtransaction",     &createrawtransaction,      false,  false,    false },
+    { "decoderawtransaction",     &decoderawtransaction,      false,  false,    true  },
+    { "signrawtransaction",       &signrawtransaction,        false,  false,    false },
+    { "sendrawtransaction",       &sendrawtransaction,        false,  false,    false },
 #ifdef WITH_STEALTHTEXT
-    { "decryptsend",              &decryptsend,               false,  false },
+    { "decryptsend",              &decryptsend,               false,  false,    false },
 #endif  /* WITH_STEALTHTEXT */
-    { "getcheckpoint",            &getcheckpoint,             true,   false },
-    { "reservebalance",           &reservebalance,            false,  true  },
-    { "checkwallet",              &checkwallet,               false,  true  },
-    { "repairwallet",             &repairwallet,              false,  true  },
-    { "resendtx",                 &resendtx,                  false,  true  },
-    { "createfeework",            &createfeework,             false,  true  },
-    { "makekeypair",              &makekeypair,               false,  true  },
-    { "sendalert",                &sendalert,                 false,  false },
-    { "getnewstealthaddress",     &getnewstealthaddress,      false,  false },
-    { "liststealthaddresses",     &liststealthaddresses,      false,  false },
-    { "importstealthaddress",     &importstealthaddress,      false,  false },
-    { "sendtostealthaddress",     &sendtostealthaddress,      false,  false },
-    { "clearwallettransactions",  &clearwallettransactions,   false,  false },
-    { "scanforalltxns",           &scanforalltxns,            false,  false },
-    { "scanforstealthtxns",       &scanforstealthtxns,        false,  false },
-    { "getstakerprice",           &getstakerprice,            false,  false },
-    { "getstakerid",              &getstakerid,               false,  false },
-    { "purchasestaker",           &purchasestaker,            false,  true  },
-    { "setstakerowner",           &setstakerowner,            false,  true  },
+    { "getcheckpoint",            &getcheckpoint,             true,   false,    false },
+    { "reservebalance",           &reservebalance,            false,  true,     false },
+    { "checkwallet",              &checkwallet,               false,  true,     false },
+    { "repairwallet",             &repairwallet,              false,  true,     false },
+    { "resendtx",                 &resendtx,                  false,  true,     false },
+    { "createfeework",            &createfeework,             false,  true,     false },
+    { "makekeypair",              &makekeypair,               false,  true,     false },
+    { "sendalert",                &sendalert,                 false,  false,    false },
+    { "getnewstealthaddress",     &getnewstealthaddress,      false,  false,    false },
+    { "liststealthaddresses",     &liststealthaddresses,      false,  false,    false },
+    { "importstealthaddress",     &importstealthaddress,      false,  false,    false },
+    { "sendtostealthaddress",     &sendtostealthaddress,      false,  false,    false },
+    { "clearwallettransactions",  &clearwallettransactions,   false,  false,    false },
+    { "scanforalltxns",           &scanforalltxns,            false,  false,    false },
+    { "scanforstealthtxns",       &scanforstealthtxns,        false,  false,    false },
+    { "getstakerprice",           &getstakerprice,            false,  false,    false },
+    { "getstakerid",              &getstakerid,               false,  false,    false },
+    { "purchasestaker",           &purchasestaker,            false,  true,     false },
+    { "setstakerowner",           &setstakerowner,            false,  true,     false },
     // will enable after everyone on testnet upgrades, to avoid forking logic
-    { "setstakermanager",         &setstakermanager,          false,  true  },
-    { "setstakerdelegate",        &setstakerdelegate,         false,  true  },
-    { "setstakercontroller",      &setstakercontroller,       false,  true  },
-    { "enablestaker",             &enablestaker,              false,  true  },
-    { "disablestaker",            &disablestaker,             false,  true  },
-    { "setstakermeta",            &setstakermeta,             false,  true  },
-    { "claimqposbalance",         &claimqposbalance,          false,  true  },
-    { "getstakerinfo",            &getstakerinfo,             false,  false },
-    { "getstakerauthorities",     &getstakerauthorities,      false,  false },
-    { "liststakerunspent",        &liststakerunspent,         false,  false },
-    { "getqposinfo",              &getqposinfo,               false,  false },
-    { "getqueuesummary",          &getqueuesummary,           false,  false },
-    { "getblockschedule",         &getblockschedule,          false,  false },
-    { "getstakersbyid",           &getstakersbyid,            false,  false },
-    { "getstakersbyweight",       &getstakersbyweight,        false,  false },
-    { "getstakersummary",         &getstakersummary,          false,  false },
-    { "getstakerpriceinfo",       &getstakerpriceinfo,        false,  false },
-    { "getcertifiednodes",        &getcertifiednodes,         false,  false },
-    { "getrecentqueue",           &getrecentqueue,            false,  false },
-    { "getqposbalance",           &getqposbalance,            false,  false },
-    { "getcharacterspg",          &getcharacterspg,           false,  false },
-    { "exitreplay",               &exitreplay,                false,  false },
+    { "setstakermanager",         &setstakermanager,          false,  true,     false },
+    { "setstakerdelegate",        &setstakerdelegate,         false,  true,     false },
+    { "setstakercontroller",      &setstakercontroller,       false,  true,     false },
+    { "enablestaker",             &enablestaker,              false,  true,     false },
+    { "disablestaker",            &disablestaker,             false,  true,     false },
+    { "setstakermeta",            &setstakermeta,             false,  true,     false },
+    { "claimqposbalance",         &claimqposbalance,          false,  true,     false },
+    { "getstakerinfo",            &getstakerinfo,             false,  true,     true  },
+    { "getstakerauthorities",     &getstakerauthorities,      false,  false,    false },
+    { "liststakerunspent",        &liststakerunspent,         false,  false,    false },
+    { "getqposinfo",              &getqposinfo,               false,  false,    false },
+    { "getqueuesummary",          &getqueuesummary,           false,  false,    false },
+    { "getblockschedule",         &getblockschedule,          false,  false,    false },
+    { "getstakersbyid",           &getstakersbyid,            false,  false,    false },
+    { "getstakersbyweight",       &getstakersbyweight,        false,  false,    false },
+    { "getstakersummary",         &getstakersummary,          false,  false,    false },
+    { "getstakerpriceinfo",       &getstakerpriceinfo,        false,  false,    false },
+    { "getcertifiednodes",        &getcertifiednodes,         false,  false,    false },
+    { "getrecentqueue",           &getrecentqueue,            false,  false,    false },
+    { "getqposbalance",           &getqposbalance,            false,  false,    false },
+    { "getcharacterspg",          &getcharacterspg,           false,  false,    false },
+    { "exitreplay",               &exitreplay,                false,  false,    false },
     // explorer api
-    { "gettxvolume",              &gettxvolume,               false,  false },
-    { "getxstvolume",             &getxstvolume,              false,  false },
-    { "getblockinterval",         &getblockinterval,          false,  false },
-    { "getblockintervalmean",     &getblockintervalmean,      false,  false },
-    { "getblockintervalrmsd",     &getblockintervalrmsd,      false,  false },
-    { "getpicopowermean",         &getpicopowermean,          false,  false },
-    { "gethourlymissed",          &gethourlymissed,           false,  false },
-    { "getchildkey",              &getchildkey,               false,  false },
-    { "getaddressbalance",        &getaddressbalance,         false,  false },
-    { "getaddressinfo",           &getaddressinfo,            false,  false },
-    { "getaddressinputs",         &getaddressinputs,          false,  false },
-    { "getaddresstxspg",          &getaddresstxspg,           false,  false },
-    { "getaddressinouts",         &getaddressinouts,          false,  false },
-    { "getaddressinoutspg",       &getaddressinoutspg,        false,  false },
-    { "getaddressoutputs",        &getaddressoutputs,         false,  false },
-    { "gethdaccountpg",           &gethdaccountpg,            false,  false },
-    { "gethdaccount",             &gethdaccount,              false,  false },
-    { "gethdaddresses",           &gethdaddresses,            false,  false },
-    { "getrichlistsize",          &getrichlistsize,           false,  false },
-    { "getrichlist",              &getrichlist,               false,  false },
-    { "getrichlistpg",            &getrichlistpg,             false,  false }
+    { "gettxvolume",              &gettxvolume,               false,  false,    false },
+    { "getxstvolume",             &getxstvolume,              false,  false,    false },
+    { "getblockinterval",         &getblockinterval,          false,  false,    false },
+    { "getblockintervalmean",     &getblockintervalmean,      false,  false,    false },
+    { "getblockintervalrmsd",     &getblockintervalrmsd,      false,  false,    false },
+    { "getpicopowermean",         &getpicopowermean,          false,  false,    false },
+    { "gethourlymissed",          &gethourlymissed,           false,  false,    false },
+    { "getchildkey",              &getchildkey,               false,  false,    false },
+    { "getaddressbalance",        &getaddressbalance,         false,  true,     true  },
+    { "getaddressinfo",           &getaddressinfo,            false,  true,     true  },
+    { "getaddressinputs",         &getaddressinputs,          false,  true,     true  },
+    { "getaddresstxspg",          &getaddresstxspg,           false,  true,     true  },
+    { "getaddressinouts",         &getaddressinouts,          false,  true,     true  },
+    { "getaddressinoutspg",       &getaddressinoutspg,        false,  true,     true  },
+    { "getexplorecursorpg",       &getexplorecursorpg,        false,  true,     true  },
+    { "getaddressoutputs",        &getaddressoutputs,         false,  true,     true  },
+    { "gethdaccountpg",           &gethdaccountpg,            false,  false,    false },
+    { "gethdaccount",             &gethdaccount,              false,  false,    false },
+    { "gethdaddresses",           &gethdaddresses,            false,  false,    false },
+    { "getrichlistsize",          &getrichlistsize,           false,  true,     true  },
+    { "getrichlist",              &getrichlist,               false,  true,     true  },
+    { "getrichlistpg",            &getrichlistpg,             false,  true,     true  }
+};
+
+// Commands that can write their result as it is made. Over HTTP/1.1 their
+//    replies are sent with chunked encoding. They must be in vRPCCommands
+//    too, where the actor builds the same result as a json_spirit value.
+static const struct
+{
+    const char* name;
+    rpcstreamfn_type streamer;
+} vRPCStreamCommands[] =
+{ //  name                        streamer
+  //  ------------------------    ---------------------------
+    { "getblock",                 &StreamGetBlock              },
+    { "getblockbynumber",         &StreamGetBlockByNumber      },
+    { "listtransactions",         &StreamListTransactions      },
+    { "getblockschedule",         &StreamGetBlockSchedule      },
+    { "getaddresstxspg",          &StreamGetAddressTxsPg       },
+    { "getaddressinoutspg",       &StreamGetAddressInOutsPg    },
+    { "getexplorecursorpg",       &StreamGetExploreCursorPg    },
+    { "getrichlist",              &StreamGetRichList           },
+    { "getrichlistpg",            &StreamGetRichListPg         }
 };
 
 CRPCTable::CRPCTable()
@@ -489,6 +554,23 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0;
+         vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0]));
+         vcidx++)
+    {
+        mapStreamers[vRPCStreamCommands[vcidx].name] =
+                                         vRPCStreamCommands[vcidx].streamer;
+    }
+}
+
+rpcstreamfn_type CRPCTable::GetStreamer(const string& name) const
+{
+    map<string, rpcstreamfn_type>::const_iterator it = mapStreamers.find(name);
+    if (it == mapStreamers.end())
+    {
+        return NULL;
+    }
+    return (*it).second;
 }
 
 const CRPCCommand *CRPCTable::operator[](string name) const
@@ -536,7 +618,8 @@ string rfc1123Time()
     return string(buffer);
 }
 
-static string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
+static string HTTPReply(int nStatus, const string& strMsg, bool keepalive,
+                        const char* pszContentType = "application/json")
 {
     if (nStatus == HTTP_UNAUTHORIZED)
         return strprintf("HTTP/1.0 401 Authorization Required\r\n"
@@ -561,13 +644,14 @@ static string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
     else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
     else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
     else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
+    else if (nStatus == HTTP_SERVICE_UNAVAILABLE) cStatus = "Service Unavailable";
     else cStatus = "";
     return strprintf(
             "HTTP/1.1 %d %s\r\n"
             "Date: %s\r\n"
             "Connection: %s\r\n"
             "Content-Length: %" PRIszu "\r\n"
-            "Content-Type: application/json\r\n"
+            "Content-Type: %s\r\n"
             "Server: StealthCoin-json-rpc/%s\r\n"
             "\r\n"
             "%s",
@@ -576,10 +660,38 @@ static string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
         rfc1123Time().c_str(),
         keepalive ? "keep-alive" : "close",
         strMsg.size(),
+        pszContentType,
         FormatFullVersion().c_str(),
         strMsg.c_str());
 }
 
+// Headers of a reply whose body follows in chunks.
+static string HTTPReplyChunked(bool keepalive)
+{
+    return strprintf(
+            "HTTP/1.1 200 OK\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Content-Type: application/json\r\n"
+            "Server: StealthCoin-json-rpc/%s\r\n"
+            "\r\n",
+        rfc1123Time().c_str(),
+        keepalive ? "keep-alive" : "close",
+        FormatFullVersion().c_str());
+}
+
+static string HTTPChunk(const string& strData)
+{
+    if (strData.empty())
+    {
+        // a zero size chunk would end the body
+        return "";
+    }
+    return strprintf("%x\r\n", (unsigned int)strData.size()) +
+           strData + "\r\n";
+}
+
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto)
 {
     string str;
@@ -597,6 +709,24 @@ int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto)
     return atoi(vWords[1].c_str());
 }
 
+// Reads "<method> <path> HTTP/1.x", the first line of a request.
+static void ReadHTTPRequestLine(std::basic_istream<char>& stream,
+                                string& strMethodRet,
+                                string& strPathRet,
+                                int& protoRet)
+{
+    string str;
+    getline(stream, str);
+    vector<string> vWords;
+    boost::split(vWords, str, boost::is_any_of(" "));
+    strMethodRet = (vWords.size() > 0) ? vWords[0] : "";
+    strPathRet = (vWords.size() > 1) ? vWords[1] : "";
+    protoRet = 0;
+    const char *ver = strstr(str.c_str(), "HTTP/1.");
+    if (ver != NULL)
+        protoRet = atoi(ver+7);
+}
+
 int ReadHTTPHeader(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet)
 {
     int nLen = 0;
@@ -622,6 +752,49 @@ int ReadHTTPHeader(std::basic_istream<char>& stream, map<string, string>& mapHea
     return nLen;
 }
 
+// Reads a body sent with chunked transfer encoding, and its trailer.
+static bool ReadHTTPChunks(std::basic_istream<char>& stream, string& strMessageRet)
+{
+    LOOP
+    {
+        string str;
+        std::getline(stream, str);
+        if (!stream)
+        {
+            return false;
+        }
+        // any chunk extension after the size is ignored
+        unsigned long nSize = strtoul(str.c_str(), NULL, 16);
+        if (nSize == 0)
+        {
+            break;
+        }
+        if (strMessageRet.size() + nSize > MAX_SIZE)
+        {
+            return false;
+        }
+        size_t nPos = strMessageRet.size();
+        strMessageRet.resize(nPos + nSize);
+        stream.read(&strMessageRet[nPos], nSize);
+        // CRLF after the data
+        std::getline(stream, str);
+        if (!stream)
+        {
+            return false;
+        }
+    }
+    LOOP
+    {
+        string str;
+        std::getline(stream, str);
+        if (!stream || str.empty() || str == "\r")
+        {
+            break;
+        }
+    }
+    return true;
+}
+
 int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRet, string& strMessageRet)
 {
     mapHeadersRet.clear();
@@ -639,7 +812,14 @@ int ReadHTTP(std::basic_istream<char>& stream, map<string, string>& mapHeadersRe
     }
 
     // Read message
-    if (nLen > 0)
+    if (mapHeadersRet["transfer-encoding"] == "chunked")
+    {
+        if (!ReadHTTPChunks(stream, strMessageRet))
+        {
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
+    }
+    else if (nLen > 0)
     {
         vector<char> vch(nLen);
         stream.read(&vch[0], nLen);
@@ -706,7 +886,7 @@ string JSONRPCReply(const Value& result, const Value& error, const Value& id)
     return write_string(Value(reply), false) + "\n";
 }
 
-void ErrorReply(std::ostream& stream, const Object& objError, const Value& id)
+string ErrorReply(const Object& objError, const Value& id)
 {
     // Send error reply from json-rpc error object
     int nStatus = HTTP_INTERNAL_SERVER_ERROR;
@@ -714,7 +894,7 @@ void ErrorReply(std::ostream& stream, const Object& objError, const Value& id)
     if (code == RPC_INVALID_REQUEST) nStatus = HTTP_BAD_REQUEST;
     else if (code == RPC_METHOD_NOT_FOUND) nStatus = HTTP_NOT_FOUND;
     string strReply = JSONRPCReply(Value::null, objError, id);
-    stream << HTTPReply(nStatus, strReply, false) << std::flush;
+    return HTTPReply(nStatus, strReply, false);
 }
 
 bool ClientAllowed(const boost::asio::ip::address& address)
@@ -831,55 +1011,481 @@ private:
     asio::ssl::stream<typename Protocol::socket>& stream;
 };
 
-class AcceptedConnection
+//
+// RPC work queue
+//
+// Connections are read and written asynchronously on the listener thread.
+// Each complete request waits here for one of the -rpcthreads workers, and
+// once -rpcworkqueue requests are waiting new ones are refused with a 503.
+//
+class CRPCWorkQueue
 {
+private:
+    boost::mutex mutex;
+    boost::condition_variable condition;
+    std::deque<boost::function<void ()> > queue;
+    size_t nMaxDepth;
+
 public:
-    virtual ~AcceptedConnection() {}
+    CRPCWorkQueue()
+    {
+        nMaxDepth = 0;
+    }
+
+    void SetMaxDepth(size_t nMaxDepthIn)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nMaxDepth = nMaxDepthIn;
+    }
 
-    virtual std::iostream& stream() = 0;
-    virtual std::string peer_address_to_string() const = 0;
-    virtual void close() = 0;
+    // false if the queue is full
+    bool Enqueue(const boost::function<void ()>& work)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (queue.size() >= nMaxDepth)
+            {
+                return false;
+            }
+            queue.push_back(work);
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    // false on shutdown
+    bool Dequeue(boost::function<void ()>& workRet)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.empty())
+        {
+            if (fShutdown)
+            {
+                return false;
+            }
+            condition.timed_wait(lock, boost::posix_time::milliseconds(250));
+        }
+        workRet = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    void Clear()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queue.clear();
+    }
+
+    size_t size()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        return queue.size();
+    }
 };
 
+static CRPCWorkQueue rpcWorkQueue;
+
+// see JSONRPCExecBatch
+static int nRPCBatchThreads = 1;
+static uint64_t nRPCBatchMaxBytes = 0;
+
+
+/**
+ * An HTTP/1.1 connection to the RPC server.
+ *
+ * Reads, writes and the SSL handshake run as asio handlers on the listener
+ * thread, so an idle keep-alive connection costs no thread. Each request is
+ * executed on a worker, which posts the reply back to the listener thread.
+ * A streamed reply is posted in parts, which queue up and are written in
+ * order. Pending handlers hold the connection alive through
+ * shared_from_this().
+ */
 template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class CRPCConnection :
+        public boost::enable_shared_from_this< CRPCConnection<Protocol> >
 {
 public:
-    AcceptedConnectionImpl(
+    typename Protocol::endpoint peer;
+    asio::ssl::stream<typename Protocol::socket> sslStream;
+    // delays refusing a wrong password
+    asio::deadline_timer timerRefuse;
+
+    CRPCConnection(
 #if BOOST_ASIO_HAS_IO_SERVICE
             asio::io_service& io_service,
 #else
             asio::io_context& io_service,
 #endif
             ssl::context &context,
-            bool fUseSSL) :
+            bool fUseSSLIn) :
         sslStream(io_service, context),
-        _d(sslStream, fUseSSL),
-        _stream(_d)
+        timerRefuse(io_service),
+        buf(MAX_SIZE)
     {
+        fUseSSL = fUseSSLIn;
+        fKeepAlive = false;
+        nContentLength = 0;
+        nProto = 0;
+        nSendPending = 0;
+        fSendFailed = false;
     }
 
-    virtual std::iostream& stream()
+    void Start()
     {
-        return _stream;
+        if (fUseSSL)
+        {
+            sslStream.async_handshake(
+                    ssl::stream_base::server,
+                    boost::bind(&CRPCConnection::HandleHandshake,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+        else
+        {
+            ReadHeader();
+        }
     }
 
-    virtual std::string peer_address_to_string() const
+    // reply without a worker and close
+    void Refuse(int nStatus, const string& strMsg)
     {
-        return peer.address().to_string();
+        fKeepAlive = false;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexSend);
+            nSendPending++;
+        }
+        QueueWrite(HTTPReply(nStatus, strMsg, false), true);
     }
 
-    virtual void close()
+private:
+    bool fUseSSL;
+    asio::streambuf buf;
+    map<string, string> mapHeaders;
+    size_t nContentLength;
+    string strRequest;
+    string strHTTPMethod;
+    string strPath;
+    bool fKeepAlive;
+    int nProto;
+    // parts of the reply to write, each marked if it is the last one,
+    //    only touched on the listener thread
+    std::deque<std::pair<string, bool> > queueWrite;
+    // parts posted by the worker and not yet written
+    boost::mutex mutexSend;
+    boost::condition_variable condSend;
+    int nSendPending;
+    bool fSendFailed;
+
+    void HandleHandshake(const boost::system::error_code& error)
     {
-        _stream.close();
+        if (error)
+        {
+            Close();
+            return;
+        }
+        ReadHeader();
     }
 
-    typename Protocol::endpoint peer;
-    asio::ssl::stream<typename Protocol::socket> sslStream;
+    void ReadHeader()
+    {
+        if (fUseSSL)
+        {
+            asio::async_read_until(
+                    sslStream, buf, "\r\n\r\n",
+                    boost::bind(&CRPCConnection::HandleReadHeader,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+        else
+        {
+            asio::async_read_until(
+                    sslStream.next_layer(), buf, "\r\n\r\n",
+                    boost::bind(&CRPCConnection::HandleReadHeader,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+    }
 
-private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
+    void HandleReadHeader(const boost::system::error_code& error)
+    {
+        if (error || fShutdown)
+        {
+            Close();
+            return;
+        }
+
+        // consumes the request line and headers, leaving any body in buf
+        std::istream stream(&buf);
+        ReadHTTPRequestLine(stream, strHTTPMethod, strPath, nProto);
+        mapHeaders.clear();
+        int nLen = ReadHTTPHeader(stream, mapHeaders);
+        if (nLen < 0 || nLen > (int)MAX_SIZE)
+        {
+            Refuse(HTTP_BAD_REQUEST, "");
+            return;
+        }
+        nContentLength = nLen;
+
+        // checked here so unauthorized requests never take a worker
+        if ((mapHeaders.count("authorization") == 0) ||
+            !HTTPAuthorized(mapHeaders))
+        {
+            RefuseUnauthorized();
+            return;
+        }
+
+        string sConHdr = mapHeaders["connection"];
+        if ((sConHdr != "close") && (sConHdr != "keep-alive"))
+        {
+            mapHeaders["connection"] = (nProto >= 1) ? "keep-alive" : "close";
+        }
+
+        if (buf.size() >= nContentLength)
+        {
+            HandleReadBody(boost::system::error_code());
+            return;
+        }
+
+        size_t nNeed = nContentLength - buf.size();
+        if (fUseSSL)
+        {
+            asio::async_read(
+                    sslStream, buf, asio::transfer_exactly(nNeed),
+                    boost::bind(&CRPCConnection::HandleReadBody,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+        else
+        {
+            asio::async_read(
+                    sslStream.next_layer(), buf, asio::transfer_exactly(nNeed),
+                    boost::bind(&CRPCConnection::HandleReadBody,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+    }
+
+    // Refuses the request for its credentials. The listener thread must
+    //    not sleep, so a wrong password is answered when a timer expires.
+    void RefuseUnauthorized()
+    {
+        if (mapHeaders.count("authorization") == 0)
+        {
+            Refuse(HTTP_UNAUTHORIZED, "");
+            return;
+        }
+        printf("ThreadRPCServer incorrect password attempt from %s\n",
+               peer.address().to_string().c_str());
+        /* Deter brute-forcing short passwords.
+           If this results in a DOS the user really
+           shouldn't have their RPC port exposed.*/
+        if (mapArgs["-rpcpassword"].size() >= 20)
+        {
+            Refuse(HTTP_UNAUTHORIZED, "");
+            return;
+        }
+        timerRefuse.expires_from_now(boost::posix_time::milliseconds(250));
+        timerRefuse.async_wait(
+                boost::bind(&CRPCConnection::HandleRefuseTimer,
+                            this->shared_from_this(),
+                            boost::asio::placeholders::error));
+    }
+
+    void HandleRefuseTimer(const boost::system::error_code& error)
+    {
+        if (error || fShutdown)
+        {
+            Close();
+            return;
+        }
+        Refuse(HTTP_UNAUTHORIZED, "");
+    }
+
+    void HandleReadBody(const boost::system::error_code& error)
+    {
+        if (error || fShutdown)
+        {
+            Close();
+            return;
+        }
+
+        // anything past the body is the next pipelined request
+        asio::streambuf::const_buffers_type data = buf.data();
+        strRequest.assign(asio::buffers_begin(data),
+                          asio::buffers_begin(data) + nContentLength);
+        buf.consume(nContentLength);
+
+        if (!rpcWorkQueue.Enqueue(boost::bind(&CRPCConnection::Execute,
+                                              this->shared_from_this())))
+        {
+            printf("ThreadRPCServer work queue full, refusing %s\n",
+                   peer.address().to_string().c_str());
+            Refuse(HTTP_SERVICE_UNAVAILABLE,
+                   JSONRPCReply(Value::null,
+                                JSONRPCError(RPC_MISC_ERROR,
+                                             "Work queue depth exceeded"),
+                                Value::null));
+        }
+    }
+
+    // runs on a worker thread
+    void Execute()
+    {
+        // only HTTP/1.1 clients understand chunked replies
+        ReplySender sendReply;
+        if (nProto >= 1)
+        {
+            sendReply = boost::bind(&CRPCConnection::SendFromWorker,
+                                    this->shared_from_this(),
+                                    boost::placeholders::_1,
+                                    boost::placeholders::_2,
+                                    false);
+        }
+        string strReply;
+        if ((strHTTPMethod == "GET") && (strPath == "/metrics"))
+        {
+            strReply = ExecHTTPMetrics(mapHeaders, fKeepAlive);
+        }
+        else
+        {
+            strReply = ExecHTTPRequest(mapHeaders,
+                                       strRequest,
+                                       fKeepAlive,
+                                       sendReply);
+        }
+        strRequest.clear();
+        SendFromWorker(strReply, false, true);
+    }
+
+    // Runs on a worker thread. With fWait, holds the worker while two parts
+    //    are still unwritten, so a slow client limits how far a streamed
+    //    reply runs ahead of it. Without, the parts queue up to
+    //    RPC_STREAM_MAX_PENDING, then the worker is held as well, but for
+    //    no more than RPC_STREAM_MAX_WAIT because it may hold cs_main.
+    //    The last part of a reply is never held.
+    bool SendFromWorker(const string& strData, bool fWait, bool fLast)
+    {
+        {
+            int nMaxPending = fWait ? 2 : RPC_STREAM_MAX_PENDING;
+            int64_t nWaitStart = GetTimeMillis();
+            boost::unique_lock<boost::mutex> lock(mutexSend);
+            while (!fLast && (nSendPending >= nMaxPending) && !fSendFailed)
+            {
+                if (fShutdown)
+                {
+                    return false;
+                }
+                if (!fWait &&
+                    (GetTimeMillis() - nWaitStart > RPC_STREAM_MAX_WAIT))
+                {
+                    printf("SendFromWorker() : client too slow, giving up\n");
+                    return false;
+                }
+                condSend.timed_wait(lock,
+                                    boost::posix_time::milliseconds(250));
+            }
+            if (fSendFailed)
+            {
+                return false;
+            }
+            nSendPending++;
+        }
+#if BOOST_VERSION >= 106600
+        asio::post(sslStream.get_executor(),
+                   boost::bind(&CRPCConnection::QueueWrite,
+                               this->shared_from_this(),
+                               strData,
+                               fLast));
+#else
+        sslStream.get_io_service().post(
+                   boost::bind(&CRPCConnection::QueueWrite,
+                               this->shared_from_this(),
+                               strData,
+                               fLast));
+#endif
+        return true;
+    }
+
+    void QueueWrite(const string& strData, bool fLast)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutexSend);
+            if (fSendFailed)
+            {
+                nSendPending--;
+                return;
+            }
+        }
+        queueWrite.push_back(std::make_pair(strData, fLast));
+        if (queueWrite.size() == 1)
+        {
+            Write();
+        }
+    }
+
+    void Write()
+    {
+        if (fUseSSL)
+        {
+            asio::async_write(
+                    sslStream, asio::buffer(queueWrite.front().first),
+                    boost::bind(&CRPCConnection::HandleWrite,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+        else
+        {
+            asio::async_write(
+                    sslStream.next_layer(),
+                    asio::buffer(queueWrite.front().first),
+                    boost::bind(&CRPCConnection::HandleWrite,
+                                this->shared_from_this(),
+                                boost::asio::placeholders::error));
+        }
+    }
+
+    void HandleWrite(const boost::system::error_code& error)
+    {
+        bool fLast = queueWrite.front().second;
+        queueWrite.pop_front();
+        bool fFailed = (error || fShutdown);
+        {
+            boost::unique_lock<boost::mutex> lock(mutexSend);
+            nSendPending -= (1 + (fFailed ? queueWrite.size() : 0));
+            fSendFailed = fFailed;
+        }
+        condSend.notify_all();
+
+        if (fFailed)
+        {
+            queueWrite.clear();
+            Close();
+            return;
+        }
+        if (!queueWrite.empty())
+        {
+            Write();
+            return;
+        }
+        if (!fLast)
+        {
+            // the worker is still making the reply
+            return;
+        }
+        if (!fKeepAlive)
+        {
+            Close();
+            return;
+        }
+        ReadHeader();
+    }
+
+    void Close()
+    {
+        boost::system::error_code ec;
+        sslStream.lowest_layer().shutdown(socket_base::shutdown_both, ec);
+        sslStream.lowest_layer().close(ec);
+    }
 };
 
 void ThreadRPCServer(void* parg)
@@ -908,7 +1514,7 @@ template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
                              ssl::context& context,
                              bool fUseSSL,
-                             AcceptedConnection* conn,
+                             boost::shared_ptr< CRPCConnection<Protocol> > conn,
                              const boost::system::error_code& error);
 
 /**
@@ -921,14 +1527,14 @@ static void RPCListen(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketA
 {
     // Accept connection
 #if BOOST_VERSION >= 106600
-    AcceptedConnectionImpl<Protocol>* conn =
-          new AcceptedConnectionImpl<Protocol>(
+    boost::shared_ptr< CRPCConnection<Protocol> > conn(
+          new CRPCConnection<Protocol>(
                  (boost::asio::io_context&)acceptor->get_executor().context(),
-                  context, fUseSSL);
+                  context, fUseSSL));
 #else
-    AcceptedConnectionImpl<Protocol>* conn =
-          new AcceptedConnectionImpl<Protocol>(
-                 acceptor->get_io_service(), context, fUseSSL);
+    boost::shared_ptr< CRPCConnection<Protocol> > conn(
+          new CRPCConnection<Protocol>(
+                 acceptor->get_io_service(), context, fUseSSL));
 #endif
     acceptor->async_accept(
             conn->sslStream.lowest_layer(),
@@ -948,7 +1554,7 @@ template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
                              ssl::context& context,
                              const bool fUseSSL,
-                             AcceptedConnection* conn,
+                             boost::shared_ptr< CRPCConnection<Protocol> > conn,
                              const boost::system::error_code& error)
 {
     vnThreadsRunning[THREAD_RPCLISTENER]++;
@@ -959,37 +1565,66 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol,
         RPCListen(acceptor, context, fUseSSL);
     }
 
-    AcceptedConnectionImpl<ip::tcp>* tcp_conn = dynamic_cast< AcceptedConnectionImpl<ip::tcp>* >(conn);
-
     // TODO: Actually handle errors
     if (error)
     {
-        delete conn;
+        // conn is released with the handler
     }
 
     // Restrict callers by IP.  It is important to
-    // do this before starting client thread, to filter out
+    // do this before reading anything, to filter out
     // certain DoS and misbehaving clients.
-    else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address()))
+    else if (!ClientAllowed(conn->peer.address()))
     {
         // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
         if (!fUseSSL)
         {
-            conn->stream() << HTTPReply(HTTP_FORBIDDEN, "", false) << std::flush;
+            conn->Refuse(HTTP_FORBIDDEN, "");
         }
-        delete conn;
     }
 
-    // start HTTP client thread
-    else if (!NewThread(ThreadRPCServer3, conn))
+    else
     {
-        printf("Failed to create RPC server client thread\n");
-        delete conn;
+        conn->Start();
     }
 
     vnThreadsRunning[THREAD_RPCLISTENER]--;
 }
 
+void ThreadRPCWorker(void* parg)
+{
+    // Make this thread recognisable as an RPC worker
+    RenameThread("stealth-rpcwork");
+
+    {
+        LOCK(cs_THREAD_RPCHANDLER);
+        vnThreadsRunning[THREAD_RPCHANDLER]++;
+    }
+
+    boost::function<void ()> work;
+    while (rpcWorkQueue.Dequeue(work))
+    {
+        try
+        {
+            work();
+        }
+        catch (std::exception& e)
+        {
+            PrintExceptionContinue(&e, "ThreadRPCWorker()");
+        }
+        catch (...)
+        {
+            PrintExceptionContinue(NULL, "ThreadRPCWorker()");
+        }
+        work.clear();
+    }
+
+    {
+        LOCK(cs_THREAD_RPCHANDLER);
+        vnThreadsRunning[THREAD_RPCHANDLER]--;
+    }
+}
+
 void ThreadRPCServer2(void* parg)
 {
     printf("ThreadRPCServer started\n");
@@ -1159,11 +1794,44 @@ void ThreadRPCServer2(void* parg)
         return;
     }
 
+    rpcWorkQueue.SetMaxDepth(
+            max((int)GetArg("-rpcworkqueue",
+                            (int64_t) chainParams.DEFAULT_RPCWORKQUEUE), 1));
+    int nThreads = max((int)GetArg("-rpcthreads",
+                                   (int64_t) chainParams.DEFAULT_RPCTHREADS), 1);
+    nRPCBatchThreads = max((int)GetArg("-rpcbatchthreads",
+                                 (int64_t) chainParams.DEFAULT_RPCBATCHTHREADS),
+                           1);
+    nRPCBatchMaxBytes = (uint64_t)max(GetArg("-rpcbatchmaxsize",
+                             (int64_t) chainParams.DEFAULT_RPCBATCHMAXSIZE),
+                             (int64_t)1) << 20;
+    for (int i = 0; i < nThreads; i++)
+    {
+        if (!NewThread(ThreadRPCWorker, NULL))
+        {
+            printf("Error: NewThread(ThreadRPCWorker) failed\n");
+        }
+    }
+
     vnThreadsRunning[THREAD_RPCLISTENER]--;
     while (!fShutdown)
     {
         io_service.run_one();
     }
+    // workers post replies to io_service, so it has to outlive them
+    rpcWorkQueue.Clear();
+    while (vnThreadsRunning[THREAD_RPCHANDLER] > 0)
+    {
+        MilliSleep(20);
+    }
+    // let replies already handed back by workers (such as stop's) go out
+    for (int i = 0; i < 8; i++)
+    {
+        if (io_service.poll() == 0)
+        {
+            break;
+        }
+    }
     vnThreadsRunning[THREAD_RPCLISTENER]++;
     StopRequests();
 }
@@ -1233,113 +1901,360 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
-static string JSONRPCExecBatch(const Array& vReq)
+//
+// Batch requests
+//
+// Runs of consecutive read-only calls in a batch are executed concurrently:
+// the worker handling the batch takes calls in turn with up to
+// -rpcbatchthreads - 1 helpers queued on the RPC work queue. Any other call
+// waits for the calls before it and runs alone, so side effects keep their
+// order. Replies are serialized as they are made and kept in request order;
+// once they pass -rpcbatchmaxsize the remaining calls are not executed.
+//
+static bool IsReadOnlyRequest(const Value& req)
 {
-    Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
-
-    return write_string(Value(ret), false) + "\n";
+    if (req.type() != obj_type)
+    {
+        return false;
+    }
+    const Value& valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+    {
+        return false;
+    }
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return (pcmd && pcmd->readonly);
 }
 
-static CCriticalSection cs_THREAD_RPCHANDLER;
-
-void ThreadRPCServer3(void* parg)
+class CRPCBatch
 {
-    // Make this thread recognisable as the RPC handler
-    RenameThread("bitcoin-rpchand");
-
+private:
+    boost::mutex mutex;
+    boost::condition_variable condition;
+    const Array& vReq;
+    std::vector<std::string>& vReplies;
+    size_t nNext;
+    size_t nEnd;
+    // helpers running calls, and whether new helpers may start
+    int nActive;
+    bool fClosed;
+    uint64_t nBytes;
+
+    std::string ExecOne(size_t nIndex)
     {
-        LOCK(cs_THREAD_RPCHANDLER);
-        vnThreadsRunning[THREAD_RPCHANDLER]++;
-    }
-    AcceptedConnection *conn = (AcceptedConnection *) parg;
-
-    bool fRun = true;
-    LOOP {
-        if (fShutdown || !fRun)
         {
-            conn->close();
-            delete conn;
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nBytes > nRPCBatchMaxBytes)
             {
-                LOCK(cs_THREAD_RPCHANDLER);
-                --vnThreadsRunning[THREAD_RPCHANDLER];
+                Value id;
+                if (vReq[nIndex].type() == obj_type)
+                {
+                    id = find_value(vReq[nIndex].get_obj(), "id");
+                }
+                Object error = JSONRPCError(RPC_OUT_OF_MEMORY,
+                                            "Batch reply size limit exceeded");
+                return write_string(
+                           Value(JSONRPCReplyObj(Value::null, error, id)),
+                           false);
             }
-            return;
         }
-        map<string, string> mapHeaders;
-        string strRequest;
+        return write_string(Value(JSONRPCExecOne(vReq[nIndex])), false);
+    }
 
-        ReadHTTP(conn->stream(), mapHeaders, strRequest);
+public:
+    CRPCBatch(const Array& vReqIn, std::vector<std::string>& vRepliesIn) :
+        vReq(vReqIn), vReplies(vRepliesIn)
+    {
+        nNext = 0;
+        nEnd = 0;
+        nActive = 0;
+        fClosed = true;
+        nBytes = 0;
+    }
 
-        // Check authorization
-        if (mapHeaders.count("authorization") == 0)
+    // executes vReq[nBegin, nEndIn) with up to nHelpers helpers
+    void Run(size_t nBegin, size_t nEndIn, int nHelpers,
+             const boost::shared_ptr<CRPCBatch>& pthis)
+    {
         {
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
-            break;
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nNext = nBegin;
+            nEnd = nEndIn;
+            fClosed = false;
+        }
+        for (int i = 0; i < nHelpers; i++)
+        {
+            if (!rpcWorkQueue.Enqueue(boost::bind(&CRPCBatch::Help, pthis)))
+            {
+                // the caller does the rest
+                break;
+            }
         }
-        if (!HTTPAuthorized(mapHeaders))
+        Work();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        // a helper dequeued from now on finds nothing to do
+        fClosed = true;
+        while (nActive > 0)
         {
-            printf("ThreadRPCServer incorrect password attempt from %s\n", conn->peer_address_to_string().c_str());
-            /* Deter brute-forcing short passwords.
-               If this results in a DOS the user really
-               shouldn't have their RPC port exposed.*/
-            if (mapArgs["-rpcpassword"].size() < 20)
-                MilliSleep(250);
+            condition.wait(lock);
+        }
+    }
 
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
-            break;
+    // runs calls until none of the current run are left
+    void Work()
+    {
+        while (true)
+        {
+            size_t nIndex;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (nNext >= nEnd)
+                {
+                    return;
+                }
+                nIndex = nNext;
+                nNext += 1;
+            }
+            std::string strReply = ExecOne(nIndex);
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nBytes += strReply.size();
+            vReplies[nIndex].swap(strReply);
         }
-        if (mapHeaders["connection"] == "close")
-            fRun = false;
+    }
 
-        JSONRequest jreq;
-        try
+    void Help()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fClosed)
+            {
+                return;
+            }
+            nActive += 1;
+        }
+        Work();
         {
-            // Parse request
-            Value valRequest;
-            if (!read_string(strRequest, valRequest))
-                throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nActive -= 1;
+        }
+        condition.notify_all();
+    }
+};
 
-            string strReply;
+static string JSONRPCExecBatch(const Array& vReq)
+{
+    vector<string> vReplies(vReq.size());
+    boost::shared_ptr<CRPCBatch> pbatch(new CRPCBatch(vReq, vReplies));
 
-            // singleton request
-            if (valRequest.type() == obj_type) {
-                jreq.parse(valRequest);
+    size_t nBegin = 0;
+    while (nBegin < vReq.size())
+    {
+        size_t nEnd = nBegin + 1;
+        if (IsReadOnlyRequest(vReq[nBegin]))
+        {
+            while ((nEnd < vReq.size()) && IsReadOnlyRequest(vReq[nEnd]))
+            {
+                nEnd += 1;
+            }
+        }
+        int nHelpers = 0;
+        if (nEnd - nBegin > 1)
+        {
+            nHelpers = (int)min((size_t)(nRPCBatchThreads - 1),
+                                nEnd - nBegin - 1);
+        }
+        pbatch->Run(nBegin, nEnd, nHelpers, pbatch);
+        nBegin = nEnd;
+    }
 
-                Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+    size_t nSize = 2 + vReplies.size();
+    BOOST_FOREACH(const string& strReply, vReplies)
+    {
+        nSize += strReply.size();
+    }
+    string strRet;
+    strRet.reserve(nSize + 1);
+    strRet += "[";
+    for (unsigned int i = 0; i < vReplies.size(); i++)
+    {
+        if (i > 0)
+        {
+            strRet += ",";
+        }
+        strRet += vReplies[i];
+        // free each reply as soon as it is copied
+        string().swap(vReplies[i]);
+    }
+    strRet += "]\n";
 
-                // Send reply
-                strReply = JSONRPCReply(result, Value::null, jreq.id);
+    return strRet;
+}
 
-            // array of requests
-            } else if (valRequest.type() == array_type)
-                strReply = JSONRPCExecBatch(valRequest.get_array());
-            else
-                throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+// Writes the chunks of a streamed reply, headers first.
+class CHTTPChunkedReply
+{
+public:
+    CHTTPChunkedReply(const ReplySender& sendReplyIn, bool fKeepAliveIn, bool fWaitIn)
+    {
+        sendReply = sendReplyIn;
+        fKeepAlive = fKeepAliveIn;
+        fWait = fWaitIn;
+        fStarted = false;
+    }
 
-            conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
+    void Send(const string& strData)
+    {
+        string strOut;
+        if (!fStarted)
+        {
+            strOut = HTTPReplyChunked(fKeepAlive);
+            fStarted = true;
         }
-        catch (Object& objError)
+        strOut += HTTPChunk(strData);
+        if (!sendReply(strOut, fWait))
         {
-            ErrorReply(conn->stream(), objError, jreq.id);
-            break;
+            throw runtime_error("client disconnected");
         }
-        catch (std::exception& e)
+    }
+
+    bool IsStarted() const
+    {
+        return fStarted;
+    }
+
+private:
+    ReplySender sendReply;
+    bool fKeepAlive;
+    bool fWait;
+    bool fStarted;
+};
+
+// Executes a request whose result can be streamed. A reply that fits in one
+//    chunk is returned whole with a Content-Length. Otherwise the chunks are
+//    sent as they fill and the end of the body is returned. An error before
+//    anything was sent is thrown as usual, after that the connection can
+//    only be dropped.
+static string ExecHTTPStream(const JSONRequest& jreq,
+                             bool fRun,
+                             const ReplySender& sendReply,
+                             bool& fKeepAliveRet)
+{
+    const CRPCCommand *pcmd = tableRPC[jreq.strMethod];
+
+    // Commands run under cs_main wait for the client only once many parts
+    //    are unwritten, and not for long, so a slow client can neither
+    //    stall the node nor make it buffer the whole reply.
+    CHTTPChunkedReply reply(sendReply, fRun, (pcmd != NULL) && pcmd->unlocked);
+    CJSONTextStream stream(boost::bind(&CHTTPChunkedReply::Send,
+                                       &reply,
+                                       boost::placeholders::_1),
+                           RPC_STREAM_CHUNK_SIZE);
+    try
+    {
+        stream.BeginObject();
+        stream.Key("result");
+        tableRPC.executeStream(jreq.strMethod, jreq.params, stream);
+        stream.WritePair("error", Value::null);
+        stream.WritePair("id", jreq.id);
+        stream.EndObject();
+        stream.Append("\n");
+    }
+    catch (...)
+    {
+        if (!reply.IsStarted())
         {
-            ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
-            break;
+            throw;
         }
+        printf("ExecHTTPStream() : %s aborted after %" PRIu64 " bytes\n",
+               jreq.strMethod.c_str(), stream.GetBytesWritten());
+        fKeepAliveRet = false;
+        return "";
     }
 
-    delete conn;
+    string strRest;
+    stream.TakeBuffer(strRest);
+    fKeepAliveRet = fRun;
+    if (!reply.IsStarted())
     {
-        LOCK(cs_THREAD_RPCHANDLER);
-        vnThreadsRunning[THREAD_RPCHANDLER]--;
+        return HTTPReply(HTTP_OK, strRest, fRun);
     }
+    return HTTPChunk(strRest) + "0\r\n\r\n";
 }
 
-json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
+// Serves GET /metrics for Prometheus. The connection has checked the RPC
+// credentials.
+static string ExecHTTPMetrics(map<string, string>& mapHeaders,
+                              bool& fKeepAliveRet)
+{
+    fKeepAliveRet = false;
+    if (!GetBoolArg("-rpcmetrics"))
+    {
+        return HTTPReply(HTTP_NOT_FOUND, "", false);
+    }
+    fKeepAliveRet = (mapHeaders["connection"] != "close");
+    return HTTPReply(HTTP_OK, MetricsToPrometheus(), fKeepAliveRet,
+                     "text/plain; version=0.0.4");
+}
+
+// Execute one authorized HTTP request, returning the full HTTP reply.
+// fKeepAliveRet is false when the connection should close after the reply.
+// If sendReply is set, a streamed reply may send its start through it, and
+// only the rest is returned.
+static string ExecHTTPRequest(map<string, string>& mapHeaders,
+                              const string& strRequest,
+                              bool& fKeepAliveRet,
+                              const ReplySender& sendReply)
+{
+    fKeepAliveRet = false;
+
+    bool fRun = (mapHeaders["connection"] != "close");
+
+    JSONRequest jreq;
+    try
+    {
+        // Parse request
+        Value valRequest;
+        if (!ReadJSON(strRequest, valRequest))
+            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+
+        string strReply;
+
+        // singleton request
+        if (valRequest.type() == obj_type) {
+            jreq.parse(valRequest);
+
+            if (!sendReply.empty() &&
+                (tableRPC.GetStreamer(jreq.strMethod) != NULL))
+            {
+                return ExecHTTPStream(jreq, fRun, sendReply, fKeepAliveRet);
+            }
+
+            Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+
+            // Send reply
+            strReply = JSONRPCReply(result, Value::null, jreq.id);
+
+        // array of requests
+        } else if (valRequest.type() == array_type)
+            strReply = JSONRPCExecBatch(valRequest.get_array());
+        else
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+
+        fKeepAliveRet = fRun;
+        return HTTPReply(HTTP_OK, strReply, fRun);
+    }
+    catch (Object& objError)
+    {
+        return ErrorReply(objError, jreq.id);
+    }
+    catch (std::exception& e)
+    {
+        return ErrorReply(JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+    }
+}
+
+// Finds the command for strMethod and checks that it may run.
+static const CRPCCommand* GetRunnableCommand(const string& strMethod)
 {
     // Find method
     const CRPCCommand *pcmd = tableRPC[strMethod];
@@ -1352,6 +2267,49 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    return pcmd;
+}
+
+static CMetricHistogram* NewRPCHistogram(const string& strMethod)
+{
+    return GetMetricHistogram("stealth_rpc_seconds",
+                              "Time to execute an RPC call, by method",
+                              "method", strMethod);
+}
+
+static map<string, CMetricHistogram*> RegisterRPCHistograms()
+{
+    map<string, CMetricHistogram*> mapHistograms;
+    for (unsigned int i = 0;
+         i < (sizeof(vRPCCommands) / sizeof(vRPCCommands[0]));
+         i++)
+    {
+        string strMethod(vRPCCommands[i].name);
+        mapHistograms[strMethod] = NewRPCHistogram(strMethod);
+    }
+    return mapHistograms;
+}
+
+// The histograms of all methods are registered together on first use and
+//    never change after, so a call finds its own without taking cs_metrics.
+static CMetricHistogram* GetRPCHistogram(const string& strMethod)
+{
+    static const map<string, CMetricHistogram*> mapHistograms =
+                                                   RegisterRPCHistograms();
+    map<string, CMetricHistogram*>::const_iterator it =
+                                              mapHistograms.find(strMethod);
+    if (it != mapHistograms.end())
+    {
+        return it->second;
+    }
+    return NewRPCHistogram(strMethod);
+}
+
+json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
+{
+    const CRPCCommand *pcmd = GetRunnableCommand(strMethod);
+    CMetricTimer timer(GetRPCHistogram(strMethod));
+
     try
     {
         // Execute
@@ -1375,6 +2333,34 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
     }
 }
 
+void CRPCTable::executeStream(const std::string &strMethod,
+                              const json_spirit::Array &params,
+                              CJSONStream& stream) const
+{
+    const CRPCCommand *pcmd = GetRunnableCommand(strMethod);
+    rpcstreamfn_type streamer = GetStreamer(strMethod);
+    if (!streamer)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+    CMetricTimer timer(GetRPCHistogram(strMethod));
+
+    try
+    {
+        if (pcmd->unlocked)
+        {
+            streamer(params, false, stream);
+        }
+        else
+        {
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            streamer(params, false, stream);
+        }
+    }
+    catch (std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 
 Object CallRPC(const string& strMethod, const Array& params)
 {
@@ -1429,7 +2415,7 @@ Object CallRPC(const string& strMethod, const Array& params)
 
     // Parse reply
     Value valReply;
-    if (!read_string(strReply, valReply))
+    if (!ReadJSON(strReply, valReply))
         throw runtime_error("couldn't parse reply from server");
     const Object& reply = valReply.get_obj();
     if (reply.empty())
@@ -1489,6 +2475,9 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "listreceivedbyaccount"  && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getbalance"             && n > 1) ConvertTo<boost::int64_t>(params[1]);
     if (strMethod == "getblock"               && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "getlockstats"           && n > 0) ConvertTo<boost::int64_t>(params[0]);
+    if (strMethod == "getlockstats"           && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "dumptrace"              && n > 0) ConvertTo<bool>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getbestblock"           && n > 0) ConvertTo<bool>(params[0]);
@@ -11,6 +11,7 @@
 #include <map>
 
 #include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/version.hpp>
 #include <boost/asio/version.hpp>
 
@@ -23,6 +24,10 @@
 
 
 class CBlockIndex;
+class CChainView;
+class CJSONStream;
+
+typedef boost::shared_ptr<const CChainView> ChainViewPtr;
 
 extern bool fWithExploreAPI;
 
@@ -86,6 +91,7 @@ enum HTTPStatusCode
     HTTP_FORBIDDEN             = 403,
     HTTP_NOT_FOUND             = 404,
     HTTP_INTERNAL_SERVER_ERROR = 500,
+    HTTP_SERVICE_UNAVAILABLE   = 503,
 };
 
 // Bitcoin RPC error codes
@@ -107,6 +113,7 @@ enum RPCErrorCode
     RPC_INVALID_PARAMETER           = -8,  // Invalid, missing or duplicate parameter
     RPC_DATABASE_ERROR              = -20, // Database error
     RPC_DESERIALIZATION_ERROR       = -22, // Error parsing or validating structure in raw format
+    RPC_IN_WARMUP                   = -28, // Client still warming up
 
     // P2P client errors
     RPC_CLIENT_NOT_CONNECTED        = -9,  // Bitcoin is not connected
@@ -140,6 +147,10 @@ enum RPCErrorCode
 
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
+// Chain view for commands marked unlocked in the dispatch table.
+//    Throws RPC_IN_WARMUP before the first view is published.
+ChainViewPtr GetRPCChainView();
+
 void ThreadRPCServer(void* parg);
 int CommandLineRPC(int argc, char *argv[]);
 
@@ -164,6 +175,7 @@ void RPCTypeCheck(const json_spirit::Object& o,
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, json_spirit::Object& out);
 
 typedef json_spirit::Value(*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
+typedef void(*rpcstreamfn_type)(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
 
 
 //
@@ -193,6 +205,8 @@ public:
     rpcfn_type actor;
     bool okSafeMode;
     bool unlocked;
+    // no side effects, may run concurrently with others in a batch
+    bool readonly;
 };
 
 /**
@@ -202,11 +216,15 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamers;
 public:
     CRPCTable();
     const CRPCCommand* operator[](std::string name) const;
     std::string help(std::string name) const;
 
+    // NULL unless the method can write its result incrementally
+    rpcstreamfn_type GetStreamer(const std::string& name) const;
+
     /**
      * Execute a method.
      * @param method   Method to execute
@@ -215,6 +233,12 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string &method, const json_spirit::Array &params) const;
+
+    /**
+     * Execute a method that has a streamer, writing its result to stream.
+     * Locking and safe mode are as for execute().
+     */
+    void executeStream(const std::string &method, const json_spirit::Array &params, CJSONStream& stream) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -238,6 +262,9 @@ extern std::vector<unsigned char> ParseHexO(const json_spirit::Object& o, std::s
 extern json_spirit::Value getconnectioncount(const json_spirit::Array& params, bool fHelp); // in rpcnet.cpp
 extern json_spirit::Value getadjustedtime(const json_spirit::Array& params, bool fHelp); // in rpcnet.cpp
 extern json_spirit::Value getpeerinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getmetrics(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getlockstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value dumptrace(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHelp); // in rpcdump.cpp
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importaddress(const json_spirit::Array& params, bool fHelp);
@@ -303,6 +330,8 @@ extern json_spirit::Value signrawtransaction(const json_spirit::Array& params, b
 extern json_spirit::Value sendrawtransaction(const json_spirit::Array& params, bool fHelp);
 // in rpcblockchain.cpp
 extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value compactdb(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value exportchainstate(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value decryptsend(const json_spirit::Array& params, bool fHelp);
 // in rpcblockchain.cpp
 extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool fHelp);
@@ -331,6 +360,7 @@ extern json_spirit::Value getaddressoutputs(const json_spirit::Array& params, bo
 extern json_spirit::Value getaddresstxspg(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getaddressinouts(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getaddressinoutspg(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getexplorecursorpg(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gethdaccountpg(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gethdaccount(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gethdaddresses(const json_spirit::Array& params, bool fHelp);
@@ -374,4 +404,15 @@ extern json_spirit::Value getqposbalance(const json_spirit::Array& params, bool
 extern json_spirit::Value getcharacterspg(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value exitreplay(const json_spirit::Array& params, bool fHelp);
 
+// streaming versions of the commands with large results, see jsonstream.h
+extern void StreamGetBlock(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetBlockByNumber(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamListTransactions(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetAddressTxsPg(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetAddressInOutsPg(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetExploreCursorPg(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetRichList(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetRichListPg(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+extern void StreamGetBlockSchedule(const json_spirit::Array& params, bool fHelp, CJSONStream& stream);
+
 #endif
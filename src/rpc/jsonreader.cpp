@@ -0,0 +1,414 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonreader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+using namespace json_spirit;
+using namespace std;
+
+
+class CJSONReader
+{
+public:
+    CJSONReader(const char* pBeginIn, const char* pEndIn)
+    {
+        p = pBeginIn;
+        pEnd = pEndIn;
+        nDepth = 0;
+    }
+
+    bool Read(Value& valRet)
+    {
+        SkipSpace();
+        return ReadValue(valRet);
+    }
+
+private:
+    const char* p;
+    const char* pEnd;
+    int nDepth;
+
+    // the same characters as isspace() in the "C" locale
+    void SkipSpace()
+    {
+        while ((p < pEnd) &&
+               ((*p == ' ') || ((*p >= '\t') && (*p <= '\r'))))
+        {
+            ++p;
+        }
+    }
+
+    bool Expect(char c)
+    {
+        SkipSpace();
+        if ((p < pEnd) && (*p == c))
+        {
+            ++p;
+            return true;
+        }
+        return false;
+    }
+
+    bool ReadLiteral(const char* pszLiteral, size_t nLen)
+    {
+        if ((size_t)(pEnd - p) < nLen)
+        {
+            return false;
+        }
+        if (memcmp(p, pszLiteral, nLen) != 0)
+        {
+            return false;
+        }
+        p += nLen;
+        return true;
+    }
+
+    bool ReadValue(Value& valRet);
+    bool ReadObject(Value& valRet);
+    bool ReadArray(Value& valRet);
+    bool ReadString(string& strRet);
+    bool ReadNumber(Value& valRet);
+};
+
+bool CJSONReader::ReadValue(Value& valRet)
+{
+    if (p >= pEnd)
+    {
+        return false;
+    }
+    switch (*p)
+    {
+    case '{':
+        return ReadObject(valRet);
+    case '[':
+        return ReadArray(valRet);
+    case '"':
+        {
+            string str;
+            if (!ReadString(str))
+            {
+                return false;
+            }
+            valRet = Value(str);
+            return true;
+        }
+    case 't':
+        if (!ReadLiteral("true", 4))
+        {
+            return false;
+        }
+        valRet = Value(true);
+        return true;
+    case 'f':
+        if (!ReadLiteral("false", 5))
+        {
+            return false;
+        }
+        valRet = Value(false);
+        return true;
+    case 'n':
+        if (!ReadLiteral("null", 4))
+        {
+            return false;
+        }
+        valRet = Value::null;
+        return true;
+    default:
+        return ReadNumber(valRet);
+    }
+}
+
+// Members are added before they are read so each value is parsed into its
+//    final place. Nothing else is added to a container while a member of it
+//    is being read, so the reference stays valid. Containers grow as they
+//    fill, which copies only the members read so far.
+bool CJSONReader::ReadObject(Value& valRet)
+{
+    if (++nDepth > MAX_JSON_DEPTH)
+    {
+        return false;
+    }
+    ++p;
+    valRet = Object();
+    Object& obj = valRet.get_obj();
+    SkipSpace();
+    if ((p < pEnd) && (*p == '}'))
+    {
+        ++p;
+        --nDepth;
+        return true;
+    }
+    do
+    {
+        SkipSpace();
+        if ((p >= pEnd) || (*p != '"'))
+        {
+            return false;
+        }
+        string strName;
+        if (!ReadString(strName))
+        {
+            return false;
+        }
+        if (!Expect(':'))
+        {
+            return false;
+        }
+        obj.push_back(Pair(string(), Value()));
+        obj.back().name_.swap(strName);
+        SkipSpace();
+        if (!ReadValue(obj.back().value_))
+        {
+            return false;
+        }
+    } while (Expect(','));
+    if (!Expect('}'))
+    {
+        return false;
+    }
+    --nDepth;
+    return true;
+}
+
+bool CJSONReader::ReadArray(Value& valRet)
+{
+    if (++nDepth > MAX_JSON_DEPTH)
+    {
+        return false;
+    }
+    ++p;
+    valRet = Array();
+    Array& arr = valRet.get_array();
+    SkipSpace();
+    if ((p < pEnd) && (*p == ']'))
+    {
+        ++p;
+        --nDepth;
+        return true;
+    }
+    do
+    {
+        SkipSpace();
+        arr.push_back(Value());
+        if (!ReadValue(arr.back()))
+        {
+            return false;
+        }
+    } while (Expect(','));
+    if (!Expect(']'))
+    {
+        return false;
+    }
+    --nDepth;
+    return true;
+}
+
+static int HexToNum(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+    return 0;
+}
+
+// Any character may follow a backslash, and the string ends at the first
+//    quote that does not. Escapes are replaced exactly as read_string()
+//    replaces them.
+bool CJSONReader::ReadString(string& strRet)
+{
+    const char* pBegin = ++p;
+    bool fEscaped = false;
+    while ((p < pEnd) && (*p != '"'))
+    {
+        if (*p == '\\')
+        {
+            fEscaped = true;
+            ++p;
+            if (p >= pEnd)
+            {
+                return false;
+            }
+        }
+        ++p;
+    }
+    if (p >= pEnd)
+    {
+        return false;
+    }
+    const char* pStop = p++;
+
+    if (!fEscaped)
+    {
+        strRet.assign(pBegin, pStop);
+        return true;
+    }
+
+    strRet.clear();
+    strRet.reserve(pStop - pBegin);
+    const char* pChunk = pBegin;
+    for (const char* i = pBegin; i < pStop - 1; ++i)
+    {
+        if (*i != '\\')
+        {
+            continue;
+        }
+        strRet.append(pChunk, i);
+        ++i;
+        switch (*i)
+        {
+        case 't':  strRet += '\t'; break;
+        case 'b':  strRet += '\b'; break;
+        case 'f':  strRet += '\f'; break;
+        case 'n':  strRet += '\n'; break;
+        case 'r':  strRet += '\r'; break;
+        case '\\': strRet += '\\'; break;
+        case '/':  strRet += '/';  break;
+        case '"':  strRet += '"';  break;
+        case 'x':
+            if (pStop - i >= 3)
+            {
+                strRet += (char)((HexToNum(i[1]) << 4) + HexToNum(i[2]));
+                i += 2;
+            }
+            break;
+        case 'u':
+            if (pStop - i >= 5)
+            {
+                // only the low byte is kept, as by read_string()
+                strRet += (char)((HexToNum(i[3]) << 4) + HexToNum(i[4]));
+                i += 4;
+            }
+            break;
+        default:
+            break;
+        }
+        pChunk = i + 1;
+    }
+    strRet.append(pChunk, pStop);
+    return true;
+}
+
+// A number with a point or an exponent is a real, anything else an int64,
+//    or a uint64 if it is too big for an int64 and not negative.
+bool CJSONReader::ReadNumber(Value& valRet)
+{
+    const char* pBegin = p;
+    bool fNegative = false;
+    if ((p < pEnd) && ((*p == '-') || (*p == '+')))
+    {
+        fNegative = (*p == '-');
+        ++p;
+    }
+    const char* pDigits = p;
+    while ((p < pEnd) && (*p >= '0') && (*p <= '9'))
+    {
+        ++p;
+    }
+    const char* pDigitsEnd = p;
+    int nDigits = pDigitsEnd - pDigits;
+    bool fReal = false;
+    if ((p < pEnd) && (*p == '.'))
+    {
+        ++p;
+        while ((p < pEnd) && (*p >= '0') && (*p <= '9'))
+        {
+            ++p;
+            ++nDigits;
+        }
+        fReal = true;
+    }
+    if (nDigits == 0)
+    {
+        return false;
+    }
+    if ((p < pEnd) && ((*p == 'e') || (*p == 'E')))
+    {
+        const char* pExp = p + 1;
+        if ((pExp < pEnd) && ((*pExp == '-') || (*pExp == '+')))
+        {
+            ++pExp;
+        }
+        if ((pExp < pEnd) && (*pExp >= '0') && (*pExp <= '9'))
+        {
+            while ((pExp < pEnd) && (*pExp >= '0') && (*pExp <= '9'))
+            {
+                ++pExp;
+            }
+            p = pExp;
+            fReal = true;
+        }
+    }
+
+    if (fReal)
+    {
+        // strtod needs the number alone, it would take more than JSON
+        char buf[64];
+        size_t nLen = p - pBegin;
+        if (nLen >= sizeof(buf))
+        {
+            string str(pBegin, p);
+            valRet = Value(strtod(str.c_str(), NULL));
+        }
+        else
+        {
+            memcpy(buf, pBegin, nLen);
+            buf[nLen] = '\0';
+            valRet = Value(strtod(buf, NULL));
+        }
+        return true;
+    }
+
+    static const boost::uint64_t nMaxUint64 =
+                            numeric_limits<boost::uint64_t>::max();
+    boost::uint64_t n = 0;
+    for (const char* i = pDigits; i < pDigitsEnd; ++i)
+    {
+        unsigned int nDigit = *i - '0';
+        if (n > (nMaxUint64 - nDigit) / 10)
+        {
+            return false;
+        }
+        n = (n * 10) + nDigit;
+    }
+
+    static const boost::uint64_t nMaxInt64 =
+                            numeric_limits<boost::int64_t>::max();
+    if (fNegative)
+    {
+        if (n > nMaxInt64 + 1)
+        {
+            return false;
+        }
+        valRet = Value((boost::int64_t)(0 - n));
+    }
+    else if (n > nMaxInt64)
+    {
+        valRet = Value(n);
+    }
+    else
+    {
+        valRet = Value((boost::int64_t)n);
+    }
+    return true;
+}
+
+
+bool ReadJSON(const string& str, Value& valRet)
+{
+    CJSONReader reader(str.data(), str.data() + str.size());
+    return reader.Read(valRet);
+}
@@ -0,0 +1,28 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include "json/json_spirit_value.h"
+
+#include <string>
+
+//
+// Hand written JSON reader for RPC requests and replies.
+//
+// A single pass over the text that builds the json_spirit::Value in place,
+// without the per character semantic actions and the position iterators of
+// the boost::spirit based read_string(). It accepts what read_string()
+// accepts and makes the same values from it, including read_string()'s
+// quirks: text after the first value is ignored, "\u" escapes keep only
+// their low byte, and unknown escapes are dropped. Nesting is limited to
+// MAX_JSON_DEPTH levels.
+//
+static const int MAX_JSON_DEPTH = 512;
+
+// false if str does not start with a JSON value
+bool ReadJSON(const std::string& str, json_spirit::Value& valRet);
+
+#endif  /* JSONREADER_H */
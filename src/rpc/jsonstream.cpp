@@ -0,0 +1,188 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonstream.h"
+
+#include "json/json_spirit_writer_template.h"
+
+#include <boost/foreach.hpp>
+
+#include <stdexcept>
+
+using namespace json_spirit;
+using namespace std;
+
+
+void CJSONStream::WritePairs(const Object& obj)
+{
+    BOOST_FOREACH(const Pair& pair, obj)
+    {
+        WritePair(pair.name_, pair.value_);
+    }
+}
+
+
+CJSONTextStream::CJSONTextStream(const Sink& sinkIn, size_t nChunkSizeIn)
+{
+    sink = sinkIn;
+    nChunkSize = nChunkSizeIn;
+    strBuf.reserve(nChunkSize + 1024);
+    nBytesWritten = 0;
+    fAfterKey = false;
+}
+
+// comma before every member but the first
+void CJSONTextStream::Separate()
+{
+    if (fAfterKey)
+    {
+        fAfterKey = false;
+        return;
+    }
+    if (vEmpty.empty())
+    {
+        return;
+    }
+    if (vEmpty.back())
+    {
+        vEmpty.back() = false;
+    }
+    else
+    {
+        strBuf += ',';
+    }
+}
+
+// hands a full chunk to the sink
+void CJSONTextStream::Check()
+{
+    if (strBuf.size() < nChunkSize)
+    {
+        return;
+    }
+    string strChunk;
+    strChunk.reserve(nChunkSize + 1024);
+    strChunk.swap(strBuf);
+    nBytesWritten += strChunk.size();
+    sink(strChunk);
+}
+
+void CJSONTextStream::BeginObject()
+{
+    Separate();
+    strBuf += '{';
+    vEmpty.push_back(true);
+}
+
+void CJSONTextStream::EndObject()
+{
+    vEmpty.pop_back();
+    strBuf += '}';
+    Check();
+}
+
+void CJSONTextStream::BeginArray()
+{
+    Separate();
+    strBuf += '[';
+    vEmpty.push_back(true);
+}
+
+void CJSONTextStream::EndArray()
+{
+    vEmpty.pop_back();
+    strBuf += ']';
+    Check();
+}
+
+void CJSONTextStream::Key(const string& strKey)
+{
+    Separate();
+    strBuf += write_string(Value(strKey), false);
+    strBuf += ':';
+    fAfterKey = true;
+}
+
+void CJSONTextStream::Write(const Value& value)
+{
+    Separate();
+    strBuf += write_string(value, false);
+    Check();
+}
+
+void CJSONTextStream::Append(const string& str)
+{
+    strBuf += str;
+    Check();
+}
+
+void CJSONTextStream::TakeBuffer(string& strRet)
+{
+    nBytesWritten += strBuf.size();
+    strRet.swap(strBuf);
+    strBuf.clear();
+}
+
+
+CJSONValueStream::CJSONValueStream()
+{
+    fHaveRoot = false;
+}
+
+// adds value where the next one goes and returns it in place
+Value& CJSONValueStream::Place(const Value& value)
+{
+    if (vOpen.empty())
+    {
+        if (fHaveRoot)
+        {
+            throw runtime_error("CJSONValueStream : second top level value");
+        }
+        fHaveRoot = true;
+        valRoot = value;
+        return valRoot;
+    }
+    // nothing is added to a parent while a child is open,
+    //    so pointers in vOpen stay valid
+    Value& valTop = *vOpen.back();
+    if (valTop.type() == obj_type)
+    {
+        Object& obj = valTop.get_obj();
+        obj.push_back(Pair(strKey, value));
+        return obj.back().value_;
+    }
+    Array& arr = valTop.get_array();
+    arr.push_back(value);
+    return arr.back();
+}
+
+void CJSONValueStream::BeginObject()
+{
+    vOpen.push_back(&Place(Object()));
+}
+
+void CJSONValueStream::EndObject()
+{
+    vOpen.pop_back();
+}
+
+void CJSONValueStream::BeginArray()
+{
+    vOpen.push_back(&Place(Array()));
+}
+
+void CJSONValueStream::EndArray()
+{
+    vOpen.pop_back();
+}
+
+void CJSONValueStream::Key(const string& strKeyIn)
+{
+    strKey = strKeyIn;
+}
+
+void CJSONValueStream::Write(const Value& value)
+{
+    Place(value);
+}
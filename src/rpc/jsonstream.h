@@ -0,0 +1,124 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#include "json/json_spirit_value.h"
+
+#include <boost/function.hpp>
+
+#include <string>
+#include <vector>
+
+//
+// Incremental JSON output for RPC handlers.
+//
+// A handler opens objects and arrays, names keys and writes values in the
+// order they appear in the reply. Small pieces can still be built as
+// json_spirit values and written whole. The same handler serves two kinds
+// of callers:
+//
+//   CJSONTextStream  : serialized text handed to a sink in chunks, used to
+//                      send large replies over HTTP as they are made
+//   CJSONValueStream : a json_spirit::Value, used by batches, the console
+//                      and anything else that calls tableRPC.execute()
+//
+// Both produce exactly what write_string() makes of the equivalent tree.
+//
+class CJSONStream
+{
+public:
+    virtual ~CJSONStream() {}
+
+    virtual void BeginObject() = 0;
+    virtual void EndObject() = 0;
+    virtual void BeginArray() = 0;
+    virtual void EndArray() = 0;
+
+    // names the next value, only inside an object
+    virtual void Key(const std::string& strKey) = 0;
+
+    virtual void Write(const json_spirit::Value& value) = 0;
+
+    void WritePair(const std::string& strKey, const json_spirit::Value& value)
+    {
+        Key(strKey);
+        Write(value);
+    }
+
+    // writes the members of obj into the object that is open
+    void WritePairs(const json_spirit::Object& obj);
+};
+
+
+class CJSONTextStream : public CJSONStream
+{
+public:
+    typedef boost::function<void (const std::string&)> Sink;
+
+    // the sink gets pieces of at least nChunkSize bytes, it may throw
+    CJSONTextStream(const Sink& sinkIn, size_t nChunkSizeIn);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKey);
+    void Write(const json_spirit::Value& value);
+
+    // raw text, such as the newline ending a reply
+    void Append(const std::string& str);
+
+    // text not yet given to the sink
+    void TakeBuffer(std::string& strRet);
+
+    uint64_t GetBytesWritten() const
+    {
+        return nBytesWritten;
+    }
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuf;
+    uint64_t nBytesWritten;
+    // one per open object or array: no member written yet
+    std::vector<bool> vEmpty;
+    bool fAfterKey;
+
+    void Separate();
+    void Check();
+};
+
+
+class CJSONValueStream : public CJSONStream
+{
+public:
+    CJSONValueStream();
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKey);
+    void Write(const json_spirit::Value& value);
+
+    // the value written, once everything opened is closed
+    json_spirit::Value& GetValue()
+    {
+        return valRoot;
+    }
+
+private:
+    json_spirit::Value valRoot;
+    // open objects and arrays, each inside the one before it
+    std::vector<json_spirit::Value*> vOpen;
+    std::string strKey;
+    bool fHaveRoot;
+
+    json_spirit::Value& Place(const json_spirit::Value& value);
+};
+
+#endif  /* JSONSTREAM_H */
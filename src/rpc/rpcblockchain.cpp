@@ -6,6 +6,10 @@
 // #include "main.h"
 #include "txdb-leveldb.h"
 #include "bitcoinrpc.h"
+#include "chainview.h"
+#include "jsonstream.h"
+#include "prune.h"
+#include "chainstate.h"
 
 
 using namespace json_spirit;
@@ -14,7 +18,9 @@ using namespace std;
 
 extern QPRegistry *pregistryMain;
 
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, json_spirit::Object& entry);
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock,
+                     json_spirit::Object& entry,
+                     const CChainView* pview=NULL);
 
 double GetDifficulty(const CBlockIndex* pindex)
 {
@@ -101,18 +107,39 @@ double GetPoSKernelPS()
     return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
 }
 
-Object blockToJSON(const CBlock& block,
-                   const CBlockIndex* blockindex,
-                   bool fPrintTransactionDetail)
+// With a chain view, whether the block is in the main chain as of the view.
+static bool IsInViewChain(const CChainView* pview, const CBlockIndex* blockindex)
+{
+    CBlockMemIndex* pmemIndex = pview->GetBlockByHeight(blockindex->nHeight);
+    return (pmemIndex && (pmemIndex->GetBlockHash() ==
+                          blockindex->GetBlockHash()));
+}
+
+// Writes the block to stream one transaction at a time, so a large
+//    verbose block is never held as a whole tree.
+// Without a chain view the caller must hold cs_main.
+static void BlockToStream(const CBlock& block,
+                          const CBlockIndex* blockindex,
+                          bool fPrintTransactionDetail,
+                          const CChainView* pview,
+                          CJSONStream& stream)
 {
     Object result;
     result.push_back(Pair("hash", block.GetHash().GetHex()));
 
+    const QPRegistry* pregistry = pview ? pview->pregistry.get() :
+                                          pregistryMain;
+
     if (block.IsQuantumProofOfStake())
     {
         int nConfs = 0;
         bool fInMainChain = false; 
-        if (blockindex)
+        if (blockindex && pview)
+        {
+            nConfs = pview->nHeight + 1 - blockindex->nHeight;
+            fInMainChain = IsInViewChain(pview, blockindex);
+        }
+        else if (blockindex)
         {
             nConfs = pindexBest->nHeight + 1 - blockindex->nHeight;
             CBlockMemIndex* pmemIndex = nullptr;
@@ -141,6 +168,15 @@ Object blockToJSON(const CBlock& block,
         result.push_back(Pair("pico_power",
                               blockindex ? blockindex->nPicoPower : 0));
     }
+    else if (pview)
+    {
+        int nConfs = 0;
+        if (blockindex && IsInViewChain(pview, blockindex))
+        {
+            nConfs = pview->nHeight + 1 - blockindex->nHeight;
+        }
+        result.push_back(Pair("confirmations", nConfs));
+    }
     else
     {
         CMerkleTx txGen(block.vtx[0]);
@@ -157,7 +193,7 @@ Object blockToJSON(const CBlock& block,
     {
         result.push_back(Pair("staker_id", (boost::int64_t)block.nStakerID));
         string sAlias;
-        if (pregistryMain->GetAliasForID(block.nStakerID, sAlias))
+        if (pregistry->GetAliasForID(block.nStakerID, sAlias))
         {
             result.push_back(Pair("staker_alias", sAlias));
         }
@@ -194,10 +230,23 @@ Object blockToJSON(const CBlock& block,
         result.push_back(Pair("previousblockhash",
                               block.hashPrevBlock.GetHex()));
     }
-    if (blockindex && blockindex->pnext)
+    // pnext is only safe to read under cs_main
+    const CBlockMemIndex* pmemIndexNext = NULL;
+    if (blockindex && pview)
+    {
+        if (IsInViewChain(pview, blockindex))
+        {
+            pmemIndexNext = pview->GetBlockByHeight(blockindex->nHeight + 1);
+        }
+    }
+    else if (blockindex)
+    {
+        pmemIndexNext = blockindex->pnext;
+    }
+    if (pmemIndexNext)
     {
         result.push_back(Pair("nextblockhash",
-                              blockindex->pnext->GetBlockHash().GetHex()));
+                              pmemIndexNext->GetBlockHash().GetHex()));
     }
     string sFlags;
     if (!blockindex)
@@ -238,7 +287,11 @@ Object blockToJSON(const CBlock& block,
                                         blockindex->nStakeModifierChecksum)));
     }
 
-    Array txinfo;
+    stream.BeginObject();
+    stream.WritePairs(result);
+
+    stream.Key("tx");
+    stream.BeginArray();
     BOOST_FOREACH (const CTransaction& tx, block.vtx)
     {
         if (fPrintTransactionDetail)
@@ -246,19 +299,29 @@ Object blockToJSON(const CBlock& block,
             Object entry;
 
             entry.push_back(Pair("txid", tx.GetHash().GetHex()));
-            TxToJSON(tx, 0, entry);
+            TxToJSON(tx, 0, entry, pview);
 
-            txinfo.push_back(entry);
+            stream.Write(entry);
         }
         else
-            txinfo.push_back(tx.GetHash().GetHex());
+            stream.Write(tx.GetHash().GetHex());
     }
+    stream.EndArray();
 
-    result.push_back(Pair("tx", txinfo));
-    result.push_back(Pair("signature", HexStr(block.vchBlockSig.begin(),
-                                              block.vchBlockSig.end())));
+    stream.WritePair("signature", HexStr(block.vchBlockSig.begin(),
+                                         block.vchBlockSig.end()));
+    stream.EndObject();
+}
 
-    return result;
+// Without a chain view the caller must hold cs_main.
+Object blockToJSON(const CBlock& block,
+                   const CBlockIndex* blockindex,
+                   bool fPrintTransactionDetail,
+                   const CChainView* pview=NULL)
+{
+    CJSONValueStream stream;
+    BlockToStream(block, blockindex, fPrintTransactionDetail, pview, stream);
+    return stream.GetValue().get_obj();
 }
 
 Value getbestblockhash(const Array& params, bool fHelp)
@@ -268,7 +331,59 @@ Value getbestblockhash(const Array& params, bool fHelp)
             "getbestblockhash\n"
             "Returns the hash of the best block in the longest block chain.");
 
-    return hashBestChain.GetHex();
+    return GetRPCChainView()->hashBest.GetHex();
+}
+
+Value compactdb(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "compactdb [database]\n"
+            "Compacts all of [database], which is \"index\", \"explore\"\n"
+            "or \"all\" (default). Use after -reindexexplore to reclaim\n"
+            "space and speed up reads. Takes minutes on a large database.");
+
+    string strName = "all";
+    if (params.size() > 0)
+    {
+        strName = params[0].get_str();
+    }
+    if ((strName != "index") && (strName != "explore") && (strName != "all"))
+    {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Database must be index, explore or all");
+    }
+    if (!CTxDB::CompactDB(strName))
+    {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Can't compact " + strName);
+    }
+    return Value::null;
+}
+
+Value exportchainstate(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "exportchainstate <file>\n"
+            "Writes a chain state snapshot at the best block to <file>.\n"
+            "A new node starts from it with -importchainstate=<file>\n"
+            "and -chainstatehash=<snapshothash>. Takes minutes and\n"
+            "a file of several hundred MB.");
+
+    CChainstateInfo info;
+    string strError;
+    if (!ExportChainstate(params[0].get_str(), info, strError))
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    Object result;
+    result.push_back(Pair("height", info.nHeight));
+    result.push_back(Pair("hash", info.hashBlock.GetHex()));
+    result.push_back(Pair("snapshothash", info.hashSnapshot.GetHex()));
+    result.push_back(Pair("blocks", (int64_t)info.nBlocks));
+    result.push_back(Pair("transactions", (int64_t)info.nTransactions));
+    return result;
 }
 
 Value getblockcount(const Array& params, bool fHelp)
@@ -277,7 +392,7 @@ Value getblockcount(const Array& params, bool fHelp)
         throw runtime_error(
             "getblockcount\n"
             "Returns the number of blocks in the longest block chain.");
-    return nBestHeight;
+    return GetRPCChainView()->nHeight;
 }
 
 Value getdifficulty(const Array& params, bool fHelp)
@@ -346,13 +461,19 @@ Value getblockhash(const Array& params, bool fHelp)
             "Returns hash of block in best-block-chain at <index>.");
     }
 
+    ChainViewPtr pview = GetRPCChainView();
+
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
+    if (nHeight < 0 || nHeight > pview->nHeight)
     {
         throw runtime_error("Block number out of range.");
     }
 
-    CBlockMemIndex* pmemIndex = FindBlockByHeight(nHeight);
+    CBlockMemIndex* pmemIndex = pview->GetBlockByHeight(nHeight);
+    if (pmemIndex == NULL)
+    {
+        throw runtime_error("Block number not in lookup.");
+    }
     return pmemIndex->phashBlock->GetHex();
 }
 
@@ -375,7 +496,7 @@ Value getblockhash9(const Array& params, bool fHelp)
     return block.GetHash9().GetHex();
 }
 
-Value getblock(const Array& params, bool fHelp)
+void StreamGetBlock(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
     {
@@ -388,31 +509,47 @@ Value getblock(const Array& params, bool fHelp)
     string strHash = params[0].get_str();
     uint256 hash(strHash);
 
+    ChainViewPtr pview = GetRPCChainView();
+
     CBlock block;
-    CBlockMemIndex* pmemIndex = NULL;
-    if (mapBlockIndex.count(hash))
-    {
-        pmemIndex = mapBlockIndex[hash];
-        block.ReadFromDisk(pmemIndex, true);
-    }
-    else if (mapOrphanBlocks.count(hash))
+    CBlockMemIndex* pmemIndex = LookupBlockIndex(hash);
+    if (pmemIndex)
     {
-        block = *mapOrphanBlocks[hash];
+        if (!block.ReadFromDisk(pmemIndex, true) &&
+            IsBlockPruned(GetMemIndexHeight("getblock", pmemIndex)))
+        {
+            throw JSONRPCError(RPC_MISC_ERROR,
+                               "Block not available (pruned data)");
+        }
     }
     else
     {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        LOCK(cs_main);
+        if (!mapOrphanBlocks.count(hash))
+        {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block = *mapOrphanBlocks[hash];
     }
 
     CDiskBlockIndex diskIndex;
     ReadDiskBlockIndex("getblock", pmemIndex, diskIndex);
 
-    return blockToJSON(block,
-                       &diskIndex,
-                       params.size() > 1 ? params[1].get_bool() : false);
+    BlockToStream(block,
+                  &diskIndex,
+                  params.size() > 1 ? params[1].get_bool() : false,
+                  pview.get(),
+                  stream);
 }
 
-Value getblockbynumber(const Array& params, bool fHelp)
+Value getblock(const Array& params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetBlock(params, fHelp, stream);
+    return stream.GetValue();
+}
+
+void StreamGetBlockByNumber(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
     {
@@ -422,30 +559,44 @@ Value getblockbynumber(const Array& params, bool fHelp)
             "Returns details of a block with given block-number.");
     }
 
+    ChainViewPtr pview = GetRPCChainView();
+
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
+    if (nHeight < 0 || nHeight > pview->nHeight)
     {
         throw runtime_error("Block number out of range.");
     }
 
-    CMapBlockLookup::const_iterator it = mapBlockLookup.find(nHeight);
+    const CBlockMemIndex* pmemIndex = pview->GetBlockByHeight(nHeight);
 
-    if (it == mapBlockLookup.end())
+    if (pmemIndex == NULL)
     {
         throw runtime_error("Block number not in lookup.");
     }
 
-    const CBlockMemIndex* pmemIndex = it->second;
     CDiskBlockIndex diskIndex;
     ReadDiskBlockIndex("getblockbynumber", pmemIndex, diskIndex);
 
     CBlock block;
 
-    block.ReadFromDisk(pmemIndex, true);
+    if (!block.ReadFromDisk(pmemIndex, true) && IsBlockPruned(nHeight))
+    {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Block not available (pruned data)");
+    }
 
-    return blockToJSON(block,
-                       &diskIndex,
-                       params.size() > 1 ? params[1].get_bool() : false);
+    BlockToStream(block,
+                  &diskIndex,
+                  params.size() > 1 ? params[1].get_bool() : false,
+                  pview.get(),
+                  stream);
+}
+
+Value getblockbynumber(const Array& params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetBlockByNumber(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 Value getbestblock(const Array& params, bool fHelp)
@@ -5,6 +5,8 @@
 #include "main.h"
 #include "bitcoinrpc.h"
 #include "txdb-leveldb.h"
+#include "chainview.h"
+#include "jsonstream.h"
 #include "base58.h"
 
 #include "AddrInOutInfo.hpp"
@@ -22,7 +24,6 @@ using namespace std;
 
 
 extern int64_t nMaxDust;
-extern MapBalanceCounts mapAddressBalances;
 
 static const unsigned int SEC_PER_DAY = 86400;
 
@@ -231,9 +232,12 @@ void GetInOuts(CTxDB& txdb,
 //
 // Addresses
 //
-void GetAddrInfo(const string& strAddress, Object& objRet)
+void GetAddrInfo(const CChainView& view,
+                 const string& strAddress,
+                 Object& objRet)
 {
     CTxDB txdb;
+    view.Attach(txdb);
 
     if (!txdb.AddrValueIsViable(ADDR_BALANCE, strAddress))
     {
@@ -279,8 +283,9 @@ void GetAddrInfo(const string& strAddress, Object& objRet)
     int nRank = 0;
     if (nBalance > nMaxDust)
     {
+        const MapBalanceCounts& mapBalances = *view.pmapAddressBalances;
         MapBalanceCounts::const_iterator it;
-        for (it = mapAddressBalances.begin(); it != mapAddressBalances.end(); ++it)
+        for (it = mapBalances.begin(); it != mapBalances.end(); ++it)
         {
             if ((*it).first < nBalance)
             {
@@ -311,7 +316,7 @@ void GetAddrInfo(const string& strAddress, Object& objRet)
     objRet.push_back(Pair("sent", ValueFromAmount(nValueOut)));
     objRet.push_back(Pair("unspent", (boost::int64_t)nQtyUnspent));
     objRet.push_back(Pair("in-outs", (boost::int64_t)(nQtyOutputs + nQtyInputs)));
-    objRet.push_back(Pair("blocks", (boost::int64_t)nBestHeight));
+    objRet.push_back(Pair("blocks", (boost::int64_t)view.nHeight));
 }
 
 void GetAddrTx(CTxDB& txdb,
@@ -384,6 +389,199 @@ void GetAddrTxs(CTxDB& txdb,
     }
 }
 
+void WriteAddrTxsPg(CTxDB& txdb,
+                    const int nBestHeight,
+                    const string& strAddress,
+                    const int nQtyTxs,
+                    const pagination_t& pg,
+                    const string& strCursor,
+                    CJSONStream& stream)
+{
+    vector<AddrTxInfo> vAddrTx;
+    GetAddrTxs(txdb, strAddress, pg.start, pg.max, nQtyTxs, vAddrTx);
+
+    if (!pg.forward)
+    {
+        reverse(vAddrTx.begin(), vAddrTx.end());
+    }
+
+    stream.BeginObject();
+    stream.WritePair("total", nQtyTxs);
+    stream.WritePair("page", pg.page);
+    stream.WritePair("per_page", pg.per_page);
+    stream.WritePair("last_page", pg.last_page);
+    if (!strCursor.empty())
+    {
+        stream.WritePair("cursor", strCursor);
+    }
+    stream.Key("data");
+    stream.BeginArray();
+    BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
+    {
+        Object obj;
+        addrtx.AsJSON(nBestHeight, obj);
+        stream.Write(obj);
+    }
+    stream.EndArray();
+    stream.EndObject();
+}
+
+void WriteAddrInOutsPg(CTxDB& txdb,
+                       const int nBestHeight,
+                       const string& strAddress,
+                       const int nQtyInOuts,
+                       const pagination_t& pg,
+                       const string& strCursor,
+                       CJSONStream& stream)
+{
+    vector<AddrTxInfo> vAddrTx;
+    GetInOuts(txdb, strAddress, pg.start, pg.max, nQtyInOuts, vAddrTx);
+
+    stream.BeginObject();
+    stream.WritePair("total", nQtyInOuts);
+    stream.WritePair("page", pg.page);
+    stream.WritePair("per_page", pg.per_page);
+    stream.WritePair("last_page", pg.last_page);
+    if (!strCursor.empty())
+    {
+        stream.WritePair("cursor", strCursor);
+    }
+
+    int nInOuts = 0;
+    BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
+    {
+        nInOuts += addrtx.inouts.size();
+    }
+    stream.Key("data");
+    stream.BeginArray();
+    for (int n = 0; n < nInOuts; ++n)
+    {
+        // backward pages list the same in-outs from last to first
+        int nPos = pg.forward ? n : (nInOuts - 1 - n);
+        unsigned int nTx = 0;
+        while (nPos >= (int)vAddrTx[nTx].inouts.size())
+        {
+            nPos -= vAddrTx[nTx].inouts.size();
+            nTx += 1;
+        }
+        Object objOutput;
+        vAddrTx[nTx].AsJSON(nBestHeight, nPos, objOutput);
+        stream.Write(objOutput);
+    }
+    stream.EndArray();
+    stream.EndObject();
+}
+
+
+//
+// Cursors
+//
+// A paginated listing of an address that goes on where its last page
+//    left off, on the chain view of its first page, so blocks connected
+//    in between don't shift the pages. Records are read by their index
+//    under the snapshots of the view, so a deep page costs the same as
+//    the first.
+class CExploreCursor
+{
+public:
+    ChainViewPtr pview;
+    string strAddress;
+    // transactions (getaddresstxspg) or in-outs (getaddressinoutspg)
+    bool fTxs;
+    int nTotal;
+    // the next page
+    int nPage;
+    int nPerPage;
+    bool fForward;
+    int64_t nExpires;
+};
+
+static CCriticalSection cs_mapExploreCursors;
+static map<string, CExploreCursor> mapExploreCursors;
+
+static int64_t GetExploreCursorTTL()
+{
+    return GetArg("-explorecursorttl",
+                  (int64_t) chainParams.DEFAULT_EXPLORECURSORTTL);
+}
+
+// Each cursor holds a chain view, with its snapshots, until it expires,
+//    so the live ones are limited.
+static unsigned int GetMaxExploreCursors()
+{
+    return max((int64_t) 1,
+               GetArg("-maxexplorecursors",
+                      (int64_t) chainParams.DEFAULT_MAXEXPLORECURSORS));
+}
+
+// ** Caller must hold cs_mapExploreCursors. **
+static void ExpireExploreCursors(int64_t nNow)
+{
+    map<string, CExploreCursor>::iterator mi = mapExploreCursors.begin();
+    while (mi != mapExploreCursors.end())
+    {
+        if ((*mi).second.nExpires <= nNow)
+        {
+            mapExploreCursors.erase(mi++);
+        }
+        else
+        {
+            ++mi;
+        }
+    }
+}
+
+// The cursor of the page after pg, empty after the last page or with
+//    -explorecursorttl=0. The cursor expiring first makes room for it
+//    when -maxexplorecursors are live.
+static string NewExploreCursor(const ChainViewPtr& pview,
+                               const string& strAddress,
+                               const bool fTxs,
+                               const int nTotal,
+                               const pagination_t& pg)
+{
+    int64_t nTTL = GetExploreCursorTTL();
+    if ((pg.page >= pg.last_page) || (nTTL <= 0))
+    {
+        return "";
+    }
+
+    CExploreCursor cursor;
+    cursor.pview = pview;
+    cursor.strAddress = strAddress;
+    cursor.fTxs = fTxs;
+    cursor.nTotal = nTotal;
+    cursor.nPage = pg.page + 1;
+    cursor.nPerPage = pg.per_page;
+    cursor.fForward = pg.forward;
+
+    string strCursor = GetRandHash().GetHex().substr(0, 32);
+
+    LOCK(cs_mapExploreCursors);
+    int64_t nNow = GetTime();
+    cursor.nExpires = nNow + nTTL;
+    ExpireExploreCursors(nNow);
+    unsigned int nMaxCursors = GetMaxExploreCursors();
+    while (mapExploreCursors.size() >= nMaxCursors)
+    {
+        map<string, CExploreCursor>::iterator miFirst;
+        miFirst = mapExploreCursors.begin();
+        map<string, CExploreCursor>::iterator mi;
+        for (mi = mapExploreCursors.begin();
+             mi != mapExploreCursors.end();
+             ++mi)
+        {
+            if ((*mi).second.nExpires < (*miFirst).second.nExpires)
+            {
+                miFirst = mi;
+            }
+        }
+        mapExploreCursors.erase(miFirst);
+    }
+    mapExploreCursors[strCursor] = cursor;
+    return strCursor;
+}
+
 
 //
 // Stats
@@ -542,7 +740,9 @@ Value getaddressbalance(const Array &params, bool fHelp)
 
     string strAddress = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
     CTxDB txdb;
+    pview->Attach(txdb);
 
     if (!txdb.AddrValueIsViable(ADDR_BALANCE, strAddress))
     {
@@ -572,7 +772,7 @@ Value getaddressinfo(const Array &params, bool fHelp)
     string strAddress = params[0].get_str();
 
     Object obj;
-    GetAddrInfo(strAddress, obj);
+    GetAddrInfo(*GetRPCChainView(), strAddress, obj);
     return obj;
 }
 
@@ -594,7 +794,9 @@ Value getaddressinputs(const Array &params, bool fHelp)
 
     string strAddress = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
     CTxDB txdb;
+    pview->Attach(txdb);
 
     int nQtyInputs;
     if (!txdb.ReadAddrQty(ADDR_QTY_INPUT, strAddress, nQtyInputs))
@@ -634,7 +836,7 @@ Value getaddressinputs(const Array &params, bool fHelp)
         }
     }
 
-    int nBestHeightStart = nBestHeight;
+    int nBestHeightStart = pview->nHeight;
     vector<AddrTxInfo> vAddrTx;
     GetAddrInputs(txdb, strAddress, nStart, nMax, nQtyInputs, vAddrTx);
     BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
@@ -673,7 +875,9 @@ Value getaddressoutputs(const Array &params, bool fHelp)
 
     string strAddress = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
     CTxDB txdb;
+    pview->Attach(txdb);
 
     int nQtyOutputs;
     if (!txdb.ReadAddrQty(ADDR_QTY_OUTPUT, strAddress, nQtyOutputs))
@@ -713,7 +917,7 @@ Value getaddressoutputs(const Array &params, bool fHelp)
         }
     }
 
-    int nBestHeightStart = nBestHeight;
+    int nBestHeightStart = pview->nHeight;
     vector<AddrTxInfo> vAddrTx;
     GetAddrOutputs(txdb, strAddress, nStart, nMax, nQtyOutputs, vAddrTx);
     BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
@@ -735,7 +939,7 @@ Value getaddressoutputs(const Array &params, bool fHelp)
     return result;
 }
 
-Value getaddresstxspg(const Array &params, bool fHelp)
+void StreamGetAddressTxsPg(const Array &params, bool fHelp, CJSONStream& stream)
 {
     string strExploreHelp = CheckExploreAPI(fHelp);
     if (fHelp || (params.size() < 3) || (params.size() > 4))
@@ -749,7 +953,9 @@ Value getaddresstxspg(const Array &params, bool fHelp)
             "  return transactions 21 - 40 (if possible).\n"
             "    <page> is the page number\n"
             "    <perpage> is the number of transactions per page\n"
-            "    [ordering] by blockchain position (default=true -> forward)");
+            "    [ordering] by blockchain position (default=true -> forward)\n"
+            "Unless it is the last page, \"cursor\" gets the next page\n"
+            "  with getexplorecursorpg.");
     }
 
     // leading params = 1 (1st param is <address>, 2nd is <page>)
@@ -757,7 +963,9 @@ Value getaddresstxspg(const Array &params, bool fHelp)
 
     string strAddress = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
     CTxDB txdb;
+    pview->Attach(txdb);
 
     int nQtyTxs;
     if (!txdb.ReadAddrQty(ADDR_QTY_VIO, strAddress, nQtyTxs))
@@ -773,31 +981,16 @@ Value getaddresstxspg(const Array &params, bool fHelp)
     pagination_t pg;
     GetPagination(params, LEADING_PARAMS, nQtyTxs, pg);
 
-    vector<AddrTxInfo> vAddrTx;
-    GetAddrTxs(txdb, strAddress, pg.start, pg.max, nQtyTxs, vAddrTx);
-
-    if (!pg.forward)
-    {
-        reverse(vAddrTx.begin(), vAddrTx.end());
-    }
-
-    int nBestHeightStart = nBestHeight;
-    Array data;
-    BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
-    {
-        Object obj;
-        addrtx.AsJSON(nBestHeightStart, obj);
-        data.push_back(obj);
-    }
-
-    Object result;
-    result.push_back(Pair("total", nQtyTxs));
-    result.push_back(Pair("page", pg.page));
-    result.push_back(Pair("per_page", pg.per_page));
-    result.push_back(Pair("last_page", pg.last_page));
-    result.push_back(Pair("data", data));
+    string strCursor = NewExploreCursor(pview, strAddress, true, nQtyTxs, pg);
+    WriteAddrTxsPg(txdb, pview->nHeight, strAddress, nQtyTxs, pg, strCursor,
+                   stream);
+}
 
-    return result;
+Value getaddresstxspg(const Array &params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetAddressTxsPg(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 Value getaddressinouts(const Array &params, bool fHelp)
@@ -817,7 +1010,9 @@ Value getaddressinouts(const Array &params, bool fHelp)
 
     string strAddress = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
     CTxDB txdb;
+    pview->Attach(txdb);
 
     int nQtyInOuts;
     if (!txdb.ReadAddrQty(ADDR_QTY_INOUT, strAddress, nQtyInOuts))
@@ -857,7 +1052,7 @@ Value getaddressinouts(const Array &params, bool fHelp)
         }
     }
 
-    int nBestHeightStart = nBestHeight;
+    int nBestHeightStart = pview->nHeight;
     vector<AddrTxInfo> vAddrTx;
     GetInOuts(txdb, strAddress, nStart, nMax, nQtyInOuts, vAddrTx);
 
@@ -874,7 +1069,7 @@ Value getaddressinouts(const Array &params, bool fHelp)
     return result;
 }
 
-Value getaddressinoutspg(const Array &params, bool fHelp)
+void StreamGetAddressInOutsPg(const Array &params, bool fHelp, CJSONStream& stream)
 {
     string strExploreHelp = CheckExploreAPI(fHelp);
     if (fHelp || (params.size() < 3) || (params.size() > 4))
@@ -888,7 +1083,9 @@ Value getaddressinoutspg(const Array &params, bool fHelp)
             "  return in-outs 21 - 40 (if possible).\n"
             "    <page> is the page number\n"
             "    <perpage> is the number of input/outputs per page\n"
-            "    [ordering] by blockchain position (default=true -> forward)");
+            "    [ordering] by blockchain position (default=true -> forward)\n"
+            "Unless it is the last page, \"cursor\" gets the next page\n"
+            "  with getexplorecursorpg.");
     }
 
     // leading params = 1 (1st param is <address>, 2nd is <page>)
@@ -896,7 +1093,9 @@ Value getaddressinoutspg(const Array &params, bool fHelp)
 
     string strAddress = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
     CTxDB txdb;
+    pview->Attach(txdb);
 
     int nQtyInOuts;
     if (!txdb.ReadAddrQty(ADDR_QTY_INOUT, strAddress, nQtyInOuts))
@@ -912,34 +1111,87 @@ Value getaddressinoutspg(const Array &params, bool fHelp)
     pagination_t pg;
     GetPagination(params, LEADING_PARAMS, nQtyInOuts, pg);
 
-    vector<AddrTxInfo> vAddrTx;
-    GetInOuts(txdb, strAddress, pg.start, pg.max, nQtyInOuts, vAddrTx);
+    string strCursor = NewExploreCursor(pview, strAddress, false,
+                                        nQtyInOuts, pg);
+    WriteAddrInOutsPg(txdb, pview->nHeight, strAddress, nQtyInOuts, pg,
+                      strCursor, stream);
+}
 
-    int nBestHeightStart = nBestHeight;
-    Array data;
-    BOOST_FOREACH(const AddrTxInfo& addrtx, vAddrTx)
+Value getaddressinoutspg(const Array &params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetAddressInOutsPg(params, fHelp, stream);
+    return stream.GetValue();
+}
+
+void StreamGetExploreCursorPg(const Array &params, bool fHelp, CJSONStream& stream)
+{
+    string strExploreHelp = CheckExploreAPI(fHelp);
+    if (fHelp || (params.size() != 1))
     {
-        for (unsigned int i = 0; i < addrtx.inouts.size(); ++i)
+        throw runtime_error(
+            strExploreHelp +
+            "getexplorecursorpg <cursor>\n"
+            "Returns the next page of the getaddresstxspg or\n"
+            "  getaddressinoutspg listing that returned <cursor>.\n"
+            "  The pages are of the chain as it was at the first page,\n"
+            "  whatever blocks were connected since.\n"
+            "  A cursor expires -explorecursorttl seconds after its last\n"
+            "  use, and after its last page.");
+    }
+
+    string strCursor = params[0].get_str();
+
+    CExploreCursor cursor;
+    {
+        LOCK(cs_mapExploreCursors);
+        int64_t nNow = GetTime();
+        ExpireExploreCursors(nNow);
+        map<string, CExploreCursor>::iterator mi =
+                                        mapExploreCursors.find(strCursor);
+        if (mi == mapExploreCursors.end())
         {
-            Object objOutput;
-            addrtx.AsJSON(nBestHeightStart, i, objOutput);
-            data.push_back(objOutput);
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Cursor is unknown or expired.");
         }
+        cursor = (*mi).second;
+        (*mi).second.nPage += 1;
+        (*mi).second.nExpires = nNow + GetExploreCursorTTL();
     }
 
-    if (!pg.forward)
+    Array paramsPg;
+    paramsPg.push_back(cursor.nPage);
+    paramsPg.push_back(cursor.nPerPage);
+    paramsPg.push_back(cursor.fForward);
+    pagination_t pg;
+    GetPagination(paramsPg, 0, cursor.nTotal, pg);
+
+    if (pg.page >= pg.last_page)
     {
-        reverse(data.begin(), data.end());
+        LOCK(cs_mapExploreCursors);
+        mapExploreCursors.erase(strCursor);
+        strCursor = "";
     }
 
-    Object result;
-    result.push_back(Pair("total", nQtyInOuts));
-    result.push_back(Pair("page", pg.page));
-    result.push_back(Pair("per_page", pg.per_page));
-    result.push_back(Pair("last_page", pg.last_page));
-    result.push_back(Pair("data", data));
+    CTxDB txdb;
+    cursor.pview->Attach(txdb);
+    if (cursor.fTxs)
+    {
+        WriteAddrTxsPg(txdb, cursor.pview->nHeight, cursor.strAddress,
+                       cursor.nTotal, pg, strCursor, stream);
+    }
+    else
+    {
+        WriteAddrInOutsPg(txdb, cursor.pview->nHeight, cursor.strAddress,
+                          cursor.nTotal, pg, strCursor, stream);
+    }
+}
 
-    return result;
+Value getexplorecursorpg(const Array &params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetExploreCursorPg(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 
@@ -1374,11 +1626,12 @@ Value gethdaddresses(const Array &params, bool fHelp)
 //
 // Richlist
 
-boost::int64_t GetRichListSize(int64_t nMinBalance)
+boost::int64_t GetRichListSize(const MapBalanceCounts& mapBalances,
+                               int64_t nMinBalance)
 {
     unsigned int nCount = 0;
     MapBalanceCounts::const_iterator it;
-    for (it = mapAddressBalances.begin(); it != mapAddressBalances.end(); ++it)
+    for (it = mapBalances.begin(); it != mapBalances.end(); ++it)
     {
         if ((*it).first < nMinBalance)
         {
@@ -1409,19 +1662,24 @@ Value getrichlistsize(const Array &params, bool fHelp)
         nMinBalance = AmountFromValue(params[0]);
     }
 
-    return GetRichListSize(nMinBalance);
+    ChainViewPtr pview = GetRPCChainView();
+
+    return GetRichListSize(*pview->pmapAddressBalances, nMinBalance);
 }
 
 
 
-void GetRichList(int nStart, int nMax, Object& objRet)
+// Writes the addresses as pairs into the object open in stream.
+void GetRichList(const CChainView& view, int nStart, int nMax, CJSONStream& stream)
 {
     CTxDB txdb;
+    view.Attach(txdb);
     int nLimit = nStart + nMax - 1;
     int nCount = 0;
 
+    const MapBalanceCounts& mapBalances = *view.pmapAddressBalances;
     MapBalanceCounts::const_iterator it;
-    for (it = mapAddressBalances.begin(); it != mapAddressBalances.end(); ++it)
+    for (it = mapBalances.begin(); it != mapBalances.end(); ++it)
     {
         int nSize = static_cast<int>((*it).second);
         if ((nSize + nCount) >= nStart)
@@ -1443,7 +1701,7 @@ void GetRichList(int nStart, int nMax, Object& objRet)
             }
             BOOST_FOREACH(const string& addr, setBalances)
             {
-                objRet.push_back(Pair(addr, ValueFromAmount(nBalance)));
+                stream.WritePair(addr, ValueFromAmount(nBalance));
                 nCount += 1;
             }
             // return all that tied for last spot
@@ -1459,7 +1717,7 @@ void GetRichList(int nStart, int nMax, Object& objRet)
     }
 }
 
-Value getrichlist(const Array &params, bool fHelp)
+void StreamGetRichList(const Array &params, bool fHelp, CJSONStream& stream)
 {
     string strExploreHelp = CheckExploreAPI(fHelp);
     if (fHelp || (params.size()  > 2))
@@ -1474,11 +1732,14 @@ Value getrichlist(const Array &params, bool fHelp)
             "    [max] is the max addresses to return (default: 100)");
     }
 
-    Object obj;
+    ChainViewPtr pview = GetRPCChainView();
+
+    stream.BeginObject();
     // nothing to count
-    if (mapAddressBalances.empty())
+    if (pview->pmapAddressBalances->empty())
     {
-        return obj;
+        stream.EndObject();
+        return;
     }
 
     int nStart = 1;
@@ -1501,13 +1762,19 @@ Value getrichlist(const Array &params, bool fHelp)
         }
     }
 
-    GetRichList(nStart, nMax, obj);
+    GetRichList(*pview, nStart, nMax, stream);
+    stream.EndObject();
+}
 
-    return obj;
+Value getrichlist(const Array &params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetRichList(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 
-Value getrichlistpg(const Array &params, bool fHelp)
+void StreamGetRichListPg(const Array &params, bool fHelp, CJSONStream& stream)
 {
     string strExploreHelp = CheckExploreAPI(fHelp);
     if (fHelp || (params.size() < 2) || (params.size() > 3))
@@ -1527,32 +1794,52 @@ Value getrichlistpg(const Array &params, bool fHelp)
     // leading params = 0 (first param is <page>)
     static const unsigned int LEADING_PARAMS = 0;
 
-    if (mapAddressBalances.empty())
+    ChainViewPtr pview = GetRPCChainView();
+
+    if (pview->pmapAddressBalances->empty())
     {
          throw runtime_error("No rich list.");
     }
 
-    int64_t nRichListSize = GetRichListSize(nMaxDust);
+    int64_t nRichListSize = GetRichListSize(*pview->pmapAddressBalances,
+                                            nMaxDust);
 
     pagination_t pg;
     GetPagination(params, LEADING_PARAMS, nRichListSize, pg);
 
-    Object data;
-    GetRichList(pg.start, pg.max, data);
+    stream.BeginObject();
+    stream.WritePair("total", nRichListSize);
+    stream.WritePair("page", pg.page);
+    stream.WritePair("per_page", pg.per_page);
+    stream.WritePair("last_page", pg.last_page);
 
-    if (!pg.forward)
+    stream.Key("data");
+    stream.BeginObject();
+    if (pg.forward)
+    {
+        GetRichList(*pview, pg.start, pg.max, stream);
+    }
+    else
     {
+        // ties can add to a page, so collect it before reversing
+        CJSONValueStream streamPage;
+        streamPage.BeginObject();
+        GetRichList(*pview, pg.start, pg.max, streamPage);
+        streamPage.EndObject();
+        Object& data = streamPage.GetValue().get_obj();
         reverse(data.begin(), data.end());
+        stream.WritePairs(data);
     }
+    stream.EndObject();
 
-    Object result;
-    result.push_back(Pair("total", nRichListSize));
-    result.push_back(Pair("page", pg.page));
-    result.push_back(Pair("per_page", pg.per_page));
-    result.push_back(Pair("last_page", pg.last_page));
-    result.push_back(Pair("data", data));
+    stream.EndObject();
+}
 
-    return result;
+Value getrichlistpg(const Array &params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetRichListPg(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 
@@ -9,6 +9,8 @@
 #include "wallet.h"
 #include "db.h"
 #include "walletdb.h"
+#include "metrics.h"
+#include "trace.h"
 
 using namespace json_spirit;
 using namespace std;
@@ -76,6 +78,14 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("releasetime", (boost::int64_t)stats.nReleaseTime));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
+        if (stats.fSyncStats)
+        {
+            obj.push_back(Pair("syncheight", stats.nSyncHeight));
+            obj.push_back(Pair("inflight", stats.nBlocksInFlight));
+            obj.push_back(Pair("askfor", stats.nAskFor));
+            obj.push_back(Pair("inventorybytes",
+                               (boost::uint64_t)stats.nInventoryBytes));
+        }
 
         ret.push_back(obj);
     }
@@ -83,6 +93,105 @@ Value getpeerinfo(const Array& params, bool fHelp)
     return ret;
 }
 
+Value getmetrics(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getmetrics [prefix]\n"
+            "Returns the node's counters, gauges and latency histograms,\n"
+            "only those with names starting with [prefix] if given.\n"
+            "Histograms give count, sum, mean, p50, p90, p99 and max,\n"
+            "all but count in seconds.");
+
+    string strPrefix;
+    if (params.size() > 0)
+    {
+        strPrefix = params[0].get_str();
+    }
+
+    return MetricsToJSON(strPrefix);
+}
+
+Value getlockstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getlockstats [count] [reset]\n"
+            "Returns the [count] lock sites with the longest total wait,\n"
+            "or all of them, if -profilelocks is set.\n"
+            "Times are in seconds. If [reset] is true, counting starts again.");
+
+    if (!fProfileLocks)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Lock profiling is off, start with -profilelocks");
+    }
+
+    int64_t nCount = -1;
+    if (params.size() > 0)
+    {
+        nCount = params[0].get_int64();
+    }
+    bool fReset = false;
+    if (params.size() > 1)
+    {
+        fReset = params[1].get_bool();
+    }
+
+    vector<CLockStats> vStats;
+    GetLockStats(vStats);
+    if (fReset)
+    {
+        ResetLockStats();
+    }
+
+    Array ret;
+    for (unsigned int i = 0; i < vStats.size(); ++i)
+    {
+        if ((nCount >= 0) && (i >= (uint64_t)nCount))
+        {
+            break;
+        }
+        const CLockStats& stats = vStats[i];
+        Object obj;
+        obj.push_back(Pair("lock", stats.strName));
+        obj.push_back(Pair("site", strprintf("%s:%d",
+                                             stats.strFile.c_str(),
+                                             stats.nLine)));
+        obj.push_back(Pair("acquisitions", (boost::uint64_t)stats.nAcquisitions));
+        obj.push_back(Pair("contended", (boost::uint64_t)stats.nContended));
+        obj.push_back(Pair("waittotal", (double)stats.nWaitTotal / 1000000.0));
+        obj.push_back(Pair("waitmax", (double)stats.nWaitMax / 1000000.0));
+        obj.push_back(Pair("holdtotal", (double)stats.nHoldTotal / 1000000.0));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+Value dumptrace(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "dumptrace [clear]\n"
+            "Returns the spans of block processing kept with -tracebuffer,\n"
+            "in the Chrome trace_event format. Save the result to a file\n"
+            "and open it in chrome://tracing or Perfetto.\n"
+            "If [clear] is true, the spans are dropped after they are returned.");
+
+    if (!fTrace)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Tracing is off, start with -tracebuffer=<n>");
+    }
+
+    Object ret = TraceToJSON();
+    if ((params.size() > 0) && params[0].get_bool())
+    {
+        ClearTrace();
+    }
+    return ret;
+}
+
 extern CCriticalSection cs_mapAlerts;
 extern map<uint256, CAlert> mapAlerts;
  
@@ -8,6 +8,8 @@
 #include "wallet.h"
 #include "bitcoinrpc.h"
 #include "txdb-leveldb.h"
+#include "chainview.h"
+#include "jsonstream.h"
 
 extern QPRegistry *pregistryMain;
 extern CWallet* pwalletMain;
@@ -63,7 +65,10 @@ string GetRegistryAtHeight(int nHeight, QPRegistry* &pRet)
                            nIndexHeight,
                            pmemIndex->phashBlock->ToString().c_str());
                 }
-                mapBlockLookup[nIndexHeight] = pmemIndex;
+                {
+                    LOCK(cs_blockmaps);
+                    mapBlockLookup[nIndexHeight] = pmemIndex;
+                }
                 if (nIndexHeight == nHeight)
                 {
                     break;
@@ -668,15 +673,17 @@ Value getstakerinfo(const Array& params, bool fHelp)
 
     string sAlias = params[0].get_str();
 
+    ChainViewPtr pview = GetRPCChainView();
+
     unsigned int nID;
-    if (!pregistryMain->GetIDForAlias(sAlias, nID))
+    if (!pview->pregistry->GetIDForAlias(sAlias, nID))
     {
         throw JSONRPCError(RPC_QPOS_STAKER_NONEXISTENT,
                             "Staker doesn't exist");
     }
 
     Object obj;
-    pregistryMain->GetStakerAsJSON(nID, obj, true);
+    pview->pregistry->GetStakerAsJSON(nID, obj, true);
 
     return obj;
 }
@@ -1013,7 +1020,7 @@ Value getqueuesummary(const Array& params, bool fHelp)
 }
 
 
-Value getblockschedule(const Array& params, bool fHelp)
+void StreamGetBlockSchedule(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() != 1)
     {
@@ -1109,8 +1116,15 @@ Value getblockschedule(const Array& params, bool fHelp)
     int nLookForward = nStop - nIndexNow;
     int nMissingAfter = nBlocks - nLookForward;
 
+    stream.BeginObject();
+    stream.WritePair("call_time", (int64_t)nTime);
+    stream.WritePair("latest_block_height", (boost::int64_t)nHeight);
+    stream.WritePair("missing_before", (int64_t)nMissingBefore);
+    stream.WritePair("missing_after", (int64_t)nMissingAfter);
+
     int nOffset = -nLookBack;
-    Array aryStakers;
+    stream.Key("schedule");
+    stream.BeginArray();
     for (int i = nStart; i <= nStop; ++i)
     {
         const QPSlotInfo& info = vAll[i];
@@ -1139,18 +1153,18 @@ Value getblockschedule(const Array& params, bool fHelp)
         int64_t nSchedule = (int64_t)nOffset *  QP_TARGET_SPACING;
         objStkr.push_back(Pair("relative_schedule", nSchedule));
         objStkr.push_back(Pair("relative_status", vStatus[i]));
-        aryStakers.push_back(objStkr);
+        stream.Write(objStkr);
         nOffset += 1;
     }
+    stream.EndArray();
+    stream.EndObject();
+}
 
-    Object result;
-    result.push_back(Pair("call_time", (int64_t)nTime));
-    result.push_back(Pair("latest_block_height", (boost::int64_t)nHeight));
-    result.push_back(Pair("missing_before", (int64_t)nMissingBefore));
-    result.push_back(Pair("missing_after", (int64_t)nMissingAfter));
-    result.push_back(Pair("schedule", aryStakers));
-
-    return result;
+Value getblockschedule(const Array& params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamGetBlockSchedule(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 Value getstakersbyid(const Array& params, bool fHelp)
@@ -12,6 +12,7 @@
 #include "bitcoinrpc.h"
 #include "txdb-leveldb.h"
 #include "init.h"
+#include "chainview.h"
 #include "main.h"
 #include "net.h"
 #include "wallet.h"
@@ -26,10 +27,19 @@ using namespace json_spirit;
 // SSend: Externally constructed transactions have a 10 minute window
 const int MaxTxnTimeDrift = 5 * 60;
 
-void StakerIDToJSON(const unsigned int nStakerID, Object& obj)
+// With a chain view the registry is the view's own copy,
+//    otherwise the caller must hold cs_main.
+static const QPRegistry* GetJSONRegistry(const CChainView* pview)
 {
+    return pview ? pview->pregistry.get() : pregistryMain;
+}
+
+void StakerIDToJSON(const unsigned int nStakerID, Object& obj,
+                    const CChainView* pview=NULL)
+{
+    const QPRegistry* pregistry = GetJSONRegistry(pview);
     string strAlias;
-    if (pregistryMain->GetAliasForID(nStakerID, strAlias))
+    if (pregistry->GetAliasForID(nStakerID, strAlias))
     {
         obj.push_back(Pair("staker_alias", strAlias));
     }
@@ -40,15 +50,17 @@ void StakerIDToJSON(const unsigned int nStakerID, Object& obj)
     obj.push_back(Pair("staker_id", (int64_t)nStakerID));
 }
 
-void StakerAliasToJSON(const string& strAlias, Object& obj)
+void StakerAliasToJSON(const string& strAlias, Object& obj,
+                       const CChainView* pview=NULL)
 {
+    const QPRegistry* pregistry = GetJSONRegistry(pview);
     obj.push_back(Pair("purchase_alias", strAlias));
     unsigned int nStakerID;
-    if (pregistryMain->GetIDForAlias(strAlias, nStakerID))
+    if (pregistry->GetIDForAlias(strAlias, nStakerID))
     {
         obj.push_back(Pair("staker_id", (int64_t)nStakerID));
         string strStakerAlias;
-        if (pregistryMain->GetAliasForID(nStakerID, strStakerAlias))
+        if (pregistry->GetAliasForID(nStakerID, strStakerAlias))
         {
             obj.push_back(Pair("staker_alias", strStakerAlias));
         }
@@ -64,7 +76,7 @@ void StakerAliasToJSON(const string& strAlias, Object& obj)
 }
 
 void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
-                  const CTransaction* ptx)
+                  const CTransaction* ptx, const CChainView* pview=NULL)
 {
     txnouttype typetxo;
     vector<valtype> vSolutions;
@@ -80,7 +92,7 @@ void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
       {
         qpos_purchase purchase;
         ExtractPurchase(vSolutions.front(), purchase);
-        StakerAliasToJSON(purchase.alias, obj);
+        StakerAliasToJSON(purchase.alias, obj, pview);
         if (purchase.keys.size() == 1)
         {
             obj.push_back(Pair("owner_key",
@@ -143,7 +155,7 @@ void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
         {
             obj.push_back(Pair("set_key_type", "controller"));
         }
-        StakerIDToJSON(setkey.id, obj);
+        StakerIDToJSON(setkey.id, obj, pview);
         obj.push_back(Pair("pubkey", HexStr(setkey.key.Raw())));
         if (setkey.keytype == QPKEY_DELEGATE)
         {
@@ -164,7 +176,7 @@ void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
         {
             obj.push_back(Pair("set_state", "disable"));
         }
-        StakerIDToJSON(setstate.id, obj);
+        StakerIDToJSON(setstate.id, obj, pview);
         break;
       }
     case TX_CLAIM:
@@ -179,7 +191,7 @@ void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
       {
         qpos_setmeta setmeta;
         ExtractSetMeta(vSolutions.front(), setmeta);
-        StakerIDToJSON(setmeta.id, obj);
+        StakerIDToJSON(setmeta.id, obj, pview);
         obj.push_back(Pair("meta_key", setmeta.key));
         obj.push_back(Pair("meta_value", setmeta.value));
         break;
@@ -189,28 +201,21 @@ void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
         Feework feework;
         feework.ExtractFeework(vSolutions.front());
         feework.limit = chainParams.TX_FEEWORK_LIMIT;
-        CBlock block;
-        CBlockMemIndex* pmemIndex = mapBlockIndex[hashBestChain];
-        CBlockMemIndex* pmemIndexNext = pmemIndex;
-        int nHeight = GetMemIndexHeight("SpecOpToJSON", pmemIndex);
-        while (nHeight > feework.height)
+        // Only the hash is shown, which needs the block at the feework
+        //    height but not cs_main: unlocked callers pass their view.
+        CBlockMemIndex* pmemIndex = pview ?
+                                       pview->GetBlockByHeight(feework.height) :
+                                       LookupBlockByHeight(feework.height);
+        if (pmemIndex)
         {
-            pmemIndexNext = pmemIndex;
-            pmemIndex = pmemIndex->pprev;
-            nHeight -= 1;
-            if (!pmemIndex->pprev)
+            feework.pblockhash = pmemIndex->phashBlock;
+            if (ptx)
             {
-                break;
+                feework.bytes = ::GetSerializeSize(*ptx, SER_NETWORK,
+                                                   PROTOCOL_VERSION);
+                ptx->HashFeework(feework, bfrFeeworkValidator);
             }
         }
-        feework.pblockhash = pmemIndex->phashBlock;
-        if (ptx)
-        {
-            CTransaction tx(*ptx);
-            feework.bytes = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            tx.CheckFeework(feework, true, bfrFeeworkValidator, pmemIndexNext,
-                            1, GMF_BLOCK, false);
-        }
         feework.AsJSON(obj);
         break;
       }
@@ -222,7 +227,8 @@ void SpecOpToJSON(const CScript& scriptPubKey, Object& obj,
 
 void ScriptPubKeyToJSON(const CScript& scriptPubKey,
                         Object& out,
-                        const CTransaction* ptx)
+                        const CTransaction* ptx,
+                        const CChainView* pview=NULL)
 {
     out.push_back(Pair("asm", scriptPubKey.ToString()));
     out.push_back(Pair("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end())));
@@ -240,7 +246,7 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey,
         if ((type >= TX_PURCHASE1) && (type <= TX_FEEWORK))
         {
             out.push_back(Pair("type", GetTxnOutputType(type)));
-            SpecOpToJSON(scriptPubKey, out, ptx);
+            SpecOpToJSON(scriptPubKey, out, ptx, pview);
         }
         else
         {
@@ -255,7 +261,10 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey,
     out.push_back(Pair("addresses", a));
 }
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
+// With a chain view, confirmations are counted as of the view and
+//    no global lock is needed. Without one the caller must hold cs_main.
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry,
+              const CChainView* pview=NULL)
 {
     entry.push_back(Pair("txid", tx.GetHash().GetHex()));
     entry.push_back(Pair("version", tx.nVersion));
@@ -297,7 +306,7 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
         out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
         out.push_back(Pair("n", (int64_t)i));
         Object o;
-        ScriptPubKeyToJSON(txout.scriptPubKey, o, &tx);
+        ScriptPubKeyToJSON(txout.scriptPubKey, o, &tx, pview);
         out.push_back(Pair("scriptPubKey", o));
         vout.push_back(out);
     }
@@ -306,16 +315,40 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
     if (hashBlock != 0)
     {
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-        CMapBlockIndex::iterator mi = mapBlockIndex.find(hashBlock);
-        if (mi != mapBlockIndex.end() && (*mi).second)
+        CBlockMemIndex* pmemIndex = NULL;
+        if (pview)
+        {
+            pmemIndex = LookupBlockIndex(hashBlock);
+        }
+        else
         {
-            CBlockMemIndex* pmemIndex = (*mi).second;
-            if (pmemIndex->IsInMainChain())
+            CMapBlockIndex::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end())
+            {
+                pmemIndex = (*mi).second;
+            }
+        }
+        if (pmemIndex)
+        {
+            CDiskBlockIndex diskIndex;
+            ReadDiskBlockIndex("TxToJSON", pmemIndex, diskIndex);
+            bool fInMainChain;
+            int nTipHeight;
+            if (pview)
+            {
+                fInMainChain = (pview->GetBlockByHeight(diskIndex.nHeight) ==
+                                pmemIndex);
+                nTipHeight = pview->nHeight;
+            }
+            else
+            {
+                fInMainChain = pmemIndex->IsInMainChain();
+                nTipHeight = nBestHeight;
+            }
+            if (fInMainChain)
             {
-                CDiskBlockIndex diskIndex;
-                ReadDiskBlockIndex("TxToJSON", pmemIndex, diskIndex);
                 entry.push_back(Pair("confirmations",
-                                     1 + nBestHeight - diskIndex.nHeight));
+                                     1 + nTipHeight - diskIndex.nHeight));
                 entry.push_back(
                     Pair("time", (int64_t) diskIndex.nTime));
                 entry.push_back(
@@ -327,6 +360,33 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
     }
 }
 
+// GetTransaction without cs_main: the mempool is checked under its own
+//    lock and the transaction index is read as of the chain view.
+static bool GetViewTransaction(const CChainView& view, const uint256& hash,
+                               CTransaction& tx, uint256& hashBlock)
+{
+    {
+        LOCK(mempool.cs);
+        if (mempool.lookup(hash, tx))
+        {
+            return true;
+        }
+    }
+    CTxDB txdb("r");
+    view.Attach(txdb);
+    CTxIndex txindex;
+    if (!tx.ReadFromDisk(txdb, COutPoint(hash, 0), txindex))
+    {
+        return false;
+    }
+    CBlock block;
+    if (block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+    {
+        hashBlock = block.GetHash();
+    }
+    return true;
+}
+
 Value getrawtransaction(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -344,10 +404,11 @@ Value getrawtransaction(const Array& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = (params[1].get_int() != 0);
 
+    ChainViewPtr pview = GetRPCChainView();
+
     CTransaction tx;
     uint256 hashBlock = 0;
-    unsigned int nTimeBlock;
-    if (!GetTransaction(hash, tx, hashBlock, nTimeBlock))
+    if (!GetViewTransaction(*pview, hash, tx, hashBlock))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
 
     CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
@@ -359,7 +420,7 @@ Value getrawtransaction(const Array& params, bool fHelp)
 
     Object result;
     result.push_back(Pair("hex", strHex));
-    TxToJSON(tx, hashBlock, result);
+    TxToJSON(tx, hashBlock, result, pview.get());
     return result;
 }
 
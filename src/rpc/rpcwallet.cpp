@@ -8,6 +8,7 @@
 #include "stealthaddress.h"
 #include "txdb-leveldb.h"
 #include "init.h"
+#include "jsonstream.h"
 
 #include <boost/assign/list_of.hpp>
 
@@ -20,7 +21,8 @@ static CCriticalSection cs_nWalletUnlockTime;
 
 extern void TxToJSON(const CTransaction& tx,
                      const uint256 hashBlock,
-                     json_spirit::Object& entry);
+                     json_spirit::Object& entry,
+                     const CChainView* pview=NULL);
 
 std::string HelpRequiringPassphrase()
 {
@@ -97,6 +99,11 @@ Value getinfo(const Array& params, bool fHelp)
     obj.push_back(Pair("newmint",         ValueFromAmount(pwalletMain->GetNewMint())));
     obj.push_back(Pair("stake",           ValueFromAmount(pwalletMain->GetStake())));
     obj.push_back(Pair("blocks",          (int)nBestHeight));
+    obj.push_back(Pair("headers",         max(nBestHeight, nBestHeaderHeight)));
+    if (nPruneHeight >= 0)
+    {
+        obj.push_back(Pair("pruneheight", nPruneHeight));
+    }
     obj.push_back(Pair("blockhash",       pindexBest->phashBlock->GetHex()));
     obj.push_back(Pair("moneysupply",     ValueFromAmount(pindexBest->nMoneySupply)));
     obj.push_back(Pair("connections",     (int)vNodes.size()));
@@ -1199,7 +1206,7 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Ar
     }
 }
 
-Value listtransactions(const Array& params, bool fHelp)
+void StreamListTransactions(const Array& params, bool fHelp, CJSONStream& stream)
 {
     if (fHelp || params.size() > 3)
         throw runtime_error(
@@ -1252,9 +1259,21 @@ Value listtransactions(const Array& params, bool fHelp)
     if (last != ret.end()) ret.erase(last, ret.end());
     if (first != ret.begin()) ret.erase(ret.begin(), first);
 
-    std::reverse(ret.begin(), ret.end()); // Return oldest to newest
+    // Return oldest to newest, freeing each entry once written
+    stream.BeginArray();
+    while (!ret.empty())
+    {
+        stream.Write(ret.back());
+        ret.pop_back();
+    }
+    stream.EndArray();
+}
 
-    return ret;
+Value listtransactions(const Array& params, bool fHelp)
+{
+    CJSONValueStream stream;
+    StreamListTransactions(params, fHelp, stream);
+    return stream.GetValue();
 }
 
 Value listaccounts(const Array& params, bool fHelp)
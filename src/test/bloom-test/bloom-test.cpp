@@ -0,0 +1,98 @@
+#include "test-utils.hpp"
+
+#include "bloom.h"
+#include "limitedmap.h"
+#include "util.h"
+
+
+using namespace std;
+
+
+class BloomTest : public ::testing::Test
+{
+protected:
+    void SetUp() override {}
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+// The most recent nElements entries are never forgotten
+TEST_F(BloomTest, RollingBloomRecent)
+{
+    CRollingBloomFilter rb(1000, 0.000001);
+
+    vector<uint256> vHashes;
+    for (int i = 0; i < 5000; i++)
+    {
+        uint256 hash = GetRandHash();
+        rb.insert(hash);
+        vHashes.push_back(hash);
+    }
+
+    print_info("Testing the last 1000 entries are kept");
+    for (int i = 4000; i < 5000; i++)
+    {
+        ASSERT_TRUE(rb.contains(vHashes[i]));
+    }
+
+    // random lookups hit only at about the false positive rate
+    int nHits = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        if (rb.contains(GetRandHash()))
+        {
+            nHits += 1;
+        }
+    }
+    print_info("Testing the false positive rate");
+    ASSERT_LE(nHits, 1);
+
+    rb.reset();
+    ASSERT_FALSE(rb.contains(vHashes[4999]));
+}
+
+
+// Memory use is fixed no matter how much is inserted
+TEST_F(BloomTest, RollingBloomMemory)
+{
+    CRollingBloomFilter rb(1000, 0.000001);
+    size_t nBytes = rb.GetMemoryUsage();
+    for (int i = 0; i < 10000; i++)
+    {
+        rb.insert(GetRandHash());
+    }
+    ASSERT_EQ(rb.GetMemoryUsage(), nBytes);
+}
+
+
+// A limitedmap drops the entries with the lowest values first
+TEST_F(BloomTest, LimitedMapOldest)
+{
+    limitedmap<int, int> lm(10);
+    for (int i = 0; i < 20; i++)
+    {
+        lm.insert(make_pair(i, 100 + i));
+        ASSERT_LE(lm.size(), 10u);
+    }
+    ASSERT_EQ(lm.count(9), 0u);
+    ASSERT_EQ(lm.count(10), 1u);
+
+    // refreshing an entry keeps it past later inserts
+    lm.update(lm.find(10), 1000);
+    lm.insert(make_pair(20, 120));
+    ASSERT_EQ(lm.count(10), 1u);
+    ASSERT_EQ(lm.count(11), 0u);
+
+    lm.erase(10);
+    ASSERT_EQ(lm.count(10), 0u);
+    ASSERT_EQ(lm.size(), 9u);
+}
@@ -0,0 +1,201 @@
+#include "test-utils.hpp"
+
+#include "compactblock.h"
+
+
+using namespace std;
+
+
+// stand-ins for what main.h uses from sources not linked here
+int nBestHeight = 0;
+uint256 hashOfNftHashes = 0;
+
+int64_t GetAdjustedTime()
+{
+    return GetTime();
+}
+
+
+class CompactBlockTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        CTransaction txCoinBase;
+        txCoinBase.vin.push_back(CTxIn());
+        txCoinBase.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+        block.vtx.push_back(txCoinBase);
+        for (int i = 0; i < 6; ++i)
+        {
+            CTransaction tx;
+            tx.vin.push_back(CTxIn(COutPoint(uint256(1000 + i), 0)));
+            tx.vout.push_back(CTxOut(100 + i, CScript() << OP_TRUE));
+            block.vtx.push_back(tx);
+        }
+        block.nVersion = CBlock::QPOS_VERSION;
+        block.hashPrevBlock = uint256(7);
+        block.nTime = 1700000000;
+        block.nBits = 0x1e0fffff;
+        block.nHeight = 100;
+        block.hashMerkleRoot = block.BuildMerkleTree();
+    }
+
+    CBlock block;
+
+    // the block's transactions nFirst..nLast in the pool
+    void AddToPool(CTxMemPool& pool, unsigned int nFirst, unsigned int nLast)
+    {
+        for (unsigned int i = nFirst; i <= nLast; ++i)
+        {
+            pool.mapTx[block.vtx[i].GetHash()] = block.vtx[i];
+        }
+    }
+
+    template<typename T>
+    static T RoundTrip(const T& obj)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << obj;
+        T objRet;
+        ss >> objRet;
+        return objRet;
+    }
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+TEST_F(CompactBlockTest, Reconstruction)
+{
+    print_info("Testing the compact block survives the wire");
+    CCompactBlock cmpctblock = RoundTrip(CCompactBlock(block));
+    ASSERT_EQ(cmpctblock.header.GetHash(), block.GetHash());
+    ASSERT_EQ(cmpctblock.GetTransactionCount(), block.vtx.size());
+    ASSERT_EQ(cmpctblock.vPrefilled.size(), 1U);
+    ASSERT_EQ(cmpctblock.vPrefilled[0].nIndex, 0U);
+
+    print_info("Testing a block is rebuilt from a full pool");
+    CTxMemPool pool;
+    AddToPool(pool, 1, 6);
+    CTransaction txOther;
+    txOther.vin.push_back(CTxIn(COutPoint(uint256(2000), 0)));
+    txOther.vout.push_back(CTxOut(5, CScript() << OP_TRUE));
+    pool.mapTx[txOther.GetHash()] = txOther;
+
+    CPartialBlock partial;
+    ASSERT_EQ(partial.Init(cmpctblock, pool), CPartialBlock::READ_OK);
+    ASSERT_EQ(partial.nPrefilled, 1U);
+    ASSERT_EQ(partial.nFromPool, 6U);
+    vector<unsigned int> vMissing;
+    partial.GetMissing(vMissing);
+    ASSERT_TRUE(vMissing.empty());
+
+    CBlock blockRet;
+    ASSERT_EQ(partial.Fill(vector<CTransaction>(), blockRet),
+              CPartialBlock::READ_OK);
+    ASSERT_EQ(blockRet.GetHash(), block.GetHash());
+    ASSERT_EQ(blockRet.vtx.size(), block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); ++i)
+    {
+        ASSERT_EQ(blockRet.vtx[i].GetHash(), block.vtx[i].GetHash());
+    }
+}
+
+
+TEST_F(CompactBlockTest, MissingRoundTrip)
+{
+    CCompactBlock cmpctblock(block);
+    CTxMemPool pool;
+    AddToPool(pool, 1, 2);
+    AddToPool(pool, 5, 5);
+
+    CPartialBlock partial;
+    ASSERT_EQ(partial.Init(cmpctblock, pool), CPartialBlock::READ_OK);
+    ASSERT_EQ(partial.nFromPool, 3U);
+
+    print_info("Testing the missing transactions are asked for in order");
+    vector<unsigned int> vMissing;
+    partial.GetMissing(vMissing);
+    ASSERT_EQ(vMissing.size(), 3U);
+    ASSERT_EQ(vMissing[0], 3U);
+    ASSERT_EQ(vMissing[1], 4U);
+    ASSERT_EQ(vMissing[2], 6U);
+
+    CBlockTransactionsRequest req;
+    req.hashBlock = block.GetHash();
+    req.vIndexes = vMissing;
+    req = RoundTrip(req);
+    ASSERT_EQ(req.hashBlock, block.GetHash());
+    ASSERT_EQ(req.vIndexes, vMissing);
+
+    print_info("Testing the answer fills the block");
+    CBlockTransactions resp;
+    resp.hashBlock = req.hashBlock;
+    for (unsigned int i = 0; i < req.vIndexes.size(); ++i)
+    {
+        resp.vtx.push_back(block.vtx[req.vIndexes[i]]);
+    }
+    resp = RoundTrip(resp);
+    CBlock blockRet;
+    ASSERT_EQ(partial.Fill(resp.vtx, blockRet), CPartialBlock::READ_OK);
+    ASSERT_EQ(blockRet.GetHash(), block.GetHash());
+    ASSERT_EQ(blockRet.hashMerkleRoot, block.hashMerkleRoot);
+
+    print_info("Testing an answer of the wrong size is invalid");
+    vector<CTransaction> vtxShort(resp.vtx.begin(), resp.vtx.end() - 1);
+    ASSERT_EQ(partial.Fill(vtxShort, blockRet), CPartialBlock::READ_INVALID);
+    vector<CTransaction> vtxLong(resp.vtx);
+    vtxLong.push_back(block.vtx[1]);
+    ASSERT_EQ(partial.Fill(vtxLong, blockRet), CPartialBlock::READ_INVALID);
+
+    print_info("Testing an answer with the wrong transaction fails");
+    vector<CTransaction> vtxWrong(resp.vtx);
+    vtxWrong[0] = block.vtx[1];
+    ASSERT_EQ(partial.Fill(vtxWrong, blockRet), CPartialBlock::READ_FAILED);
+}
+
+
+TEST_F(CompactBlockTest, ShortIDCollisions)
+{
+    CTxMemPool pool;
+    AddToPool(pool, 1, 6);
+
+    print_info("Testing two block transactions sharing a short id fail");
+    CCompactBlock cmpctblock(block);
+    cmpctblock.vShortIDs[3] = cmpctblock.vShortIDs[1];
+    CPartialBlock partial;
+    ASSERT_EQ(partial.Init(cmpctblock, pool), CPartialBlock::READ_FAILED);
+
+    print_info("Testing a short id matching the wrong pool transaction "
+               "fails at the merkle root");
+    CCompactBlock cmpctblockWrong(block);
+    uint64_t k0, k1;
+    cmpctblockWrong.GetKeys(k0, k1);
+    CTransaction txOther;
+    txOther.vin.push_back(CTxIn(COutPoint(uint256(2000), 0)));
+    txOther.vout.push_back(CTxOut(5, CScript() << OP_TRUE));
+    pool.mapTx.erase(block.vtx[2].GetHash());
+    pool.mapTx[txOther.GetHash()] = txOther;
+    cmpctblockWrong.vShortIDs[1] =
+                CCompactBlock::GetShortID(k0, k1, txOther.GetHash());
+    ASSERT_EQ(partial.Init(cmpctblockWrong, pool), CPartialBlock::READ_OK);
+    vector<unsigned int> vMissing;
+    partial.GetMissing(vMissing);
+    ASSERT_TRUE(vMissing.empty());
+    CBlock blockRet;
+    ASSERT_EQ(partial.Fill(vector<CTransaction>(), blockRet),
+              CPartialBlock::READ_FAILED);
+
+    print_info("Testing prefilled positions out of range are invalid");
+    CCompactBlock cmpctblockBad(block);
+    cmpctblockBad.vPrefilled[0].nIndex = block.vtx.size();
+    ASSERT_EQ(partial.Init(cmpctblockBad, pool), CPartialBlock::READ_INVALID);
+}
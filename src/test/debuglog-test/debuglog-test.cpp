@@ -0,0 +1,156 @@
+#include "test-utils.hpp"
+
+#include "debuglog.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+
+class DebugLogTest : public ::testing::Test
+{
+protected:
+    // every test starts with an empty debug.log
+    void SetUp() override
+    {
+        fs::remove(GetDataDir() / "debug.log");
+        ReopenDebugLog();
+    }
+
+    void TearDown() override
+    {
+        StopDebugLog();
+    }
+};
+
+
+static fs::path pathTestDir;
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    pathTestDir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(pathTestDir);
+    mapArgs["-datadir"] = pathTestDir.string();
+
+    int ret = RUN_ALL_TESTS();
+
+    fs::remove_all(pathTestDir);
+    return ret;
+}
+
+
+static string ReadDebugLog()
+{
+    ifstream file((GetDataDir() / "debug.log").string().c_str());
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static int CountLines(const string& strLog, const string& strPart)
+{
+    int nCount = 0;
+    size_t nPos = 0;
+    while ((nPos = strLog.find(strPart, nPos)) != string::npos)
+    {
+        nCount += 1;
+        nPos += strPart.size();
+    }
+    return nCount;
+}
+
+
+// Lines are limited by their format, and error() never is
+TEST_F(DebugLogTest, RateLimit)
+{
+    StartDebugLog(5);
+    ASSERT_TRUE(IsDebugLogAsync());
+
+    for (int i = 0; i < 20; ++i)
+    {
+        printf("rate test alpha %d\n", i);
+        printf("rate test alpha %d again\n", i);
+        printf("rate test beta %d\n", i);
+        warning("rate test gamma %d", i);
+        error("rate test %d", i);
+    }
+    StopDebugLog();
+
+    string strLog = ReadDebugLog();
+    int nAgain = CountLines(strLog, "again");
+    int nAlpha = CountLines(strLog, "rate test alpha") - nAgain;
+    int nBeta = CountLines(strLog, "rate test beta");
+    int nGamma = CountLines(strLog, "WARNING: rate test gamma");
+
+    print_info("Testing lines of one format share one limit");
+    // a new second may start during the loop
+    ASSERT_GE(nAlpha, 5);
+    ASSERT_LE(nAlpha, 10);
+    print_info("Testing other formats have their own limits, however "
+               "their lines start");
+    ASSERT_GE(nAgain, 5);
+    ASSERT_LE(nAgain, 10);
+    ASSERT_GE(nBeta, 5);
+    ASSERT_LE(nBeta, 10);
+    print_info("Testing warning() is limited by its caller's format");
+    ASSERT_GE(nGamma, 5);
+    ASSERT_LE(nGamma, 10);
+    print_info("Testing error() is never limited");
+    ASSERT_EQ(CountLines(strLog, "ERROR: rate test"), 20);
+}
+
+
+// Once the writer is stopped, lines are written directly
+TEST_F(DebugLogTest, Stopped)
+{
+    StartDebugLog(0);
+    printf("queued line\n");
+    StopDebugLog();
+
+    ASSERT_FALSE(IsDebugLogAsync());
+    ASSERT_FALSE(QueueDebugLog("not queued\n"));
+    printf("direct line\n");
+
+    string strLog = ReadDebugLog();
+    ASSERT_EQ(CountLines(strLog, "queued line"), 1);
+    ASSERT_EQ(CountLines(strLog, "direct line"), 1);
+}
+
+
+// Each writer reopens debug.log on its own after a rotation
+TEST_F(DebugLogTest, Reopen)
+{
+    fs::path pathLog = GetDataDir() / "debug.log";
+    fs::path pathRotated = GetDataDir() / "debug.log.1";
+
+    // the direct writer has the file open
+    printf("direct before rotation\n");
+
+    StartDebugLog(0);
+    printf("queued before rotation\n");
+    // longer than the writer waits between flushes
+    MilliSleep(500);
+
+    fs::rename(pathLog, pathRotated);
+    ReopenDebugLog();
+
+    printf("queued after rotation\n");
+    StopDebugLog();
+    printf("direct after rotation\n");
+
+    string strLog = ReadDebugLog();
+    print_info("Testing the new debug.log has only the later lines");
+    ASSERT_EQ(CountLines(strLog, "queued after rotation"), 1);
+    ASSERT_EQ(CountLines(strLog, "direct after rotation"), 1);
+    ASSERT_EQ(CountLines(strLog, "before rotation"), 0);
+
+    fs::remove(pathRotated);
+}
@@ -0,0 +1,212 @@
+#include "test-utils.hpp"
+
+#include "headerssync.h"
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+class HeadersSyncTest : public ::testing::Test
+{
+protected:
+    void SetUp() override {}
+
+    // peers are only compared, never dereferenced
+    int nPeerA;
+    int nPeerB;
+
+    const CNode* PeerA()
+    {
+        return reinterpret_cast<const CNode*>(&nPeerA);
+    }
+
+    const CNode* PeerB()
+    {
+        return reinterpret_cast<const CNode*>(&nPeerB);
+    }
+
+    static CSyncHeader MakeHeader(const uint256& hashPrev, int nHeight)
+    {
+        CSyncHeader header;
+        header.hashPrev = hashPrev;
+        header.nHeight = nHeight;
+        return header;
+    }
+
+    // Adds the headers nFirst..nLast on top of hashPrev (heights from
+    //    nHeight), hashed as nBase + n.
+    static uint256 AddChain(CSyncHeaderChain& chain,
+                            const CNode* pfrom,
+                            uint256 hashPrev,
+                            int nHeight,
+                            uint64_t nBase,
+                            int nCount,
+                            bool fExtendsBest)
+    {
+        for (int i = 0; i < nCount; ++i)
+        {
+            uint256 hash(nBase + i);
+            if (!chain.Add(pfrom, hash, MakeHeader(hashPrev, nHeight + i),
+                           fExtendsBest))
+            {
+                return 0;
+            }
+            hashPrev = hash;
+        }
+        return hashPrev;
+    }
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+TEST_F(HeadersSyncTest, BestChain)
+{
+    CSyncHeaderChain chain(1000, 100);
+    uint256 hashIndexTip(7);
+
+    print_info("Testing headers extending the best chain are appended");
+    uint256 hashTip = AddChain(chain, PeerA(), hashIndexTip, 11, 100, 5, true);
+    ASSERT_EQ(hashTip, uint256(104));
+    ASSERT_EQ(chain.GetChain().size(), 5U);
+    ASSERT_EQ(chain.GetChainStart(), 11);
+    for (int i = 0; i < 5; ++i)
+    {
+        ASSERT_EQ(chain.GetChain()[i], uint256(100 + i));
+    }
+
+    print_info("Testing side headers stay off the best chain");
+    uint256 hashSide = AddChain(chain, PeerB(), uint256(101), 13, 200, 2,
+                                false);
+    ASSERT_EQ(hashSide, uint256(201));
+    ASSERT_EQ(chain.Size(), 7U);
+    ASSERT_EQ(chain.GetChain().size(), 5U);
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 2);
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 0);
+
+    print_info("Testing a side branch that overtakes becomes the best chain");
+    CSyncHeader header = MakeHeader(uint256(201), 15);
+    ASSERT_TRUE(chain.Add(PeerB(), uint256(202), header, true));
+    ASSERT_EQ(chain.GetChain().size(), 5U);
+    ASSERT_EQ(chain.GetChainStart(), 11);
+    ASSERT_EQ(chain.GetChain()[1], uint256(101));
+    ASSERT_EQ(chain.GetChain()[2], uint256(200));
+    ASSERT_EQ(chain.GetChain().back(), uint256(202));
+
+    CSyncHeader headerRet;
+    ASSERT_TRUE(chain.Get(uint256(202), headerRet));
+    ASSERT_EQ(headerRet.hashPrev, uint256(201));
+    ASSERT_EQ(headerRet.nHeight, 15);
+    ASSERT_FALSE(chain.Get(uint256(999), headerRet));
+}
+
+
+TEST_F(HeadersSyncTest, TrimAndPop)
+{
+    CSyncHeaderChain chain(1000, 100);
+    AddChain(chain, PeerA(), uint256(7), 11, 100, 3, true);
+    AddChain(chain, PeerB(), uint256(100), 12, 200, 2, false);
+    ASSERT_EQ(chain.Size(), 5U);
+
+    print_info("Testing trim drops only headers off the best chain");
+    vector<uint256> vDropped;
+    chain.Trim(vDropped);
+    sort(vDropped.begin(), vDropped.end());
+    ASSERT_EQ(vDropped.size(), 2U);
+    ASSERT_EQ(vDropped[0], uint256(200));
+    ASSERT_EQ(vDropped[1], uint256(201));
+    ASSERT_EQ(chain.Size(), 3U);
+    ASSERT_EQ(chain.GetChain().size(), 3U);
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 0);
+
+    print_info("Testing popping the chain advances its start");
+    AddChain(chain, PeerB(), uint256(100), 12, 300, 1, false);
+    chain.PopFront();
+    ASSERT_EQ(chain.GetChainStart(), 12);
+    ASSERT_EQ(chain.GetChain().front(), uint256(101));
+    ASSERT_EQ(chain.Size(), 3U);
+
+    print_info("Testing side headers go with the last chain header");
+    chain.PopFront();
+    chain.PopFront();
+    ASSERT_TRUE(chain.GetChain().empty());
+    ASSERT_EQ(chain.Size(), 0U);
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 0);
+    chain.PopFront();
+    ASSERT_EQ(chain.GetChainStart(), 14);
+}
+
+
+TEST_F(HeadersSyncTest, Limits)
+{
+    CSyncHeaderChain chain(6, 3);
+
+    print_info("Testing side headers are limited per peer");
+    ASSERT_NE(AddChain(chain, PeerA(), uint256(7), 11, 100, 3, false), 0);
+    ASSERT_FALSE(chain.CanAdd(PeerA(), false));
+    ASSERT_TRUE(chain.CanAdd(PeerA(), true));
+    ASSERT_TRUE(chain.CanAdd(PeerB(), false));
+    ASSERT_EQ(AddChain(chain, PeerA(), uint256(102), 14, 103, 1, false), 0);
+    ASSERT_EQ(chain.Size(), 3U);
+
+    print_info("Testing all headers together are limited");
+    ASSERT_NE(AddChain(chain, PeerB(), uint256(7), 11, 200, 3, true), 0);
+    ASSERT_EQ(chain.Size(), 6U);
+    ASSERT_TRUE(chain.CanAdd(PeerB(), true));
+    ASSERT_EQ(AddChain(chain, PeerB(), uint256(202), 14, 203, 1, true), 0);
+    ASSERT_EQ(chain.GetChain().back(), uint256(202));
+}
+
+
+TEST_F(HeadersSyncTest, SideHeaderReset)
+{
+    CSyncHeaderChain chain(1000, 3);
+    AddChain(chain, PeerA(), uint256(7), 11, 100, 3, false);
+    AddChain(chain, PeerB(), uint256(7), 11, 200, 2, false);
+
+    print_info("Testing a count survives further requests to the sync peer");
+    chain.SetSyncPeer(PeerA());
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 0);
+    AddChain(chain, PeerA(), uint256(7), 11, 300, 3, false);
+    chain.SetSyncPeer(PeerA());
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 3);
+    ASSERT_FALSE(chain.CanAdd(PeerA(), false));
+
+    print_info("Testing a count starts over when the peer's sync ends");
+    chain.EndSync(PeerA());
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 0);
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 2);
+
+    print_info("Testing a count starts over when the peer is the sync peer "
+               "again");
+    AddChain(chain, PeerA(), uint256(7), 11, 400, 3, false);
+    chain.SetSyncPeer(PeerB());
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 0);
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 3);
+    chain.SetSyncPeer(PeerA());
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 0);
+
+    print_info("Testing counts of departed peers are forgotten");
+    AddChain(chain, PeerA(), uint256(7), 11, 500, 1, false);
+    AddChain(chain, PeerB(), uint256(7), 11, 600, 1, false);
+    set<CNode*> setLive;
+    setLive.insert(const_cast<CNode*>(PeerB()));
+    chain.KeepPeers(setLive);
+    ASSERT_EQ(chain.GetSideHeaders(PeerA()), 0);
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 1);
+
+    print_info("Testing clear forgets everything");
+    chain.Clear();
+    ASSERT_EQ(chain.Size(), 0U);
+    ASSERT_EQ(chain.GetSideHeaders(PeerB()), 0);
+}
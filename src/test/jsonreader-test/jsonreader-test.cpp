@@ -0,0 +1,175 @@
+#include "test-utils.hpp"
+
+#include "jsonreader.h"
+#include "json/json_spirit_reader_template.h"
+#include "json/json_spirit_writer_template.h"
+
+#include <boost/lexical_cast.hpp>
+
+
+using namespace std;
+using namespace json_spirit;
+
+
+class JSONReaderTest : public ::testing::Test
+{
+protected:
+    void SetUp() override {}
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+// ReadJSON must make what read_string makes of these
+static const char* vValid[] =
+{
+    "{\"method\":\"getblockcount\",\"params\":[],\"id\":1}",
+    "  {\"method\" : \"getblock\" ,\n\t\"params\" : [ \"00ab\" , true ] , \"id\" : \"x\" }  ",
+    "[{\"method\":\"getblockhash\",\"params\":[1]},{\"method\":\"getblockhash\",\"params\":[2]}]",
+    "{}", "[]", "[[]]", "[{}]", "{\"a\":{}}", "{\"a\":[]}",
+    "0", "-0", "7", "007", "+7", "-7",
+    "9223372036854775807", "-9223372036854775808",
+    "9223372036854775808", "18446744073709551615",
+    "1.5", "-1.5", "0.1", "1e3", "1E-3", "2.5e+10", "1.", ".5", "-.5",
+    "123456789.123456789", "1e400", "[0.00000001, 21000000.0]",
+    "true", "false", "null", "[true,false,null]",
+    "\"\"", "\"abc\"", "\"a b\\tc\"", "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"",
+    "\"\\u0041\\u00e9\\u20ac\"", "\"\\x41\\x7a\"", "\"\\q\"", "\"tab\tin\"",
+    "\"\\u12\"", "\"\\x4\"", "\"\xc3\xa9\"",
+    "{\"a\":1,\"a\":2}",
+    "[1,\"two\",3.0,[4,[5,{\"six\":6}]]]",
+    "1 2", "{\"a\":1} trailing", "truex", "[1]]",
+};
+
+// and reject these
+static const char* vInvalid[] =
+{
+    "", "   ", "{", "}", "[", "]", "[1,]", "[,1]", "{\"a\"}", "{\"a\":}",
+    "{\"a\" 1}", "{a:1}", "{\"a\":1,}", "[1 2]", "\"abc", "\"abc\\\"",
+    "tru", "nul", "fals", "-", "+", ".", "-x", "abc",
+    "18446744073709551616", "-9223372036854775809",
+    "[\"a\":1]", "{\"a\":1]", "[1}",
+};
+
+static string ReadWithSpirit(const string& str, bool& fOk)
+{
+    Value value;
+    fOk = read_string(str, value);
+    return fOk ? write_string(value, false) : "";
+}
+
+static string ReadWithReader(const string& str, bool& fOk)
+{
+    Value value;
+    fOk = ReadJSON(str, value);
+    return fOk ? write_string(value, false) : "";
+}
+
+TEST_F(JSONReaderTest, Valid)
+{
+    for (unsigned int i = 0; i < (sizeof(vValid) / sizeof(vValid[0])); ++i)
+    {
+        bool fSpirit = false;
+        bool fReader = false;
+        string strSpirit = ReadWithSpirit(vValid[i], fSpirit);
+        string strReader = ReadWithReader(vValid[i], fReader);
+        ASSERT_TRUE(fSpirit) << vValid[i];
+        ASSERT_TRUE(fReader) << vValid[i];
+        ASSERT_EQ(strReader, strSpirit);
+    }
+}
+
+
+TEST_F(JSONReaderTest, Invalid)
+{
+    for (unsigned int i = 0; i < (sizeof(vInvalid) / sizeof(vInvalid[0])); ++i)
+    {
+        bool fSpirit = true;
+        bool fReader = true;
+        ReadWithSpirit(vInvalid[i], fSpirit);
+        ReadWithReader(vInvalid[i], fReader);
+        ASSERT_FALSE(fSpirit) << vInvalid[i];
+        ASSERT_FALSE(fReader) << vInvalid[i];
+    }
+}
+
+
+TEST_F(JSONReaderTest, Types)
+{
+    Value value;
+    ASSERT_TRUE(ReadJSON("18446744073709551615", value));
+    ASSERT_EQ(value.type(), int_type);
+    ASSERT_TRUE(value.is_uint64());
+    ASSERT_EQ(value.get_uint64(), 18446744073709551615ULL);
+
+    ASSERT_TRUE(ReadJSON("-9223372036854775808", value));
+    ASSERT_FALSE(value.is_uint64());
+    ASSERT_EQ(value.get_int64(), (-9223372036854775807LL - 1));
+
+    ASSERT_TRUE(ReadJSON("1.0", value));
+    ASSERT_EQ(value.type(), real_type);
+    ASSERT_TRUE(ReadJSON("10", value));
+    ASSERT_EQ(value.type(), int_type);
+
+    ASSERT_TRUE(ReadJSON("{\"a\":[1,{\"b\":\"c\"}]}", value));
+    const Object& obj = value.get_obj();
+    ASSERT_EQ(obj.size(), 1U);
+    ASSERT_EQ(obj[0].name_, "a");
+    ASSERT_EQ(obj[0].value_.get_array()[1].get_obj()[0].value_.get_str(), "c");
+}
+
+
+// Reals come from strtod, which rounds correctly
+TEST_F(JSONReaderTest, Reals)
+{
+    static const char* vReals[] =
+    {
+        "0.1", "0.00000001", "20999999.9769", "1.7976931348623157e308",
+        "2.2250738585072014e-308", "3.141592653589793",
+    };
+    for (unsigned int i = 0; i < (sizeof(vReals) / sizeof(vReals[0])); ++i)
+    {
+        Value value;
+        ASSERT_TRUE(ReadJSON(vReals[i], value));
+        ASSERT_EQ(value.get_real(), strtod(vReals[i], NULL));
+    }
+}
+
+
+TEST_F(JSONReaderTest, Depth)
+{
+    Value value;
+    string strDeep = string(MAX_JSON_DEPTH, '[') + string(MAX_JSON_DEPTH, ']');
+    ASSERT_TRUE(ReadJSON(strDeep, value));
+    string strTooDeep = "[" + strDeep + "]";
+    ASSERT_FALSE(ReadJSON(strTooDeep, value));
+}
+
+
+TEST_F(JSONReaderTest, Batch)
+{
+    string strBatch = "[";
+    for (int i = 0; i < 100; ++i)
+    {
+        string strIndex = boost::lexical_cast<string>(i);
+        strBatch += (i ? "," : "");
+        strBatch += "{\"method\":\"getblockhash\",\"params\":[" + strIndex +
+                    "],\"id\":" + strIndex + "}";
+    }
+    strBatch += "]";
+
+    bool fSpirit = false;
+    bool fReader = false;
+    string strSpirit = ReadWithSpirit(strBatch, fSpirit);
+    ASSERT_TRUE(fSpirit);
+    ASSERT_EQ(ReadWithReader(strBatch, fReader), strSpirit);
+    ASSERT_TRUE(fReader);
+}
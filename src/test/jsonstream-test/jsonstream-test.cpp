@@ -0,0 +1,113 @@
+#include "test-utils.hpp"
+
+#include "jsonstream.h"
+#include "json/json_spirit_writer_template.h"
+
+#include <boost/bind/bind.hpp>
+
+
+using namespace std;
+using namespace json_spirit;
+
+
+class JSONStreamTest : public ::testing::Test
+{
+protected:
+    void SetUp() override {}
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+static void WriteSample(CJSONStream& stream)
+{
+    stream.BeginObject();
+    stream.WritePair("height", 1234);
+    stream.WritePair("hash", "ab\"cd\n");
+    stream.Key("tx");
+    stream.BeginArray();
+    for (int i = 0; i < 500; i++)
+    {
+        Object entry;
+        entry.push_back(Pair("n", i));
+        entry.push_back(Pair("amount", 1.25));
+        entry.push_back(Pair("coinbase", (i == 0)));
+        stream.Write(entry);
+    }
+    stream.BeginArray();
+    stream.EndArray();
+    stream.BeginObject();
+    stream.EndObject();
+    stream.EndArray();
+    stream.Key("info");
+    stream.BeginObject();
+    Object info;
+    info.push_back(Pair("signature", Value::null));
+    info.push_back(Pair("flags", "proof-of-stake"));
+    stream.WritePairs(info);
+    stream.EndObject();
+    stream.WritePair("empty", Array());
+    stream.EndObject();
+}
+
+static void AppendChunk(string* pstrOut, int* pnChunks, const string& strChunk)
+{
+    *pstrOut += strChunk;
+    *pnChunks += 1;
+}
+
+
+// Text and tree output are what write_string makes of the same tree
+TEST_F(JSONStreamTest, MatchesWriteString)
+{
+    CJSONValueStream valueStream;
+    WriteSample(valueStream);
+    string strExpected = write_string(valueStream.GetValue(), false);
+
+    string strOut;
+    int nChunks = 0;
+    CJSONTextStream textStream(boost::bind(&AppendChunk,
+                                           &strOut,
+                                           &nChunks,
+                                           boost::placeholders::_1),
+                               1000);
+    WriteSample(textStream);
+    string strRest;
+    textStream.TakeBuffer(strRest);
+    strOut += strRest;
+
+    print_info("Testing the text stream matches write_string");
+    ASSERT_EQ(strOut, strExpected);
+    print_info("Testing the text stream was flushed in chunks");
+    ASSERT_GT(nChunks, 1);
+    ASSERT_EQ(textStream.GetBytesWritten(), strExpected.size());
+}
+
+
+// A single scalar is a valid reply
+TEST_F(JSONStreamTest, Scalar)
+{
+    CJSONValueStream valueStream;
+    valueStream.Write(42);
+    ASSERT_EQ(valueStream.GetValue().get_int(), 42);
+
+    string strOut;
+    int nChunks = 0;
+    CJSONTextStream textStream(boost::bind(&AppendChunk,
+                                           &strOut,
+                                           &nChunks,
+                                           boost::placeholders::_1),
+                               1000);
+    textStream.Write(42);
+    textStream.TakeBuffer(strOut);
+    ASSERT_EQ(strOut, "42");
+    ASSERT_EQ(nChunks, 0);
+}
@@ -0,0 +1,108 @@
+#include "test-utils.hpp"
+
+#include "metrics.h"
+#include "json/json_spirit_utils.h"
+
+
+using namespace std;
+using namespace json_spirit;
+
+
+class MetricsTest : public ::testing::Test
+{
+protected:
+    void SetUp() override {}
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+TEST_F(MetricsTest, Buckets)
+{
+    const int nBuckets = CMetricHistogram::HISTOGRAM_BUCKETS;
+
+    print_info("Testing every value lands in a bucket whose range holds it");
+    uint64_t vValues[] = { 0, 1, 7, 15, 16, 17, 31, 32, 1000, 123456789,
+                           0x7fffffffffffffffULL, 0xffffffffffffffffULL };
+    for (unsigned int i = 0; i < (sizeof(vValues) / sizeof(vValues[0])); ++i)
+    {
+        int nBucket = CMetricHistogram::GetBucket(vValues[i]);
+        ASSERT_GE(nBucket, 0);
+        ASSERT_LT(nBucket, nBuckets);
+        ASSERT_LE(vValues[i], CMetricHistogram::GetBucketMax(nBucket));
+        if (nBucket > 0)
+        {
+            ASSERT_GT(vValues[i], CMetricHistogram::GetBucketMax(nBucket - 1));
+        }
+    }
+
+    print_info("Testing the buckets are contiguous");
+    for (int i = 1; i < nBuckets; ++i)
+    {
+        uint64_t nFirst = CMetricHistogram::GetBucketMax(i - 1) + 1;
+        ASSERT_EQ(CMetricHistogram::GetBucket(nFirst), i);
+    }
+}
+
+
+TEST_F(MetricsTest, Quantiles)
+{
+    CMetricHistogram* phistogram =
+                GetMetricHistogram("test_quantiles_seconds", "test");
+    for (uint64_t n = 1; n <= 1000; ++n)
+    {
+        phistogram->Observe(n);
+    }
+    ASSERT_EQ(phistogram->GetCount(), 1000U);
+    ASSERT_EQ(phistogram->GetSum(), 500500U);
+    ASSERT_EQ(phistogram->GetMax(), 1000U);
+
+    print_info("Testing quantiles are within one sub-bucket of the true value");
+    uint64_t nMedian = phistogram->GetQuantile(0.5);
+    ASSERT_GE(nMedian, 500U);
+    ASSERT_LE(nMedian, 500U + 500 / 8);
+    uint64_t nP99 = phistogram->GetQuantile(0.99);
+    ASSERT_GE(nP99, 990U);
+    ASSERT_LE(nP99, 1000U);
+    ASSERT_EQ(phistogram->GetQuantile(1.0), 1000U);
+}
+
+
+TEST_F(MetricsTest, Registry)
+{
+    CMetricCounter* pcounter = GetMetricCounter("test_total", "test",
+                                                "command", "tx");
+    ASSERT_EQ(pcounter, GetMetricCounter("test_total", "", "command", "tx"));
+    ASSERT_NE(pcounter, GetMetricCounter("test_total", "", "command", "inv"));
+    pcounter->Inc(3);
+
+    print_info("Testing label values past the limit share one series");
+    for (unsigned int i = 0; i < MAX_METRIC_SERIES + 10; ++i)
+    {
+        GetMetricCounter("test_limit_total", "test",
+                         "command", strprintf("c%u", i))->Inc();
+    }
+    Object obj = MetricsToJSON("test_limit_total");
+    ASSERT_EQ(obj.size(), MAX_METRIC_SERIES + 1);
+    Value val = find_value(obj, string("test_limit_total{command=\"other\"}"));
+    ASSERT_EQ(val.get_uint64(), 10U);
+
+    print_info("Testing the Prometheus text format");
+    GetMetricGauge("test_gauge", "A \"gauge\"")->Set(-5);
+    GetMetricHistogram("test_registry_seconds", "test")->Observe(7);
+    string strText = MetricsToPrometheus();
+    ASSERT_NE(strText.find("# TYPE test_total counter\n"), string::npos);
+    ASSERT_NE(strText.find("test_total{command=\"tx\"} 3\n"), string::npos);
+    ASSERT_NE(strText.find("test_gauge -5\n"), string::npos);
+    ASSERT_NE(strText.find("# TYPE test_registry_seconds summary\n"),
+              string::npos);
+    ASSERT_NE(strText.find("test_registry_seconds_count 1\n"), string::npos);
+}
@@ -0,0 +1,156 @@
+#include "test-utils.hpp"
+
+#include "txcache.h"
+#include "main.h"
+
+
+using namespace std;
+
+
+// stand-ins for what main.h uses from sources not linked here
+int nBestHeight = 0;
+uint256 hashOfNftHashes = 0;
+
+int64_t GetAdjustedTime()
+{
+    return GetTime();
+}
+
+
+class TxCacheTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        for (int i = 0; i < 5; ++i)
+        {
+            CTransaction tx;
+            tx.vin.push_back(CTxIn(COutPoint(uint256(1000 + i), 0)));
+            tx.vout.push_back(CTxOut(100 + i, CScript() << OP_TRUE));
+            vtx.push_back(tx);
+            vtxindex.push_back(CTxIndex(CDiskTxPos(1, 100 * i, 100 * i + 81),
+                                        tx.vout.size()));
+        }
+    }
+
+    vector<CTransaction> vtx;
+    vector<CTxIndex> vtxindex;
+
+    // the bytes an entry of the nth tx takes
+    size_t GetEntrySize(unsigned int n) const
+    {
+        return ::GetSerializeSize(vtx[n], SER_DISK, CLIENT_VERSION) +
+               ::GetSerializeSize(vtxindex[n], SER_DISK, CLIENT_VERSION) +
+               TXCACHE_ENTRY_OVERHEAD;
+    }
+
+    void Put(CPrevTxCache& cache, unsigned int n)
+    {
+        cache.Put(vtx[n].GetHash(), vtx[n], vtxindex[n]);
+    }
+
+    bool Has(CPrevTxCache& cache, unsigned int n)
+    {
+        CTransaction tx;
+        CTxIndex txindex;
+        return cache.Get(vtx[n].GetHash(), tx, txindex);
+    }
+};
+
+
+int main(int argc, char **argv)
+{
+    set_debug(argc, argv);
+
+    testing::InitGoogleTest(&argc, argv);
+
+    return RUN_ALL_TESTS();
+}
+
+
+TEST_F(TxCacheTest, Eviction)
+{
+    CPrevTxCache cache;
+    ASSERT_FALSE(cache.IsEnabled());
+    Put(cache, 0);
+    ASSERT_FALSE(Has(cache, 0));
+
+    print_info("Testing the least recently used tx is evicted first");
+    cache.SetMaxBytes(GetEntrySize(0) * 3);
+    ASSERT_TRUE(cache.IsEnabled());
+    Put(cache, 0);
+    Put(cache, 1);
+    Put(cache, 2);
+    ASSERT_TRUE(Has(cache, 0));
+    Put(cache, 3);
+    ASSERT_TRUE(Has(cache, 0));
+    ASSERT_FALSE(Has(cache, 1));
+    ASSERT_TRUE(Has(cache, 2));
+    ASSERT_TRUE(Has(cache, 3));
+
+    print_info("Testing putting a cached tx again refreshes it");
+    Put(cache, 2);
+    Put(cache, 4);
+    ASSERT_FALSE(Has(cache, 0));
+    ASSERT_TRUE(Has(cache, 2));
+
+    print_info("Testing a lower limit trims the cache");
+    cache.SetMaxBytes(GetEntrySize(0));
+    ASSERT_TRUE(Has(cache, 2));
+    ASSERT_FALSE(Has(cache, 3));
+    ASSERT_FALSE(Has(cache, 4));
+
+    print_info("Testing a tx bigger than the cache is not kept");
+    cache.SetMaxBytes(GetEntrySize(0) - 1);
+    Put(cache, 0);
+    ASSERT_FALSE(Has(cache, 0));
+}
+
+
+TEST_F(TxCacheTest, TxIndex)
+{
+    CPrevTxCache cache;
+    cache.SetMaxBytes(GetEntrySize(0) * 10);
+    Put(cache, 0);
+
+    print_info("Testing the tx and its txindex come back");
+    CTransaction tx;
+    CTxIndex txindex;
+    ASSERT_TRUE(cache.Get(vtx[0].GetHash(), tx, txindex));
+    ASSERT_EQ(tx.GetHash(), vtx[0].GetHash());
+    ASSERT_TRUE(txindex == vtxindex[0]);
+
+    print_info("Testing a written txindex replaces the cached one");
+    CTxIndex txindexSpent = vtxindex[0];
+    txindexSpent.vSpent[0] = CDiskTxPos(2, 500, 581);
+    cache.UpdateTxIndex(vtx[0].GetHash(), txindexSpent);
+    ASSERT_TRUE(cache.Get(vtx[0].GetHash(), tx, txindex));
+    ASSERT_TRUE(txindex == txindexSpent);
+    ASSERT_FALSE(txindex == vtxindex[0]);
+
+    print_info("Testing a txindex alone is not cached");
+    cache.UpdateTxIndex(vtx[1].GetHash(), vtxindex[1]);
+    ASSERT_FALSE(Has(cache, 1));
+}
+
+
+TEST_F(TxCacheTest, Invalidation)
+{
+    CPrevTxCache cache;
+    cache.SetMaxBytes(GetEntrySize(0) * 10);
+    Put(cache, 0);
+    Put(cache, 1);
+    Put(cache, 2);
+
+    print_info("Testing the txs of a disconnected block are erased");
+    cache.Erase(vtx[1].GetHash());
+    ASSERT_TRUE(Has(cache, 0));
+    ASSERT_FALSE(Has(cache, 1));
+    ASSERT_TRUE(Has(cache, 2));
+
+    print_info("Testing an aborted batch clears the cache");
+    cache.Clear();
+    ASSERT_FALSE(Has(cache, 0));
+    ASSERT_FALSE(Has(cache, 2));
+    ASSERT_TRUE(cache.IsEnabled());
+}
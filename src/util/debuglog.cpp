@@ -0,0 +1,442 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "debuglog.h"
+#include "util.h"
+
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <vector>
+
+using namespace std;
+
+// size of the ring of each thread that logs, in bytes
+static const unsigned int DEBUGLOG_RING_SIZE = 256 * 1024;
+// how often the writer drains the rings if no ring fills up first
+static const int DEBUGLOG_FLUSH_MILLIS = 100;
+// how long a thread with a full ring waits for the writer before it drops
+//    the line
+static const int DEBUGLOG_FULL_WAIT_MILLIS = 50;
+
+class CLogLine
+{
+public:
+    uint64_t nSeq;
+    string str;
+
+    bool operator<(const CLogLine& other) const
+    {
+        return nSeq < other.nSeq;
+    }
+};
+
+// Lines of one thread on their way to the writer. Only the owning thread
+//    moves nHead and only the writer moves nTail, so neither needs a lock.
+//    Each line is stored as its sequence number, its length and its text.
+class CLogRing
+{
+private:
+    static const unsigned int HEADER_SIZE = sizeof(uint64_t) +
+                                            sizeof(uint32_t);
+    vector<char> vch;
+
+    void Write(uint64_t nPos, const void* pv, size_t nSize)
+    {
+        const char* p = (const char*)pv;
+        size_t nStart = nPos & (vch.size() - 1);
+        size_t nFirst = min(nSize, vch.size() - nStart);
+        memcpy(&vch[nStart], p, nFirst);
+        memcpy(&vch[0], p + nFirst, nSize - nFirst);
+    }
+
+    void Read(uint64_t nPos, void* pv, size_t nSize) const
+    {
+        char* p = (char*)pv;
+        size_t nStart = nPos & (vch.size() - 1);
+        size_t nFirst = min(nSize, vch.size() - nStart);
+        memcpy(p, &vch[nStart], nFirst);
+        memcpy(p + nFirst, &vch[0], nSize - nFirst);
+    }
+
+public:
+    // bytes ever added and taken
+    atomic<uint64_t> nHead;
+    atomic<uint64_t> nTail;
+    // lines lost because the ring was full
+    atomic<unsigned int> nDropped;
+    // set when the owning thread exits, the writer frees the ring
+    atomic<bool> fOrphaned;
+    // only used by the owning thread
+    bool fStartedNewLine;
+
+    // nSize must be a power of two
+    explicit CLogRing(unsigned int nSize)
+        : vch(nSize),
+          nHead(0),
+          nTail(0),
+          nDropped(0),
+          fOrphaned(false),
+          fStartedNewLine(true) {}
+
+    uint64_t GetUsed() const
+    {
+        return nHead.load(memory_order_relaxed) -
+               nTail.load(memory_order_relaxed);
+    }
+
+    bool Push(uint64_t nSeq, const string& str)
+    {
+        uint64_t nNeed = HEADER_SIZE + str.size();
+        uint64_t nHeadNow = nHead.load(memory_order_relaxed);
+        uint64_t nTailNow = nTail.load(memory_order_acquire);
+        if (nNeed > vch.size() - (nHeadNow - nTailNow))
+        {
+            return false;
+        }
+        uint32_t nLen = str.size();
+        Write(nHeadNow, &nSeq, sizeof(nSeq));
+        Write(nHeadNow + sizeof(nSeq), &nLen, sizeof(nLen));
+        Write(nHeadNow + HEADER_SIZE, str.data(), nLen);
+        nHead.store(nHeadNow + nNeed, memory_order_release);
+        return true;
+    }
+
+    void Drain(vector<CLogLine>& vRet)
+    {
+        uint64_t nHeadNow = nHead.load(memory_order_acquire);
+        uint64_t nTailNow = nTail.load(memory_order_relaxed);
+        while (nTailNow < nHeadNow)
+        {
+            CLogLine line;
+            uint32_t nLen;
+            Read(nTailNow, &line.nSeq, sizeof(line.nSeq));
+            Read(nTailNow + sizeof(line.nSeq), &nLen, sizeof(nLen));
+            line.str.resize(nLen);
+            if (nLen > 0)
+            {
+                Read(nTailNow + HEADER_SIZE, &line.str[0], nLen);
+            }
+            nTailNow += HEADER_SIZE + nLen;
+            vRet.push_back(line);
+        }
+        nTail.store(nTailNow, memory_order_release);
+    }
+};
+
+// Counts the lines of one format string in the current second. A slot
+//    is claimed by the first format that lands on it and then kept.
+class CLogRateSlot
+{
+public:
+    atomic<const char*> pszFormat;
+    atomic<int64_t> nSecond;
+    atomic<unsigned int> nCount;
+    atomic<unsigned int> nSuppressed;
+};
+
+static const unsigned int DEBUGLOG_RATE_SLOTS = 4096;
+// slots tried for a format before it goes unlimited
+static const unsigned int DEBUGLOG_RATE_PROBES = 16;
+
+static CLogRateSlot vLogRateSlots[DEBUGLOG_RATE_SLOTS];
+static atomic<int> nLogRateLimit(0);
+
+static atomic<bool> fLogAsync(false);
+static atomic<uint64_t> nLogSeq(0);
+
+// The asynchronous writer's own reopen request, fReopenDebugLog belongs
+//    to the direct writer in util.cpp.
+static atomic<bool> fReopenAsyncLog(false);
+
+// These are allocated once and never freed, because printf may still run
+//    in global destructors at exit.
+static boost::mutex* pmutexLogRings = NULL;
+static list<CLogRing*>* plistLogRings = NULL;
+static boost::thread_specific_ptr<CLogRing>* pthreadLogRing = NULL;
+static boost::mutex* pmutexLogWake = NULL;
+static boost::condition_variable* pcondLogWake = NULL;
+
+// guarded by pmutexLogWake
+static bool fLogStopping = false;
+static boost::thread* pthreadLogWriter = NULL;
+
+// only used by the writer
+static FILE* fileLog = NULL;
+
+
+static void OrphanLogRing(CLogRing* pring)
+{
+    pring->fOrphaned.store(true, memory_order_release);
+}
+
+static CLogRing* GetThreadLogRing()
+{
+    CLogRing* pring = pthreadLogRing->get();
+    if (pring == NULL)
+    {
+        pring = new CLogRing(DEBUGLOG_RING_SIZE);
+        pthreadLogRing->reset(pring);
+        boost::mutex::scoped_lock lock(*pmutexLogRings);
+        plistLogRings->push_back(pring);
+    }
+    return pring;
+}
+
+static void OpenLogFile()
+{
+    boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+    if (fileLog == NULL)
+    {
+        fileLog = fopen(pathDebug.string().c_str(), "a");
+    }
+    else if (fReopenAsyncLog.exchange(false))
+    {
+        fileLog = freopen(pathDebug.string().c_str(), "a", fileLog);
+    }
+    if (fileLog != NULL)
+    {
+        setvbuf(fileLog, NULL, _IOFBF, 64 * 1024);
+    }
+}
+
+// Writes every line queued so far, oldest first.
+static void WriteQueuedLines()
+{
+    vector<CLogLine> vLines;
+    {
+        boost::mutex::scoped_lock lock(*pmutexLogRings);
+        list<CLogRing*>::iterator it = plistLogRings->begin();
+        while (it != plistLogRings->end())
+        {
+            CLogRing* pring = *it;
+            // an orphan gets no more lines once this is seen
+            bool fOrphaned = pring->fOrphaned.load(memory_order_acquire);
+            pring->Drain(vLines);
+            unsigned int nDropped = pring->nDropped.exchange(0);
+            if (nDropped > 0)
+            {
+                CLogLine line;
+                line.nSeq = nLogSeq.fetch_add(1);
+                line.str = strprintf("debug.log: dropped %u lines from a "
+                                     "thread logging too fast\n", nDropped);
+                vLines.push_back(line);
+            }
+            if (fOrphaned)
+            {
+                delete pring;
+                it = plistLogRings->erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    if (vLines.empty())
+    {
+        return;
+    }
+
+    sort(vLines.begin(), vLines.end());
+    if ((fileLog == NULL) || fReopenAsyncLog.load())
+    {
+        OpenLogFile();
+    }
+    if (fileLog == NULL)
+    {
+        return;
+    }
+    for (unsigned int i = 0; i < vLines.size(); ++i)
+    {
+        fwrite(vLines[i].str.data(), 1, vLines[i].str.size(), fileLog);
+    }
+    fflush(fileLog);
+}
+
+static void ThreadDebugLog()
+{
+    RenameThread("stealth-log");
+    LOOP
+    {
+        bool fStop;
+        {
+            boost::unique_lock<boost::mutex> lock(*pmutexLogWake);
+            if (!fLogStopping)
+            {
+                pcondLogWake->timed_wait(
+                    lock,
+                    boost::posix_time::milliseconds(DEBUGLOG_FLUSH_MILLIS));
+            }
+            fStop = fLogStopping;
+        }
+        WriteQueuedLines();
+        if (fStop)
+        {
+            return;
+        }
+    }
+}
+
+
+void StartDebugLog(int nRateLimit)
+{
+    if (fLogAsync.load() || fPrintToConsole || fPrintToDebugger)
+    {
+        return;
+    }
+    if (pmutexLogRings == NULL)
+    {
+        pmutexLogRings = new boost::mutex();
+        plistLogRings = new list<CLogRing*>();
+        pthreadLogRing = new boost::thread_specific_ptr<CLogRing>(
+                                                              OrphanLogRing);
+        pmutexLogWake = new boost::mutex();
+        pcondLogWake = new boost::condition_variable();
+    }
+    nLogRateLimit.store(max(nRateLimit, 0));
+    fLogStopping = false;
+    try
+    {
+        pthreadLogWriter = new boost::thread(ThreadDebugLog);
+    }
+    catch (std::exception&)
+    {
+        return;
+    }
+    fLogAsync.store(true);
+}
+
+void StopDebugLog()
+{
+    if (!fLogAsync.exchange(false))
+    {
+        return;
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(*pmutexLogWake);
+        fLogStopping = true;
+    }
+    pcondLogWake->notify_one();
+    pthreadLogWriter->join();
+    delete pthreadLogWriter;
+    pthreadLogWriter = NULL;
+
+    // lines from threads that saw the writer running a moment ago
+    WriteQueuedLines();
+    if (fileLog != NULL)
+    {
+        fclose(fileLog);
+        fileLog = NULL;
+    }
+}
+
+bool IsDebugLogAsync()
+{
+    return fLogAsync.load(memory_order_relaxed);
+}
+
+// The slot of the format, NULL if none is free near its hash
+static CLogRateSlot* GetLogRateSlot(const char* pszFormat)
+{
+    uint64_t nHash = (uint64_t)(uintptr_t)pszFormat * 0x9E3779B97F4A7C15ULL;
+    unsigned int nStart = (unsigned int)(nHash >> 32);
+    for (unsigned int i = 0; i < DEBUGLOG_RATE_PROBES; ++i)
+    {
+        CLogRateSlot& slot =
+                       vLogRateSlots[(nStart + i) % DEBUGLOG_RATE_SLOTS];
+        const char* pszSlot = slot.pszFormat.load(memory_order_acquire);
+        if (pszSlot == NULL)
+        {
+            if (slot.pszFormat.compare_exchange_strong(pszSlot, pszFormat))
+            {
+                return &slot;
+            }
+        }
+        if (pszSlot == pszFormat)
+        {
+            return &slot;
+        }
+    }
+    return NULL;
+}
+
+bool AllowDebugLog(const char* pszFormat)
+{
+    int nLimit = nLogRateLimit.load(memory_order_relaxed);
+    if (nLimit <= 0)
+    {
+        return true;
+    }
+    CLogRateSlot* pslot = GetLogRateSlot(pszFormat);
+    if (pslot == NULL)
+    {
+        return true;
+    }
+    CLogRateSlot& slot = *pslot;
+    int64_t nNow = GetTime();
+    if (slot.nSecond.load(memory_order_relaxed) != nNow)
+    {
+        slot.nSecond.store(nNow, memory_order_relaxed);
+        slot.nCount.store(0, memory_order_relaxed);
+        unsigned int nSuppressed = slot.nSuppressed.exchange(0);
+        if (nSuppressed > 0)
+        {
+            QueueDebugLog(strprintf("debug.log: dropped %u lines like the "
+                                    "next, over %d a second\n",
+                                    nSuppressed, nLimit));
+        }
+    }
+    if (slot.nCount.fetch_add(1, memory_order_relaxed) >=
+        (unsigned int)nLimit)
+    {
+        slot.nSuppressed.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool QueueDebugLog(const string& str)
+{
+    if (!IsDebugLogAsync())
+    {
+        return false;
+    }
+    CLogRing* pring = GetThreadLogRing();
+    bool fStartedNewLine = pring->fStartedNewLine;
+    pring->fStartedNewLine = (!str.empty() && (str[str.size() - 1] == '\n'));
+
+    string strLine = str;
+    if (fLogTimestamps && fStartedNewLine)
+    {
+        strLine = DateTimeStrFormat("%x %H:%M:%S", GetTime()) + " " + str;
+    }
+
+    uint64_t nSeq = nLogSeq.fetch_add(1);
+    bool fPushed = pring->Push(nSeq, strLine);
+    for (int i = 0; !fPushed && (i < DEBUGLOG_FULL_WAIT_MILLIS); ++i)
+    {
+        pcondLogWake->notify_one();
+        MilliSleep(1);
+        fPushed = pring->Push(nSeq, strLine);
+    }
+    if (!fPushed)
+    {
+        pring->nDropped.fetch_add(1, memory_order_relaxed);
+    }
+
+    if (pring->GetUsed() > (DEBUGLOG_RING_SIZE / 4))
+    {
+        pcondLogWake->notify_one();
+    }
+    return true;
+}
+
+void ReopenDebugLog()
+{
+    fReopenDebugLog = true;
+    fReopenAsyncLog.store(true);
+}
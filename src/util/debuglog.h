@@ -0,0 +1,46 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DEBUGLOG_H
+#define DEBUGLOG_H
+
+#include <string>
+
+//
+// Asynchronous writer for debug.log.
+//
+// While it runs, printf (OutputDebugStringF) formats on the calling thread
+// and copies the text into a ring buffer owned by that thread, without
+// taking a lock. A background thread drains the rings, puts the lines back
+// in the order they were logged, and writes them through one buffered
+// file. A thread whose ring is full waits a little for the writer, then
+// loses the line, and the writer notes how many were lost.
+//
+// Before StartDebugLog() and after StopDebugLog(), lines are written
+// directly as before.
+//
+
+// nRateLimit is the most lines per second of one format string, 0 for
+//    no limit
+void StartDebugLog(int nRateLimit);
+// writes everything queued
+void StopDebugLog();
+
+bool IsDebugLogAsync();
+
+// False if more lines than the rate limit were logged this second with
+//    the format pszFormat. A format string stands for its call site, so a
+//    noisy call site does not silence others. The first line allowed again
+//    reports how many were dropped.
+bool AllowDebugLog(const char* pszFormat);
+
+// Queues text for debug.log. Returns false if the writer isn't running,
+//    and the caller must write the text itself.
+bool QueueDebugLog(const std::string& str);
+
+// Asks both the direct and the asynchronous writer to reopen debug.log,
+//    for log rotation. Safe to call from a signal handler.
+void ReopenDebugLog();
+
+#endif  /* DEBUGLOG_H */
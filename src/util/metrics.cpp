@@ -0,0 +1,357 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+#include "sync.h"
+
+#include <boost/algorithm/string/replace.hpp>
+
+#include <cassert>
+#include <cmath>
+#include <map>
+
+using namespace json_spirit;
+using namespace std;
+
+
+CMetricHistogram::CMetricHistogram(const string& strNameIn,
+                                   const string& strLabelIn,
+                                   const string& strLabelValueIn)
+    : CMetric(METRIC_HISTOGRAM, strNameIn, strLabelIn, strLabelValueIn),
+      nCount(0),
+      nSum(0),
+      nMax(0)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        vBuckets[i].store(0, memory_order_relaxed);
+    }
+}
+
+// Values below twice HISTOGRAM_SUB_BUCKETS have a bucket each. Above that,
+//    a value is counted by its top HISTOGRAM_SUB_BITS + 1 bits.
+int CMetricHistogram::GetBucket(uint64_t n)
+{
+    if (n < (uint64_t)(2 * HISTOGRAM_SUB_BUCKETS))
+    {
+        return (int)n;
+    }
+    int nShift = (63 - __builtin_clzll(n)) - HISTOGRAM_SUB_BITS;
+    return (nShift * HISTOGRAM_SUB_BUCKETS) + (int)(n >> nShift);
+}
+
+uint64_t CMetricHistogram::GetBucketMax(int nBucket)
+{
+    if (nBucket < (2 * HISTOGRAM_SUB_BUCKETS))
+    {
+        return nBucket;
+    }
+    int nShift = (nBucket / HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t nTop = (nBucket % HISTOGRAM_SUB_BUCKETS) +
+                    HISTOGRAM_SUB_BUCKETS + 1;
+    // wraps to the largest uint64 for the last bucket
+    return (nTop << nShift) - 1;
+}
+
+void CMetricHistogram::Observe(uint64_t n)
+{
+    vBuckets[GetBucket(n)].fetch_add(1, memory_order_relaxed);
+    nCount.fetch_add(1, memory_order_relaxed);
+    nSum.fetch_add(n, memory_order_relaxed);
+    uint64_t nOldMax = nMax.load(memory_order_relaxed);
+    while ((n > nOldMax) &&
+           !nMax.compare_exchange_weak(nOldMax, n, memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t CMetricHistogram::GetQuantile(double dQuantile) const
+{
+    // the buckets may move on while they are read, so they make their
+    //    own total
+    uint64_t vCounts[HISTOGRAM_BUCKETS];
+    uint64_t nTotal = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        vCounts[i] = vBuckets[i].load(memory_order_relaxed);
+        nTotal += vCounts[i];
+    }
+    if (nTotal == 0)
+    {
+        return 0;
+    }
+    uint64_t nRank = (uint64_t)ceil(dQuantile * nTotal);
+    if (nRank < 1)
+    {
+        nRank = 1;
+    }
+    uint64_t nSeen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        nSeen += vCounts[i];
+        if (nSeen >= nRank)
+        {
+            return min(GetBucketMax(i), GetMax());
+        }
+    }
+    return GetMax();
+}
+
+
+class CMetricFamily
+{
+public:
+    MetricType type;
+    string strHelp;
+    // by label value
+    map<string, CMetric*> mapSeries;
+
+    CMetricFamily(MetricType typeIn, const string& strHelpIn)
+        : type(typeIn), strHelp(strHelpIn) {}
+};
+
+static CCriticalSection cs_metrics;
+// by name, only grows
+static map<string, CMetricFamily> mapMetricFamilies;
+
+template <typename T>
+static T* GetMetric(MetricType type,
+                    const string& strName,
+                    const string& strHelp,
+                    const string& strLabel,
+                    const string& strLabelValue)
+{
+    LOCK(cs_metrics);
+    map<string, CMetricFamily>::iterator it =
+                                  mapMetricFamilies.find(strName);
+    if (it == mapMetricFamilies.end())
+    {
+        it = mapMetricFamilies.insert(
+                  make_pair(strName, CMetricFamily(type, strHelp))).first;
+    }
+    CMetricFamily& family = it->second;
+    assert(family.type == type);
+
+    map<string, CMetric*>::iterator itSeries =
+                                  family.mapSeries.find(strLabelValue);
+    if (itSeries == family.mapSeries.end())
+    {
+        string strValue = strLabelValue;
+        if (family.mapSeries.size() >= MAX_METRIC_SERIES)
+        {
+            strValue = "other";
+            itSeries = family.mapSeries.find(strValue);
+        }
+        if (itSeries == family.mapSeries.end())
+        {
+            itSeries = family.mapSeries.insert(
+                   make_pair(strValue,
+                             new T(strName, strLabel, strValue))).first;
+        }
+    }
+    return static_cast<T*>(itSeries->second);
+}
+
+CMetricCounter* GetMetricCounter(const string& strName,
+                                 const string& strHelp,
+                                 const string& strLabel,
+                                 const string& strLabelValue)
+{
+    return GetMetric<CMetricCounter>(METRIC_COUNTER, strName, strHelp,
+                                     strLabel, strLabelValue);
+}
+
+CMetricGauge* GetMetricGauge(const string& strName,
+                             const string& strHelp,
+                             const string& strLabel,
+                             const string& strLabelValue)
+{
+    return GetMetric<CMetricGauge>(METRIC_GAUGE, strName, strHelp,
+                                   strLabel, strLabelValue);
+}
+
+CMetricHistogram* GetMetricHistogram(const string& strName,
+                                     const string& strHelp,
+                                     const string& strLabel,
+                                     const string& strLabelValue)
+{
+    return GetMetric<CMetricHistogram>(METRIC_HISTOGRAM, strName, strHelp,
+                                       strLabel, strLabelValue);
+}
+
+
+static const double vQuantiles[] = { 0.5, 0.9, 0.99 };
+
+static double MicrosToSeconds(uint64_t n)
+{
+    return (double)n / 1000000.0;
+}
+
+static string EscapeLabelValue(const string& str)
+{
+    string strRet;
+    strRet.reserve(str.size());
+    for (unsigned int i = 0; i < str.size(); ++i)
+    {
+        switch (str[i])
+        {
+        case '\\': strRet += "\\\\"; break;
+        case '"':  strRet += "\\\""; break;
+        case '\n': strRet += "\\n";  break;
+        default:   strRet += str[i]; break;
+        }
+    }
+    return strRet;
+}
+
+// name{label="value"}, with strExtra added to the labels
+static string SeriesName(const CMetric* pmetric,
+                         const string& strSuffix,
+                         const string& strExtra)
+{
+    string strLabels;
+    if (!pmetric->strLabel.empty())
+    {
+        strLabels = pmetric->strLabel + "=\"" +
+                    EscapeLabelValue(pmetric->strLabelValue) + "\"";
+    }
+    if (!strExtra.empty())
+    {
+        strLabels += (strLabels.empty() ? "" : ",") + strExtra;
+    }
+    string strRet = pmetric->strName + strSuffix;
+    if (!strLabels.empty())
+    {
+        strRet += "{" + strLabels + "}";
+    }
+    return strRet;
+}
+
+Object MetricsToJSON(const string& strPrefix)
+{
+    Object obj;
+    LOCK(cs_metrics);
+    map<string, CMetricFamily>::const_iterator it;
+    for (it = mapMetricFamilies.begin(); it != mapMetricFamilies.end(); ++it)
+    {
+        if (it->first.compare(0, strPrefix.size(), strPrefix) != 0)
+        {
+            continue;
+        }
+        map<string, CMetric*>::const_iterator itSeries;
+        for (itSeries = it->second.mapSeries.begin();
+             itSeries != it->second.mapSeries.end();
+             ++itSeries)
+        {
+            const CMetric* pmetric = itSeries->second;
+            string strName = SeriesName(pmetric, "", "");
+            switch (pmetric->type)
+            {
+            case METRIC_COUNTER:
+                obj.push_back(Pair(strName,
+                    (boost::uint64_t)((const CMetricCounter*)pmetric)->Get()));
+                break;
+            case METRIC_GAUGE:
+                obj.push_back(Pair(strName,
+                    (boost::int64_t)((const CMetricGauge*)pmetric)->Get()));
+                break;
+            case METRIC_HISTOGRAM:
+                {
+                    const CMetricHistogram* phistogram =
+                                         (const CMetricHistogram*)pmetric;
+                    uint64_t nCount = phistogram->GetCount();
+                    uint64_t nSum = phistogram->GetSum();
+                    Object objHistogram;
+                    objHistogram.push_back(Pair("count",
+                                                (boost::uint64_t)nCount));
+                    objHistogram.push_back(Pair("sum", MicrosToSeconds(nSum)));
+                    objHistogram.push_back(Pair("mean",
+                            nCount ? MicrosToSeconds(nSum / nCount) : 0.0));
+                    objHistogram.push_back(Pair("p50",
+                            MicrosToSeconds(phistogram->GetQuantile(0.5))));
+                    objHistogram.push_back(Pair("p90",
+                            MicrosToSeconds(phistogram->GetQuantile(0.9))));
+                    objHistogram.push_back(Pair("p99",
+                            MicrosToSeconds(phistogram->GetQuantile(0.99))));
+                    objHistogram.push_back(Pair("max",
+                            MicrosToSeconds(phistogram->GetMax())));
+                    obj.push_back(Pair(strName, objHistogram));
+                }
+                break;
+            }
+        }
+    }
+    return obj;
+}
+
+// Histograms are exported as summaries, their buckets are too fine to send.
+string MetricsToPrometheus()
+{
+    string strRet;
+    LOCK(cs_metrics);
+    map<string, CMetricFamily>::const_iterator it;
+    for (it = mapMetricFamilies.begin(); it != mapMetricFamilies.end(); ++it)
+    {
+        const CMetricFamily& family = it->second;
+        string strHelp = family.strHelp;
+        boost::replace_all(strHelp, "\\", "\\\\");
+        boost::replace_all(strHelp, "\n", "\\n");
+        const char* pszType = "counter";
+        if (family.type == METRIC_GAUGE)
+        {
+            pszType = "gauge";
+        }
+        else if (family.type == METRIC_HISTOGRAM)
+        {
+            pszType = "summary";
+        }
+        strRet += "# HELP " + it->first + " " + strHelp + "\n";
+        strRet += "# TYPE " + it->first + " " + pszType + "\n";
+
+        map<string, CMetric*>::const_iterator itSeries;
+        for (itSeries = family.mapSeries.begin();
+             itSeries != family.mapSeries.end();
+             ++itSeries)
+        {
+            const CMetric* pmetric = itSeries->second;
+            switch (pmetric->type)
+            {
+            case METRIC_COUNTER:
+                strRet += strprintf("%s %" PRIu64 "\n",
+                    SeriesName(pmetric, "", "").c_str(),
+                    ((const CMetricCounter*)pmetric)->Get());
+                break;
+            case METRIC_GAUGE:
+                strRet += strprintf("%s %" PRId64 "\n",
+                    SeriesName(pmetric, "", "").c_str(),
+                    ((const CMetricGauge*)pmetric)->Get());
+                break;
+            case METRIC_HISTOGRAM:
+                {
+                    const CMetricHistogram* phistogram =
+                                         (const CMetricHistogram*)pmetric;
+                    for (unsigned int i = 0;
+                         i < (sizeof(vQuantiles) / sizeof(vQuantiles[0]));
+                         ++i)
+                    {
+                        string strQuantile =
+                                strprintf("quantile=\"%g\"", vQuantiles[i]);
+                        strRet += strprintf("%s %.6f\n",
+                            SeriesName(pmetric, "", strQuantile).c_str(),
+                            MicrosToSeconds(
+                                phistogram->GetQuantile(vQuantiles[i])));
+                    }
+                    strRet += strprintf("%s %.6f\n",
+                        SeriesName(pmetric, "_sum", "").c_str(),
+                        MicrosToSeconds(phistogram->GetSum()));
+                    strRet += strprintf("%s %" PRIu64 "\n",
+                        SeriesName(pmetric, "_count", "").c_str(),
+                        phistogram->GetCount());
+                }
+                break;
+            }
+        }
+    }
+    return strRet;
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "util.h"
+#include "json/json_spirit_value.h"
+
+#include <atomic>
+#include <string>
+
+//
+// Counters, gauges and latency histograms for watching a running node.
+//
+// Metrics are registered by name the first time they are asked for and live
+// until the process exits, so callers keep the pointer, usually in a static.
+// Updating a metric never takes a lock. A metric may have one label, for
+// example the command of a network message. A family takes at most
+// MAX_METRIC_SERIES label values, later ones are all counted as "other",
+// so peers can't make the registry grow without end.
+//
+// getmetrics reports them all, and with -rpcmetrics they are also served
+// for Prometheus at /metrics on the RPC port.
+//
+static const unsigned int MAX_METRIC_SERIES = 256;
+
+enum MetricType
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+class CMetric
+{
+public:
+    const MetricType type;
+    const std::string strName;
+    const std::string strLabel;
+    const std::string strLabelValue;
+
+    CMetric(MetricType typeIn,
+            const std::string& strNameIn,
+            const std::string& strLabelIn,
+            const std::string& strLabelValueIn)
+        : type(typeIn),
+          strName(strNameIn),
+          strLabel(strLabelIn),
+          strLabelValue(strLabelValueIn) {}
+
+    virtual ~CMetric() {}
+};
+
+// only ever goes up
+class CMetricCounter : public CMetric
+{
+private:
+    std::atomic<uint64_t> nValue;
+
+public:
+    CMetricCounter(const std::string& strNameIn,
+                   const std::string& strLabelIn,
+                   const std::string& strLabelValueIn)
+        : CMetric(METRIC_COUNTER, strNameIn, strLabelIn, strLabelValueIn),
+          nValue(0) {}
+
+    void Inc(uint64_t n = 1)
+    {
+        nValue.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t Get() const
+    {
+        return nValue.load(std::memory_order_relaxed);
+    }
+};
+
+// a level that goes up and down, like the size of the mempool
+class CMetricGauge : public CMetric
+{
+private:
+    std::atomic<int64_t> nValue;
+
+public:
+    CMetricGauge(const std::string& strNameIn,
+                 const std::string& strLabelIn,
+                 const std::string& strLabelValueIn)
+        : CMetric(METRIC_GAUGE, strNameIn, strLabelIn, strLabelValueIn),
+          nValue(0) {}
+
+    void Set(int64_t n)
+    {
+        nValue.store(n, std::memory_order_relaxed);
+    }
+
+    void Add(int64_t n)
+    {
+        nValue.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t Get() const
+    {
+        return nValue.load(std::memory_order_relaxed);
+    }
+};
+
+// Durations in microseconds, counted in log-linear buckets as HDR histograms
+//    do: each power of two is split into HISTOGRAM_SUB_BUCKETS buckets, so
+//    percentiles are within 1/HISTOGRAM_SUB_BUCKETS of the true value.
+class CMetricHistogram : public CMetric
+{
+public:
+    static const int HISTOGRAM_SUB_BITS = 3;
+    static const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+    static const int HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) *
+                                         HISTOGRAM_SUB_BUCKETS;
+
+private:
+    std::atomic<uint64_t> vBuckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nSum;
+    std::atomic<uint64_t> nMax;
+
+public:
+    CMetricHistogram(const std::string& strNameIn,
+                     const std::string& strLabelIn,
+                     const std::string& strLabelValueIn);
+
+    static int GetBucket(uint64_t n);
+    // the largest value counted in nBucket
+    static uint64_t GetBucketMax(int nBucket);
+
+    void Observe(uint64_t n);
+
+    uint64_t GetCount() const
+    {
+        return nCount.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetSum() const
+    {
+        return nSum.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetMax() const
+    {
+        return nMax.load(std::memory_order_relaxed);
+    }
+
+    // dQuantile from 0 to 1, rounded up to the top of its bucket
+    uint64_t GetQuantile(double dQuantile) const;
+};
+
+// Times its scope into a histogram, which may be NULL.
+class CMetricTimer
+{
+private:
+    CMetricHistogram* phistogram;
+    int64_t nStart;
+
+public:
+    explicit CMetricTimer(CMetricHistogram* phistogramIn)
+        : phistogram(phistogramIn), nStart(GetTimeMicros()) {}
+
+    ~CMetricTimer()
+    {
+        if (phistogram)
+        {
+            int64_t nElapsed = GetTimeMicros() - nStart;
+            phistogram->Observe((nElapsed > 0) ? nElapsed : 0);
+        }
+    }
+};
+
+// Finds or registers a metric. strHelp is kept from the first call for the
+//    family, and one name must always be asked for with the same type.
+CMetricCounter* GetMetricCounter(const std::string& strName,
+                                 const std::string& strHelp,
+                                 const std::string& strLabel = "",
+                                 const std::string& strLabelValue = "");
+CMetricGauge* GetMetricGauge(const std::string& strName,
+                             const std::string& strHelp,
+                             const std::string& strLabel = "",
+                             const std::string& strLabelValue = "");
+CMetricHistogram* GetMetricHistogram(const std::string& strName,
+                                     const std::string& strHelp,
+                                     const std::string& strLabel = "",
+                                     const std::string& strLabelValue = "");
+
+// metrics whose names start with strPrefix, histograms in seconds
+json_spirit::Object MetricsToJSON(const std::string& strPrefix);
+// all metrics in the Prometheus text exposition format
+std::string MetricsToPrometheus();
+
+#endif  /* METRICS_H */
@@ -0,0 +1,155 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "trace.h"
+#include "util.h"
+#include "sync.h"
+
+#include <boost/thread.hpp>
+
+#include <map>
+
+#if defined(__linux__)
+# include <sys/prctl.h>
+#endif
+
+using namespace json_spirit;
+using namespace std;
+
+bool fTrace = false;
+
+class CTraceEvent
+{
+public:
+    const char* pszName;
+    const char* pszArg;
+    int64_t nArg;
+    int64_t nStart;
+    int64_t nDuration;
+    int nThread;
+};
+
+static CCriticalSection cs_trace;
+static vector<CTraceEvent> vTraceEvents;
+// spans ever recorded, the next goes at nTraceNext % size
+static uint64_t nTraceNext = 0;
+// small numbers for threads, so the trace is easy to read
+static map<boost::thread::id, int> mapTraceThreads;
+static map<int, string> mapTraceThreadNames;
+
+
+// the name given by RenameThread, if the system keeps one
+static string GetThreadName()
+{
+#if defined(PR_GET_NAME)
+    char pszName[17] = { 0 };
+    if (::prctl(PR_GET_NAME, pszName, 0, 0, 0) == 0)
+    {
+        return string(pszName);
+    }
+#endif
+    return "";
+}
+
+void StartTrace(unsigned int nEvents)
+{
+    if (nEvents == 0)
+    {
+        return;
+    }
+    {
+        LOCK(cs_trace);
+        vTraceEvents.resize(nEvents);
+        nTraceNext = 0;
+    }
+    fTrace = true;
+}
+
+void CTraceSpan::Begin(const char* pszNameIn)
+{
+    pszName = pszNameIn;
+    nStart = GetTimeMicros();
+}
+
+void CTraceSpan::End()
+{
+    int64_t nEnd = GetTimeMicros();
+    boost::thread::id id = boost::this_thread::get_id();
+    LOCK(cs_trace);
+    map<boost::thread::id, int>::iterator it = mapTraceThreads.find(id);
+    if (it == mapTraceThreads.end())
+    {
+        int nThread = mapTraceThreads.size() + 1;
+        it = mapTraceThreads.insert(make_pair(id, nThread)).first;
+        mapTraceThreadNames[nThread] = GetThreadName();
+    }
+    CTraceEvent& event = vTraceEvents[nTraceNext % vTraceEvents.size()];
+    event.pszName = pszName;
+    event.pszArg = pszArg;
+    event.nArg = nArg;
+    event.nStart = nStart;
+    event.nDuration = (nEnd > nStart) ? (nEnd - nStart) : 0;
+    event.nThread = it->second;
+    ++nTraceNext;
+}
+
+Object TraceToJSON()
+{
+    Array arrayEvents;
+    LOCK(cs_trace);
+    map<int, string>::const_iterator itName;
+    for (itName = mapTraceThreadNames.begin();
+         itName != mapTraceThreadNames.end();
+         ++itName)
+    {
+        if (itName->second.empty())
+        {
+            continue;
+        }
+        Object objArgs;
+        objArgs.push_back(Pair("name", itName->second));
+        Object objMeta;
+        objMeta.push_back(Pair("name", "thread_name"));
+        objMeta.push_back(Pair("ph", "M"));
+        objMeta.push_back(Pair("pid", 1));
+        objMeta.push_back(Pair("tid", itName->first));
+        objMeta.push_back(Pair("args", objArgs));
+        arrayEvents.push_back(objMeta);
+    }
+
+    uint64_t nSize = vTraceEvents.size();
+    uint64_t nFirst = (nTraceNext > nSize) ? (nTraceNext - nSize) : 0;
+    for (uint64_t n = nFirst; n < nTraceNext; ++n)
+    {
+        const CTraceEvent& event = vTraceEvents[n % nSize];
+        Object obj;
+        obj.push_back(Pair("name", event.pszName));
+        obj.push_back(Pair("cat", "block"));
+        obj.push_back(Pair("ph", "X"));
+        obj.push_back(Pair("ts", (boost::int64_t)event.nStart));
+        obj.push_back(Pair("dur", (boost::int64_t)event.nDuration));
+        obj.push_back(Pair("pid", 1));
+        obj.push_back(Pair("tid", event.nThread));
+        if (event.pszArg != NULL)
+        {
+            Object objArgs;
+            objArgs.push_back(Pair(event.pszArg, (boost::int64_t)event.nArg));
+            obj.push_back(Pair("args", objArgs));
+        }
+        arrayEvents.push_back(obj);
+    }
+
+    Object ret;
+    ret.push_back(Pair("traceEvents", arrayEvents));
+    ret.push_back(Pair("displayTimeUnit", "ms"));
+    // spans pushed out of the ring since it was last cleared
+    ret.push_back(Pair("dropped", (boost::uint64_t)nFirst));
+    return ret;
+}
+
+void ClearTrace()
+{
+    LOCK(cs_trace);
+    nTraceNext = 0;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2024 The Stealth Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "json/json_spirit_value.h"
+
+#include <stdint.h>
+
+//
+// Spans of block processing, kept for dumptrace.
+//
+// With -tracebuffer=<n>, each TRACE_SPAN records when its scope started and
+// how long it took into a ring of the last n spans. dumptrace returns the
+// ring in the Chrome trace_event format, which chrome://tracing, Perfetto
+// and speedscope can open. Nested spans on one thread show as a stack, so
+// a slow block can be broken down into the stages it spent its time in.
+//
+// When tracing is off, a span costs one test of fTrace.
+//
+
+extern bool fTrace;
+
+// nEvents is the size of the ring, 0 leaves tracing off
+void StartTrace(unsigned int nEvents);
+
+// pszName and pszArg must be string literals, they are kept as pointers
+class CTraceSpan
+{
+private:
+    const char* pszName;
+    const char* pszArg;
+    int64_t nArg;
+    int64_t nStart;
+
+public:
+    explicit CTraceSpan(const char* pszNameIn)
+        : pszName(NULL), pszArg(NULL), nArg(0), nStart(0)
+    {
+        if (fTrace)
+        {
+            Begin(pszNameIn);
+        }
+    }
+
+    // nArgIn is shown with the span, like the height of the block
+    CTraceSpan(const char* pszNameIn, const char* pszArgIn, int64_t nArgIn)
+        : pszName(NULL), pszArg(pszArgIn), nArg(nArgIn), nStart(0)
+    {
+        if (fTrace)
+        {
+            Begin(pszNameIn);
+        }
+    }
+
+    ~CTraceSpan()
+    {
+        if (pszName != NULL)
+        {
+            End();
+        }
+    }
+
+    // for an argument that is only known part way through the span
+    void SetArg(const char* pszArgIn, int64_t nArgIn)
+    {
+        pszArg = pszArgIn;
+        nArg = nArgIn;
+    }
+
+private:
+    void Begin(const char* pszNameIn);
+    void End();
+};
+
+#define TRACE_SPAN_CAT2(a, b) a ## b
+#define TRACE_SPAN_CAT(a, b) TRACE_SPAN_CAT2(a, b)
+#define TRACE_SPAN(name) \
+    CTraceSpan TRACE_SPAN_CAT(tracespan, __LINE__)(name)
+
+// the spans in the ring, oldest first, as a Chrome trace_event object
+json_spirit::Object TraceToJSON();
+void ClearTrace();
+
+#endif  /* TRACE_H */
@@ -5,6 +5,7 @@
 
 #include "util.h"
 #include "sync.h"
+#include "debuglog.h"
 #include "bitcoin-strlcpy.h"
 #include "version.h"
 #include "chainparams.hpp"
@@ -197,6 +198,11 @@ uint256 GetRandHash()
 
 static FILE* fileout = NULL;
 
+// error() lines are never rate limited, OutputDebugStringF knows them
+//    by this format. warning() lines are limited by the caller's format.
+static const char* const pszErrorFormat = "ERROR: %s\n";
+static const char* const pszWarningFormat = "WARNING: %s\n";
+
 inline int OutputDebugStringF(const char* pszFormat, ...)
 {
     int ret = 0;
@@ -208,7 +214,23 @@ inline int OutputDebugStringF(const char* pszFormat, ...)
         ret = vprintf(pszFormat, arg_ptr);
         va_end(arg_ptr);
     }
-    else if (!fPrintToDebugger)
+    bool fQueued = false;
+    if (!fPrintToConsole && !fPrintToDebugger && IsDebugLogAsync())
+    {
+        // queue for the debug.log writer, formatting on this thread
+        if ((pszFormat != pszErrorFormat) &&
+            (pszFormat != pszWarningFormat) &&
+            !AllowDebugLog(pszFormat))
+            return 0;
+        va_list arg_ptr;
+        va_start(arg_ptr, pszFormat);
+        std::string str = vstrprintf(pszFormat, arg_ptr);
+        va_end(arg_ptr);
+        fQueued = QueueDebugLog(str);
+        ret = str.size();
+    }
+    // the writer may have stopped since it was checked
+    if (!fPrintToConsole && !fPrintToDebugger && !fQueued)
     {
         // print to debug.log
 
@@ -336,24 +358,26 @@ bool error(const char *format, ...)
     va_start(arg_ptr, format);
     std::string str = vstrprintf(format, arg_ptr);
     va_end(arg_ptr);
-    printf("ERROR: %s\n", str.c_str());
+    printf(pszErrorFormat, str.c_str());
     return false;
 }
 
 bool error(const string& str)
 {
-    printf("ERROR: %s\n", str.c_str());
+    printf(pszErrorFormat, str.c_str());
     return false;
 }
 
 
 bool warning(const char *format, ...)
 {
+    if (IsDebugLogAsync() && !AllowDebugLog(format))
+        return false;
     va_list arg_ptr;
     va_start(arg_ptr, format);
     std::string str = vstrprintf(format, arg_ptr);
     va_end(arg_ptr);
-    printf("WARNING: %s\n", str.c_str());
+    printf(pszWarningFormat, str.c_str());
     return false;
 }
 
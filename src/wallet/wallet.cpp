@@ -5,6 +5,7 @@
 
 #include "main.h"
 #include "txdb-leveldb.h"
+#include "prune.h"
 #include "wallet.h"
 #include "walletdb.h"
 #include "crypter.h"
@@ -990,6 +991,19 @@ int CWallet::ScanForWalletTransactions(CBlockMemIndex* pmemIndexStart,
     CTxDB txdb("r");
 
     CBlockMemIndex* pmemIndex = pmemIndexStart;
+
+    // pruned blocks can't be scanned, start at the first that is kept
+    if (pmemIndex &&
+        IsBlockPruned(GetMemIndexHeight("ScanForWalletTransactions",
+                                        pmemIndex,
+                                        &txdb)))
+    {
+        printf("ScanForWalletTransactions() : blocks to %d are pruned,"
+               " scanning from %d\n",
+               nPruneHeight, nPruneHeight + 1);
+        pmemIndex = FindBlockByHeight(nPruneHeight + 1);
+    }
+
     {
         LOCK(cs_wallet);
         while (pmemIndex)